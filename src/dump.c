@@ -39,15 +39,12 @@ static int rl_dump_list(struct rlite *db, const unsigned char *key, long keylen,
 	uint32_t length;
 	long valuelen = 0;
 	rl_list_iterator *iterator = NULL;
-	void *tmp;
-	long page, size;
+	unsigned char *value;
+	long size;
 
 	RL_CALL(rl_lrange_iterator, RL_OK, db, key, keylen, 0, -1, &size, &iterator);
 	buflen = 16;
-	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		page = *(long *)tmp;
-		rl_free(tmp);
-		RL_CALL(rl_multi_string_get, RL_OK, db, page, NULL, &valuelen);
+	while ((retval = rl_llist_iterator_next(iterator, NULL, NULL, &valuelen)) == RL_OK) {
 		buflen += 5 + valuelen;
 	}
 	iterator = NULL;
@@ -64,15 +61,15 @@ static int rl_dump_list(struct rlite *db, const unsigned char *key, long keylen,
 	buflen = 6;
 
 	RL_CALL(rl_lrange_iterator, RL_OK, db, key, keylen, 0, -1, &size, &iterator);
-	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		page = *(long *)tmp;
-		rl_free(tmp);
+	while ((retval = rl_llist_iterator_next(iterator, NULL, &value, &valuelen)) == RL_OK) {
 		buf[buflen++] = (REDIS_RDB_32BITLEN << 6);
-		RL_CALL(rl_multi_string_get, RL_OK, db, page, NULL, &valuelen);
 		length = htonl(valuelen);
 		memcpy(&buf[buflen], &length, 4);
 		buflen += 4;
-		RL_CALL(rl_multi_string_cpy, RL_OK, db, page, &buf[buflen], NULL);
+		if (valuelen > 0) {
+			memcpy(&buf[buflen], value, valuelen);
+		}
+		rl_free(value);
 		buflen += valuelen;
 	}
 	iterator = NULL;
@@ -154,8 +151,8 @@ static int rl_dump_zset(struct rlite *db, const unsigned char *key, long keylen,
 {
 	int retval;
 	long valuelen;
-	unsigned char *buf = NULL;
-	long buflen, page;
+	unsigned char *buf = NULL, *value;
+	long buflen;
 	uint32_t length;
 	double score;
 	char f[40];
@@ -181,12 +178,13 @@ static int rl_dump_zset(struct rlite *db, const unsigned char *key, long keylen,
 	buflen = 6;
 
 	RL_CALL(rl_zrange, RL_OK, db, key, keylen, 0, -1, &iterator);
-	while ((retval = rl_zset_iterator_next(iterator, &page, &score, NULL, &valuelen)) == RL_OK) {
+	while ((retval = rl_zset_iterator_next(iterator, NULL, &score, &value, &valuelen)) == RL_OK) {
 		buf[buflen++] = (REDIS_RDB_32BITLEN << 6);
 		length = htonl(valuelen);
 		memcpy(&buf[buflen], &length, 4);
 		buflen += 4;
-		RL_CALL(rl_multi_string_cpy, RL_OK, db, page, &buf[buflen], NULL);
+		memcpy(&buf[buflen], value, valuelen);
+		rl_free(value);
 		buflen += valuelen;
 
 		valuelen = snprintf(f, 40, "%lf", score);
@@ -216,10 +214,9 @@ static int rl_dump_hash(struct rlite *db, const unsigned char *key, long keylen,
 {
 	int retval;
 	long valuelen, value2len;
-	unsigned char *buf = NULL;
+	unsigned char *buf = NULL, *value = NULL, *value2 = NULL;
 	long buflen;
 	uint32_t length;
-	long valuepage, value2page;
 
 	rl_hash_iterator *iterator = NULL;
 	RL_CALL(rl_hgetall, RL_OK, db, &iterator, key, keylen);
@@ -242,20 +239,24 @@ static int rl_dump_hash(struct rlite *db, const unsigned char *key, long keylen,
 	buflen = 6;
 
 	RL_CALL(rl_hgetall, RL_OK, db, &iterator, key, keylen);
-	while ((retval = rl_hash_iterator_next(iterator, &valuepage, NULL, &valuelen, &value2page, NULL, &value2len)) == RL_OK) {
+	while ((retval = rl_hash_iterator_next(iterator, NULL, &value, &valuelen, NULL, &value2, &value2len)) == RL_OK) {
 		buf[buflen++] = (REDIS_RDB_32BITLEN << 6);
 		length = htonl(valuelen);
 		memcpy(&buf[buflen], &length, 4);
 		buflen += 4;
-		RL_CALL(rl_multi_string_cpy, RL_OK, db, valuepage, &buf[buflen], NULL);
+		memcpy(&buf[buflen], value, valuelen);
 		buflen += valuelen;
+		rl_free(value);
+		value = NULL;
 
 		buf[buflen++] = (REDIS_RDB_32BITLEN << 6);
 		length = htonl(value2len);
 		memcpy(&buf[buflen], &length, 4);
 		buflen += 4;
-		RL_CALL(rl_multi_string_cpy, RL_OK, db, value2page, &buf[buflen], NULL);
+		memcpy(&buf[buflen], value2, value2len);
 		buflen += value2len;
+		rl_free(value2);
+		value2 = NULL;
 	}
 	iterator = NULL;
 
@@ -167,10 +167,24 @@ rliteReply *createStringObject(const char *str, const int len) {
 
 /**
  * Creates a string reply, taking ownership of a pre-existent pointer.
- * The pointer will be free'd once the reply is free'd.
+ * The pointer will be free'd once the reply is free'd, or right away if the
+ * reply cannot be allocated. This is the way to reply with buffers handed
+ * out by the storage layer, which are already NUL terminated; an empty value
+ * comes back as NULL and gets an empty string instead.
  */
 static rliteReply *createTakeStringObject(char *str, int len) {
 	rliteReply *reply = createReplyObject(RLITE_REPLY_STRING);
+	if (reply && !str) {
+		str = rl_malloc(sizeof(char));
+		if (str) {
+			str[0] = 0;
+		}
+	}
+	if (!reply || !str) {
+		rl_free(str);
+		rl_free(reply);
+		return NULL;
+	}
 	reply->str = str;
 	reply->len = len;
 	return reply;
@@ -188,17 +202,19 @@ rliteReply *createStatusObject(const char *str) {
 	return createStringTypeObject(RLITE_REPLY_STATUS, str, strlen(str));
 }
 
-rliteReply *createDoubleObject(double d) {
-	char dbuf[128];
-	int dlen;
+static int formatDouble(char *buf, size_t size, double d) {
 	if (isinf(d)) {
 		/* Libc in odd systems (Hi Solaris!) will format infinite in a
 		 * different way, so better to handle it in an explicit way. */
-		return createCStringObject(d > 0 ? "inf" : "-inf");
-	} else {
-		dlen = snprintf(dbuf,sizeof(dbuf),"%.17g",d);
-		return createStringObject(dbuf, dlen);
+		return snprintf(buf, size, "%s", d > 0 ? "inf" : "-inf");
 	}
+	return snprintf(buf, size, "%.17g", d);
+}
+
+rliteReply *createDoubleObject(double d) {
+	char dbuf[128];
+	int dlen = formatDouble(dbuf, sizeof(dbuf), d);
+	return createStringObject(dbuf, dlen);
 }
 
 rliteReply *createLongLongObject(long long value) {
@@ -207,12 +223,87 @@ rliteReply *createLongLongObject(long long value) {
 	return reply;
 }
 
+typedef struct rliteStream {
+	rliteStreamChunkCallback *chunk;
+	rliteStreamFillCallback *fill;
+	rliteStreamElementCallback *element;
+	void *privdata;
+	long long length;
+	int aborted;
+} streamContext;
+
+static rliteReply *streamErrorReply(streamContext *stream, int retval) {
+	if (stream->aborted) {
+		return createErrorObject("ERR stream aborted by callback");
+	}
+	if (retval == RL_WRONG_TYPE) {
+		return createErrorObject(RLITE_WRONGTYPEERR);
+	}
+	if (retval == RL_OUT_OF_MEMORY) {
+		return createErrorObject("ERR out of memory");
+	}
+	return createErrorObject("ERR unexpected");
+}
+
+/**
+ * Passes one string element to the stream callback. The reply lives on the
+ * stack and only borrows 'str'; the caller still owns it.
+ */
+static int streamString(streamContext *stream, char *str, long len) {
+	rliteReply element = {RLITE_REPLY_STRING, 0, len, str, 0, NULL};
+	if (stream->element(stream->privdata, &element) != RLITE_OK) {
+		stream->aborted = 1;
+		return RL_UNEXPECTED;
+	}
+	stream->length++;
+	return RL_OK;
+}
+
+static int streamDouble(streamContext *stream, double d) {
+	char dbuf[128];
+	int dlen = formatDouble(dbuf, sizeof(dbuf), d);
+	return streamString(stream, dbuf, dlen);
+}
+
+static rliteReply *streamElementsReply(streamContext *stream, int retval) {
+	if (retval != RL_OK && retval != RL_END && retval != RL_NOT_FOUND) {
+		return streamErrorReply(stream, retval);
+	}
+	return createLongLongObject(stream->length);
+}
+
+static void addZsetIteratorStream(rliteClient *c, int retval, rl_zset_iterator *iterator, int withscores)
+{
+	unsigned char *vstr;
+	long vlen;
+	double score;
+
+	if (retval == RL_OK) {
+		while ((retval = rl_zset_iterator_next(iterator, NULL, withscores ? &score : NULL, &vstr, &vlen)) == RL_OK) {
+			retval = streamString(c->stream, (char *)vstr, vlen);
+			rl_free(vstr);
+			if (retval == RL_OK && withscores) {
+				retval = streamDouble(c->stream, score);
+			}
+			if (retval != RL_OK) {
+				rl_zset_iterator_destroy(iterator);
+				break;
+			}
+		}
+	}
+	c->reply = streamElementsReply(c->stream, retval);
+}
+
 static void addZsetIteratorReply(rliteClient *c, int retval, rl_zset_iterator *iterator, int withscores)
 {
 	unsigned char *vstr;
 	long vlen, i;
 	double score;
 
+	if (c->stream) {
+		addZsetIteratorStream(c, retval, iterator, withscores);
+		return;
+	}
 	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
 	if (retval == RL_NOT_FOUND) {
 		c->reply->elements = 0;
@@ -346,6 +437,29 @@ static int getDoubleFromObjectOrReply(rliteClient *c, const char *o, long olen,
 	return RLITE_OK;
 }
 
+/* Parses the timeout of a blocking command, in seconds. Zero waits forever
+ * and leaves *_timeout NULL. Commands run by EXEC or by a script never block. */
+static int getBlockingTimeoutOrReply(rliteClient *c, const char *o, long olen, struct timeval *timeout, struct timeval **_timeout) {
+	double seconds;
+	if (getDoubleFromObjectOrReply(c, o, olen, &seconds, "ERR timeout is not a float or out of range") != RLITE_OK) {
+		return RLITE_ERR;
+	}
+	if (seconds < 0) {
+		c->reply = createErrorObject("ERR timeout is negative");
+		return RLITE_ERR;
+	}
+	if (c->flags & (RLITE_MULTI_CLIENT | RLITE_LUA_CLIENT)) {
+		seconds = 0;
+	} else if (seconds == 0) {
+		*_timeout = NULL;
+		return RLITE_OK;
+	}
+	timeout->tv_sec = (long)seconds;
+	timeout->tv_usec = (long)((seconds - timeout->tv_sec) * 1000000);
+	*_timeout = timeout;
+	return RLITE_OK;
+}
+
 static int getLongLongFromObject(const char *_o, size_t len, long long *target) {
 	long long value;
 	char *eptr;
@@ -1070,8 +1184,9 @@ int rliteAppendCommandClient(rliteClient *c) {
 			}
 
 			MALLOC(c->context->enqueuedCommands[c->context->enqueuedCommandsLength], sizeof(rliteClient));
-			c->context->enqueuedCommands[c->context->enqueuedCommandsLength]->flags = 0;
+			c->context->enqueuedCommands[c->context->enqueuedCommandsLength]->flags = RLITE_MULTI_CLIENT;
 #define COMMAND c->context->enqueuedCommands[c->context->enqueuedCommandsLength]
+			COMMAND->stream = NULL;
 			COMMAND->argc = c->argc;
 			MALLOC(COMMAND->argvlen, sizeof(size_t) * c->argc);
 			CHECK_OOM_ELSE(COMMAND->argv = rl_malloc(sizeof(char *) * c->argc),
@@ -1124,6 +1239,8 @@ int rliteAppendFormattedCommand(rliteContext *UNUSED(c), const char *UNUSED(cmd)
 int rlitevAppendCommand(rliteContext *c, const char *format, va_list ap) {
 	rliteClient client;
 	client.context = c;
+	client.flags = 0;
+	client.stream = NULL;
 	if (rlitevFormatCommand(&client, format, ap) != RLITE_OK) {
 		return RLITE_ERR;
 	}
@@ -1151,6 +1268,8 @@ int rliteAppendCommand(rliteContext *c, const char *format, ...) {
 int rliteAppendCommandArgv(rliteContext *c, int argc, char **argv, size_t *argvlen) {
 	rliteClient client;
 	client.context = c;
+	client.flags = 0;
+	client.stream = NULL;
 	client.argc = argc;
 	client.argv = argv;
 	client.argvlen = argvlen;
@@ -1179,6 +1298,123 @@ void *rliteCommandArgv(rliteContext *c, int argc, char **argv, size_t *argvlen)
 	return _popReply(c);
 }
 
+static int streamChunk(void *context, long UNUSED(offset), unsigned char *data, long size) {
+	streamContext *stream = context;
+	if (stream->chunk(stream->privdata, (const char *)data, size) != RLITE_OK) {
+		stream->aborted = 1;
+		return RL_UNEXPECTED;
+	}
+	stream->length += size;
+	return RL_OK;
+}
+
+static int streamFill(void *context, unsigned char *data, long size, long *written) {
+	streamContext *stream = context;
+	size_t filled = 0;
+	if (stream->fill(stream->privdata, (char *)data, size, &filled) != RLITE_OK) {
+		stream->aborted = 1;
+		return RL_UNEXPECTED;
+	}
+	if (filled == 0) {
+		return RL_END;
+	}
+	*written = filled;
+	stream->length += filled;
+	return RL_OK;
+}
+
+void *rliteGetStream(rliteContext *c, const char *key, size_t keylen, rliteStreamChunkCallback *callback, void *privdata) {
+	streamContext stream = {callback, NULL, NULL, privdata, 0, 0};
+	int retval;
+
+	if (c->inTransaction) {
+		return createErrorObject("ERR streaming commands are not allowed inside MULTI");
+	}
+	retval = refresh_rlite_fp(c);
+	if (retval == RL_OK) {
+		retval = rl_get_stream(c->db, UNSIGN(key), keylen, streamChunk, &stream);
+	}
+	if (retval == RL_NOT_FOUND) {
+		return createNullReplyObject();
+	} else if (retval != RL_OK) {
+		return streamErrorReply(&stream, retval);
+	}
+	return createLongLongObject(stream.length);
+}
+
+void *rliteSetStream(rliteContext *c, const char *key, size_t keylen, rliteStreamFillCallback *callback, void *privdata) {
+	streamContext stream = {NULL, callback, NULL, privdata, 0, 0};
+	char *argv[3];
+	size_t argvlen[3];
+	unsigned char *value = NULL;
+	long valuelen;
+	int retval;
+
+	if (c->inTransaction) {
+		return createErrorObject("ERR streaming commands are not allowed inside MULTI");
+	}
+	retval = refresh_rlite_fp(c);
+	if (retval == RL_OK) {
+		retval = rl_set_stream(c->db, UNSIGN(key), keylen, streamFill, &stream, 0, 0);
+	}
+	if (retval == RL_OK && c->writeCommand) {
+		// the write hook takes the whole command, so the value is read back
+		retval = rl_get(c->db, UNSIGN(key), keylen, &value, &valuelen);
+		if (retval == RL_OK) {
+			argv[0] = "SET";
+			argvlen[0] = 3;
+			argv[1] = (char *)key;
+			argvlen[1] = keylen;
+			argv[2] = (char *)value;
+			argvlen[2] = valuelen;
+			c->writeCommand(rl_get_selected_db(c->db), 3, argv, argvlen);
+			rl_free(value);
+		}
+	}
+	if (retval == RL_OK) {
+		retval = rl_commit(c->db);
+	}
+	if (retval != RL_OK) {
+		rl_discard(c->db);
+		return streamErrorReply(&stream, retval);
+	}
+	return createStatusObject(RLITE_STR_OK);
+}
+
+void *rliteCommandStream(rliteContext *c, int argc, char **argv, size_t *argvlen, rliteStreamElementCallback *callback, void *privdata) {
+	streamContext stream = {NULL, NULL, callback, privdata, 0, 0};
+	rliteClient client;
+	rliteReply *reply;
+	size_t i;
+
+	if (c->inTransaction) {
+		return createErrorObject("ERR streaming commands are not allowed inside MULTI");
+	}
+	client.context = c;
+	client.flags = 0;
+	client.argc = argc;
+	client.argv = argv;
+	client.argvlen = argvlen;
+	client.stream = &stream;
+	if (rliteAppendCommandClient(&client) != RLITE_OK) {
+		return NULL;
+	}
+	reply = _popReply(c);
+	if (reply && reply->type == RLITE_REPLY_ARRAY) {
+		// the command has no streaming path, hand over the reply it built
+		for (i = 0; i < reply->elements; i++) {
+			if (callback(privdata, reply->element[i]) != RLITE_OK) {
+				stream.aborted = 1;
+				break;
+			}
+			stream.length++;
+		}
+		rliteFreeReplyObject(reply);
+		reply = stream.aborted ? streamErrorReply(&stream, RL_UNEXPECTED) : createLongLongObject(stream.length);
+	}
+	return reply;
+}
+
 static void echoCommand(rliteClient *c)
 {
 	c->reply = createStringObject(c->argv[1], c->argvlen[1]);
@@ -1195,48 +1431,76 @@ static void pingCommand(rliteClient *c)
 	}
 }
 
-static void zaddGenericCommand(rliteClient *c, int incr) {
+static void zaddGenericCommand(rliteClient *c, int flags) {
 	const unsigned char *key = UNSIGN(c->argv[1]);
 	size_t keylen = c->argvlen[1];
 	double score = 0, *scores = NULL;
-	int j, elements = (c->argc - 2) / 2;
-	int added = 0;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, changed = 0;
+	int j, scoreidx = 2, elements;
+	int zincrby = flags & RL_ZADD_INCR;
 	int retval;
 
-	if (c->argc % 2) {
+	/* Parse the options, in any order. ZINCRBY is ZADD INCR without options. */
+	while (!zincrby && scoreidx < c->argc) {
+		if (ARGVCASEEQ(c, scoreidx, "nx")) flags |= RL_ZADD_NX;
+		else if (ARGVCASEEQ(c, scoreidx, "xx")) flags |= RL_ZADD_XX;
+		else if (ARGVCASEEQ(c, scoreidx, "gt")) flags |= RL_ZADD_GT;
+		else if (ARGVCASEEQ(c, scoreidx, "lt")) flags |= RL_ZADD_LT;
+		else if (ARGVCASEEQ(c, scoreidx, "ch")) flags |= RL_ZADD_CH;
+		else if (ARGVCASEEQ(c, scoreidx, "incr")) flags |= RL_ZADD_INCR;
+		else break;
+		scoreidx++;
+	}
+
+	elements = (c->argc - scoreidx) / 2;
+	if ((c->argc - scoreidx) % 2 || elements == 0) {
 		c->reply = createErrorObject(RLITE_SYNTAXERR);
 		return;
 	}
+	if ((flags & RL_ZADD_NX) && (flags & RL_ZADD_XX)) {
+		c->reply = createErrorObject("ERR XX and NX options at the same time are not compatible");
+		return;
+	}
+	if (((flags & RL_ZADD_GT) && (flags & (RL_ZADD_LT | RL_ZADD_NX))) ||
+		((flags & RL_ZADD_LT) && (flags & RL_ZADD_NX))) {
+		c->reply = createErrorObject("ERR GT, LT, and/or NX options at the same time are not compatible");
+		return;
+	}
+	if ((flags & RL_ZADD_INCR) && elements > 1) {
+		c->reply = createErrorObject("ERR INCR option supports a single increment-element pair");
+		return;
+	}
 
 	/* Start parsing all the scores, we need to emit any syntax error
 	 * before executing additions to the sorted set, as the command should
 	 * either execute fully or nothing at all. */
 	MALLOC(scores, sizeof(double) * elements);
+	MALLOC(members, sizeof(unsigned char *) * elements);
+	MALLOC(memberslen, sizeof(long) * elements);
 	for (j = 0; j < elements; j++) {
-		if (getDoubleFromObjectOrReply(c, c->argv[2+j*2], c->argvlen[2+j*2], &scores[j],NULL)
+		if (getDoubleFromObjectOrReply(c, c->argv[scoreidx+j*2], c->argvlen[scoreidx+j*2], &scores[j],NULL)
 			!= RLITE_OK) goto cleanup;
+		members[j] = UNSIGN(c->argv[scoreidx+1+j*2]);
+		memberslen[j] = c->argvlen[scoreidx+1+j*2];
 	}
 
-	for (j = 0; j < elements; j++) {
-		score = scores[j];
-		if (incr) {
-			retval = rl_zincrby(c->context->db, key, keylen, score, UNSIGN(c->argv[3+j*2]), c->argvlen[3+j*2], NULL);
-			RLITE_SERVER_OK(c, retval);
-		} else {
-			retval = rl_zadd(c->context->db, key, keylen, score, UNSIGN(c->argv[3+j*2]), c->argvlen[3+j*2]);
-			RLITE_SERVER_ERR2(c, retval, RL_OK, RL_FOUND);
-			if (retval == RL_OK) {
-				added++;
-			}
-		}
+	retval = rl_zadd_multi(c->context->db, key, keylen, flags, elements, scores, members, memberslen, &changed, &score);
+	if (flags & RL_ZADD_INCR) {
+		RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+		if (retval == RL_NOT_FOUND) /* the options prevented the update */
+			c->reply = createNullReplyObject();
+		else
+			c->reply = createDoubleObject(score);
+	} else {
+		RLITE_SERVER_OK(c, retval);
+		c->reply = createLongLongObject(changed);
 	}
-	if (incr) /* ZINCRBY */
-		c->reply = createDoubleObject(score);
-	else /* ZADD */
-		c->reply = createLongLongObject(added);
 
 cleanup:
 	rl_free(scores);
+	rl_free(members);
+	rl_free(memberslen);
 }
 
 static void zaddCommand(rliteClient *c) {
@@ -1244,7 +1508,108 @@ static void zaddCommand(rliteClient *c) {
 }
 
 static void zincrbyCommand(rliteClient *c) {
-	zaddGenericCommand(c,1);
+	zaddGenericCommand(c,RL_ZADD_INCR);
+}
+
+static void zpopGenericCommand(rliteClient *c, int max) {
+	unsigned char **members = NULL;
+	long count = 1, size = 0, *memberslen = NULL, i;
+	double *scores = NULL;
+	int retval;
+
+	if (c->argc > 3) {
+		c->reply = createErrorObject(RLITE_SYNTAXERR);
+		return;
+	}
+	if (c->argc == 3) {
+		if (getLongFromObjectOrReply(c, c->argv[2], c->argvlen[2], &count, NULL) != RLITE_OK) {
+			return;
+		}
+		if (count < 0) {
+			c->reply = createErrorObject("ERR value is out of range, must be positive");
+			return;
+		}
+	}
+
+	if (count > 0) {
+		retval = rl_zpop(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], count, max, &size, &members, &memberslen, &scores);
+		RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+	}
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = 0;
+	if (size > 0) {
+		MALLOC(c->reply->element, sizeof(rliteReply*) * size * 2);
+		for (i = 0; i < size; i++) {
+			c->reply->element[c->reply->elements] = createTakeStringObject((char *)members[i], memberslen[i]);
+			members[i] = NULL;
+			CHECK_OOM(c->reply->element[c->reply->elements]);
+			c->reply->elements++;
+			CHECK_OOM(c->reply->element[c->reply->elements] = createDoubleObject(scores[i]));
+			c->reply->elements++;
+		}
+	}
+cleanup:
+	if (members) {
+		for (i = 0; i < size; i++) {
+			rl_free(members[i]);
+		}
+	}
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(scores);
+}
+
+static void zpopminCommand(rliteClient *c) {
+	zpopGenericCommand(c, 0);
+}
+
+static void zpopmaxCommand(rliteClient *c) {
+	zpopGenericCommand(c, 1);
+}
+
+static void bzpopGenericCommand(rliteClient *c, int max) {
+	unsigned char **keys = (unsigned char **)&c->argv[1], *member = NULL;
+	long *keyslen = NULL, memberlen;
+	struct timeval timeout, *timeoutp;
+	double score;
+	int i, keyc = c->argc - 2, key_index;
+	int retval;
+
+	if (getBlockingTimeoutOrReply(c, c->argv[c->argc - 1], c->argvlen[c->argc - 1], &timeout, &timeoutp) != RLITE_OK) {
+		return;
+	}
+	MALLOC(keyslen, sizeof(long) * keyc);
+	for (i = 0; i < keyc; i++) {
+		keyslen[i] = c->argvlen[1 + i];
+	}
+	retval = rl_bzpop(c->context->db, keyc, keys, keyslen, max, timeoutp, &key_index, &member, &memberlen, &score);
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_TIMEOUT);
+	if (retval == RL_TIMEOUT) {
+		c->reply = createNullReplyObject();
+		goto cleanup;
+	}
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = 0;
+	MALLOC(c->reply->element, sizeof(rliteReply*) * 3);
+	CHECK_OOM(c->reply->element[0] = createStringObject(c->argv[1 + key_index], c->argvlen[1 + key_index]));
+	c->reply->elements++;
+	c->reply->element[1] = createTakeStringObject((char *)member, memberlen);
+	member = NULL;
+	CHECK_OOM(c->reply->element[1]);
+	c->reply->elements++;
+	CHECK_OOM(c->reply->element[2] = createDoubleObject(score));
+	c->reply->elements++;
+cleanup:
+	rl_free(member);
+	rl_free(keyslen);
+}
+
+static void bzpopminCommand(rliteClient *c) {
+	bzpopGenericCommand(c, 0);
+}
+
+static void bzpopmaxCommand(rliteClient *c) {
+	bzpopGenericCommand(c, 1);
 }
 
 static void zrangeGenericCommand(rliteClient *c, int reverse) {
@@ -1386,42 +1751,45 @@ static void zcardCommand(rliteClient *c) {
 cleanup:
 	return;
 }
-#define RLITE_AGGR_SUM 1
-#define RLITE_AGGR_MIN 2
-#define RLITE_AGGR_MAX 3
 #define RLITE_OP_UNION 1
 #define RLITE_OP_INTER 2
+#define RLITE_OP_DIFF 3
 
-static void zunionInterGenericCommand(rliteClient *c, int op) {
-	int i, j;
-	long setnum;
+/* ZUNION, ZINTER and ZDIFF and their STORE variants. The STORE variants take
+ * the destination before numkeys and reply with its cardinality. */
+static void zunionInterDiffGenericCommand(rliteClient *c, int store, int op) {
+	int i, j, withscores = 0;
+	long setnum, size = 0, k;
 	int aggregate = RL_ZSET_AGGREGATE_SUM;
-	double *weights = NULL;
-	unsigned char **keys = NULL;
-	long *keys_len = NULL;
+	double *weights = NULL, *scores = NULL;
+	unsigned char **keys = NULL, **members = NULL;
+	long *keys_len = NULL, *memberslen = NULL;
+	int numkeys_index = store ? 2 : 1;
 	int retval;
 
 	/* expect setnum input keys to be given */
-	if ((getLongFromObjectOrReply(c, c->argv[2], c->argvlen[2], &setnum, NULL) != RLITE_OK))
+	if ((getLongFromObjectOrReply(c, c->argv[numkeys_index], c->argvlen[numkeys_index], &setnum, NULL) != RLITE_OK))
 		return;
 
 	if (setnum < 1) {
-		c->reply = createErrorObject("ERR at least 1 input key is needed for ZUNIONSTORE/ZINTERSTORE");
+		c->reply = createErrorObject(store && op != RLITE_OP_DIFF ?
+				"ERR at least 1 input key is needed for ZUNIONSTORE/ZINTERSTORE" :
+				"ERR at least 1 input key is needed for ZUNION/ZINTER/ZDIFF");
 		return;
 	}
 
 	/* test if the expected number of keys would overflow */
-	if (setnum > c->argc - 3) {
+	if (setnum > c->argc - numkeys_index - 1) {
 		c->reply = createErrorObject(RLITE_SYNTAXERR);
 		return;
 	}
 
-	if (c->argc > 3 + setnum) {
-		j = 3 + setnum;
-		if (ARGVCASEEQ(c, j, "weights")) {
+	j = numkeys_index + 1 + setnum;
+	while (j < c->argc) {
+		if (op != RLITE_OP_DIFF && !weights && ARGVCASEEQ(c, j, "weights")) {
 			if (j + 1 + setnum > c->argc) {
 				c->reply = createErrorObject(RLITE_SYNTAXERR);
-				return;
+				goto cleanup;
 			}
 			MALLOC(weights, sizeof(double) * setnum);
 			for (i = 0; i < setnum; i++) {
@@ -1432,7 +1800,7 @@ static void zunionInterGenericCommand(rliteClient *c, int op) {
 			}
 			j += setnum + 1;
 		}
-		if (c->argc > j && c->argvlen[j] == 9 && memcmp(c->argv[j], "aggregate", 9) == 0) {
+		else if (op != RLITE_OP_DIFF && j + 1 < c->argc && ARGVCASEEQ(c, j, "aggregate")) {
 			if (ARGVCASEEQ(c, j + 1, "min")) {
 				aggregate = RL_ZSET_AGGREGATE_MIN;
 			} else if (ARGVCASEEQ(c, j + 1, "max")) {
@@ -1445,7 +1813,11 @@ static void zunionInterGenericCommand(rliteClient *c, int op) {
 			}
 			j += 2;
 		}
-		if (j != c->argc) {
+		else if (!store && ARGVCASEEQ(c, j, "withscores")) {
+			withscores = 1;
+			j++;
+		}
+		else {
 			c->reply = createErrorObject(RLITE_SYNTAXERR);
 			goto cleanup;
 		}
@@ -1456,24 +1828,79 @@ static void zunionInterGenericCommand(rliteClient *c, int op) {
 	keys[0] = UNSIGN(c->argv[1]);
 	keys_len[0] = (long)c->argvlen[1];
 	for (i = 0; i < setnum; i++) {
-		keys[i + 1] = UNSIGN(c->argv[3 + i]);
-		keys_len[i + 1] = c->argvlen[3 + i];
+		keys[i + 1] = UNSIGN(c->argv[numkeys_index + 1 + i]);
+		keys_len[i + 1] = c->argvlen[numkeys_index + 1 + i];
+	}
+	if (store) {
+		if (op == RLITE_OP_DIFF) {
+			retval = rl_zdiffstore(c->context->db, setnum + 1, keys, keys_len);
+		}
+		else {
+			retval = (op == RLITE_OP_UNION ? rl_zunionstore : rl_zinterstore)(c->context->db, setnum + 1, keys, keys_len, weights, aggregate);
+		}
+		RLITE_SERVER_OK(c, retval);
+		zcardCommand(c);
+		goto cleanup;
+	}
+
+	if (op == RLITE_OP_DIFF) {
+		retval = rl_zdiff(c->context->db, setnum, &keys[1], &keys_len[1], &size, &members, &memberslen, &scores);
+	}
+	else {
+		retval = (op == RLITE_OP_UNION ? rl_zunion : rl_zinter)(c->context->db, setnum, &keys[1], &keys_len[1], weights, aggregate, &size, &members, &memberslen, &scores);
 	}
-	retval = (op == RLITE_OP_UNION ? rl_zunionstore : rl_zinterstore)(c->context->db, setnum + 1, keys, keys_len, weights, aggregate);
 	RLITE_SERVER_OK(c, retval);
-	zcardCommand(c);
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = 0;
+	if (size > 0) {
+		MALLOC(c->reply->element, sizeof(rliteReply*) * (withscores ? size * 2 : size));
+		for (k = 0; k < size; k++) {
+			c->reply->element[c->reply->elements] = createTakeStringObject((char *)members[k], memberslen[k]);
+			members[k] = NULL;
+			CHECK_OOM(c->reply->element[c->reply->elements]);
+			c->reply->elements++;
+			if (withscores) {
+				CHECK_OOM(c->reply->element[c->reply->elements] = createDoubleObject(scores[k]));
+				c->reply->elements++;
+			}
+		}
+	}
 cleanup:
+	if (members) {
+		for (k = 0; k < size; k++) {
+			rl_free(members[k]);
+		}
+	}
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(scores);
 	rl_free(keys);
 	rl_free(keys_len);
 	rl_free(weights);
 }
 
 static void zunionstoreCommand(rliteClient *c) {
-	zunionInterGenericCommand(c, RLITE_OP_UNION);
+	zunionInterDiffGenericCommand(c, 1, RLITE_OP_UNION);
 }
 
 static void zinterstoreCommand(rliteClient *c) {
-	zunionInterGenericCommand(c, RLITE_OP_INTER);
+	zunionInterDiffGenericCommand(c, 1, RLITE_OP_INTER);
+}
+
+static void zdiffstoreCommand(rliteClient *c) {
+	zunionInterDiffGenericCommand(c, 1, RLITE_OP_DIFF);
+}
+
+static void zunionCommand(rliteClient *c) {
+	zunionInterDiffGenericCommand(c, 0, RLITE_OP_UNION);
+}
+
+static void zinterCommand(rliteClient *c) {
+	zunionInterDiffGenericCommand(c, 0, RLITE_OP_INTER);
+}
+
+static void zdiffCommand(rliteClient *c) {
+	zunionInterDiffGenericCommand(c, 0, RLITE_OP_DIFF);
 }
 
 /* This command implements ZRANGEBYSCORE, ZREVRANGEBYSCORE. */
@@ -1653,10 +2080,6 @@ cleanup:
 	return;
 }
 
-static void hsetCommand(rliteClient *c) {
-	hsetGenericCommand(c, 1);
-}
-
 static void hsetnxCommand(rliteClient *c) {
 	hsetGenericCommand(c, 0);
 }
@@ -1675,10 +2098,8 @@ static void hgetCommand(rliteClient *c) {
 	if (retval == RL_NOT_FOUND) {
 		c->reply = createReplyObject(RLITE_REPLY_NIL);
 	} else {
-		c->reply = createStringObject((char *)value, valuelen);
+		c->reply = createTakeStringObject((char *)value, valuelen);
 	}
-
-	rl_free(value);
 cleanup:
 	return;
 }
@@ -1697,9 +2118,10 @@ cleanup:
 	return;
 }
 
-static void hmsetCommand(rliteClient *c) {
+static void hmsetGenericCommand(rliteClient *c, int reply_added) {
 	unsigned char *key = UNSIGN(c->argv[1]);
 	size_t keylen = c->argvlen[1];
+	long added = 0;
 
 	int i, j, retval;
 	if (c->argc % 2) {
@@ -1724,9 +2146,13 @@ static void hmsetCommand(rliteClient *c) {
 		values[i] = UNSIGN(c->argv[j]);
 		valueslen[i] = c->argvlen[j++];
 	}
-	retval = rl_hmset(c->context->db, key, keylen, fieldc, fields, fieldslen, values, valueslen);
+	retval = rl_hmset(c->context->db, key, keylen, fieldc, fields, fieldslen, values, valueslen, &added);
 	RLITE_SERVER_OK(c, retval);
-	c->reply = createStatusObject(RLITE_STR_OK);
+	if (reply_added) {
+		c->reply = createLongLongObject(added);
+	} else {
+		c->reply = createStatusObject(RLITE_STR_OK);
+	}
 cleanup:
 	rl_free(fields);
 	rl_free(fieldslen);
@@ -1734,6 +2160,14 @@ cleanup:
 	rl_free(valueslen);
 }
 
+static void hsetCommand(rliteClient *c) {
+	hmsetGenericCommand(c, 1);
+}
+
+static void hmsetCommand(rliteClient *c) {
+	hmsetGenericCommand(c, 0);
+}
+
 static void bitcountCommand(rliteClient *c) {
 	unsigned char *key = UNSIGN(c->argv[1]);
 	long keylen = c->argvlen[1];
@@ -1927,12 +2361,43 @@ cleanup:
 	return;
 }
 
+static void addHashIteratorStream(rliteClient *c, int retval, rl_hash_iterator *iterator, int fields, int values)
+{
+	unsigned char *field = NULL, *value = NULL;
+	long fieldlen, valuelen;
+
+	if (retval == RL_OK) {
+		while ((retval = rl_hash_iterator_next(iterator,
+						NULL, fields ? &field : NULL, fields ? &fieldlen : NULL,
+						NULL, values ? &value : NULL, values ? &valuelen : NULL
+						)) == RL_OK) {
+			if (fields) {
+				retval = streamString(c->stream, (char *)field, fieldlen);
+			}
+			if (values && retval == RL_OK) {
+				retval = streamString(c->stream, (char *)value, valuelen);
+			}
+			rl_free(field);
+			rl_free(value);
+			if (retval != RL_OK) {
+				rl_hash_iterator_destroy(iterator);
+				break;
+			}
+		}
+	}
+	c->reply = streamElementsReply(c->stream, retval);
+}
+
 static void addHashIteratorReply(rliteClient *c, int retval, rl_hash_iterator *iterator, int fields, int values)
 {
 	unsigned char *field, *value;
 	long fieldlen, valuelen;
 	long i = 0;
 
+	if (c->stream) {
+		addHashIteratorStream(c, retval, iterator, fields, values);
+		return;
+	}
 	c->reply = createReplyObject(RLITE_REPLY_ARRAY);
 	if (retval == RL_NOT_FOUND) {
 		c->reply->elements = 0;
@@ -2084,19 +2549,52 @@ cleanup:
 	return;
 }
 
-static void smoveCommand(rliteClient *c) {
-	int retval = rl_smove(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], UNSIGN(c->argv[2]), c->argvlen[2], UNSIGN(c->argv[3]), c->argvlen[3]);
-	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
-	c->reply = createLongLongObject(retval == RL_OK ? 1 : 0);
-cleanup:
-	return;
-}
+static void smismemberCommand(rliteClient *c) {
+	unsigned char *key = UNSIGN(c->argv[1]);
+	size_t keylen = c->argvlen[1];
 
-static void spopCommand(rliteClient *c) {
-	unsigned char *member;
-	long memberlen;
-	int retval = rl_spop(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], &member, &memberlen);
-	RLITE_SERVER_ERR2(c, retval, RL_NOT_FOUND, RL_OK);
+	int retval, i, memberc = c->argc - 2;
+	unsigned char **members = NULL;
+	long *memberslen = NULL;
+	int *results = NULL;
+
+	MALLOC(members, sizeof(unsigned char *) * memberc);
+	MALLOC(memberslen, sizeof(long) * memberc);
+	MALLOC(results, sizeof(int) * memberc);
+	for (i = 0; i < memberc; i++) {
+		members[i] = (unsigned char *)c->argv[2 + i];
+		memberslen[i] = (long)c->argvlen[2 + i];
+	}
+
+	retval = rl_smismember(c->context->db, key, keylen, memberc, members, memberslen, results);
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = memberc;
+	CHECK_OOM_ELSE(c->reply->element = rl_malloc(sizeof(rliteReply*) * c->reply->elements),
+			rl_free(c->reply); c->reply = NULL);
+	for (i = 0; i < memberc; i++) {
+		CHECK_OOM_ELSE(c->reply->element[i] = createLongLongObject(results[i]),
+				c->reply->elements = i; rliteFreeReplyObject(c->reply); c->reply = NULL);
+	}
+cleanup:
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(results);
+}
+
+static void smoveCommand(rliteClient *c) {
+	int retval = rl_smove(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], UNSIGN(c->argv[2]), c->argvlen[2], UNSIGN(c->argv[3]), c->argvlen[3]);
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+	c->reply = createLongLongObject(retval == RL_OK ? 1 : 0);
+cleanup:
+	return;
+}
+
+static void spopCommand(rliteClient *c) {
+	unsigned char *member;
+	long memberlen;
+	int retval = rl_spop(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], &member, &memberlen);
+	RLITE_SERVER_ERR2(c, retval, RL_NOT_FOUND, RL_OK);
 	if (retval == RL_NOT_FOUND) {
 		c->reply = createReplyObject(RLITE_REPLY_NIL);
 	} else if (retval == RL_OK) {
@@ -2171,11 +2669,35 @@ cleanup:
 #define OP_INTER 0
 #define OP_UNION 1
 #define OP_DIFF 2
+static void smembersStream(rliteClient *c) {
+	rl_set_iterator *iterator;
+	unsigned char *member;
+	long memberlen;
+
+	int retval = rl_smembers(c->context->db, &iterator, UNSIGN(c->argv[1]), c->argvlen[1]);
+	if (retval == RL_OK) {
+		while ((retval = rl_set_iterator_next(iterator, NULL, &member, &memberlen)) == RL_OK) {
+			retval = streamString(c->stream, (char *)member, memberlen);
+			rl_free(member);
+			if (retval != RL_OK) {
+				rl_set_iterator_destroy(iterator);
+				break;
+			}
+		}
+	}
+	c->reply = streamElementsReply(c->stream, retval);
+}
+
 static void sOperationGenericCommand(rliteClient *c, int op) {
 	int keyc = c->argc - 1, i, retval;
 	unsigned char **keys = NULL, **members = NULL;
 	long *keyslen = NULL, j, membersc, *memberslen = NULL;
 
+	if (c->stream && keyc == 1) {
+		// any operation on a single set is the set itself
+		smembersStream(c);
+		return;
+	}
 	MALLOC(keys, sizeof(unsigned char *) * keyc);
 	MALLOC(keyslen, sizeof(long) * keyc);
 	for (i = 0; i < keyc; i++) {
@@ -2230,6 +2752,52 @@ cleanup:
 	return;
 }
 
+static void sintercardCommand(rliteClient *c) {
+	int i, retval;
+	unsigned char **keys = NULL;
+	long *keyslen = NULL, numkeys, limit = 0, card;
+
+	if (getLongFromObjectOrReply(c, c->argv[1], c->argvlen[1], &numkeys, NULL) != RLITE_OK) {
+		return;
+	}
+	if (numkeys < 1) {
+		c->reply = createErrorObject("ERR numkeys should be greater than 0");
+		return;
+	}
+	if (numkeys > c->argc - 2) {
+		c->reply = createErrorObject("ERR Number of keys can't be greater than number of args");
+		return;
+	}
+	for (i = 2 + numkeys; i < c->argc; i += 2) {
+		if (i + 1 < c->argc && ARGVCASEEQ(c, i, "limit")) {
+			if (getLongFromObjectOrReply(c, c->argv[i + 1], c->argvlen[i + 1], &limit, NULL) != RLITE_OK) {
+				return;
+			}
+			if (limit < 0) {
+				c->reply = createErrorObject("ERR LIMIT can't be negative");
+				return;
+			}
+		}
+		else {
+			c->reply = createErrorObject(RLITE_SYNTAXERR);
+			return;
+		}
+	}
+
+	MALLOC(keys, sizeof(unsigned char *) * numkeys);
+	MALLOC(keyslen, sizeof(long) * numkeys);
+	for (i = 0; i < numkeys; i++) {
+		keys[i] = UNSIGN(c->argv[2 + i]);
+		keyslen[i] = c->argvlen[2 + i];
+	}
+	retval = rl_sintercard(c->context->db, numkeys, keys, keyslen, limit, &card);
+	RLITE_SERVER_OK(c, retval);
+	c->reply = createLongLongObject(card);
+cleanup:
+	rl_free(keys);
+	rl_free(keyslen);
+}
+
 static void sinterCommand(rliteClient *c) {
 	sOperationGenericCommand(c, OP_INTER);
 }
@@ -2374,6 +2942,29 @@ cleanup:
 	return;
 }
 
+static void lrangeStream(rliteClient *c, long start, long stop) {
+	rl_llist_iterator *iterator = NULL;
+	unsigned char *value;
+	long size = 0, valuelen, i;
+
+	int retval = rl_lrange_iterator(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], start, stop, &size, &iterator);
+	for (i = 0; retval == RL_OK && i < size; i++) {
+		retval = rl_llist_iterator_next(iterator, NULL, &value, &valuelen);
+		if (retval == RL_OK) {
+			retval = streamString(c->stream, (char *)value, valuelen);
+			rl_free(value);
+			if (retval != RL_OK) {
+				rl_llist_iterator_destroy(iterator);
+			}
+		}
+	}
+	// the iterator runs to the end of the list, not the end of the range
+	if (retval == RL_OK && size > 0) {
+		rl_llist_iterator_destroy(iterator);
+	}
+	c->reply = streamElementsReply(c->stream, retval);
+}
+
 static void lrangeCommand(rliteClient *c) {
 	unsigned char *key = UNSIGN(c->argv[1]);
 	size_t keylen = c->argvlen[1];
@@ -2386,6 +2977,10 @@ static void lrangeCommand(rliteClient *c) {
 	if ((getLongFromObjectOrReply(c, c->argv[2], c->argvlen[2], &start, NULL) != RLITE_OK) ||
 		(getLongFromObjectOrReply(c, c->argv[3], c->argvlen[3], &stop, NULL) != RLITE_OK)) return;
 
+	if (c->stream) {
+		lrangeStream(c, start, stop);
+		return;
+	}
 	int retval = rl_lrange(c->context->db, key, keylen, start, stop, &size, &values, &valueslen);
 	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
 	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
@@ -2478,6 +3073,68 @@ cleanup:
 	return;
 }
 
+static void bpopGenericCommand(rliteClient *c, int left) {
+	unsigned char **keys = (unsigned char **)&c->argv[1], *value = NULL;
+	long *keyslen = NULL, valuelen;
+	struct timeval timeout, *timeoutp;
+	int i, keyc = c->argc - 2, key_index;
+	int retval;
+
+	if (getBlockingTimeoutOrReply(c, c->argv[c->argc - 1], c->argvlen[c->argc - 1], &timeout, &timeoutp) != RLITE_OK) {
+		return;
+	}
+	MALLOC(keyslen, sizeof(long) * keyc);
+	for (i = 0; i < keyc; i++) {
+		keyslen[i] = c->argvlen[1 + i];
+	}
+	retval = rl_bpop(c->context->db, keyc, keys, keyslen, left, timeoutp, &key_index, &value, &valuelen);
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_TIMEOUT);
+	if (retval == RL_TIMEOUT) {
+		c->reply = createNullReplyObject();
+		goto cleanup;
+	}
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = 0;
+	MALLOC(c->reply->element, sizeof(rliteReply*) * 2);
+	CHECK_OOM(c->reply->element[0] = createStringObject(c->argv[1 + key_index], c->argvlen[1 + key_index]));
+	c->reply->elements++;
+	c->reply->element[1] = createTakeStringObject((char *)value, valuelen);
+	value = NULL;
+	CHECK_OOM(c->reply->element[1]);
+	c->reply->elements++;
+cleanup:
+	rl_free(value);
+	rl_free(keyslen);
+}
+
+static void blpopCommand(rliteClient *c) {
+	bpopGenericCommand(c, 1);
+}
+
+static void brpopCommand(rliteClient *c) {
+	bpopGenericCommand(c, 0);
+}
+
+static void brpoplpushCommand(rliteClient *c) {
+	unsigned char *value;
+	long valuelen;
+	struct timeval timeout, *timeoutp;
+	int retval;
+
+	if (getBlockingTimeoutOrReply(c, c->argv[3], c->argvlen[3], &timeout, &timeoutp) != RLITE_OK) {
+		return;
+	}
+	retval = rl_brpoplpush(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], UNSIGN(c->argv[2]), c->argvlen[2], timeoutp, &value, &valuelen);
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_TIMEOUT);
+	if (retval == RL_TIMEOUT) {
+		c->reply = createNullReplyObject();
+		goto cleanup;
+	}
+	c->reply = createTakeStringObject((char *)value, valuelen);
+cleanup:
+	return;
+}
+
 #define RLITE_SET_NO_FLAGS 0
 #define RLITE_SET_NX (1<<0)	 /* Set if key not exists. */
 #define RLITE_SET_XX (1<<1)	 /* Set if key exists. */
@@ -2638,10 +3295,19 @@ cleanup:
 
 static void mgetCommand(rliteClient *c) {
 	int retval = RL_OK, i = 0, keyc = c->argc - 1;
-	unsigned char *key;
-	long keylen;
-	unsigned char *value;
-	long valuelen;
+	unsigned char **keys = NULL;
+	long *keyslen = NULL;
+	unsigned char **values = NULL;
+	long *valueslen = NULL;
+
+	MALLOC(keys, sizeof(unsigned char *) * keyc);
+	MALLOC(keyslen, sizeof(long) * keyc);
+	for (i = 0; i < keyc; i++) {
+		keys[i] = (unsigned char *)c->argv[1 + i];
+		keyslen[i] = (long)c->argvlen[1 + i];
+	}
+	retval = rl_mget(c->context->db, keyc, keys, keyslen, &values, &valueslen);
+	RLITE_SERVER_OK(c, retval);
 
 	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
 	c->reply->elements = keyc;
@@ -2649,24 +3315,26 @@ static void mgetCommand(rliteClient *c) {
 			rl_free(c->reply); c->reply = NULL);
 
 	for (i = 0; i < keyc; i++) {
-		key = (unsigned char *)c->argv[1 + i];
-		keylen = (long)c->argvlen[1 + i];
-		retval = rl_get(c->context->db, key, keylen, &value, &valuelen);
 		// return nil for keys that are not strings
-		if (retval == RL_WRONG_TYPE) {
-			retval = RL_NOT_FOUND;
-		}
-		RLITE_SERVER_ERR2(c, retval, RL_NOT_FOUND, RL_OK);
-		if (retval == RL_NOT_FOUND) {
+		if (valueslen[i] < 0) {
 			c->reply->element[i] = createReplyObject(RLITE_REPLY_NIL);
 		} else {
-			c->reply->element[i] = createTakeStringObject((char *)value, valuelen);
+			c->reply->element[i] = createTakeStringObject((char *)values[i], valueslen[i]);
+			values[i] = NULL;
 		}
 		CHECK_OOM_ELSE(c->reply->element[i],
 				c->reply->elements = i - 1; rliteFreeReplyObject(c->reply); c->reply = NULL);
 	}
 cleanup:
-	return;
+	if (values) {
+		for (i = 0; i < keyc; i++) {
+			rl_free(values[i]);
+		}
+	}
+	rl_free(keys);
+	rl_free(keyslen);
+	rl_free(values);
+	rl_free(valueslen);
 }
 
 static void msetCommand(rliteClient *c) {
@@ -2909,6 +3577,149 @@ cleanup:
 	return;
 }
 
+static int getBitfieldTypeFromArgument(rliteClient *c, const char *p, size_t plen, int *sign, int *bits) {
+	long long llbits;
+	const char *err = "ERR Invalid bitfield type. Use something like i16 u8. Note that u64 is not supported but i64 is.";
+
+	if (plen > 1 && (p[0] == 'i' || p[0] == 'I')) {
+		*sign = 1;
+	} else if (plen > 1 && (p[0] == 'u' || p[0] == 'U')) {
+		*sign = 0;
+	} else {
+		c->reply = createErrorObject(err);
+		return RLITE_ERR;
+	}
+
+	if (getLongLongFromObject(p + 1, plen - 1, &llbits) != RLITE_OK ||
+			llbits < 1 || (*sign == 1 && llbits > 64) || (*sign == 0 && llbits > 63)) {
+		c->reply = createErrorObject(err);
+		return RLITE_ERR;
+	}
+	*bits = (int)llbits;
+	return RLITE_OK;
+}
+
+/* The offset may be prefixed by "#", in which case it is multiplied by the
+ * field width. */
+static int getBitfieldOffsetFromArgument(rliteClient *c, const char *p, size_t plen, int bits, long long *offset) {
+	const char *err = "ERR bit offset is not an integer or out of range";
+	int usehash = plen > 1 && p[0] == '#';
+	long long loffset;
+
+	if (getLongLongFromObject(usehash ? p + 1 : p, usehash ? plen - 1 : plen, &loffset) != RLITE_OK) {
+		c->reply = createErrorObject(err);
+		return RLITE_ERR;
+	}
+	if (usehash) {
+		if (loffset < 0 || loffset > LLONG_MAX / bits) {
+			c->reply = createErrorObject(err);
+			return RLITE_ERR;
+		}
+		loffset *= bits;
+	}
+	/* Limit offset to 512MB in bytes */
+	if (loffset < 0 || ((loffset + bits - 1) >> 3) >= (512*1024*1024)) {
+		c->reply = createErrorObject(err);
+		return RLITE_ERR;
+	}
+	*offset = loffset;
+	return RLITE_OK;
+}
+
+static void bitfieldGenericCommand(rliteClient *c, int readonly) {
+	rl_bitfield_op *ops = NULL;
+	long long *results = NULL;
+	int *failed = NULL;
+	int j, opc = 0, overflow = BFOVERFLOW_WRAP, retval;
+	const char *subcmd;
+
+	MALLOC(ops, sizeof(rl_bitfield_op) * c->argc);
+	for (j = 2; j < c->argc; j++) {
+		int remargs = c->argc - j - 1;
+		subcmd = c->argv[j];
+		rl_bitfield_op *op = &ops[opc];
+
+		if (!strcasecmp(subcmd, "get") && remargs >= 2) {
+			op->opcode = RL_BITFIELD_GET;
+		} else if (!strcasecmp(subcmd, "set") && remargs >= 3) {
+			op->opcode = RL_BITFIELD_SET;
+		} else if (!strcasecmp(subcmd, "incrby") && remargs >= 3) {
+			op->opcode = RL_BITFIELD_INCRBY;
+		} else if (!strcasecmp(subcmd, "overflow") && remargs >= 1) {
+			subcmd = c->argv[++j];
+			if (!strcasecmp(subcmd, "wrap")) {
+				overflow = BFOVERFLOW_WRAP;
+			} else if (!strcasecmp(subcmd, "sat")) {
+				overflow = BFOVERFLOW_SAT;
+			} else if (!strcasecmp(subcmd, "fail")) {
+				overflow = BFOVERFLOW_FAIL;
+			} else {
+				c->reply = createErrorObject("ERR Invalid OVERFLOW type specified");
+				goto cleanup;
+			}
+			continue;
+		} else {
+			c->reply = createErrorObject(RLITE_SYNTAXERR);
+			goto cleanup;
+		}
+
+		if (readonly && op->opcode != RL_BITFIELD_GET) {
+			c->reply = createErrorObject("ERR BITFIELD_RO only supports the GET subcommand");
+			goto cleanup;
+		}
+		if (getBitfieldTypeFromArgument(c, c->argv[j + 1], c->argvlen[j + 1], &op->sign, &op->bits) != RLITE_OK) {
+			goto cleanup;
+		}
+		if (getBitfieldOffsetFromArgument(c, c->argv[j + 2], c->argvlen[j + 2], op->bits, &op->offset) != RLITE_OK) {
+			goto cleanup;
+		}
+		op->value = 0;
+		if (op->opcode != RL_BITFIELD_GET) {
+			if (getLongLongFromObjectOrReply(c, c->argv[j + 3], c->argvlen[j + 3], &op->value, NULL) != RLITE_OK) {
+				goto cleanup;
+			}
+			j++;
+		}
+		op->overflow = overflow;
+		opc++;
+		j += 2;
+	}
+
+	if (opc == 0) {
+		CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+		c->reply->elements = 0;
+		goto cleanup;
+	}
+	MALLOC(results, sizeof(long long) * opc);
+	MALLOC(failed, sizeof(int) * opc);
+	retval = rl_bitfield(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], opc, ops, results, failed);
+	RLITE_SERVER_OK(c, retval);
+
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = 0;
+	MALLOC(c->reply->element, sizeof(rliteReply*) * opc);
+	for (j = 0; j < opc; j++) {
+		if (failed[j]) {
+			CHECK_OOM(c->reply->element[j] = createNullReplyObject());
+		} else {
+			CHECK_OOM(c->reply->element[j] = createLongLongObject(results[j]));
+		}
+		c->reply->elements++;
+	}
+cleanup:
+	rl_free(ops);
+	rl_free(results);
+	rl_free(failed);
+}
+
+static void bitfieldCommand(rliteClient *c) {
+	bitfieldGenericCommand(c, 0);
+}
+
+static void bitfieldroCommand(rliteClient *c) {
+	bitfieldGenericCommand(c, 1);
+}
+
 static void pfselftestCommand(rliteClient *c) {
 	if (rl_str_pfselftest() == 0) {
 		c->reply = createStatusObject(RLITE_STR_OK);
@@ -3019,12 +3830,14 @@ static void pfdebugCommand(rliteClient *c) {
 	else if (ARGVCASEEQ(c, 1, "decode")) {
 		retval = rl_pfdebug_decode(c->context->db, key, keylen, &value, &valuelen);
 		RLITE_SERVER_OK(c, retval);
-		c->reply = createStringObject((char *)value, valuelen);
+		c->reply = createTakeStringObject((char *)value, valuelen);
+		value = NULL;
 	}
 	else if (ARGVCASEEQ(c, 1, "encoding")) {
 		retval = rl_pfdebug_encoding(c->context->db, key, keylen, &value, &valuelen);
 		RLITE_SERVER_OK(c, retval);
-		c->reply = createStringObject((char *)value, valuelen);
+		c->reply = createTakeStringObject((char *)value, valuelen);
+		value = NULL;
 	}
 	else if (ARGVCASEEQ(c, 1, "todense")) {
 		retval = rl_pfdebug_todense(c->context->db, key, keylen, &size);
@@ -3194,17 +4007,14 @@ static void pttlCommand(rliteClient *c) {
 static void persistCommand(rliteClient *c) {
 	unsigned char *key = UNSIGN(c->argv[1]);
 	long keylen = c->argvlen[1];
-	long page;
-	unsigned char type;
 	unsigned long long expires;
-	long version = 0;
-	int retval = rl_key_get(c->context->db, key, keylen, &type, NULL, &page, &expires, &version);
+	int retval = rl_key_get(c->context->db, key, keylen, NULL, NULL, NULL, &expires, NULL);
 	RLITE_SERVER_ERR2(c, retval, RL_FOUND, RL_NOT_FOUND);
 	if (retval == RL_NOT_FOUND || expires == 0) {
 		c->reply = createLongLongObject(0);
 		goto cleanup;
 	}
-	retval = rl_key_set(c->context->db, key, keylen, type, page, 0, version + 1);
+	retval = rl_key_expires(c->context->db, key, keylen, 0);
 	RLITE_SERVER_OK(c, retval);
 	c->reply = createLongLongObject(1);
 cleanup:
@@ -3267,9 +4077,252 @@ cleanup:
 	return;
 }
 
+static void keysrangeCommand(rliteClient *c) {
+	long i = -1, size = 0;
+	unsigned char **result = NULL;
+	long *resultlen = NULL;
+	int retval = rl_keys_range(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], UNSIGN(c->argv[2]), c->argvlen[2], &size, &result, &resultlen);
+	RLITE_SERVER_OK(c, retval);
+	CHECK_OOM(c->reply = createReplyObject(RLITE_REPLY_ARRAY));
+	c->reply->elements = size;
+	if (size == 0) {
+		goto cleanup;
+	}
+	CHECK_OOM_ELSE(c->reply->element = rl_malloc(sizeof(rliteReply*) * c->reply->elements),
+			rl_free(c->reply); c->reply = NULL);
+
+	for (i = 0; i < size; i++) {
+		CHECK_OOM_ELSE(c->reply->element[i] = createTakeStringObject((char *)result[i], resultlen[i]),
+				c->reply->elements = i; rliteFreeReplyObject(c->reply); c->reply = NULL);
+	}
+	// the reply took the strings
+	size = 0;
+cleanup:
+	// free the strings the reply did not take
+	for (i++; i < size; i++) {
+		rl_free(result[i]);
+	}
+	rl_free(result);
+	rl_free(resultlen);
+	return;
+}
+
+static void keyindexCommand(rliteClient *c) {
+	int retval;
+	if (!strcasecmp(c->argv[1], "create")) {
+		retval = rl_key_index_create(c->context->db);
+		if (retval == RL_INVALID_PARAMETERS) {
+			c->reply = createErrorObject("ERR key index is not supported in this database");
+			goto cleanup;
+		}
+		RLITE_SERVER_ERR2(c, retval, RL_OK, RL_FOUND);
+		c->reply = createLongLongObject(retval == RL_OK ? 1 : 0);
+	}
+	else if (!strcasecmp(c->argv[1], "drop")) {
+		retval = rl_key_index_drop(c->context->db);
+		RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+		c->reply = createLongLongObject(retval == RL_OK ? 1 : 0);
+	}
+	else {
+		c->reply = createErrorObject(RLITE_SYNTAXERR);
+	}
+cleanup:
+	return;
+}
+
+static int parseScanCursorOrReply(rliteClient *c, const char *o, size_t len, unsigned long long *cursor) {
+	char buf[32], *eptr;
+
+	if (len > 0 && len < sizeof(buf)) {
+		memcpy(buf, o, len);
+		buf[len] = 0;
+		errno = 0;
+		*cursor = strtoull(buf, &eptr, 10);
+		if (!isspace(buf[0]) && buf[0] != '-' && eptr[0] == '\0' && errno != ERANGE) {
+			return RLITE_OK;
+		}
+	}
+	c->reply = createErrorObject("ERR invalid cursor");
+	return RLITE_ERR;
+}
+
+/**
+ * Shared by SCAN, SSCAN, HSCAN and ZSCAN. `keytype` is 0 for SCAN, otherwise
+ * the type of the key in argv[1].
+ * The cursor is stateless: for the keyspace, sets and hashes it encodes the
+ * sha1 digest where the next call resumes, for sorted sets it is a rank.
+ */
+static void scanGenericCommand(rliteClient *c, unsigned char keytype) {
+	int retval;
+	int first = keytype ? 3 : 2;
+	unsigned long long cursor, next_cursor = 0;
+	long count = 10, i, size = 0, patternlen = 0;
+	unsigned char *pattern = NULL, type = 0;
+	unsigned char **items = NULL, **datas = NULL;
+	long *itemslen = NULL, *dataslen = NULL;
+	double *scores = NULL;
+	char cursorstr[24];
+	rliteReply *reply = NULL, *list;
+
+	if (parseScanCursorOrReply(c, c->argv[first - 1], c->argvlen[first - 1], &cursor) != RLITE_OK) {
+		return;
+	}
+	for (i = first; i < c->argc; i += 2) {
+		if (i + 1 == c->argc) {
+			c->reply = createErrorObject(RLITE_SYNTAXERR);
+			return;
+		}
+		if (!strcasecmp(c->argv[i], "count")) {
+			if (getLongFromObjectOrReply(c, c->argv[i + 1], c->argvlen[i + 1], &count, NULL) != RLITE_OK) {
+				return;
+			}
+			if (count < 1) {
+				c->reply = createErrorObject(RLITE_SYNTAXERR);
+				return;
+			}
+		}
+		else if (!strcasecmp(c->argv[i], "match")) {
+			pattern = UNSIGN(c->argv[i + 1]);
+			patternlen = c->argvlen[i + 1];
+			if (patternlen == 1 && pattern[0] == '*') {
+				pattern = NULL;
+				patternlen = 0;
+			}
+		}
+		else if (!keytype && !strcasecmp(c->argv[i], "type")) {
+			if (!strcasecmp(c->argv[i + 1], "string")) {
+				type = RL_TYPE_STRING;
+			}
+			else if (!strcasecmp(c->argv[i + 1], "list")) {
+				type = RL_TYPE_LIST;
+			}
+			else if (!strcasecmp(c->argv[i + 1], "set")) {
+				type = RL_TYPE_SET;
+			}
+			else if (!strcasecmp(c->argv[i + 1], "zset")) {
+				type = RL_TYPE_ZSET;
+			}
+			else if (!strcasecmp(c->argv[i + 1], "hash")) {
+				type = RL_TYPE_HASH;
+			}
+			else {
+				addReplyErrorFormat(c->context, "ERR unknown type name '%s'", c->argv[i + 1]);
+				return;
+			}
+		}
+		else {
+			c->reply = createErrorObject(RLITE_SYNTAXERR);
+			return;
+		}
+	}
+
+	if (keytype == RL_TYPE_SET) {
+		retval = rl_sscan(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], cursor, pattern, patternlen, count, &next_cursor, &size, &items, &itemslen);
+	}
+	else if (keytype == RL_TYPE_HASH) {
+		retval = rl_hscan(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], cursor, pattern, patternlen, count, &next_cursor, &size, &items, &itemslen, &datas, &dataslen);
+	}
+	else if (keytype == RL_TYPE_ZSET) {
+		retval = rl_zscan(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], cursor, pattern, patternlen, count, &next_cursor, &size, &items, &itemslen, &scores);
+	}
+	else {
+		retval = rl_scan(c->context->db, cursor, pattern, patternlen, count, type, &next_cursor, &size, &items, &itemslen);
+	}
+	RLITE_SERVER_ERR2(c, retval, RL_OK, RL_NOT_FOUND);
+
+	CHECK_OOM(reply = createReplyObject(RLITE_REPLY_ARRAY));
+	reply->elements = 0;
+	MALLOC(reply->element, sizeof(rliteReply *) * 2);
+	snprintf(cursorstr, sizeof(cursorstr), "%llu", next_cursor);
+	CHECK_OOM(reply->element[0] = createCStringObject(cursorstr));
+	reply->elements++;
+	CHECK_OOM(list = reply->element[1] = createReplyObject(RLITE_REPLY_ARRAY));
+	reply->elements++;
+	list->elements = 0;
+	if (size > 0) {
+		MALLOC(list->element, sizeof(rliteReply *) * (datas || scores ? size * 2 : size));
+	}
+	for (i = 0; i < size; i++) {
+		list->element[list->elements] = createTakeStringObject((char *)items[i], itemslen[i]);
+		items[i] = NULL;
+		CHECK_OOM(list->element[list->elements]);
+		list->elements++;
+		if (datas) {
+			list->element[list->elements] = createTakeStringObject((char *)datas[i], dataslen[i]);
+			datas[i] = NULL;
+			CHECK_OOM(list->element[list->elements]);
+			list->elements++;
+		}
+		else if (scores) {
+			CHECK_OOM(list->element[list->elements] = createDoubleObject(scores[i]));
+			list->elements++;
+		}
+	}
+	c->reply = reply;
+	reply = NULL;
+cleanup:
+	for (i = 0; i < size; i++) {
+		rl_free(items[i]);
+		if (datas) {
+			rl_free(datas[i]);
+		}
+	}
+	rl_free(items);
+	rl_free(itemslen);
+	rl_free(datas);
+	rl_free(dataslen);
+	rl_free(scores);
+	rliteFreeReplyObject(reply);
+}
+
+static void scanCommand(rliteClient *c) {
+	scanGenericCommand(c, 0);
+}
+
+static void sscanCommand(rliteClient *c) {
+	scanGenericCommand(c, RL_TYPE_SET);
+}
+
+static void hscanCommand(rliteClient *c) {
+	scanGenericCommand(c, RL_TYPE_HASH);
+}
+
+static void zscanCommand(rliteClient *c) {
+	scanGenericCommand(c, RL_TYPE_ZSET);
+}
+
 static void existsCommand(rliteClient *c) {
-	int retval = rl_key_get(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], NULL, NULL, NULL, NULL, NULL);
-	c->reply = createLongLongObject(retval == RL_FOUND ? 1 : 0);
+	int retval, i, keyc = c->argc - 1;
+	long count = 0;
+	unsigned char **keys = NULL;
+	long *keyslen = NULL;
+	unsigned char *types = NULL;
+
+	if (keyc == 1) {
+		retval = rl_key_get(c->context->db, UNSIGN(c->argv[1]), c->argvlen[1], NULL, NULL, NULL, NULL, NULL);
+		c->reply = createLongLongObject(retval == RL_FOUND ? 1 : 0);
+		return;
+	}
+
+	MALLOC(keys, sizeof(unsigned char *) * keyc);
+	MALLOC(keyslen, sizeof(long) * keyc);
+	MALLOC(types, sizeof(unsigned char) * keyc);
+	for (i = 0; i < keyc; i++) {
+		keys[i] = (unsigned char *)c->argv[1 + i];
+		keyslen[i] = (long)c->argvlen[1 + i];
+	}
+	retval = rl_key_mget(c->context->db, keyc, keys, keyslen, types, NULL);
+	RLITE_SERVER_OK(c, retval);
+	for (i = 0; i < keyc; i++) {
+		if (types[i]) {
+			count++;
+		}
+	}
+	c->reply = createLongLongObject(count);
+cleanup:
+	rl_free(keys);
+	rl_free(keyslen);
+	rl_free(types);
 }
 
 static void typeCommand(rliteClient *c) {
@@ -3310,7 +4363,10 @@ static void getKeyEncoding(rliteClient *c, char *encoding, unsigned char *key, l
 			memcpy(encoding, enc, (strlen(enc) + 1) * sizeof(char));
 		}
 		else if (type == RL_TYPE_ZSET) {
-			const char *enc = c->context->debugSkiplist ? "skiplist" : "ziplist";
+			int zencoding = RL_ZSET_ENCODING_TREE;
+			int retval = rl_zset_encoding(c->context->db, key, keylen, &zencoding);
+			RLITE_SERVER_OK(c, retval);
+			const char *enc = c->context->debugSkiplist || zencoding == RL_ZSET_ENCODING_TREE ? "skiplist" : "ziplist";
 			memcpy(encoding, enc, (strlen(enc) + 1) * sizeof(char));
 		}
 		else if (type == RL_TYPE_HASH) {
@@ -3797,7 +4853,7 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"append",appendCommand,3,"wm",0,1,1,1,0,0},
 	{"strlen",strlenCommand,2,"rF",0,1,1,1,0,0},
 	{"del",delCommand,-2,"w",0,1,-1,1,0,0},
-	{"exists",existsCommand,2,"rF",0,1,1,1,0,0},
+	{"exists",existsCommand,-2,"rF",0,1,-1,1,0,0},
 	{"setbit",setbitCommand,4,"wm",0,1,1,1,0,0},
 	{"getbit",getbitCommand,3,"rF",0,1,1,1,0,0},
 	{"setrange",setrangeCommand,4,"wm",0,1,1,1,0,0},
@@ -3813,9 +4869,9 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"linsert",linsertCommand,5,"wm",0,1,1,1,0,0},
 	{"rpop",rpopCommand,2,"wF",0,1,1,1,0,0},
 	{"lpop",lpopCommand,2,"wF",0,1,1,1,0,0},
-	// {"brpop",brpopCommand,-3,"ws",0,NULL,1,1,1,0,0},
-	// {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0},
-	// {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
+	{"brpop",brpopCommand,-3,"ws",0,1,-2,1,0,0},
+	{"brpoplpush",brpoplpushCommand,4,"wms",0,1,2,1,0,0},
+	{"blpop",blpopCommand,-3,"ws",0,1,-2,1,0,0},
 	{"llen",llenCommand,2,"rF",0,1,1,1,0,0},
 	{"lindex",lindexCommand,3,"r",0,1,1,1,0,0},
 	{"lset",lsetCommand,4,"wm",0,1,1,1,0,0},
@@ -3827,25 +4883,35 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"srem",sremCommand,-3,"wF",0,1,1,1,0,0},
 	{"smove",smoveCommand,4,"wF",0,1,2,1,0,0},
 	{"sismember",sismemberCommand,3,"rF",0,1,1,1,0,0},
+	{"smismember",smismemberCommand,-3,"rF",0,1,1,1,0,0},
 	{"scard",scardCommand,2,"rF",0,1,1,1,0,0},
 	{"spop",spopCommand,2,"wRsF",0,1,1,1,0,0},
 	{"srandmember",srandmemberCommand,-2,"rR",0,1,1,1,0,0},
 	{"sinter",sinterCommand,-2,"rS",0,1,-1,1,0,0},
 	{"sinterstore",sinterstoreCommand,-3,"wm",0,1,-1,1,0,0},
+	{"sintercard",sintercardCommand,-3,"r",0,0,0,0,0,0},
 	{"sunion",sunionCommand,-2,"rS",0,1,-1,1,0,0},
 	{"sunionstore",sunionstoreCommand,-3,"wm",0,1,-1,1,0,0},
 	{"sdiff",sdiffCommand,-2,"rS",0,1,-1,1,0,0},
 	{"sdiffstore",sdiffstoreCommand,-3,"wm",0,1,-1,1,0,0},
 	{"smembers",sinterCommand,2,"rS",0,1,1,1,0,0},
-	// {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
+	{"sscan",sscanCommand,-3,"rR",0,1,1,1,0,0},
 	{"zadd",zaddCommand,-4,"wmF",0,1,1,1,0,0},
 	{"zincrby",zincrbyCommand,4,"wmF",0,1,1,1,0,0},
 	{"zrem",zremCommand,-3,"wF",0,1,1,1,0,0},
+	{"zpopmin",zpopminCommand,-2,"wF",0,1,1,1,0,0},
+	{"zpopmax",zpopmaxCommand,-2,"wF",0,1,1,1,0,0},
+	{"bzpopmin",bzpopminCommand,-3,"ws",0,1,-2,1,0,0},
+	{"bzpopmax",bzpopmaxCommand,-3,"ws",0,1,-2,1,0,0},
 	{"zremrangebyscore",zremrangebyscoreCommand,4,"w",0,1,1,1,0,0},
 	{"zremrangebyrank",zremrangebyrankCommand,4,"w",0,1,1,1,0,0},
 	{"zremrangebylex",zremrangebylexCommand,4,"w",0,1,1,1,0,0},
 	{"zunionstore",zunionstoreCommand,-4,"wm",0,0,0,0,0,0},
 	{"zinterstore",zinterstoreCommand,-4,"wm",0,0,0,0,0,0},
+	{"zdiffstore",zdiffstoreCommand,-4,"wm",0,0,0,0,0,0},
+	{"zunion",zunionCommand,-3,"r",0,0,0,0,0,0},
+	{"zinter",zinterCommand,-3,"r",0,0,0,0,0,0},
+	{"zdiff",zdiffCommand,-3,"r",0,0,0,0,0,0},
 	{"zrange",zrangeCommand,-4,"r",0,1,1,1,0,0},
 	{"zrangebyscore",zrangebyscoreCommand,-4,"r",0,1,1,1,0,0},
 	{"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,1,1,1,0,0},
@@ -3858,8 +4924,8 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"zscore",zscoreCommand,3,"rF",0,1,1,1,0,0},
 	{"zrank",zrankCommand,3,"rF",0,1,1,1,0,0},
 	{"zrevrank",zrevrankCommand,3,"rF",0,1,1,1,0,0},
-	// {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-	{"hset",hsetCommand,4,"wmF",0,1,1,1,0,0},
+	{"zscan",zscanCommand,-3,"rR",0,1,1,1,0,0},
+	{"hset",hsetCommand,-4,"wmF",0,1,1,1,0,0},
 	{"hsetnx",hsetnxCommand,4,"wmF",0,1,1,1,0,0},
 	{"hget",hgetCommand,3,"rF",0,1,1,1,0,0},
 	{"hmset",hmsetCommand,-4,"wm",0,1,1,1,0,0},
@@ -3872,7 +4938,7 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"hvals",hvalsCommand,2,"rS",0,1,1,1,0,0},
 	{"hgetall",hgetallCommand,2,"r",0,1,1,1,0,0},
 	{"hexists",hexistsCommand,3,"rF",0,1,1,1,0,0},
-	// {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
+	{"hscan",hscanCommand,-3,"rR",0,1,1,1,0,0},
 	{"incrby",incrbyCommand,3,"wmF",0,1,1,1,0,0},
 	{"decrby",decrbyCommand,3,"wmF",0,1,1,1,0,0},
 	{"incrbyfloat",incrbyfloatCommand,3,"wmF",0,1,1,1,0,0},
@@ -3889,7 +4955,9 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"pexpire",pexpireCommand,3,"wF",0,1,1,1,0,0},
 	{"pexpireat",pexpireatCommand,3,"wF",0,1,1,1,0,0},
 	{"keys",keysCommand,2,"rS",0,0,0,0,0,0},
-	// {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
+	{"keysrange",keysrangeCommand,3,"rS",0,0,0,0,0,0},
+	{"keyindex",keyindexCommand,2,"w",0,0,0,0,0,0},
+	{"scan",scanCommand,-2,"rR",0,0,0,0,0,0},
 	{"dbsize",dbsizeCommand,1,"rF",0,0,0,0,0,0},
 	// {"auth",authCommand,2,"rsltF",0,NULL,0,0,0,0,0},
 	{"ping",pingCommand,-1,"rtF",0,0,0,0,0,0},
@@ -3945,6 +5013,8 @@ static struct rliteCommand rliteCommandTable[] = {
 	{"bitop",bitopCommand,-4,"wm",0,2,-1,1,0,0},
 	{"bitcount",bitcountCommand,-2,"r",0,1,1,1,0,0},
 	{"bitpos",bitposCommand,-3,"r",0,1,1,1,0,0},
+	{"bitfield",bitfieldCommand,-2,"wm",0,1,1,1,0,0},
+	{"bitfield_ro",bitfieldroCommand,-2,"r",0,1,1,1,0,0},
 	// {"wait",waitCommand,3,"rs",0,NULL,0,0,0,0,0},
 	// {"command",commandCommand,0,"rlt",0,NULL,0,0,0,0,0},
 	{"pfselftest",pfselftestCommand,1,"r",0,0,0,0,0,0},
@@ -500,13 +500,10 @@ static int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     }
 }
 
-/* Compute SUM(2^-reg) in the dense representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-static double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+/* Compute the histogram of the register values in the dense representation:
+ * reghisto[v] is incremented once for every register whose value is v. */
+static void hllDenseRegHistoGeneric(uint8_t *registers, int *reghisto) {
+    int j;
 
     /* Redis default is to use 16384 registers 6 bits each. The code works
      * with other values by modifying the defines, but for our target value
@@ -517,29 +514,27 @@ static double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
                       r10, r11, r12, r13, r14, r15;
         for (j = 0; j < 1024; j++) {
             /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63; if (r0 == 0) ez++;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-            r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-            r4 = r[3] & 63; if (r4 == 0) ez++;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-            r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-            r8 = r[6] & 63; if (r8 == 0) ez++;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-            r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-            r12 = r[9] & 63; if (r12 == 0) ez++;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-            r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-            /* Additional parens will allow the compiler to optimize the
-             * code more with a loss of precision that is not very relevant
-             * here (floating point math is not commutative!). */
-            E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-                 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-                 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
+            r0 = r[0] & 63;
+            r1 = (r[0] >> 6 | r[1] << 2) & 63;
+            r2 = (r[1] >> 4 | r[2] << 4) & 63;
+            r3 = (r[2] >> 2) & 63;
+            r4 = r[3] & 63;
+            r5 = (r[3] >> 6 | r[4] << 2) & 63;
+            r6 = (r[4] >> 4 | r[5] << 4) & 63;
+            r7 = (r[5] >> 2) & 63;
+            r8 = r[6] & 63;
+            r9 = (r[6] >> 6 | r[7] << 2) & 63;
+            r10 = (r[7] >> 4 | r[8] << 4) & 63;
+            r11 = (r[8] >> 2) & 63;
+            r12 = r[9] & 63;
+            r13 = (r[9] >> 6 | r[10] << 2) & 63;
+            r14 = (r[10] >> 4 | r[11] << 4) & 63;
+            r15 = (r[11] >> 2) & 63;
+
+            reghisto[r0]++; reghisto[r1]++; reghisto[r2]++; reghisto[r3]++;
+            reghisto[r4]++; reghisto[r5]++; reghisto[r6]++; reghisto[r7]++;
+            reghisto[r8]++; reghisto[r9]++; reghisto[r10]++; reghisto[r11]++;
+            reghisto[r12]++; reghisto[r13]++; reghisto[r14]++; reghisto[r15]++;
             r += 12;
         }
     } else {
@@ -547,19 +542,148 @@ static double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
             unsigned long reg;
 
             HLL_DENSE_GET_REGISTER(reg,registers,j);
-            if (reg == 0) {
-                ez++;
-                /* Increment E at the end of the loop. */
-            } else {
-                E += PE[reg]; /* Precomputed 2^(-reg[j]). */
-            }
+            reghisto[reg]++;
         }
-        E += ez; /* Add 2^0 'ez' times. */
     }
-    *ezp = ez;
+}
+
+/* Merge the dense registers into 'max' by setting max[i] to
+ * MAX(max[i],registers[i]). */
+static void hllDenseMergeGeneric(uint8_t *max, uint8_t *registers) {
+    uint8_t val;
+    int i;
+
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        HLL_DENSE_GET_REGISTER(val,registers,i);
+        if (val > max[i]) max[i] = val;
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HLL_DENSE_DISPATCH
+
+/* Unpack the 32 six bit registers stored in the 24 bytes at 'r' into one
+ * byte each. 32 bytes are loaded, so the caller must make sure the 8 bytes
+ * past the registers are readable.
+ *
+ * Every group of 3 bytes holds 4 registers: the bytes are spread into 32 bit
+ * lanes and each register is shifted into its own byte of the lane. */
+__attribute__((target("avx2")))
+static inline __m256i hllDenseUnpackAVX2(uint8_t *r) {
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i x, y;
+
+    x = _mm256_loadu_si256((__m256i *)r);
+    x = _mm256_permutevar8x32_epi32(x, spread);
+    x = _mm256_shuffle_epi8(x, shuffle);
+    y = _mm256_and_si256(x, _mm256_set1_epi32(0x3f));
+    y = _mm256_or_si256(y, _mm256_and_si256(_mm256_slli_epi32(x, 2), _mm256_set1_epi32(0x3f00)));
+    y = _mm256_or_si256(y, _mm256_and_si256(_mm256_slli_epi32(x, 4), _mm256_set1_epi32(0x3f0000)));
+    y = _mm256_or_si256(y, _mm256_and_si256(_mm256_slli_epi32(x, 6), _mm256_set1_epi32(0x3f000000)));
+    return y;
+}
+
+/* The last 24 bytes of registers are copied to a buffer before unpacking
+ * them, to avoid reading past the end of the HLL. */
+__attribute__((target("avx2")))
+static inline __m256i hllDenseUnpackAVX2At(uint8_t *registers, int j) {
+    uint8_t tail[32];
+
+    if (j < HLL_REGISTERS / 32 - 1) return hllDenseUnpackAVX2(registers + j * 24);
+    memcpy(tail, registers + j * 24, 24);
+    memset(tail + 24, 0, 8);
+    return hllDenseUnpackAVX2(tail);
+}
+
+__attribute__((target("avx2")))
+static void hllDenseRegHistoAVX2(uint8_t *registers, int *reghisto) {
+    uint8_t regs[32];
+    int j, k;
+
+    for (j = 0; j < HLL_REGISTERS / 32; j++) {
+        _mm256_storeu_si256((__m256i *)regs, hllDenseUnpackAVX2At(registers, j));
+        for (k = 0; k < 32; k++) reghisto[regs[k]]++;
+    }
+}
+
+__attribute__((target("avx2")))
+static void hllDenseMergeAVX2(uint8_t *max, uint8_t *registers) {
+    __m256i m;
+    int j;
+
+    for (j = 0; j < HLL_REGISTERS / 32; j++) {
+        m = _mm256_loadu_si256((__m256i *)(max + j * 32));
+        m = _mm256_max_epu8(m, hllDenseUnpackAVX2At(registers, j));
+        _mm256_storeu_si256((__m256i *)(max + j * 32), m);
+    }
+}
+
+static void (*hllDenseRegHistoImpl)(uint8_t *registers, int *reghisto) = NULL;
+static void (*hllDenseMergeImpl)(uint8_t *max, uint8_t *registers) = NULL;
+
+static void hllDenseSelectImpl(void) {
+    if (hllDenseRegHistoImpl != NULL) return;
+    __builtin_cpu_init();
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6 && __builtin_cpu_supports("avx2")) {
+        hllDenseMergeImpl = hllDenseMergeAVX2;
+        hllDenseRegHistoImpl = hllDenseRegHistoAVX2;
+    } else {
+        hllDenseMergeImpl = hllDenseMergeGeneric;
+        hllDenseRegHistoImpl = hllDenseRegHistoGeneric;
+    }
+}
+#endif
+
+static void hllDenseRegHisto(uint8_t *registers, int *reghisto) {
+#ifdef HLL_DENSE_DISPATCH
+    hllDenseSelectImpl();
+    hllDenseRegHistoImpl(registers, reghisto);
+#else
+    hllDenseRegHistoGeneric(registers, reghisto);
+#endif
+}
+
+static void hllDenseMerge(uint8_t *max, uint8_t *registers) {
+#ifdef HLL_DENSE_DISPATCH
+    hllDenseSelectImpl();
+    hllDenseMergeImpl(max, registers);
+#else
+    hllDenseMergeGeneric(max, registers);
+#endif
+}
+
+/* Compute SUM(2^-reg) given the histogram of the register values.
+ * Summing by value rather than by register makes the result independent
+ * of the encoding and of the order the registers are visited in.
+ * As a side effect the integer pointed by 'ezp' is set to the number
+ * of zero registers. */
+static double hllHistoSum(int *reghisto, double *PE, int *ezp) {
+    double E = 0;
+    int j;
+
+    for (j = 63; j >= 1; j--) {
+        E += PE[j] * reghisto[j];
+    }
+    E += reghisto[0]; /* Add 2^0 for every zero register. */
+    *ezp = reghisto[0];
     return E;
 }
 
+/* Compute SUM(2^-reg) in the dense representation.
+ * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
+ * As a side effect the integer pointed by 'ezp' is set to the number
+ * of zero registers. */
+static double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
+    int reghisto[64] = {0};
+
+    hllDenseRegHisto(registers, reghisto);
+    return hllHistoSum(reghisto, PE, ezp);
+}
+
 /* ================== Sparse representation implementation  ================= */
 
 /* Convert the HLL with sparse representation given as input in its dense
@@ -898,35 +1022,31 @@ promote: /* Promote to dense representation. */
  * As a side effect the integer pointed by 'ezp' is set to the number
  * of zero registers. */
 static double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp, int *invalid) {
-    double E = 0;
-    int ez = 0, idx = 0, runlen, regval;
+    int reghisto[64] = {0};
+    int idx = 0, runlen, regval;
     uint8_t *end = sparse+sparselen, *p = sparse;
 
     while(p < end) {
         if (HLL_SPARSE_IS_ZERO(p)) {
             runlen = HLL_SPARSE_ZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p++;
         } else if (HLL_SPARSE_IS_XZERO(p)) {
             runlen = HLL_SPARSE_XZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p += 2;
         } else {
             runlen = HLL_SPARSE_VAL_LEN(p);
             regval = HLL_SPARSE_VAL_VALUE(p);
             idx += runlen;
-            E += PE[regval]*runlen;
+            reghisto[regval] += runlen;
             p++;
         }
     }
     if (idx != HLL_REGISTERS && invalid) *invalid = 1;
-    E += ez; /* Add 2^0 'ez' times. */
-    *ezp = ez;
-    return E;
+    return hllHistoSum(reghisto, PE, ezp);
 }
 
 /* ========================= HyperLogLog Count ==============================
@@ -938,31 +1058,28 @@ static double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp,
 /* Implements the SUM operation for uint8_t data type which is only used
  * internally as speedup for PFCOUNT with multiple keys. */
 static double hllRawSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+    int reghisto[64] = {0};
+    int j;
     uint64_t *word = (uint64_t*) registers;
     uint8_t *bytes;
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
         if (*word == 0) {
-            ez += 8;
+            reghisto[0] += 8;
         } else {
             bytes = (uint8_t*) word;
-            if (bytes[0]) E += PE[bytes[0]]; else ez++;
-            if (bytes[1]) E += PE[bytes[1]]; else ez++;
-            if (bytes[2]) E += PE[bytes[2]]; else ez++;
-            if (bytes[3]) E += PE[bytes[3]]; else ez++;
-            if (bytes[4]) E += PE[bytes[4]]; else ez++;
-            if (bytes[5]) E += PE[bytes[5]]; else ez++;
-            if (bytes[6]) E += PE[bytes[6]]; else ez++;
-            if (bytes[7]) E += PE[bytes[7]]; else ez++;
+            reghisto[bytes[0]]++;
+            reghisto[bytes[1]]++;
+            reghisto[bytes[2]]++;
+            reghisto[bytes[3]]++;
+            reghisto[bytes[4]]++;
+            reghisto[bytes[5]]++;
+            reghisto[bytes[6]]++;
+            reghisto[bytes[7]]++;
         }
         word++;
     }
-    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every
-                zero register in the HLL. */
-    *ezp = ez;
-    return E;
+    return hllHistoSum(reghisto, PE, ezp);
 }
 
 /* Return the approximated cardinality of the set based on the harmonic
@@ -1059,12 +1176,7 @@ static int hllMerge(uint8_t *max, unsigned char *str, long strlen) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
-
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseMerge(max, hdr->registers);
     } else {
         uint8_t *p = (uint8_t *)hdr, *end = p + strlen;
         long runlen, regval;
@@ -1156,6 +1268,48 @@ invalid:
     return -1;
 }
 
+/* ==================== Page-local dense register access ==================== */
+
+/* The following functions let callers that store the HLL in fixed size
+ * pages update a dense HLL without loading all of it. */
+
+/* Check the first RL_HLL_HDR_SIZE bytes of an HLL of length 'strlen'.
+ * Return 1 if it is a valid dense HLL, 0 if it is a sparse one and -1 if
+ * it is not an HLL at all. */
+int rl_str_pfisdense(unsigned char *header, long strlen) {
+    if (isHLLObject(header, strlen) != 0) return -1;
+    return ((struct hllhdr *)header)->encoding == HLL_DENSE;
+}
+
+/* Locate the register 'ele' hashes to in a dense HLL. '*byte' is set to the
+ * offset, from the start of the HLL, of the first of the two bytes holding
+ * the register and '*regnum' to the register index. Returns the count to
+ * pass to rl_str_pfdense_update(). */
+int rl_str_pfdense_locate(unsigned char *ele, long elelen, long *byte, long *regnum) {
+    int count = hllPatLen(ele, elelen, regnum);
+    *byte = HLL_HDR_SIZE + *regnum * HLL_BITS / 8;
+    return count;
+}
+
+/* Update the register 'regnum' held in the two bytes at 'bytes' if 'count'
+ * is greater than its value. Returns 1 if the register was updated. */
+int rl_str_pfdense_update(unsigned char *bytes, long regnum, int count) {
+    unsigned long fb = regnum * HLL_BITS & 7, fb8 = 8 - fb, oldcount;
+
+    oldcount = ((bytes[0] >> fb) | ((unsigned long)bytes[1] << fb8)) & HLL_REGISTER_MAX;
+    if ((unsigned long)count <= oldcount) return 0;
+    bytes[0] &= ~(HLL_REGISTER_MAX << fb);
+    bytes[0] |= count << fb;
+    bytes[1] &= ~(HLL_REGISTER_MAX >> fb8);
+    bytes[1] |= count >> fb8;
+    return 1;
+}
+
+/* Invalidate the cached cardinality in the header of an HLL. */
+void rl_str_pfinvalidate(unsigned char *header) {
+    HLL_INVALIDATE_CACHE((struct hllhdr *)header);
+}
+
 /* PFADD var ele ele ele ... ele => :0 or :1 */
 int rl_str_pfadd(unsigned char *str, long strlen, int argc, unsigned char **argv, long *argvlen, unsigned char **_str, long *_strlen) {
     struct hllhdr *hdr;
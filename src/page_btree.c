@@ -100,6 +100,7 @@ int rl_btree_node_create(rlite *UNUSED(db), rl_btree *btree, rl_btree_node **_no
 	RL_MALLOC(node, sizeof(rl_btree_node));
 	RL_MALLOC(node->scores, sizeof(void *) * btree->max_node_size);
 	node->children = NULL;
+	node->counts = NULL;
 	RL_MALLOC(node->values, sizeof(void *) * btree->max_node_size);
 	node->size = 0;
 	*_node = node;
@@ -133,10 +134,78 @@ int rl_btree_node_destroy(rlite *UNUSED(db), void *_node)
 	if (node->children) {
 		rl_free(node->children);
 	}
+	rl_free(node->counts);
 	rl_free(node);
 	return RL_OK;
 }
 
+static int node_alloc_children(rl_btree *btree, rl_btree_node *node)
+{
+	int retval = RL_OK;
+	RL_MALLOC(node->children, sizeof(long) * (btree->max_node_size + 1));
+	RL_MALLOC(node->counts, sizeof(long) * (btree->max_node_size + 1));
+cleanup:
+	return retval;
+}
+
+/**
+ * Number of elements in the subtree rooted at `node`
+ */
+static long node_count(rl_btree_node *node)
+{
+	long i, count = node->size;
+	if (node->children) {
+		for (i = 0; i <= node->size; i++) {
+			count += node->counts[i];
+		}
+	}
+	return count;
+}
+
+static void put_number(unsigned char *data, unsigned char encoding, rl_number *number)
+{
+	data[0] = encoding;
+	if (encoding == RL_VALUE_ENCODING_DOUBLE) {
+		put_double(&data[1], number->floating);
+	}
+	else {
+		put_8bytes(&data[1], encoding == RL_VALUE_ENCODING_INT ? (unsigned long long)number->integer : 0);
+	}
+}
+
+static void get_number(unsigned char *data, unsigned char *encoding, rl_number *number)
+{
+	*encoding = data[0];
+	if (*encoding == RL_VALUE_ENCODING_DOUBLE) {
+		number->floating = get_double(&data[1]);
+	}
+	else {
+		number->integer = (long long)get_8bytes(&data[1]);
+	}
+}
+
+static void serialize_counts(rl_btree_node *node, unsigned char *data)
+{
+	long i;
+	if (node->children) {
+		for (i = 0; i <= node->size; i++) {
+			put_4bytes(&data[i * 4], node->counts[i]);
+		}
+	}
+}
+
+static int deserialize_counts(rl_btree *btree, rl_btree_node *node, unsigned char *data)
+{
+	long i;
+	int retval = RL_OK;
+	RL_MALLOC(node->counts, sizeof(long) * (btree->max_node_size + 1));
+	for (i = 0; i <= node->size; i++) {
+		node->counts[i] = get_4bytes(&data[i * 4]);
+	}
+cleanup:
+	return retval;
+}
+
 int rl_btree_create_size(rlite *db, rl_btree **_btree, rl_btree_type *type, long max_node_size)
 {
 	int retval = RL_OK;
@@ -163,7 +232,8 @@ cleanup:
 
 int rl_btree_create(rlite *db, rl_btree **_btree, rl_btree_type *type)
 {
-	long size = (db->page_size - 12) / (type->score_size + type->value_size + 4);
+	// every element takes its score, its value, a child and the child's count
+	long size = (db->page_size - 16) / (type->score_size + type->value_size + 8);
 	// TODO: make btree work with even number of elements
 	if (size % 2 != 0) {
 		size--;
@@ -247,61 +317,157 @@ cleanup:
 	return retval;
 }
 
-int rl_btree_random_element(rlite *db, rl_btree *btree, void **score, void **value)
+static void sort_scores(rl_btree *btree, void **scores, long *order, long *tmp, long size)
+{
+	long i, j, k, half = size / 2;
+	if (size < 2) {
+		return;
+	}
+	sort_scores(btree, scores, order, tmp, half);
+	sort_scores(btree, scores, &order[half], tmp, size - half);
+	memcpy(tmp, order, sizeof(long) * size);
+	for (i = 0, j = half, k = 0; k < size; k++) {
+		if (j == size || (i < half && btree->type->cmp(scores[tmp[i]], scores[tmp[j]]) <= 0)) {
+			order[k] = tmp[i++];
+		}
+		else {
+			order[k] = tmp[j++];
+		}
+	}
+}
+
+/**
+ * Looks up the sorted scores in `order[start..end)` in the subtree of `node`,
+ * which is at `depth` in the tree.
+ */
+static int find_sorted_scores(rlite *db, rl_btree *btree, rl_btree_node *node, long depth, void **scores, long *order, long start, long end, void **values)
 {
-	int retval;
-	long i, h = btree->height;
-	long *acc = NULL, random, pos;
 	void *_node;
-	rl_btree_node *node;
+	long i = start, j, pos, min, max;
+	int cmp, retval = RL_OK;
+	while (i < end) {
+		// first score in the node not lower than the one we are looking for
+		min = 0;
+		max = node->size;
+		while (min < max) {
+			pos = (max - min) / 2 + min;
+			if (btree->type->cmp(scores[order[i]], node->scores[pos]) > 0) {
+				min = pos + 1;
+			}
+			else {
+				max = pos;
+			}
+		}
+		pos = min;
+		cmp = pos < node->size ? btree->type->cmp(scores[order[i]], node->scores[pos]) : 1;
+		if (cmp == 0) {
+			values[order[i]] = node->values[pos];
+			i++;
+			continue;
+		}
+		// every score before node->scores[pos] goes to the same child
+		for (j = i + 1; j < end; j++) {
+			if (pos < node->size && btree->type->cmp(scores[order[j]], node->scores[pos]) >= 0) {
+				break;
+			}
+		}
+		if (node->children && depth + 1 < btree->height) {
+			RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, node->children[pos], btree, &_node, 1);
+			RL_CALL(find_sorted_scores, RL_OK, db, btree, _node, depth + 1, scores, order, i, j, values);
+		}
+		i = j;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
 
-	RL_MALLOC(acc, sizeof(long) * h);
-	acc[0] = 1;
-	for (i = 1; i < h; i++) {
-		acc[i] = acc[i - 1] + ceil(acc[i - 1] * 0.75 * btree->max_node_size);
+int rl_btree_find_scores(rlite *db, rl_btree *btree, long size, void **scores, void **values)
+{
+	void *_node;
+	long i, *order = NULL, *tmp = NULL;
+	int retval;
+	for (i = 0; i < size; i++) {
+		values[i] = NULL;
+	}
+	if (size == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_MALLOC(order, sizeof(long) * size);
+	RL_MALLOC(tmp, sizeof(long) * size);
+	for (i = 0; i < size; i++) {
+		order[i] = i;
 	}
+	sort_scores(btree, scores, order, tmp, size);
+	RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, btree->root, btree, &_node, 1);
+	RL_CALL(find_sorted_scores, RL_OK, db, btree, _node, 0, scores, order, 0, size, values);
+cleanup:
+	rl_free(order);
+	rl_free(tmp);
+	return retval;
+}
 
-	random = 1 + (long)(((float)rand() / RAND_MAX) * acc[h - 1]);
+int rl_btree_get_element(rlite *db, rl_btree *btree, long rank, void **score, void **value)
+{
+	int retval;
+	long i;
+	void *_node;
+	rl_btree_node *node;
 
+	if (rank < 0 || rank >= btree->number_of_elements) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
 	RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, btree->root, btree, &_node, 1);
 	node = _node;
-	for (i = 0; i < h; i++) {
-		if (random > acc[i]) {
-			pos = (long)(((float)rand() / RAND_MAX) * (1 + node->size));
-			RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, node->children[pos], btree, &_node, 1);
-			node = _node;
-		}
-		else {
-			pos = (long)(((float)rand() / RAND_MAX) * node->size);
-			if (score) {
-				*score = node->scores[pos];
+	while (node->children) {
+		for (i = 0; i < node->size; i++) {
+			if (rank < node->counts[i]) {
+				break;
 			}
-			if (value) {
-				*value = node->values[pos];
+			rank -= node->counts[i];
+			if (rank == 0) {
+				goto found;
 			}
-			break;
+			rank--;
 		}
+		RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, node->children[i], btree, &_node, 1);
+		node = _node;
+	}
+	i = rank;
+found:
+	if (score) {
+		*score = node->scores[i];
+	}
+	if (value) {
+		*value = node->values[i];
 	}
 	retval = RL_OK;
 cleanup:
-	rl_free(acc);
 	return retval;
 }
 
-int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *score, void *value)
+int rl_btree_random_element(rlite *db, rl_btree *btree, void **score, void **value)
+{
+	long rank = (long)(((double)rand() / ((double)RAND_MAX + 1)) * btree->number_of_elements);
+	return rl_btree_get_element(db, btree, rank, score, value);
+}
+
+/**
+ * Adds `score` where `nodes` and `positions`, as filled by
+ * rl_btree_find_score, say it belongs.
+ * `written` tells the btree and every node in the path are already in the
+ * write cache, it is only valid when the leaf has room for one more.
+ */
+static int add_element_at(rlite *db, rl_btree *btree, long btree_page, void *score, void *value, rl_btree_node **nodes, long *positions, int written)
 {
 	int retval;
-	long *positions = NULL;
 	rl_btree_node *right;
-	rl_btree_node **nodes;
-	RL_MALLOC(nodes, sizeof(rl_btree_node *) * btree->height);
-	RL_MALLOC(positions, sizeof(long) * btree->height);
 	void *tmp;
-	long i, pos;
+	long i, j, pos;
 	long node_page = 0;
-	long child = -1;
-	RL_CALL(rl_btree_find_score, RL_NOT_FOUND, db, btree, score, NULL, nodes, positions);
-	retval = RL_OK;
+	long child = -1, child_count = 0, left_count = 0;
 	rl_btree_node *node = NULL;
 	for (i = btree->height - 1; i >= 0; i--) {
 		if (i == 0) {
@@ -311,12 +477,17 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 			node_page = nodes[i - 1]->children[positions[i - 1]];
 		}
 		node = nodes[i];
+		if (child != -1) {
+			// the child that was split keeps the lower half
+			node->counts[positions[i]] = left_count;
+		}
 
 		if (node->size < btree->max_node_size) {
 			memmove(&node->scores[positions[i] + 1], &node->scores[positions[i]], sizeof(void *) * (node->size - positions[i]));
 			memmove(&node->values[positions[i] + 1], &node->values[positions[i]], sizeof(void *) * (node->size - positions[i]));
 			if (node->children) {
 				memmove(&node->children[positions[i] + 2], &node->children[positions[i] + 1], sizeof(long) * (node->size - positions[i]));
+				memmove(&node->counts[positions[i] + 2], &node->counts[positions[i] + 1], sizeof(long) * (node->size - positions[i]));
 			}
 			node->scores[positions[i]] = score;
 			node->values[positions[i]] = value;
@@ -325,11 +496,22 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 					fprintf(stderr, "Adding child, but children is not initialized\n");
 				}
 				node->children[positions[i] + 1] = child;
+				node->counts[positions[i] + 1] = child_count;
 			}
 			node->size++;
 			score = NULL;
 			value = NULL;
+			if (written) {
+				for (j = i - 1; j >= 0; j--) {
+					nodes[j]->counts[positions[j]]++;
+				}
+				break;
+			}
 			RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, node_page, node);
+			for (j = i - 1; j >= 0; j--) {
+				nodes[j]->counts[positions[j]]++;
+				RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, j == 0 ? btree->root : nodes[j - 1]->children[positions[j - 1]], nodes[j]);
+			}
 			break;
 		}
 		else {
@@ -337,10 +519,9 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 
 			RL_CALL(rl_btree_node_create, RL_OK, db, btree, &right);
 			if (child != -1) {
-				right->children = rl_malloc(sizeof(long) * (btree->max_node_size + 1));
-				if (!right->children) {
+				retval = node_alloc_children(btree, right);
+				if (retval != RL_OK) {
 					rl_btree_node_destroy(db, right);
-					retval = RL_OUT_OF_MEMORY;
 					goto cleanup;
 				}
 			}
@@ -350,7 +531,9 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 					memmove(right->children, &node->children[btree->max_node_size / 2], sizeof(void *) * (btree->max_node_size / 2 + 1));
 					memmove(&node->children[pos + 2], &node->children[pos + 1], sizeof(void *) * (btree->max_node_size / 2 - 1 - pos));
 					node->children[pos + 1] = child;
-
+					memmove(right->counts, &node->counts[btree->max_node_size / 2], sizeof(long) * (btree->max_node_size / 2 + 1));
+					memmove(&node->counts[pos + 2], &node->counts[pos + 1], sizeof(long) * (btree->max_node_size / 2 - 1 - pos));
+					node->counts[pos + 1] = child_count;
 				}
 				tmp = node->scores[btree->max_node_size / 2 - 1];
 				memmove(&node->scores[pos + 1], &node->scores[pos], sizeof(void *) * (btree->max_node_size / 2 - 1 - pos));
@@ -368,6 +551,8 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 				if (child != -1) {
 					memmove(&right->children[1], &node->children[btree->max_node_size / 2 + 1], sizeof(void *) * (btree->max_node_size / 2));
 					right->children[0] = child;
+					memmove(&right->counts[1], &node->counts[btree->max_node_size / 2 + 1], sizeof(long) * (btree->max_node_size / 2));
+					right->counts[0] = child_count;
 				}
 				memmove(right->scores, &node->scores[btree->max_node_size / 2], sizeof(void *) * btree->max_node_size / 2);
 				memmove(right->values, &node->values[btree->max_node_size / 2], sizeof(void *) * btree->max_node_size / 2);
@@ -378,6 +563,9 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 					memmove(right->children, &node->children[btree->max_node_size / 2 + 1], sizeof(void *) * (pos - btree->max_node_size / 2));
 					right->children[pos - btree->max_node_size / 2] = child;
 					memmove(&right->children[pos - btree->max_node_size / 2 + 1], &node->children[pos + 1], sizeof(void *) * (btree->max_node_size - pos));
+					memmove(right->counts, &node->counts[btree->max_node_size / 2 + 1], sizeof(long) * (pos - btree->max_node_size / 2));
+					right->counts[pos - btree->max_node_size / 2] = child_count;
+					memmove(&right->counts[pos - btree->max_node_size / 2 + 1], &node->counts[pos + 1], sizeof(long) * (btree->max_node_size - pos));
 				}
 				tmp = node->scores[btree->max_node_size / 2];
 				memmove(right->scores, &node->scores[btree->max_node_size / 2 + 1], sizeof(void *) * (pos - btree->max_node_size / 2 - 1));
@@ -392,6 +580,8 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 			}
 
 			node->size = right->size = btree->max_node_size / 2;
+			left_count = node_count(node);
+			child_count = node_count(right);
 			child = db->next_empty_page;
 			retval = rl_write(db, btree->type->btree_node_type, node_page, node);
 			if (retval != RL_OK) {
@@ -411,9 +601,8 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 		value = NULL;
 		score = NULL;
 		if (old_root) {
-			node->children = rl_malloc(sizeof(long) * (btree->max_node_size + 1));
-			if (!node->children) {
-				retval = RL_OUT_OF_MEMORY;
+			retval = node_alloc_children(btree, node);
+			if (retval != RL_OK) {
 				rl_btree_node_destroy(db, node);
 				goto cleanup;
 			}
@@ -421,12 +610,14 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 				node_page = db->next_empty_page;
 			}
 			node->children[0] = node_page;
+			node->counts[0] = left_count;
 			retval = rl_write(db, btree->type->btree_node_type, node->children[0], old_root);
 			if (retval != RL_OK) {
 				rl_btree_node_destroy(db, node);
 				goto cleanup;
 			}
 			node->children[1] = child;
+			node->counts[1] = child_count;
 		}
 		else if (btree->root) {
 			RL_CALL(rl_delete, RL_OK, db, btree->root);
@@ -436,8 +627,28 @@ int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *scor
 		btree->height++;
 	}
 	btree->number_of_elements++;
-	RL_CALL(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	if (!written) {
+		RL_CALL(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	}
 	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		rl_free(value);
+		rl_free(score);
+	}
+	return retval;
+}
+
+int rl_btree_add_element(rlite *db, rl_btree *btree, long btree_page, void *score, void *value)
+{
+	int retval;
+	long *positions = NULL;
+	rl_btree_node **nodes = NULL;
+	RL_MALLOC(nodes, sizeof(rl_btree_node *) * btree->height);
+	RL_MALLOC(positions, sizeof(long) * btree->height);
+	RL_CALL(rl_btree_find_score, RL_NOT_FOUND, db, btree, score, NULL, nodes, positions);
+	retval = add_element_at(db, btree, btree_page, score, value, nodes, positions, 0);
+	score = value = NULL;
 cleanup:
 	if (retval != RL_OK) {
 		rl_free(value);
@@ -445,7 +656,222 @@ cleanup:
 	}
 	rl_free(nodes);
 	rl_free(positions);
+	return retval;
+}
 
+int rl_btree_add_elements(rlite *db, rl_btree *btree, long btree_page, long size, void **scores, void **values)
+{
+	rl_btree_node **nodes = NULL, *leaf = NULL;
+	long *positions = NULL, i = 0, j, depth = 0, height = 0, min, max, pos;
+	// the first score after the cursor's leaf, NULL past the last leaf
+	void *limit = NULL;
+	int cursor = 0, written, split, retval;
+
+	for (j = 1; j < size; j++) {
+		if (btree->type->cmp(scores[j - 1], scores[j]) >= 0) {
+			retval = RL_INVALID_PARAMETERS;
+			goto cleanup;
+		}
+	}
+	if (btree->number_of_elements == 0) {
+		retval = rl_btree_bulk_load(db, btree, btree_page, size, scores, values, 1.0);
+		// the btree owns them now
+		i = size;
+		goto cleanup;
+	}
+
+	for (i = 0; i < size; i++) {
+		written = cursor && leaf->size < btree->max_node_size && (!limit || btree->type->cmp(scores[i], limit) < 0);
+		if (written) {
+			// the scores ascend, so it goes right of the previous one
+			min = positions[depth] + 1;
+			max = leaf->size;
+			while (min < max) {
+				pos = (max - min) / 2 + min;
+				if (btree->type->cmp(scores[i], leaf->scores[pos]) > 0) {
+					min = pos + 1;
+				}
+				else {
+					max = pos;
+				}
+			}
+			if (min < leaf->size && btree->type->cmp(scores[i], leaf->scores[min]) == 0) {
+				retval = RL_FOUND;
+				goto cleanup;
+			}
+			positions[depth] = min;
+		}
+		else {
+			if (height < btree->height) {
+				height = btree->height;
+				rl_free(nodes);
+				rl_free(positions);
+				nodes = NULL;
+				positions = NULL;
+				RL_MALLOC(nodes, sizeof(rl_btree_node *) * height);
+				RL_MALLOC(positions, sizeof(long) * height);
+			}
+			RL_CALL(rl_btree_find_score, RL_NOT_FOUND, db, btree, scores[i], NULL, nodes, positions);
+			depth = btree->height - 1;
+			leaf = nodes[depth];
+			limit = NULL;
+			for (j = depth - 1; j >= 0; j--) {
+				if (positions[j] < nodes[j]->size) {
+					limit = nodes[j]->scores[positions[j]];
+					break;
+				}
+			}
+		}
+		split = leaf->size == btree->max_node_size;
+		// the previous insertion already wrote the path it shares with this one
+		retval = add_element_at(db, btree, btree_page, scores[i], values[i], nodes, positions, written);
+		if (retval != RL_OK) {
+			// add_element_at already released this one
+			i++;
+			goto cleanup;
+		}
+		cursor = !split;
+	}
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		for (; i < size; i++) {
+			rl_free(scores[i]);
+			rl_free(values[i]);
+		}
+	}
+	rl_free(nodes);
+	rl_free(positions);
+	return retval;
+}
+
+/**
+ * Number of elements in a subtree of `height` levels where every node has
+ * `size` elements. Anything above `limit` is reported as `limit`.
+ */
+static long bulk_subtree_size(long size, long height, long limit)
+{
+	long i, count = 1;
+	for (i = 0; i < height; i++) {
+		if (count > limit / (size + 1)) {
+			return limit;
+		}
+		count *= size + 1;
+	}
+	return count - 1 < limit ? count - 1 : limit;
+}
+
+/**
+ * Writes a subtree of `height` levels holding the `size` sorted elements in
+ * `scores` and `values`, aiming for `fill` elements per node while keeping
+ * every non root node at least half full.
+ */
+static int bulk_load_subtree(rlite *db, rl_btree *btree, long size, void **scores, void **values, long height, long fill, int is_root, long *page)
+{
+	rl_btree_node *node = NULL;
+	long i, children, min, max, target, low, high, child_size, extra, pos = 0;
+	int retval;
+
+	RL_CALL(rl_btree_node_create, RL_OK, db, btree, &node);
+	if (height == 1) {
+		memcpy(node->scores, scores, sizeof(void *) * size);
+		memcpy(node->values, values, sizeof(void *) * size);
+		node->size = size;
+	}
+	else {
+		RL_CALL(node_alloc_children, RL_OK, btree, node);
+		// every child needs between `min` and `max` elements
+		min = bulk_subtree_size(btree->max_node_size / 2, height - 1, size + 1);
+		max = bulk_subtree_size(btree->max_node_size, height - 1, size + 1);
+		target = bulk_subtree_size(fill, height - 1, size + 1);
+		children = (size + target + 1) / (target + 1);
+		low = (size + max + 1) / (max + 1);
+		if (low < (is_root ? 2 : btree->max_node_size / 2 + 1)) {
+			low = is_root ? 2 : btree->max_node_size / 2 + 1;
+		}
+		high = (size + 1) / (min + 1);
+		if (high > btree->max_node_size + 1) {
+			high = btree->max_node_size + 1;
+		}
+		if (children < low) {
+			children = low;
+		}
+		if (children > high) {
+			children = high;
+		}
+		// spread the elements evenly, a separator goes between two children
+		child_size = (size + 1) / children - 1;
+		extra = (size + 1) % children;
+		for (i = 0; i < children; i++) {
+			node->counts[i] = child_size + (i < extra ? 1 : 0);
+			RL_CALL(bulk_load_subtree, RL_OK, db, btree, node->counts[i], &scores[pos], &values[pos], height - 1, fill, 0, &node->children[i]);
+			pos += node->counts[i];
+			if (i < children - 1) {
+				node->scores[i] = scores[pos];
+				node->values[i] = values[pos];
+				node->size++;
+				pos++;
+			}
+		}
+	}
+	*page = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, *page, node);
+	node = NULL;
+	retval = RL_OK;
+cleanup:
+	if (node) {
+		// the elements are still owned by the caller
+		node->size = 0;
+		rl_btree_node_destroy(db, node);
+	}
+	return retval;
+}
+
+int rl_btree_bulk_load(rlite *db, rl_btree *btree, long btree_page, long size, void **scores, void **values, double fill_factor)
+{
+	long i, fill, height, root;
+	int retval;
+
+	if (btree->number_of_elements != 0 || fill_factor <= 0.0 || fill_factor > 1.0) {
+		retval = RL_INVALID_PARAMETERS;
+		goto cleanup;
+	}
+	for (i = 1; i < size; i++) {
+		if (btree->type->cmp(scores[i - 1], scores[i]) >= 0) {
+			retval = RL_INVALID_PARAMETERS;
+			goto cleanup;
+		}
+	}
+	if (size == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+
+	fill = (long)(btree->max_node_size * fill_factor);
+	if (fill < btree->max_node_size / 2) {
+		fill = btree->max_node_size / 2;
+	}
+	if (fill < 1) {
+		fill = 1;
+	}
+	// lowest tree holding every element with nodes `fill` elements full
+	height = 1;
+	while (bulk_subtree_size(fill, height, size + 1) < size) {
+		height++;
+	}
+	// the root needs at least two children that are at least half full
+	if (height > 1 && size < 2 * bulk_subtree_size(btree->max_node_size / 2, height - 1, size + 1) + 1) {
+		height--;
+	}
+
+	RL_CALL(rl_delete, RL_OK, db, btree->root);
+	RL_CALL(bulk_load_subtree, RL_OK, db, btree, size, scores, values, height, fill, 1, &root);
+	btree->root = root;
+	btree->height = height;
+	btree->number_of_elements = size;
+	RL_CALL(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	retval = RL_OK;
+cleanup:
 	return retval;
 }
 
@@ -562,6 +988,12 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 		}
 	}
 
+	// `i` is the leaf that lost an element, every ancestor has one less in its subtree
+	for (j = i - 1; j >= 0; j--) {
+		nodes[j]->counts[positions[j]]--;
+		RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, j == 0 ? btree->root : nodes[j - 1]->children[positions[j - 1]], nodes[j]);
+	}
+
 	for (; i >= 0; i--) {
 		if (i == 0) {
 			node_page = btree->root;
@@ -574,7 +1006,10 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 			if (node->size == 0) {
 				btree->height--;
 				if (node->children) {
-					btree->root = node->children[0];
+					// the old root page is released, `node` is no longer valid after rl_delete
+					child_node_page = node->children[0];
+					RL_CALL(rl_delete, RL_OK, db, btree->root);
+					btree->root = child_node_page;
 				}
 				else {
 					RL_CALL(rl_delete, RL_OK, db, btree->root);
@@ -609,6 +1044,8 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 					if (node->children) {
 						memmove(&node->children[1], &node->children[0], sizeof(long) * (node->size + 1));
 						node->children[0] = sibling_node->children[sibling_node->size];
+						memmove(&node->counts[1], &node->counts[0], sizeof(long) * (node->size + 1));
+						node->counts[0] = sibling_node->counts[sibling_node->size];
 					}
 					node->scores[0] = parent_node->scores[positions[i - 1] - 1];
 					node->values[0] = parent_node->values[positions[i - 1] - 1];
@@ -618,6 +1055,8 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 
 					sibling_node->size--;
 					node->size++;
+					parent_node->counts[positions[i - 1] - 1] = node_count(sibling_node);
+					parent_node->counts[positions[i - 1]] = node_count(node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, node_page, node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, sibling_node_page, sibling_node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, parent_node_page, parent_node);
@@ -640,10 +1079,14 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 					if (node->children) {
 						node->children[node->size + 1] = sibling_node->children[0];
 						memmove(&sibling_node->children[0], &sibling_node->children[1], sizeof(long) * (sibling_node->size));
+						node->counts[node->size + 1] = sibling_node->counts[0];
+						memmove(&sibling_node->counts[0], &sibling_node->counts[1], sizeof(long) * (sibling_node->size));
 					}
 
 					sibling_node->size--;
 					node->size++;
+					parent_node->counts[positions[i - 1]] = node_count(node);
+					parent_node->counts[positions[i - 1] + 1] = node_count(sibling_node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, sibling_node_page, sibling_node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, node_page, node);
 					RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, parent_node_page, parent_node);
@@ -663,15 +1106,18 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 				memmove(&sibling_node->values[sibling_node->size + 1], &node->values[0], sizeof(void *) * (node->size));
 				if (sibling_node->children) {
 					memmove(&sibling_node->children[sibling_node->size + 1], &node->children[0], sizeof(void *) * (node->size + 1));
+					memmove(&sibling_node->counts[sibling_node->size + 1], &node->counts[0], sizeof(long) * (node->size + 1));
 				}
 
 				if (positions[i - 1] < parent_node->size) {
 					memmove(&parent_node->scores[positions[i - 1] - 1], &parent_node->scores[positions[i - 1]], sizeof(void *) * (parent_node->size - positions[i - 1]));
 					memmove(&parent_node->values[positions[i - 1] - 1], &parent_node->values[positions[i - 1]], sizeof(void *) * (parent_node->size - positions[i - 1]));
 					memmove(&parent_node->children[positions[i - 1]], &parent_node->children[positions[i - 1] + 1], sizeof(void *) * (parent_node->size - positions[i - 1]));
+					memmove(&parent_node->counts[positions[i - 1]], &parent_node->counts[positions[i - 1] + 1], sizeof(long) * (parent_node->size - positions[i - 1]));
 				}
 				parent_node->size--;
 				sibling_node->size += 1 + node->size;
+				parent_node->counts[positions[i - 1] - 1] = node_count(sibling_node);
 				RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, sibling_node_page, sibling_node);
 				RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, parent_node_page, parent_node);
 				rl_free(node->scores);
@@ -691,15 +1137,18 @@ int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page,
 				memmove(&node->values[node->size + 1], &sibling_node->values[0], sizeof(void *) * (sibling_node->size));
 				if (node->children) {
 					memmove(&node->children[node->size + 1], &sibling_node->children[0], sizeof(void *) * (sibling_node->size + 1));
+					memmove(&node->counts[node->size + 1], &sibling_node->counts[0], sizeof(long) * (sibling_node->size + 1));
 				}
 
 
 				memmove(&parent_node->scores[positions[i - 1]], &parent_node->scores[positions[i - 1] + 1], sizeof(void *) * (parent_node->size - positions[i - 1] - 1));
 				memmove(&parent_node->values[positions[i - 1]], &parent_node->values[positions[i - 1] + 1], sizeof(void *) * (parent_node->size - positions[i - 1] - 1));
 				memmove(&parent_node->children[positions[i - 1] + 1], &parent_node->children[positions[i - 1] + 2], sizeof(void *) * (parent_node->size - positions[i - 1] - 1));
+				memmove(&parent_node->counts[positions[i - 1] + 1], &parent_node->counts[positions[i - 1] + 2], sizeof(long) * (parent_node->size - positions[i - 1] - 1));
 
 				parent_node->size--;
 				node->size += 1 + sibling_node->size;
+				parent_node->counts[positions[i - 1]] = node_count(node);
 				RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, node_page, node);
 				RL_CALL(rl_write, RL_OK, db, btree->type->btree_node_type, parent_node_page, parent_node);
 				// rl_freeing manually scores before calling destroy to avoid deleting scores that were handed over to `node`
@@ -821,10 +1270,35 @@ cleanup:
 	return retval;
 }
 
+static int btree_node_check_counts(rlite *db, rl_btree *btree, rl_btree_node *node, long *count)
+{
+	void *tmp;
+	int retval = RL_OK;
+	long i, child_count;
+	*count = node->size;
+	if (!node->children) {
+		goto cleanup;
+	}
+	for (i = 0; i <= node->size; i++) {
+		RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, node->children[i], btree, &tmp, 1);
+		RL_CALL(btree_node_check_counts, RL_OK, db, btree, tmp, &child_count);
+		if (child_count != node->counts[i]) {
+			fprintf(stderr, "Expected child %ld to have %ld elements, got %ld\n", i, node->counts[i], child_count);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		*count += child_count;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
 int rl_btree_is_balanced(rlite *db, rl_btree *btree)
 {
 	void **scores = NULL, *tmp;
 	rl_btree_node *node;
+	long count;
 	int retval = rl_read(db, btree->type->btree_node_type, btree->root, btree, &tmp, 1);
 	if (retval != RL_FOUND) {
 		fprintf(stderr, "Unable to read btree in page %ld (%d)\n", btree->root, retval);
@@ -832,6 +1306,12 @@ int rl_btree_is_balanced(rlite *db, rl_btree *btree)
 	}
 	node = tmp;
 	RL_CALL(rl_btree_node_is_balanced, RL_OK, db, btree, node, 1);
+	RL_CALL(btree_node_check_counts, RL_OK, db, btree, node, &count);
+	if (count != btree->number_of_elements) {
+		fprintf(stderr, "Expected btree to have %ld elements, got %ld\n", btree->number_of_elements, count);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
 
 	long size = (long)pow(btree->max_node_size + 1, btree->height + 1);
 	RL_MALLOC(scores, sizeof(void *) * size);
@@ -969,10 +1449,12 @@ int rl_btree_node_serialize_hash_sha1_key(rlite *UNUSED(db), void *obj, unsigned
 		put_4bytes(&data[pos + 25], key->value_page);
 		put_8bytes(&data[pos + 29], key->expires);
 		put_4bytes(&data[pos + 37], key->version);
-		put_4bytes(&data[pos + 41], node->children ? node->children[i] : 0);
-		pos += 45;
+		put_number(&data[pos + 41], key->encoding, &key->number);
+		put_4bytes(&data[pos + 50], node->children ? node->children[i] : 0);
+		pos += 54;
 	}
 	put_4bytes(&data[pos], node->children ? node->children[node->size] : 0);
+	serialize_counts(node, &data[pos + 4]);
 	return RL_OK;
 }
 
@@ -1005,7 +1487,8 @@ int rl_btree_node_deserialize_hash_sha1_key(rlite *db, void **obj, void *context
 		key->value_page = get_4bytes(&data[pos + 25]);
 		key->expires = get_8bytes(&data[pos + 29]);
 		key->version = get_4bytes(&data[pos + 37]);
-		child = get_4bytes(&data[pos + 41]);
+		get_number(&data[pos + 41], &key->encoding, &key->number);
+		child = get_4bytes(&data[pos + 50]);
 		if (child != 0) {
 			if (!node->children) {
 				node->children = rl_malloc(sizeof(long) * (btree->max_node_size + 1));
@@ -1019,11 +1502,12 @@ int rl_btree_node_deserialize_hash_sha1_key(rlite *db, void **obj, void *context
 			}
 			node->children[i] = child;
 		}
-		pos += 45;
+		pos += 54;
 	}
 	child = get_4bytes(&data[pos]);
 	if (child != 0) {
 		node->children[node->size] = child;
+		RL_CALL(deserialize_counts, RL_OK, btree, node, &data[pos + 4]);
 	}
 	*obj = node;
 cleanup:
@@ -1044,10 +1528,12 @@ int rl_btree_node_serialize_hash_sha1_hashkey(rlite *UNUSED(db), void *obj, unsi
 		hashkey = node->values[i];
 		put_4bytes(&data[pos + 20], hashkey->string_page);
 		put_4bytes(&data[pos + 24], hashkey->value_page);
-		put_4bytes(&data[pos + 28], node->children ? node->children[i] : 0);
-		pos += 32;
+		put_number(&data[pos + 28], hashkey->encoding, &hashkey->number);
+		put_4bytes(&data[pos + 37], node->children ? node->children[i] : 0);
+		pos += 41;
 	}
 	put_4bytes(&data[pos], node->children ? node->children[node->size] : 0);
+	serialize_counts(node, &data[pos + 4]);
 	return RL_OK;
 }
 
@@ -1077,7 +1563,8 @@ int rl_btree_node_deserialize_hash_sha1_hashkey(rlite *db, void **obj, void *con
 		}
 		hashkey->string_page = get_4bytes(&data[pos + 20]);
 		hashkey->value_page = get_4bytes(&data[pos + 24]);
-		child = get_4bytes(&data[pos + 28]);
+		get_number(&data[pos + 28], &hashkey->encoding, &hashkey->number);
+		child = get_4bytes(&data[pos + 37]);
 		if (child != 0) {
 			if (!node->children) {
 				node->children = rl_malloc(sizeof(long) * (btree->max_node_size + 1));
@@ -1091,11 +1578,12 @@ int rl_btree_node_deserialize_hash_sha1_hashkey(rlite *db, void **obj, void *con
 			}
 			node->children[i] = child;
 		}
-		pos += 32;
+		pos += 41;
 	}
 	child = get_4bytes(&data[pos]);
 	if (child != 0) {
 		node->children[node->size] = child;
+		RL_CALL(deserialize_counts, RL_OK, btree, node, &data[pos + 4]);
 	}
 	*obj = node;
 cleanup:
@@ -1117,6 +1605,7 @@ int rl_btree_node_serialize_hash_long_long(struct rlite *UNUSED(db), void *obj,
 		pos += 12;
 	}
 	put_4bytes(&data[pos], node->children ? node->children[node->size] : 0);
+	serialize_counts(node, &data[pos + 4]);
 	return RL_OK;
 }
 
@@ -1162,6 +1651,7 @@ int rl_btree_node_deserialize_hash_long_long(struct rlite *db, void **obj, void
 	child = get_4bytes(&data[pos]);
 	if (child != 0) {
 		node->children[node->size] = child;
+		RL_CALL(deserialize_counts, RL_OK, btree, node, &data[pos + 4]);
 	}
 	*obj = node;
 cleanup:
@@ -1183,6 +1673,7 @@ int rl_btree_node_serialize_hash_sha1_long(struct rlite *UNUSED(db), void *obj,
 		pos += 28;
 	}
 	put_4bytes(&data[pos], node->children ? node->children[node->size] : 0);
+	serialize_counts(node, &data[pos + 4]);
 	return RL_OK;
 }
 int rl_btree_node_deserialize_hash_sha1_long(struct rlite *db, void **obj, void *context, unsigned char *data)
@@ -1227,6 +1718,7 @@ int rl_btree_node_deserialize_hash_sha1_long(struct rlite *db, void **obj, void
 	child = get_4bytes(&data[pos]);
 	if (child != 0) {
 		node->children[node->size] = child;
+		RL_CALL(deserialize_counts, RL_OK, btree, node, &data[pos + 4]);
 	}
 	*obj = node;
 cleanup:
@@ -1248,6 +1740,7 @@ int rl_btree_node_serialize_hash_sha1_double(struct rlite *UNUSED(db), void *obj
 		pos += 32;
 	}
 	put_4bytes(&data[pos], node->children ? node->children[node->size] : 0);
+	serialize_counts(node, &data[pos + 4]);
 	return RL_OK;
 }
 
@@ -1293,6 +1786,7 @@ int rl_btree_node_deserialize_hash_sha1_double(struct rlite *db, void **obj, voi
 	child = get_4bytes(&data[pos]);
 	if (child != 0) {
 		node->children[node->size] = child;
+		RL_CALL(deserialize_counts, RL_OK, btree, node, &data[pos + 4]);
 	}
 	*obj = node;
 cleanup:
@@ -1338,6 +1832,72 @@ cleanup:
 	return retval;
 }
 
+int rl_btree_iterator_create_at(rlite *db, rl_btree *btree, void *score, rl_btree_iterator **_iterator)
+{
+	int retval;
+	long i, pos = 0, min, max;
+	void *tmp;
+	rl_btree_node *node = NULL;
+	rl_btree_iterator *iterator = NULL;
+	if (btree->number_of_elements == 0) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	RL_MALLOC(iterator, sizeof(rl_btree_iterator) + sizeof(struct rl_btree_iterator_nodes) * btree->height);
+	iterator->db = db;
+	iterator->btree = btree;
+	iterator->position = 0;
+	iterator->size = btree->number_of_elements;
+
+	for (i = 0; i < btree->height; i++) {
+		RL_CALL(rl_read, RL_FOUND, db, btree->type->btree_node_type, i == 0 ? btree->root : node->children[pos], btree, &tmp, 0);
+		node = tmp;
+		iterator->nodes[i].node = node;
+		iterator->position = i + 1;
+
+		// first position whose score is not lower than the one requested
+		min = 0;
+		max = node->size;
+		while (min < max) {
+			pos = (max - min) / 2 + min;
+			if (btree->type->cmp(node->scores[pos], score) < 0) {
+				min = pos + 1;
+			}
+			else {
+				max = pos;
+			}
+		}
+		pos = min;
+		iterator->nodes[i].position = pos;
+		if (pos < node->size && btree->type->cmp(node->scores[pos], score) == 0) {
+			break;
+		}
+	}
+
+	// every score in the leaf is lower, resume at the closest ancestor that
+	// still has scores left
+	while (iterator->position > 0) {
+		node = iterator->nodes[iterator->position - 1].node;
+		if (iterator->nodes[iterator->position - 1].position < node->size) {
+			break;
+		}
+		RL_CALL(rl_btree_node_nocache_destroy, RL_OK, db, node);
+		iterator->position--;
+	}
+	if (iterator->position == 0) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+
+	*_iterator = iterator;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		rl_btree_iterator_destroy(iterator);
+	}
+	return retval;
+}
+
 int rl_btree_iterator_next(rl_btree_iterator *iterator, void **score, void **value)
 {
 	int retval;
@@ -1407,3 +1967,87 @@ cleanup:
 	rl_free(iterator);
 	return retval;
 }
+
+static unsigned long long digest_cursor(unsigned char *digest)
+{
+	unsigned long long cursor = 0;
+	int i;
+	for (i = 0; i < 8; i++) {
+		cursor = (cursor << 8) | digest[i];
+	}
+	// the top bit is left free for callers to tag their own cursors
+	return cursor >> 1;
+}
+
+int rl_btree_scan(rlite *db, rl_btree *btree, unsigned long long cursor, long count, unsigned long long *next_cursor, long *_size, void ***_values)
+{
+	int retval, i;
+	unsigned char digest[20];
+	unsigned long long prefix, last = 0;
+	rl_btree_iterator *iterator = NULL;
+	void **values = NULL, *score = NULL, *value = NULL, *tmp;
+	long size = 0, alloc = 16;
+
+	cursor <<= 1;
+	for (i = 0; i < 8; i++) {
+		digest[i] = (cursor >> (56 - i * 8)) & 0xff;
+	}
+	memset(&digest[8], 0, 12);
+	*next_cursor = 0;
+
+	retval = rl_btree_iterator_create_at(db, btree, digest, &iterator);
+	if (retval == RL_NOT_FOUND) {
+		iterator = NULL;
+		retval = RL_OK;
+		goto cleanup;
+	}
+	else if (retval != RL_OK) {
+		iterator = NULL;
+		goto cleanup;
+	}
+
+	RL_MALLOC(values, sizeof(void *) * alloc);
+	while ((retval = rl_btree_iterator_next(iterator, &score, &value)) == RL_OK) {
+		prefix = digest_cursor(score);
+		rl_free(score);
+		score = NULL;
+		// never stop inside a run of digests sharing the cursor prefix,
+		// otherwise resuming from the prefix would repeat them
+		if (size >= count && prefix != last && prefix != 0) {
+			*next_cursor = prefix;
+			break;
+		}
+		if (size == alloc) {
+			RL_REALLOC(values, sizeof(void *) * alloc * 2);
+			alloc *= 2;
+		}
+		values[size++] = value;
+		value = NULL;
+		last = prefix;
+	}
+	if (retval == RL_OK) {
+		retval = rl_btree_iterator_destroy(iterator);
+	}
+	// the iterator destroys itself when it reaches the end or fails
+	iterator = NULL;
+	if (retval != RL_OK && retval != RL_END) {
+		goto cleanup;
+	}
+	retval = RL_OK;
+cleanup:
+	rl_free(value);
+	if (iterator) {
+		rl_btree_iterator_destroy(iterator);
+	}
+	if (retval == RL_OK) {
+		*_size = size;
+		*_values = values;
+	}
+	else {
+		for (i = 0; i < size; i++) {
+			rl_free(values[i]);
+		}
+		rl_free(values);
+	}
+	return retval;
+}
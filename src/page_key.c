@@ -5,6 +5,7 @@
 #include "rlite/page_btree.h"
 #include "rlite/page_key.h"
 #include "rlite/page_multi_string.h"
+#include "rlite/page_zset_tree.h"
 #include "rlite/type_string.h"
 #include "rlite/type_zset.h"
 #include "rlite/type_hash.h"
@@ -50,30 +51,114 @@ static int get_type(char identifier, rl_type **type)
 	return RL_UNEXPECTED;
 }
 
-int rl_key_set(rlite *db, const unsigned char *key, long keylen, unsigned char type, long value_page, unsigned long long expires, long version)
+static int key_index_add(rlite *db, const unsigned char *key, long keylen)
+{
+	int retval;
+	rl_zset_tree *index;
+	long index_page;
+	RL_CALL2(rl_get_key_index, RL_OK, RL_NOT_FOUND, db, &index, &index_page);
+	if (retval == RL_OK) {
+		RL_CALL(rl_zset_tree_add, RL_OK, db, index, index_page, 0, (unsigned char *)key, keylen);
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int key_index_delete(rlite *db, const unsigned char *key, long keylen)
+{
+	int retval;
+	rl_zset_tree *index;
+	long index_page;
+	RL_CALL2(rl_get_key_index, RL_OK, RL_NOT_FOUND, db, &index, &index_page);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_CALL2(rl_zset_tree_delete, RL_OK, RL_DELETED, db, index, index_page, 0, (unsigned char *)key, keylen);
+	if (retval == RL_DELETED) {
+		// the index is kept even when the database is empty
+		RL_CALL(rl_zset_tree_create, RL_OK, db, &index);
+		db->key_indexes[db->selected_database] = db->next_empty_page;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, db->key_indexes[db->selected_database], index);
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int expire_index_add(rlite *db, unsigned char *digest, unsigned long long expires)
+{
+	int retval;
+	rl_zset_tree *index;
+	long index_page;
+	if (expires == 0) {
+		return RL_OK;
+	}
+	RL_CALL2(rl_get_expire_index, RL_OK, RL_NOT_FOUND, db, &index, &index_page, 1);
+	if (retval == RL_OK) {
+		RL_CALL(rl_zset_tree_add, RL_OK, db, index, index_page, (double)expires, digest, 20);
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int expire_index_delete(rlite *db, unsigned char *digest, unsigned long long expires)
+{
+	int retval;
+	rl_zset_tree *index;
+	long index_page;
+	if (expires == 0) {
+		return RL_OK;
+	}
+	RL_CALL2(rl_get_expire_index, RL_OK, RL_NOT_FOUND, db, &index, &index_page, 0);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_CALL2(rl_zset_tree_delete, RL_OK, RL_DELETED, db, index, index_page, (double)expires, digest, 20);
+	if (retval == RL_DELETED) {
+		db->expire_indexes[db->selected_database] = 0;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int key_delete(struct rlite *db, const unsigned char *key, long keylen, int update_index);
+
+static int key_set(rlite *db, const unsigned char *key, long keylen, rl_key *entry)
 {
 	int retval;
 
 	rl_key *key_obj = NULL;
 	unsigned char *digest = NULL;
-	RL_CALL2(rl_key_delete, RL_OK, RL_NOT_FOUND, db, key, keylen);
+	// an existing key is already in the index
+	RL_CALL2(key_delete, RL_OK, RL_NOT_FOUND, db, key, keylen, 0);
+	if (retval == RL_NOT_FOUND) {
+		RL_CALL(key_index_add, RL_OK, db, key, keylen);
+	}
 	RL_MALLOC(digest, sizeof(unsigned char) * 20);
 	RL_CALL(sha1, RL_OK, key, keylen, digest);
 	rl_btree *btree;
 	RL_CALL(rl_get_key_btree, RL_OK, db, &btree, 1);
 	RL_MALLOC(key_obj, sizeof(*key_obj))
+	*key_obj = *entry;
 	RL_CALL(rl_multi_string_set, RL_OK, db, &key_obj->string_page, key, keylen);
-	key_obj->type = type;
-	key_obj->value_page = value_page;
-	key_obj->expires = expires;
 	// reserving version=0 for non existent keys
-	if (version == 0) {
-		version = 1;
+	if (key_obj->version == 0) {
+		key_obj->version = 1;
 	}
-	key_obj->version = version;
 
-	RL_CALL(rl_btree_add_element, RL_OK, db, btree, db->databases[rl_get_selected_db(db)], digest, key_obj);
-	retval = RL_OK;
+	RL_CALL(expire_index_add, RL_OK, db, digest, key_obj->expires);
+	retval = rl_btree_add_element(db, btree, db->databases[rl_get_selected_db(db)], digest, key_obj);
+	// the btree owns them, even on failure
+	digest = NULL;
+	key_obj = NULL;
+	if (retval != RL_OK) {
+		goto cleanup;
+	}
 cleanup:
 	if (retval != RL_OK) {
 		rl_free(digest);
@@ -82,7 +167,66 @@ cleanup:
 	return retval;
 }
 
-static int rl_key_get_hash_ignore_expire(struct rlite *db, unsigned char digest[20], unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version, int ignore_expire)
+int rl_key_set(rlite *db, const unsigned char *key, long keylen, unsigned char type, long value_page, unsigned long long expires, long version)
+{
+	rl_key entry;
+	entry.type = type;
+	entry.value_page = value_page;
+	entry.expires = expires;
+	entry.version = version;
+	entry.encoding = RL_VALUE_ENCODING_PAGE;
+	entry.number.integer = 0;
+	return key_set(db, key, keylen, &entry);
+}
+
+int rl_key_set_entry(rlite *db, const unsigned char *key, long keylen, rl_key *entry)
+{
+	return key_set(db, key, keylen, entry);
+}
+
+static int key_find(rlite *db, const unsigned char *key, long keylen, rl_btree **btree, unsigned char digest[20], rl_key **key_obj)
+{
+	int retval;
+	void *tmp;
+	RL_CALL(sha1, RL_OK, key, keylen, digest);
+	RL_CALL(rl_get_key_btree, RL_OK, db, btree, 0);
+	RL_CALL(rl_btree_find_score, RL_FOUND, db, *btree, digest, &tmp, NULL, NULL);
+	*key_obj = tmp;
+cleanup:
+	return retval;
+}
+
+int rl_key_set_version(rlite *db, const unsigned char *key, long keylen, long version)
+{
+	int retval;
+	unsigned char digest[20];
+	rl_btree *btree;
+	rl_key *key_obj = NULL;
+	RL_CALL(key_find, RL_FOUND, db, key, keylen, &btree, digest, &key_obj);
+	// reserving version=0 for non existent keys
+	key_obj->version = version == 0 ? 1 : version;
+	RL_CALL(rl_btree_update_element, RL_OK, db, btree, digest, key_obj);
+cleanup:
+	return retval;
+}
+
+int rl_key_set_value(rlite *db, const unsigned char *key, long keylen, long value_page, unsigned char encoding, rl_number number, long version)
+{
+	int retval;
+	unsigned char digest[20];
+	rl_btree *btree;
+	rl_key *key_obj = NULL;
+	RL_CALL(key_find, RL_FOUND, db, key, keylen, &btree, digest, &key_obj);
+	key_obj->value_page = value_page;
+	key_obj->encoding = encoding;
+	key_obj->number = number;
+	key_obj->version = version == 0 ? 1 : version;
+	RL_CALL(rl_btree_update_element, RL_OK, db, btree, digest, key_obj);
+cleanup:
+	return retval;
+}
+
+static int rl_key_get_hash_ignore_expire(struct rlite *db, unsigned char digest[20], unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version, rl_key *entry, int ignore_expire)
 {
 	int retval;
 	rl_btree *btree;
@@ -112,18 +256,21 @@ static int rl_key_get_hash_ignore_expire(struct rlite *db, unsigned char digest[
 			if (version) {
 				*version = key_obj->version;
 			}
+			if (entry) {
+				*entry = *key_obj;
+			}
 		}
 	}
 cleanup:
 	return retval;
 }
 
-static int rl_key_get_ignore_expire(struct rlite *db, const unsigned char *key, long keylen, unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version, int ignore_expire)
+static int rl_key_get_ignore_expire(struct rlite *db, const unsigned char *key, long keylen, unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version, rl_key *entry, int ignore_expire)
 {
 	unsigned char digest[20];
 	int retval;
 	RL_CALL(sha1, RL_OK, key, keylen, digest);
-	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_DELETED, db, digest, type, string_page, value_page, expires, version, ignore_expire);
+	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_DELETED, db, digest, type, string_page, value_page, expires, version, entry, ignore_expire);
 	if (retval == RL_DELETED) {
 		rl_key_delete_with_value(db, key, keylen);
 		if (version) {
@@ -143,7 +290,7 @@ static int rl_key_sha_check_version(struct rlite *db, struct watched_key* key) {
 	// it seems to be relevant to redis being stateful and single process
 	// I don't think it is possible to replicate exactly the behavior, but
 	// this is pretty close.
-	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_NOT_FOUND, db, key->digest, NULL, NULL, NULL, NULL, &version, 1);
+	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_NOT_FOUND, db, key->digest, NULL, NULL, NULL, NULL, &version, NULL, 1);
 	if (retval == RL_NOT_FOUND) {
 		version = 0;
 	}
@@ -174,7 +321,7 @@ int rl_watch(struct rlite *db, struct watched_key** _watched_key, const unsigned
 	wkey->database = rl_get_selected_db(db);
 
 	RL_CALL(sha1, RL_OK, key, keylen, wkey->digest);
-	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_NOT_FOUND, db, wkey->digest, NULL, NULL, NULL, NULL, &wkey->version, 1);
+	RL_CALL2(rl_key_get_hash_ignore_expire, RL_FOUND, RL_NOT_FOUND, db, wkey->digest, NULL, NULL, NULL, NULL, &wkey->version, NULL, 1);
 	if (retval == RL_NOT_FOUND) {
 		wkey->version = 0;
 	}
@@ -190,7 +337,68 @@ cleanup:
 
 int rl_key_get(struct rlite *db, const unsigned char *key, long keylen, unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version)
 {
-	return rl_key_get_ignore_expire(db, key, keylen, type, string_page, value_page, expires, version, 0);
+	return rl_key_get_ignore_expire(db, key, keylen, type, string_page, value_page, expires, version, NULL, 0);
+}
+
+int rl_key_get_entry(struct rlite *db, const unsigned char *key, long keylen, rl_key *entry)
+{
+	return rl_key_get_ignore_expire(db, key, keylen, NULL, NULL, NULL, NULL, NULL, entry, 0);
+}
+
+int rl_key_mget(struct rlite *db, long keyc, unsigned char **keys, long *keyslen, unsigned char *types, long *value_pages)
+{
+	int retval;
+	rl_btree *btree;
+	rl_key *key_obj;
+	unsigned char *digests = NULL, *expired = NULL;
+	void **scores = NULL, **values = NULL;
+	unsigned long long now = rl_mstime();
+	long i;
+
+	for (i = 0; i < keyc; i++) {
+		types[i] = 0;
+	}
+	retval = rl_get_key_btree(db, &btree, 0);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	else if (retval != RL_OK) {
+		goto cleanup;
+	}
+
+	RL_MALLOC(digests, sizeof(unsigned char) * 20 * keyc);
+	RL_MALLOC(expired, sizeof(unsigned char) * keyc);
+	RL_MALLOC(scores, sizeof(void *) * keyc);
+	RL_MALLOC(values, sizeof(void *) * keyc);
+	for (i = 0; i < keyc; i++) {
+		RL_CALL(sha1, RL_OK, keys[i], keyslen[i], &digests[i * 20]);
+		scores[i] = &digests[i * 20];
+	}
+	RL_CALL(rl_btree_find_scores, RL_OK, db, btree, keyc, scores, values);
+	for (i = 0; i < keyc; i++) {
+		key_obj = values[i];
+		expired[i] = key_obj && key_obj->expires != 0 && key_obj->expires <= now;
+		if (key_obj && !expired[i]) {
+			types[i] = key_obj->type;
+			if (value_pages) {
+				value_pages[i] = key_obj->value_page;
+			}
+		}
+	}
+	// deleting expired keys modifies the tree, the values found are no longer valid
+	for (i = 0; i < keyc; i++) {
+		if (expired[i]) {
+			RL_CALL2(rl_key_delete_with_value, RL_OK, RL_NOT_FOUND, db, keys[i], keyslen[i]);
+		}
+	}
+	retval = RL_OK;
+cleanup:
+	rl_free(digests);
+	rl_free(expired);
+	rl_free(scores);
+	rl_free(values);
+	return retval;
 }
 
 int rl_key_get_or_create(struct rlite *db, const unsigned char *key, long keylen, unsigned char type, long *page, long *version)
@@ -216,11 +424,12 @@ cleanup:
 	return retval;
 }
 
-int rl_key_delete(struct rlite *db, const unsigned char *key, long keylen)
+static int key_delete(struct rlite *db, const unsigned char *key, long keylen, int update_index)
 {
 	int retval;
 	void *tmp;
 	unsigned char *digest;
+	unsigned long long expires;
 	rl_btree *btree = NULL;
 	rl_key *key_obj = NULL;
 	RL_MALLOC(digest, sizeof(unsigned char) * 20);
@@ -230,7 +439,9 @@ int rl_key_delete(struct rlite *db, const unsigned char *key, long keylen)
 	if (retval == RL_FOUND) {
 		int selected_database = rl_get_selected_db(db);
 		key_obj = tmp;
+		expires = key_obj->expires;
 		RL_CALL(rl_multi_string_delete, RL_OK, db, key_obj->string_page);
+		RL_CALL(expire_index_delete, RL_OK, db, digest, expires);
 		retval = rl_btree_remove_element(db, btree, db->databases[selected_database], digest);
 		if (retval == RL_DELETED) {
 			db->databases[selected_database] = 0;
@@ -239,19 +450,28 @@ int rl_key_delete(struct rlite *db, const unsigned char *key, long keylen)
 		else if (retval != RL_OK) {
 			goto cleanup;
 		}
+		if (update_index) {
+			RL_CALL(key_index_delete, RL_OK, db, key, keylen);
+		}
 	}
 cleanup:
 	rl_free(digest);
 	return retval;
 }
 
+int rl_key_delete(struct rlite *db, const unsigned char *key, long keylen)
+{
+	return key_delete(db, key, keylen, 1);
+}
+
 int rl_key_expires(struct rlite *db, const unsigned char *key, long keylen, unsigned long long expires)
 {
 	int retval;
-	unsigned char type;
-	long string_page, value_page, version;
-	RL_CALL(rl_key_get, RL_FOUND, db, key, keylen, &type, &string_page, &value_page, NULL, &version);
-	RL_CALL(rl_key_set, RL_OK, db, key, keylen, type, value_page, expires, version + 1);
+	rl_key entry;
+	RL_CALL(rl_key_get_entry, RL_FOUND, db, key, keylen, &entry);
+	entry.expires = expires;
+	entry.version++;
+	RL_CALL(key_set, RL_OK, db, key, keylen, &entry);
 cleanup:
 	return retval;
 }
@@ -273,10 +493,95 @@ int rl_key_delete_with_value(struct rlite *db, const unsigned char *key, long ke
 	unsigned char identifier;
 	long value_page;
 	unsigned long long expires;
-	RL_CALL(rl_key_get_ignore_expire, RL_FOUND, db, key, keylen, &identifier, NULL, &value_page, &expires, NULL, 1);
+	RL_CALL(rl_key_get_ignore_expire, RL_FOUND, db, key, keylen, &identifier, NULL, &value_page, &expires, NULL, NULL, 1);
 	RL_CALL(rl_key_delete_value, RL_OK, db, identifier, value_page);
 	RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
 	retval = expires != 0 && expires <= rl_mstime() ? RL_NOT_FOUND : RL_OK;
 cleanup:
 	return retval;
 }
+
+static int expire_cycle_db(struct rlite *db, unsigned long long now, long budget, long *expired)
+{
+	int retval;
+	rl_zset_tree *index;
+	rl_zset_tree_iterator *iterator = NULL;
+	unsigned char *digests = NULL, *member, *key = NULL;
+	long i, size = 0, memberlen, keylen, string_page = 0;
+	double score;
+
+	RL_CALL2(rl_get_expire_index, RL_OK, RL_NOT_FOUND, db, &index, NULL, 0);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	if (budget > index->size) {
+		budget = index->size;
+	}
+	// collect the digests first, deleting the keys modifies the index
+	RL_MALLOC(digests, sizeof(unsigned char) * 20 * budget);
+	RL_CALL(rl_zset_tree_iterator_create, RL_OK, db, index, 0, 1, budget, &iterator);
+	while ((retval = rl_zset_tree_iterator_next(iterator, &score, &member, &memberlen)) == RL_OK) {
+		if (score > now) {
+			rl_free(member);
+			rl_zset_tree_iterator_destroy(iterator);
+			break;
+		}
+		memcpy(&digests[size * 20], member, 20);
+		rl_free(member);
+		size++;
+	}
+	iterator = NULL;
+	if (retval != RL_OK && retval != RL_END) {
+		goto cleanup;
+	}
+
+	for (i = 0; i < size; i++) {
+		RL_CALL(rl_key_get_hash_ignore_expire, RL_FOUND, db, &digests[i * 20], NULL, &string_page, NULL, NULL, NULL, NULL, 1);
+		RL_CALL(rl_multi_string_get, RL_OK, db, string_page, &key, &keylen);
+		RL_CALL(rl_key_delete_with_value, RL_NOT_FOUND, db, key, keylen);
+		rl_free(key);
+		key = NULL;
+	}
+	*expired += size;
+	retval = RL_OK;
+cleanup:
+	if (iterator) {
+		rl_zset_tree_iterator_destroy(iterator);
+	}
+	rl_free(digests);
+	rl_free(key);
+	return retval;
+}
+
+int rl_expire_cycle(struct rlite *db, long budget, long *expired)
+{
+	int retval = RL_OK, selected_database = db->selected_database, selected_internal = db->selected_internal;
+	unsigned long long now = rl_mstime();
+	long i, count = 0;
+
+	db->selected_internal = RLITE_INTERNAL_DB_NO;
+	for (i = 0; i < db->number_of_databases && count < budget; i++) {
+		if (db->expire_indexes[i] == 0) {
+			continue;
+		}
+		db->selected_database = i;
+		RL_CALL(expire_cycle_db, RL_OK, db, now, budget - count, &count);
+	}
+cleanup:
+	db->selected_database = selected_database;
+	db->selected_internal = selected_internal;
+	if (expired) {
+		*expired = count;
+	}
+	return retval;
+}
+
+int rl_expire_auto(struct rlite *db, long budget)
+{
+	if (budget < 0) {
+		return RL_INVALID_PARAMETERS;
+	}
+	db->expire_budget = budget;
+	return RL_OK;
+}
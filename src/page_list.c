@@ -13,16 +13,42 @@ int rl_print_list_node(rl_list *list, rl_list_node *node);
 #endif
 int rl_list_node_create(rlite *db, rl_list *list, rl_list_node **node);
 
+static long value_serialized_size(void *element)
+{
+	rl_list_value *value = element;
+	return value->page ? 4 : 4 + value->size;
+}
+
+static long value_alloc_size(void *element)
+{
+	rl_list_value *value = element;
+	return sizeof(rl_list_value) + (value->page ? 0 : value->size);
+}
+
 rl_list_type rl_list_type_long = {
 	&rl_data_type_list_long,
 	&rl_data_type_list_node_long,
 	sizeof(long),
 	long_cmp,
+	NULL,
+	NULL,
 #ifdef RL_DEBUG
 	long_formatter,
 #endif
 };
 
+rl_list_type rl_list_type_value = {
+	&rl_data_type_list_value,
+	&rl_data_type_list_node_value,
+	4,
+	NULL,
+	value_serialized_size,
+	value_alloc_size,
+#ifdef RL_DEBUG
+	NULL,
+#endif
+};
+
 int rl_list_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
 {
 	rl_list *list = obj;
@@ -30,6 +56,8 @@ int rl_list_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
 	put_4bytes(&data[4], list->right);
 	put_4bytes(&data[8], list->max_node_size);
 	put_4bytes(&data[12], list->size);
+	put_4bytes(&data[16], list->index_root);
+	put_4bytes(&data[20], list->index_height);
 	return RL_OK;
 }
 
@@ -43,6 +71,8 @@ int rl_list_deserialize(rlite *UNUSED(db), void **obj, void *context, unsigned c
 	list->right = get_4bytes(&data[4]);
 	list->max_node_size = get_4bytes(&data[8]);
 	list->size = get_4bytes(&data[12]);
+	list->index_root = get_4bytes(&data[16]);
+	list->index_height = get_4bytes(&data[20]);
 	*obj = list;
 cleanup:
 	return retval;
@@ -88,12 +118,79 @@ cleanup:
 	return retval;
 }
 
+/**
+ * Each element is a 4 bytes length followed by the value, or, for values
+ * stored in a multi string, the multi string page as a negative length.
+ */
+int rl_list_node_serialize_value(rlite *UNUSED(db), void *obj, unsigned char *data)
+{
+	rl_list_node *node = obj;
+	rl_list_value *value;
+	long i, pos = 12;
+
+	put_4bytes(data, node->size);
+	put_4bytes(&data[4], node->left);
+	put_4bytes(&data[8], node->right);
+	for (i = 0; i < node->size; i++) {
+		value = node->elements[i];
+		if (value->page) {
+			put_4bytes(&data[pos], -value->page);
+			pos += 4;
+		}
+		else {
+			put_4bytes(&data[pos], value->size);
+			memcpy(&data[pos + 4], value->data, value->size);
+			pos += 4 + value->size;
+		}
+	}
+	return RL_OK;
+}
+
+int rl_list_node_deserialize_value(rlite *db, void **obj, void *context, unsigned char *data)
+{
+	rl_list *list = context;
+	rl_list_node *node = NULL;
+	rl_list_value *value;
+	long i = 0, pos = 12, length;
+	int retval;
+	RL_CALL(rl_list_node_create, RL_OK, db, list, &node);
+	node->size = (long)get_4bytes(data);
+	node->left = (long)get_4bytes(&data[4]);
+	node->right = (long)get_4bytes(&data[8]);
+	for (i = 0; i < node->size; i++) {
+		length = get_4bytes(&data[pos]);
+		pos += 4;
+		if (length < 0) {
+			RL_MALLOC(value, sizeof(rl_list_value));
+			value->page = -length;
+			value->size = 0;
+		}
+		else {
+			RL_MALLOC(value, sizeof(rl_list_value) + length);
+			value->page = 0;
+			value->size = length;
+			memcpy(value->data, &data[pos], length);
+			pos += length;
+		}
+		node->elements[i] = value;
+	}
+	*obj = node;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && node) {
+		node->size = i;
+		rl_list_node_destroy(db, node);
+	}
+	return retval;
+}
+
 int rl_list_node_create(rlite *UNUSED(db), rl_list *list, rl_list_node **_node)
 {
 	int retval;
 	rl_list_node *node;
 	RL_MALLOC(node, sizeof(rl_list_node));
-	RL_MALLOC(node->elements, sizeof(void *) * list->max_node_size);
+	// one extra slot, an element is added before moving the overflow out
+	RL_MALLOC(node->elements, sizeof(void *) * (list->max_node_size + 1));
 	node->size = 0;
 	node->left = 0;
 	node->right = 0;
@@ -135,6 +232,8 @@ int rl_list_create(rlite *db, rl_list **_list, rl_list_type *type)
 	node->left = 0;
 	node->right = 0;
 	list->size = 0;
+	list->index_root = 0;
+	list->index_height = 0;
 	list->left = db->next_empty_page;
 	RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, db->next_empty_page, node);
 	list->right = list->left;
@@ -153,6 +252,489 @@ int rl_list_destroy(rlite *UNUSED(db), void *list)
 	return RL_OK;
 }
 
+/**
+ * Space used by an element, and available in a node. For elements of fixed
+ * size it is counted in elements, otherwise in serialized bytes.
+ */
+static long element_space(rl_list *list, void *element)
+{
+	return list->type->element_serialized_size ? list->type->element_serialized_size(element) : 1;
+}
+
+static long node_space(rl_list *list, rl_list_node *node)
+{
+	long i, space = 0;
+	if (!list->type->element_serialized_size) {
+		return node->size;
+	}
+	for (i = 0; i < node->size; i++) {
+		space += list->type->element_serialized_size(node->elements[i]);
+	}
+	return space;
+}
+
+static long node_capacity(rlite *db, rl_list *list)
+{
+	return list->type->element_serialized_size ? db->page_size - 12 : list->max_node_size;
+}
+
+#define INDEX_MAX_SIZE(db) (((db)->page_size - 8) / 8)
+
+static int index_node_create(rlite *db, int leaf, rl_list_index_node **_node)
+{
+	int retval;
+	rl_list_index_node *node = NULL;
+	RL_MALLOC(node, sizeof(*node));
+	node->leaf = leaf;
+	node->size = 0;
+	node->pages = NULL;
+	node->counts = NULL;
+	// one extra slot, nodes are split after going over the limit
+	RL_MALLOC(node->pages, sizeof(long) * (INDEX_MAX_SIZE(db) + 1));
+	RL_MALLOC(node->counts, sizeof(long) * (INDEX_MAX_SIZE(db) + 1));
+	*_node = node;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && node) {
+		rl_list_index_node_destroy(db, node);
+	}
+	return retval;
+}
+
+int rl_list_index_node_destroy(rlite *UNUSED(db), void *obj)
+{
+	rl_list_index_node *node = obj;
+	rl_free(node->pages);
+	rl_free(node->counts);
+	rl_free(node);
+	return RL_OK;
+}
+
+int rl_list_index_node_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
+{
+	rl_list_index_node *node = obj;
+	long i, pos = 8;
+	put_4bytes(data, node->leaf);
+	put_4bytes(&data[4], node->size);
+	for (i = 0; i < node->size; i++) {
+		put_4bytes(&data[pos], node->pages[i]);
+		put_4bytes(&data[pos + 4], node->counts[i]);
+		pos += 8;
+	}
+	return RL_OK;
+}
+
+int rl_list_index_node_deserialize(rlite *db, void **obj, void *UNUSED(context), unsigned char *data)
+{
+	rl_list_index_node *node;
+	long i, pos = 8;
+	int retval;
+	RL_CALL(index_node_create, RL_OK, db, get_4bytes(data), &node);
+	node->size = get_4bytes(&data[4]);
+	for (i = 0; i < node->size; i++) {
+		node->pages[i] = get_4bytes(&data[pos]);
+		node->counts[i] = get_4bytes(&data[pos + 4]);
+		pos += 8;
+	}
+	*obj = node;
+cleanup:
+	return retval;
+}
+
+static long index_node_count(rl_list_index_node *node)
+{
+	long i, count = 0;
+	for (i = 0; i < node->size; i++) {
+		count += node->counts[i];
+	}
+	return count;
+}
+
+static void index_node_insert(rl_list_index_node *node, long position, long page, long count)
+{
+	memmove(&node->pages[position + 1], &node->pages[position], sizeof(long) * (node->size - position));
+	memmove(&node->counts[position + 1], &node->counts[position], sizeof(long) * (node->size - position));
+	node->pages[position] = page;
+	node->counts[position] = count;
+	node->size++;
+}
+
+static void index_node_remove(rl_list_index_node *node, long position)
+{
+	memmove(&node->pages[position], &node->pages[position + 1], sizeof(long) * (node->size - position - 1));
+	memmove(&node->counts[position], &node->counts[position + 1], sizeof(long) * (node->size - position - 1));
+	node->size--;
+}
+
+/**
+ * Moves `count` entries from the start of `src` to the end of `dst`,
+ * or from the end of `src` to the start of `dst` when `to_left` is not set.
+ */
+static void index_node_move(rl_list_index_node *dst, rl_list_index_node *src, long count, int to_left)
+{
+	if (to_left) {
+		memcpy(&dst->pages[dst->size], src->pages, sizeof(long) * count);
+		memcpy(&dst->counts[dst->size], src->counts, sizeof(long) * count);
+		memmove(src->pages, &src->pages[count], sizeof(long) * (src->size - count));
+		memmove(src->counts, &src->counts[count], sizeof(long) * (src->size - count));
+	}
+	else {
+		memmove(&dst->pages[count], dst->pages, sizeof(long) * dst->size);
+		memmove(&dst->counts[count], dst->counts, sizeof(long) * dst->size);
+		memcpy(dst->pages, &src->pages[src->size - count], sizeof(long) * count);
+		memcpy(dst->counts, &src->counts[src->size - count], sizeof(long) * count);
+	}
+	dst->size += count;
+	src->size -= count;
+}
+
+static int index_total(rlite *db, rl_list *list, long *total)
+{
+	void *tmp;
+	int retval = RL_OK;
+	*total = 0;
+	if (list->index_root) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, list->index_root, list, &tmp, 1);
+		*total = index_node_count(tmp);
+		retval = RL_OK;
+	}
+cleanup:
+	return retval;
+}
+
+/**
+ * Walks the index to the leaf entry for element `offset`, counting from the
+ * first indexed element. When `insert` is set, `offset` may also be the
+ * position right after the last indexed element, and the leaf position
+ * returned is the one a node starting at `offset` would take.
+ */
+static int index_path(rlite *db, rl_list *list, long offset, int insert, rl_list_index_node **nodes, long *pages, long *positions, long *_start)
+{
+	void *tmp;
+	rl_list_index_node *node = NULL;
+	long i = 0, level, page = list->index_root, start = 0;
+	int retval;
+	for (level = 0; level < list->index_height; level++) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, page, list, &tmp, 1);
+		node = tmp;
+		i = 0;
+		if (node->leaf && insert) {
+			while (i < node->size && offset >= node->counts[i]) {
+				offset -= node->counts[i];
+				start += node->counts[i];
+				i++;
+			}
+		}
+		else {
+			while (i < node->size - 1 && offset >= node->counts[i]) {
+				offset -= node->counts[i];
+				start += node->counts[i];
+				i++;
+			}
+		}
+		if (nodes) {
+			nodes[level] = node;
+			pages[level] = page;
+			positions[level] = i;
+		}
+		page = node->pages[i];
+	}
+	if (insert ? offset != 0 : offset >= node->counts[i]) {
+		fprintf(stderr, "Unexpected list index offset %ld\n", offset);
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+	if (_start) {
+		*_start = start;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int index_find(rlite *db, rl_list *list, long offset, long *page, long *start)
+{
+	int retval;
+	long *pages = NULL, *positions = NULL;
+	rl_list_index_node **nodes = NULL;
+	RL_MALLOC(nodes, sizeof(rl_list_index_node *) * list->index_height);
+	RL_MALLOC(pages, sizeof(long) * list->index_height);
+	RL_MALLOC(positions, sizeof(long) * list->index_height);
+	RL_CALL(index_path, RL_OK, db, list, offset, 0, nodes, pages, positions, start);
+	*page = nodes[list->index_height - 1]->pages[positions[list->index_height - 1]];
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+/**
+ * Adds `delta` to the count of the indexed node holding element `offset`
+ */
+static int index_update(rlite *db, rl_list *list, long offset, long delta)
+{
+	long i;
+	int retval;
+	long *pages = NULL, *positions = NULL;
+	rl_list_index_node **nodes = NULL;
+	RL_MALLOC(nodes, sizeof(rl_list_index_node *) * list->index_height);
+	RL_MALLOC(pages, sizeof(long) * list->index_height);
+	RL_MALLOC(positions, sizeof(long) * list->index_height);
+	RL_CALL(index_path, RL_OK, db, list, offset, 0, nodes, pages, positions, NULL);
+	for (i = 0; i < list->index_height; i++) {
+		nodes[i]->counts[positions[i]] += delta;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, pages[i], nodes[i]);
+	}
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+/**
+ * Adds list node `page`, with `count` elements, to the index so that its
+ * first element is at `offset`.
+ */
+static int index_insert(rlite *db, rl_list *list, long offset, long page, long count)
+{
+	rl_list_index_node *node, *new_node, *root;
+	long i, new_page, half;
+	int retval;
+	long *pages = NULL, *positions = NULL;
+	rl_list_index_node **nodes = NULL;
+
+	if (!list->index_root) {
+		RL_CALL(index_node_create, RL_OK, db, 1, &root);
+		index_node_insert(root, 0, page, count);
+		list->index_root = db->next_empty_page;
+		list->index_height = 1;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, list->index_root, root);
+		goto cleanup;
+	}
+
+	RL_MALLOC(nodes, sizeof(rl_list_index_node *) * list->index_height);
+	RL_MALLOC(pages, sizeof(long) * list->index_height);
+	RL_MALLOC(positions, sizeof(long) * list->index_height);
+	RL_CALL(index_path, RL_OK, db, list, offset, 1, nodes, pages, positions, NULL);
+	index_node_insert(nodes[list->index_height - 1], positions[list->index_height - 1], page, count);
+	for (i = 0; i < list->index_height - 1; i++) {
+		nodes[i]->counts[positions[i]] += count;
+	}
+
+	for (i = list->index_height - 1; i >= 0; i--) {
+		node = nodes[i];
+		if (node->size <= INDEX_MAX_SIZE(db)) {
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, pages[i], node);
+			continue;
+		}
+		RL_CALL(index_node_create, RL_OK, db, node->leaf, &new_node);
+		half = node->size / 2;
+		index_node_move(new_node, node, node->size - half, 0);
+		new_page = db->next_empty_page;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, new_page, new_node);
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, pages[i], node);
+		if (i > 0) {
+			nodes[i - 1]->counts[positions[i - 1]] -= index_node_count(new_node);
+			index_node_insert(nodes[i - 1], positions[i - 1] + 1, new_page, index_node_count(new_node));
+		}
+		else {
+			RL_CALL(index_node_create, RL_OK, db, 0, &root);
+			index_node_insert(root, 0, pages[i], index_node_count(node));
+			index_node_insert(root, 1, new_page, index_node_count(new_node));
+			list->index_root = db->next_empty_page;
+			list->index_height++;
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, list->index_root, root);
+		}
+	}
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+/**
+ * Removes the indexed node holding element `offset` from the index
+ */
+static int index_remove(rlite *db, rl_list *list, long offset)
+{
+	void *tmp;
+	rl_list_index_node *node, *parent, *sibling, *left, *right;
+	long i, count, p, sibling_page, moved;
+	int retval;
+	long *pages = NULL, *positions = NULL;
+	rl_list_index_node **nodes = NULL;
+	RL_MALLOC(nodes, sizeof(rl_list_index_node *) * list->index_height);
+	RL_MALLOC(pages, sizeof(long) * list->index_height);
+	RL_MALLOC(positions, sizeof(long) * list->index_height);
+	RL_CALL(index_path, RL_OK, db, list, offset, 0, nodes, pages, positions, NULL);
+	node = nodes[list->index_height - 1];
+	count = node->counts[positions[list->index_height - 1]];
+	index_node_remove(node, positions[list->index_height - 1]);
+	for (i = 0; i < list->index_height - 1; i++) {
+		nodes[i]->counts[positions[i]] -= count;
+	}
+
+	for (i = list->index_height - 1; i > 0; i--) {
+		node = nodes[i];
+		parent = nodes[i - 1];
+		p = positions[i - 1];
+		if (node->size == 0) {
+			RL_CALL(rl_delete, RL_OK, db, pages[i]);
+			index_node_remove(parent, p);
+			continue;
+		}
+		if (node->size >= INDEX_MAX_SIZE(db) / 4 || parent->size == 1) {
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, pages[i], node);
+			continue;
+		}
+		sibling_page = parent->pages[p > 0 ? p - 1 : p + 1];
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, sibling_page, list, &tmp, 1);
+		sibling = tmp;
+		if (p == 0) {
+			left = node;
+			right = sibling;
+		}
+		else {
+			p--;
+			left = sibling;
+			right = node;
+		}
+		if (left->size + right->size <= INDEX_MAX_SIZE(db)) {
+			index_node_move(left, right, right->size, 1);
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, parent->pages[p], left);
+			RL_CALL(rl_delete, RL_OK, db, parent->pages[p + 1]);
+			parent->counts[p] += parent->counts[p + 1];
+			index_node_remove(parent, p + 1);
+		}
+		else {
+			if (left->size < right->size) {
+				moved = (right->size - left->size) / 2;
+				index_node_move(left, right, moved, 1);
+			}
+			else {
+				moved = (left->size - right->size) / 2;
+				index_node_move(right, left, moved, 0);
+			}
+			parent->counts[p] = index_node_count(left);
+			parent->counts[p + 1] = index_node_count(right);
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, parent->pages[p], left);
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, parent->pages[p + 1], right);
+		}
+	}
+
+	node = nodes[0];
+	if (node->size == 0) {
+		RL_CALL(rl_delete, RL_OK, db, list->index_root);
+		list->index_root = 0;
+		list->index_height = 0;
+		goto cleanup;
+	}
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_index_node, list->index_root, node);
+	// while the root has a single child, the child can take its place
+	while (!node->leaf && node->size == 1) {
+		p = node->pages[0];
+		RL_CALL(rl_delete, RL_OK, db, list->index_root);
+		list->index_root = p;
+		list->index_height--;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, list->index_root, list, &tmp, 1);
+		node = tmp;
+	}
+	retval = RL_OK;
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+static int index_pages(rlite *db, rl_list *list, long page, short *pages)
+{
+	void *tmp;
+	rl_list_index_node *node;
+	long i;
+	int retval;
+	pages[page] = 1;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, page, list, &tmp, 1);
+	node = tmp;
+	if (!node->leaf) {
+		for (i = 0; i < node->size; i++) {
+			RL_CALL(index_pages, RL_OK, db, list, node->pages[i], pages);
+		}
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int index_delete(rlite *db, rl_list *list, long page)
+{
+	void *tmp;
+	rl_list_index_node *node;
+	long i;
+	int retval;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, page, list, &tmp, 1);
+	node = tmp;
+	if (!node->leaf) {
+		for (i = 0; i < node->size; i++) {
+			RL_CALL(index_delete, RL_OK, db, list, node->pages[i]);
+		}
+	}
+	RL_CALL(rl_delete, RL_OK, db, page);
+cleanup:
+	return retval;
+}
+
+/**
+ * Checks the counts of the index subtree in `page`, and that its leaves
+ * reference the nodes in `expected_pages`, starting at `*position`.
+ */
+static int index_is_balanced(rlite *db, rl_list *list, long page, long depth, long *expected_pages, long *expected_counts, long expected_size, long *position, long *count)
+{
+	void *tmp;
+	rl_list_index_node *node;
+	long i, child_count;
+	int retval;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_index_node, page, list, &tmp, 1);
+	node = tmp;
+	if (node->size == 0 || node->size > INDEX_MAX_SIZE(db)) {
+		fprintf(stderr, "List index node %ld has %ld entries\n", page, node->size);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	if (node->leaf != (depth == list->index_height - 1)) {
+		fprintf(stderr, "List index leaf %ld found at depth %ld, height is %ld\n", page, depth, list->index_height);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	*count = 0;
+	for (i = 0; i < node->size; i++) {
+		if (node->leaf) {
+			if (*position >= expected_size || node->pages[i] != expected_pages[*position] || node->counts[i] != expected_counts[*position]) {
+				fprintf(stderr, "List index entry %ld does not match the list node\n", *position);
+				retval = RL_INVALID_STATE;
+				goto cleanup;
+			}
+			(*position)++;
+			child_count = node->counts[i];
+		}
+		else {
+			RL_CALL(index_is_balanced, RL_OK, db, list, node->pages[i], depth + 1, expected_pages, expected_counts, expected_size, position, &child_count);
+			if (child_count != node->counts[i]) {
+				fprintf(stderr, "List index node %ld expected child %ld to have %ld elements, got %ld\n", page, i, node->counts[i], child_count);
+				retval = RL_INVALID_STATE;
+				goto cleanup;
+			}
+		}
+		*count += child_count;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
 int rl_list_find_element(rlite *db, rl_list *list, void *element, void **found_element, long *position, rl_list_node **found_node, long *found_node_page)
 {
 	if (!list->type->cmp) {
@@ -192,56 +774,50 @@ cleanup:
 	return retval;
 }
 
-static int rl_find_element_by_position(rlite *db, rl_list *list, long *position, long *_pos, rl_list_node **_node, long *_number, int add)
+/**
+ * Finds the node holding `position`. `_pos` is set to the position of the
+ * first element in the node, and `_index_pos` to the same position counting
+ * from the first indexed element.
+ */
+static int rl_find_element_by_position(rlite *db, rl_list *list, long *position, long *_pos, rl_list_node **_node, long *_number, long *_index_pos, int add)
 {
 	rl_list_node *node;
 	void *tmp_node;
-	long pos = 0, number;
+	long pos = 0, number, left_size, offset, total, start;
 	if (*position >= list->size + add || *position <= - list->size - 1 - add) {
 		return RL_INVALID_PARAMETERS;
 	}
 	int retval = RL_OK;
-	if (*position >= 0) {
-		number = list->left;
-		while (1) {
-			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &tmp_node, 1);
-			node = tmp_node;
-			if (pos + node->size > *position) {
-				break;
-			}
-			if (node->right != 0) {
-				number = node->right;
-				pos += node->size;
-			}
-			else {
-				break;
-			}
-		}
-	}
-	else {
+	if (*position < 0) {
 		*position = list->size + *position + add;
-		pos = list->size;
-		number = list->right;
-		while (1) {
-			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &tmp_node, 1);
-			node = tmp_node;
-			pos -= node->size;
-			if (pos <= *position) {
-				break;
-			}
-			if (node->left != 0) {
-				number = node->left;
-			}
-			else {
-				break;
-			}
+	}
+	number = list->left;
+	RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &tmp_node, 1);
+	node = tmp_node;
+	left_size = node->size;
+	offset = *position - left_size;
+	if (offset >= 0 && list->left != list->right) {
+		RL_CALL(index_total, RL_OK, db, list, &total);
+		if (offset < total) {
+			RL_CALL(index_find, RL_OK, db, list, offset, &number, &start);
 		}
+		else {
+			number = list->right;
+			start = total;
+		}
+		pos = left_size + start;
+		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &tmp_node, 1);
+		node = tmp_node;
 	}
 	*_pos = pos;
 	*_node = node;
 	if (_number) {
 		*_number = number;
 	}
+	if (_index_pos) {
+		*_index_pos = pos - left_size;
+	}
+	retval = RL_FOUND;
 cleanup:
 	return retval;
 }
@@ -251,117 +827,183 @@ int rl_list_get_element(struct rlite *db, rl_list *list, void **element, long po
 	long pos;
 	rl_list_node *node;
 	int retval;
-	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, NULL, 0);
+	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, NULL, NULL, 0);
 	*element = node->elements[position - pos];
 cleanup:
 	return retval;
 }
 
+int rl_list_set_element(struct rlite *db, rl_list *list, long list_page, void *element, long position)
+{
+	long pos, number;
+	rl_list_node *node;
+	int retval;
+	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, NULL, 0);
+	if (list->size > 1 && element_space(list, node->elements[position - pos]) != element_space(list, element)) {
+		// the node changes size, it may need to be split or merged
+		RL_CALL(rl_list_remove_element, RL_OK, db, list, list_page, position);
+		retval = rl_list_add_element(db, list, list_page, element, position);
+		element = NULL;
+		goto cleanup;
+	}
+	rl_free(node->elements[position - pos]);
+	node->elements[position - pos] = element;
+	element = NULL;
+	RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
+	retval = RL_OK;
+cleanup:
+	rl_free(element);
+	return retval;
+}
+
+/**
+ * Inserts the element in the node holding `position`. When the node goes
+ * over its capacity, elements are moved to its siblings while they fit, and
+ * the remaining overflow goes to new nodes on its right.
+ */
 int rl_list_add_element(rlite *db, rl_list *list, long list_page, void *element, long position)
 {
-	rl_list_node *node, *sibling_node, *new_node, *old_node;
-	long pos;
-	long number, sibling_number;
-	void *_node;
+	rl_list_node *node, *sibling_node, *old_node;
+	rl_list_node **new_nodes = NULL;
+	long pos, index_pos, node_start, offset, original_size, original_right;
+	long number, sibling_number, right_number = 0, right_moved = 0;
+	long space, sibling_space, capacity = node_capacity(db, list);
+	long i, moved, new_nodes_size = 0, *new_pages = NULL;
+	int was_right;
+	void *_node, *tmp;
 	int retval;
-	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, 1);
+	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, &index_pos, 1);
+	was_right = number == list->right;
+	original_size = node->size;
+	original_right = node->right;
+	node_start = index_pos;
 
-	if (node->size != list->max_node_size) {
-		if (position - pos + 1 < list->max_node_size) {
-			memmove(&node->elements[position - pos + 1], &node->elements[position - pos], sizeof(void *) * (node->size - (position - pos)));
-		}
-		node->elements[position - pos] = element;
-		element = NULL;
-		node->size++;
+	memmove(&node->elements[position - pos + 1], &node->elements[position - pos], sizeof(void *) * (node->size - (position - pos)));
+	node->elements[position - pos] = element;
+	element = NULL;
+	node->size++;
+	space = node_space(list, node);
 
-		RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
-	}
-	else {
-		if (node->left) {
-			sibling_number = node->left;
-			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, sibling_number, list, &_node, 1);
-			sibling_node = _node;
-			if (sibling_node->size != list->max_node_size) {
-				if (position == pos) {
-					sibling_node->elements[sibling_node->size] = element;
-				}
-				else {
-					sibling_node->elements[sibling_node->size] = node->elements[0];
-					memmove(&node->elements[0], &node->elements[1], sizeof(void *) * (position - pos - 1));
-					node->elements[position - pos - 1] = element;
-				}
-				element = NULL;
-				sibling_node->size++;
-				RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
-				RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, sibling_number, sibling_node);
-				goto succeeded;
-			}
+	if (space > capacity && node->left) {
+		sibling_number = node->left;
+		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, sibling_number, list, &_node, 1);
+		sibling_node = _node;
+		sibling_space = node_space(list, sibling_node);
+		moved = 0;
+		while (space > capacity && sibling_space + element_space(list, node->elements[moved]) <= capacity) {
+			sibling_space += element_space(list, node->elements[moved]);
+			space -= element_space(list, node->elements[moved]);
+			sibling_node->elements[sibling_node->size++] = node->elements[moved++];
 		}
-		if (node->right) {
-			sibling_number = node->right;
-			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, sibling_number, list, &_node, 1);
-			sibling_node = _node;
-			if (sibling_node->size != list->max_node_size) {
-				memmove(&sibling_node->elements[1], &sibling_node->elements[0], sizeof(void *) * sibling_node->size);
-				if (position - pos == node->size) {
-					sibling_node->elements[0] = element;
-				}
-				else {
-					sibling_node->elements[0] = node->elements[node->size - 1];
-					memmove(&node->elements[position - pos + 1], &node->elements[position - pos], sizeof(void *) * (node->size - position + pos - 1));
-					node->elements[position - pos] = element;
-				}
-				element = NULL;
-				sibling_node->size++;
-				RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
-				RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, sibling_number, sibling_node);
-				goto succeeded;
+		if (moved > 0) {
+			memmove(node->elements, &node->elements[moved], sizeof(void *) * (node->size - moved));
+			node->size -= moved;
+			RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, sibling_number, sibling_node);
+			if (sibling_number != list->left) {
+				RL_CALL(index_update, RL_OK, db, list, index_pos - 1, moved);
+				node_start += moved;
 			}
 		}
-		RL_CALL(rl_list_node_create, RL_OK, db, list, &new_node);
-		if (position - pos == node->size) {
-			new_node->elements[0] = element;
+	}
+
+	if (space > capacity && node->right) {
+		right_number = node->right;
+		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, right_number, list, &_node, 1);
+		sibling_node = _node;
+		sibling_space = node_space(list, sibling_node);
+		while (space > capacity && sibling_space + element_space(list, node->elements[node->size - 1 - right_moved]) <= capacity) {
+			sibling_space += element_space(list, node->elements[node->size - 1 - right_moved]);
+			space -= element_space(list, node->elements[node->size - 1 - right_moved]);
+			right_moved++;
 		}
-		else {
-			new_node->elements[0] = node->elements[node->size - 1];
-			memmove(&node->elements[position - pos + 1], &node->elements[position - pos], sizeof(void *) * (node->size - position + pos - 1));
-			node->elements[position - pos] = element;
+		if (right_moved > 0) {
+			memmove(&sibling_node->elements[right_moved], sibling_node->elements, sizeof(void *) * sibling_node->size);
+			memcpy(sibling_node->elements, &node->elements[node->size - right_moved], sizeof(void *) * right_moved);
+			sibling_node->size += right_moved;
+			node->size -= right_moved;
+			RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, right_number, sibling_node);
 		}
-		element = NULL;
-		new_node->size = 1;
-		new_node->left = number;
-		new_node->right = node->right;
-		node->right = db->next_empty_page;
-		RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, db->next_empty_page, new_node);
-		RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
-		if (new_node->right != 0) {
-			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, new_node->right, list, &_node, 1);
+	}
+
+	// new nodes are created from right to left
+	while (space > capacity) {
+		RL_REALLOC(new_nodes, sizeof(rl_list_node *) * (new_nodes_size + 1));
+		RL_CALL(rl_list_node_create, RL_OK, db, list, &new_nodes[new_nodes_size]);
+		sibling_node = new_nodes[new_nodes_size++];
+		sibling_space = 0;
+		moved = 0;
+		// a single element always fits in an empty node
+		while (space > capacity && (moved == 0 || sibling_space + element_space(list, node->elements[node->size - 1 - moved]) <= capacity)) {
+			sibling_space += element_space(list, node->elements[node->size - 1 - moved]);
+			space -= element_space(list, node->elements[node->size - 1 - moved]);
+			moved++;
+		}
+		memcpy(sibling_node->elements, &node->elements[node->size - moved], sizeof(void *) * moved);
+		sibling_node->size = moved;
+		node->size -= moved;
+	}
+
+	if (new_nodes_size > 0) {
+		RL_MALLOC(new_pages, sizeof(long) * new_nodes_size);
+		for (i = new_nodes_size - 1; i >= 0; i--) {
+			new_pages[i] = db->next_empty_page;
+			RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, new_pages[i], new_nodes[i]);
+		}
+		node->right = new_pages[new_nodes_size - 1];
+		for (i = new_nodes_size - 1; i >= 0; i--) {
+			new_nodes[i]->left = i == new_nodes_size - 1 ? number : new_pages[i + 1];
+			new_nodes[i]->right = i == 0 ? original_right : new_pages[i - 1];
+		}
+		if (original_right) {
+			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, original_right, list, &_node, 1);
 			old_node = _node;
-			old_node->left = node->right;
-			RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, new_node->right, old_node);
+			old_node->left = new_pages[0];
+			RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, original_right, old_node);
 		}
 		else {
-			list->right = node->right;
+			list->right = new_pages[0];
 		}
 	}
+	RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
+
+	if (number != list->left && !was_right && node->size != original_size) {
+		RL_CALL(index_update, RL_OK, db, list, node_start, node->size - original_size);
+	}
+	if (was_right && new_nodes_size > 0 && number != list->left) {
+		// the node is no longer the rightmost one
+		RL_CALL(index_insert, RL_OK, db, list, node_start, number, node->size);
+	}
+	offset = number == list->left ? 0 : node_start + node->size;
+	for (i = new_nodes_size - 1; i >= 0; i--) {
+		if (new_pages[i] == list->right) {
+			break;
+		}
+		RL_CALL(index_insert, RL_OK, db, list, offset, new_pages[i], new_nodes[i]->size);
+		offset += new_nodes[i]->size;
+	}
+	if (right_moved > 0 && right_number != list->right) {
+		RL_CALL(index_update, RL_OK, db, list, offset, right_moved);
+	}
 
-succeeded:
 	list->size++;
 	RL_CALL(rl_write, RL_OK, db, list->type->list_type, list_page, list);
 cleanup:
 	if (retval != RL_OK) {
 		rl_free(element);
 	}
+	rl_free(new_nodes);
+	rl_free(new_pages);
 	return retval;
 }
 
 int rl_list_remove_element(rlite *db, rl_list *list, long list_page, long position)
 {
 	rl_list_node *node, *sibling_node;
-	long pos, number;
+	long pos, number, index_pos;
 	void *_node;
 	int retval;
-	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, 0);
+	RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, &index_pos, 0);
+	int interior = number != list->left && number != list->right;
 
 	if (node->size - (position - pos + 1) > 0) {
 		rl_free(node->elements[position - pos]);
@@ -371,6 +1013,17 @@ int rl_list_remove_element(rlite *db, rl_list *list, long list_page, long positi
 		rl_free(node->elements[node->size - 1]);
 	}
 	if (--node->size == 0) {
+		if (interior) {
+			RL_CALL(index_remove, RL_OK, db, list, index_pos);
+		}
+		else if (number == list->left && node->right && node->right != list->right) {
+			// the next node becomes the leftmost one
+			RL_CALL(index_remove, RL_OK, db, list, 0);
+		}
+		else if (number == list->right && node->left && node->left != list->left) {
+			// the previous node becomes the rightmost one
+			RL_CALL(index_remove, RL_OK, db, list, index_pos - 1);
+		}
 		if (list->left == number) {
 			list->left = node->right;
 		}
@@ -395,7 +1048,17 @@ int rl_list_remove_element(rlite *db, rl_list *list, long list_page, long positi
 		if (node->left) {
 			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, node->left, list, &_node, 1);
 			sibling_node = _node;
-			if (sibling_node->size + node->size <= list->max_node_size) {
+			if (node_space(list, sibling_node) + node_space(list, node) <= node_capacity(db, list)) {
+				if (interior) {
+					RL_CALL(index_remove, RL_OK, db, list, index_pos);
+					if (node->left != list->left) {
+						RL_CALL(index_update, RL_OK, db, list, index_pos - sibling_node->size, node->size);
+					}
+				}
+				else if (node->left != list->left) {
+					// node is the rightmost one, its sibling takes its place
+					RL_CALL(index_remove, RL_OK, db, list, index_pos - sibling_node->size);
+				}
 				memmove(&sibling_node->elements[sibling_node->size], node->elements, sizeof(void *) * node->size);
 				sibling_node->right = node->right;
 				sibling_node->size += node->size;
@@ -420,7 +1083,17 @@ int rl_list_remove_element(rlite *db, rl_list *list, long list_page, long positi
 		if (node->right) {
 			RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, node->right, list, &_node, 1);
 			sibling_node = _node;
-			if (sibling_node->size + node->size <= list->max_node_size) {
+			if (node_space(list, sibling_node) + node_space(list, node) <= node_capacity(db, list)) {
+				if (interior) {
+					RL_CALL(index_remove, RL_OK, db, list, index_pos);
+					if (node->right != list->right) {
+						RL_CALL(index_update, RL_OK, db, list, index_pos, node->size);
+					}
+				}
+				else if (node->right != list->right) {
+					// node is the leftmost one, its sibling takes its place
+					RL_CALL(index_remove, RL_OK, db, list, 0);
+				}
 				memmove(&sibling_node->elements[node->size], sibling_node->elements, sizeof(void *) * sibling_node->size);
 				memmove(sibling_node->elements, node->elements, sizeof(void *) * node->size);
 				sibling_node->left = node->left;
@@ -444,6 +1117,9 @@ int rl_list_remove_element(rlite *db, rl_list *list, long list_page, long positi
 			}
 		}
 		RL_CALL(rl_write, RL_OK, db, list->type->list_node_type, number, node);
+		if (interior) {
+			RL_CALL(index_update, RL_OK, db, list, index_pos, -1);
+		}
 	}
 succeeded:
 	retval = RL_OK;
@@ -463,23 +1139,41 @@ int rl_list_is_balanced(rlite *db, rl_list *list)
 {
 	rl_list_iterator *iterator;
 	long i = 0, number = list->left, size = 0;
-	long prev_size;
-	long max_node = (list->size / list->max_node_size + 1) * 2;
+	long prev_space = 0, space, capacity = node_capacity(db, list);
+	long max_node = list->size + 1;
 	int retval = RL_OK;
 	long *left = NULL;
 	long *right = NULL;
+	long *node_pages = NULL;
+	long *node_sizes = NULL;
+	long index_position = 0, index_count = 0;
 	RL_MALLOC(right, sizeof(long) * max_node);
 	RL_MALLOC(left, sizeof(long) * max_node);
+	RL_MALLOC(node_pages, sizeof(long) * max_node);
+	RL_MALLOC(node_sizes, sizeof(long) * max_node);
 	rl_list_node *node;
 	void *_node;
 	while (number != 0) {
 		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &_node, 1);
 		node = _node;
+		if (i >= max_node) {
+			fprintf(stderr, "Too many nodes in list\n");
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		node_pages[i] = number;
+		node_sizes[i] = node->size;
 		size += node->size;
 		left[i] = node->left;
 		right[i] = node->right;
+		space = node_space(list, node);
+		if (space > capacity) {
+			fprintf(stderr, "Node %ld is over its capacity\n", number);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
 		if (i != 0) {
-			if (node->size + prev_size < list->max_node_size) {
+			if (space + prev_space < capacity) {
 				fprintf(stderr, "Two continous node could be merged\n");
 				retval = RL_INVALID_STATE;
 				goto cleanup;
@@ -490,7 +1184,7 @@ int rl_list_is_balanced(rlite *db, rl_list *list)
 			retval = RL_INVALID_STATE;
 			goto cleanup;
 		}
-		prev_size = node->size;
+		prev_space = space;
 		number = node->right;
 		if (i >= 2 && right[i - 2] != left[i]) {
 			fprintf(stderr, "Left and right pointers mismatch at position %ld\n", i);
@@ -506,6 +1200,16 @@ int rl_list_is_balanced(rlite *db, rl_list *list)
 		goto cleanup;
 	}
 
+	// every node but the leftmost and the rightmost must be in the index, in order
+	if (list->index_root) {
+		RL_CALL(index_is_balanced, RL_OK, db, list, list->index_root, 0, &node_pages[1], &node_sizes[1], i - 2, &index_position, &index_count);
+	}
+	if (index_position != (i > 2 ? i - 2 : 0)) {
+		fprintf(stderr, "Expected %ld nodes in the list index, got %ld\n", i > 2 ? i - 2 : 0, index_position);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+
 	i = 0;
 	retval = rl_list_iterator_create(db, &iterator, list, 1);
 	while ((retval = rl_list_iterator_next(iterator, NULL)) == RL_OK) {
@@ -538,6 +1242,8 @@ int rl_list_is_balanced(rlite *db, rl_list *list)
 cleanup:
 	rl_free(right);
 	rl_free(left);
+	rl_free(node_pages);
+	rl_free(node_sizes);
 	return retval;
 }
 
@@ -592,25 +1298,34 @@ cleanup:
 }
 
 int rl_list_iterator_create(rlite *db, rl_list_iterator **_iterator, rl_list *list, int direction)
+{
+	return rl_list_iterator_create_at(db, _iterator, list, direction, direction < 0 ? -1 : 0);
+}
+
+int rl_list_iterator_create_at(rlite *db, rl_list_iterator **_iterator, rl_list *list, int direction, long position)
 {
 	void *_node;
 	int retval;
+	long pos, number;
+	rl_list_node *node;
 	rl_list_iterator *iterator = NULL;
 	RL_MALLOC(iterator, sizeof(*iterator));
 	iterator->db = db;
 	iterator->list = list;
 	iterator->node = NULL;
-	if (direction < 0) {
-		iterator->direction = -1;
-		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, list->right, list, &_node, 0);
+	iterator->direction = direction < 0 ? -1 : 1;
+	if (list->size == 0) {
+		// an empty list only has its first node
+		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, list->left, list, &_node, 0);
 		iterator->node = _node;
-		iterator->node_position = iterator->node->size - 1;
+		iterator->node_position = iterator->direction == 1 ? 0 : -1;
 	}
 	else {
-		iterator->direction = 1;
-		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, list->left, list, &_node, 0);
+		RL_CALL(rl_find_element_by_position, RL_FOUND, db, list, &position, &pos, &node, &number, NULL, 0);
+		// the iterator keeps its own copy of the node
+		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &_node, 0);
 		iterator->node = _node;
-		iterator->node_position = 0;
+		iterator->node_position = position - pos;
 	}
 	*_iterator = iterator;
 	retval = RL_OK;
@@ -638,8 +1353,10 @@ int rl_list_iterator_next(rl_list_iterator *iterator, void **element)
 		goto cleanup;
 	}
 	if (element) {
-		RL_MALLOC(*element, iterator->list->type->element_size);
-		memcpy(*element, iterator->node->elements[iterator->node_position], iterator->list->type->element_size);
+		void *current = iterator->node->elements[iterator->node_position];
+		long size = iterator->list->type->element_alloc_size ? iterator->list->type->element_alloc_size(current) : iterator->list->type->element_size;
+		RL_MALLOC(*element, size);
+		memcpy(*element, current, size);
 	}
 	iterator->node_position += iterator->direction;
 	if (iterator->node_position < 0 || iterator->node_position == iterator->node->size) {
@@ -672,6 +1389,9 @@ int rl_list_pages(struct rlite *db, rl_list *list, short *pages)
 	long number = list->left;
 	int retval = RL_OK;
 	pages[number] = 1;
+	if (list->index_root) {
+		RL_CALL(index_pages, RL_OK, db, list, list->index_root, pages);
+	}
 	while (number != 0) {
 		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &_node, 1);
 		node = _node;
@@ -691,6 +1411,11 @@ int rl_list_delete(struct rlite *db, rl_list *list)
 	void *_node;
 	long number = list->left, new_number;
 	int retval = RL_OK;
+	if (list->index_root) {
+		RL_CALL(index_delete, RL_OK, db, list, list->index_root);
+		list->index_root = 0;
+		list->index_height = 0;
+	}
 	while (number != 0) {
 		RL_CALL(rl_read, RL_FOUND, db, list->type->list_node_type, number, list, &_node, 1);
 		node = _node;
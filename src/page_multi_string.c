@@ -178,46 +178,138 @@ cleanup:
 static int append(struct rlite *db, rl_list *list, long list_page_number, const unsigned char *data, long size)
 {
 	int retval = RL_OK;
-	long *page = NULL;
-	long pos = 0, to_copy;
+	long *page = NULL, *pages = NULL;
+	long i, count = (size + db->page_size - 1) / db->page_size, pos = 0, to_copy;
 	unsigned char *string = NULL;
-	while (pos < size) {
+	if (count == 0) {
+		goto cleanup;
+	}
+	// reserve all the data pages before the list can allocate nodes, so
+	// they are consecutive when there are no free pages to reuse
+	RL_MALLOC(pages, sizeof(long) * count);
+	for (i = 0; i < count; i++) {
+		RL_CALL(rl_alloc_page_number, RL_OK, db, &pages[i]);
+	}
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_header, 0, NULL);
+	for (i = 0; i < count; i++) {
 		RL_MALLOC(page, sizeof(*page));
-		RL_CALL(rl_string_create, RL_OK, db, &string, page);
+		*page = pages[i];
+		string = calloc(db->page_size, sizeof(unsigned char));
+		if (!string) {
+			retval = RL_OUT_OF_MEMORY;
+			goto cleanup;
+		}
 		to_copy = db->page_size;
 		if (pos + to_copy > size) {
 			to_copy = size - pos;
 		}
 		memcpy(string, &data[pos], sizeof(unsigned char) * to_copy);
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_string, *page, string);
 		string = NULL;
 		RL_CALL(rl_list_add_element, RL_OK, db, list, list_page_number, page, -1);
 		page = NULL;
 		pos += to_copy;
 	}
 cleanup:
+	rl_free(pages);
 	rl_free(string);
 	rl_free(page);
 	return retval;
 }
 
+/**
+ * Copies `size` bytes starting at `start` into `data`. Full pages with
+ * consecutive numbers are read together with a single read.
+ */
+static int read_range(struct rlite *db, rl_list *list, long start, long size, unsigned char *data)
+{
+	rl_list_iterator *iterator = NULL;
+	unsigned char *buffer = NULL;
+	long page, pos = 0, pagestart = start % db->page_size, chunk;
+	long runstart = 0, runcount = 0, runpos = 0;
+	void *tmp;
+	int retval;
+
+	// the first element in the list is the length of the array, skip to the second
+	RL_CALL(rl_list_iterator_create_at, RL_OK, db, &iterator, list, 1, start / db->page_size + 1);
+	while (pos < size) {
+		retval = rl_list_iterator_next(iterator, &tmp);
+		if (retval != RL_OK) {
+			iterator = NULL;
+			if (retval == RL_END) {
+				retval = RL_OK;
+				break;
+			}
+			goto cleanup;
+		}
+		page = *(long *)tmp;
+		rl_free(tmp);
+		chunk = db->page_size - pagestart;
+		if (chunk > size - pos) {
+			chunk = size - pos;
+		}
+		if (chunk == db->page_size && runcount > 0 && runstart + runcount == page) {
+			runcount++;
+		}
+		else {
+			if (runcount > 0) {
+				RL_CALL(rl_read_pages, RL_OK, db, &rl_data_type_string, runstart, runcount, &data[runpos]);
+				runcount = 0;
+			}
+			if (chunk == db->page_size) {
+				runstart = page;
+				runcount = 1;
+				runpos = pos;
+			}
+			else {
+				if (!buffer) {
+					RL_MALLOC(buffer, sizeof(unsigned char) * db->page_size);
+				}
+				RL_CALL(rl_read_pages, RL_OK, db, &rl_data_type_string, page, 1, buffer);
+				memcpy(&data[pos], &buffer[pagestart], sizeof(unsigned char) * chunk);
+			}
+		}
+		pos += chunk;
+		pagestart = 0;
+	}
+	if (runcount > 0) {
+		RL_CALL(rl_read_pages, RL_OK, db, &rl_data_type_string, runstart, runcount, &data[runpos]);
+	}
+	retval = RL_OK;
+cleanup:
+	if (iterator) {
+		rl_list_iterator_destroy(db, iterator);
+	}
+	rl_free(buffer);
+	return retval;
+}
+
+/**
+ * The length is updated in place in the list, and only the last page is
+ * rewritten before adding new pages, so small appends cost one list node
+ * write and one page write.
+ */
 int rl_multi_string_append(struct rlite *db, long number, const unsigned char *data, long datasize, long *newlength)
 {
 	rl_list *list = NULL;
 	unsigned char *tmp_data;
 	void *tmp;
 	int retval;
-	long size, cpsize;
+	long size, cpsize, *length = NULL;
 	long string_page_number;
 
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &tmp, 0);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &tmp, 1);
 	list = tmp;
 
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, 0);
 	size = *(long *)tmp;
-	RL_MALLOC(tmp, sizeof(long));
-	*(long *)tmp = size + datasize;
-	RL_CALL(rl_list_add_element, RL_OK, db, list, number, tmp, 0);
-	RL_CALL(rl_list_remove_element, RL_OK, db, list, number, 1);
+	RL_MALLOC(length, sizeof(long));
+	*length = size + datasize;
+	retval = rl_list_set_element(db, list, number, length, 0);
+	length = NULL;
+	if (retval != RL_OK) {
+		goto cleanup;
+	}
 	if (newlength) {
 		*newlength = size + datasize;
 	}
@@ -244,6 +336,7 @@ int rl_multi_string_append(struct rlite *db, long number, const unsigned char *d
 
 	retval = RL_OK;
 cleanup:
+	rl_free(length);
 	return retval;
 }
 
@@ -256,8 +349,6 @@ int rl_multi_string_cpyrange(struct rlite *db, long number, unsigned char *data,
 	int retval;
 	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &_list, 0);
 	list = _list;
-	unsigned char *tmp_data;
-	long i, pos = 0, pagesize, pagestart;
 	long size;
 
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, 0);
@@ -282,21 +373,7 @@ int rl_multi_string_cpyrange(struct rlite *db, long number, unsigned char *data,
 		*_size = size;
 	}
 
-	i = start / db->page_size;
-	pagestart = start % db->page_size;
-	// pos = i * db->page_size + pagestart;
-	// the first element in the list is the length of the array, skip to the second
-	for (i++; i < list->size; i++) {
-		RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, i);
-		RL_CALL(rl_string_get, RL_OK, db, &tmp_data, *(long *)tmp);
-		pagesize = db->page_size - pagestart;
-		if (pos + pagesize > size) {
-			pagesize = size - pos;
-		}
-		memcpy(&data[pos], &tmp_data[pagestart], sizeof(unsigned char) * pagesize);
-		pos += pagesize;
-		pagestart = 0;
-	}
+	RL_CALL(read_range, RL_OK, db, list, start, size, data);
 	retval = RL_OK;
 cleanup:
 	if (list) {
@@ -318,8 +395,6 @@ int rl_multi_string_getrange(struct rlite *db, long number, unsigned char **_dat
 	int retval;
 	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &_list, 0);
 	list = _list;
-	unsigned char *tmp_data;
-	long i, pos = 0, pagesize, pagestart;
 
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, 0);
 	totalsize = *(long *)tmp;
@@ -348,33 +423,124 @@ int rl_multi_string_getrange(struct rlite *db, long number, unsigned char **_dat
 
 	RL_MALLOC(data, sizeof(unsigned char) * (*size + 1));
 
-	i = start / db->page_size;
+	RL_CALL(read_range, RL_OK, db, list, start, *size, data);
+	data[*size] = 0;
+	*_data = data;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		rl_free(data);
+	}
+	if (list) {
+		rl_list_nocache_destroy(db, list);
+	}
+	if (node) {
+		rl_list_node_nocache_destroy(db, node);
+	}
+	return retval;
+}
+
+int rl_multi_string_foreach_range(struct rlite *db, long number, long start, long stop, rl_multi_string_range_callback callback, void *context)
+{
+	long totalsize, size, pos = 0, pagesize, pagestart;
+	rl_list *list = NULL;
+	rl_list_iterator *iterator = NULL;
+	void *tmp;
+	unsigned char *data = NULL;
+	int retval;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &tmp, 0);
+	list = tmp;
+
+	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, 0);
+	totalsize = *(long *)tmp;
+	if (totalsize == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	rl_normalize_string_range(totalsize, &start, &stop);
+	if (stop < start) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	size = stop - start + 1;
 	pagestart = start % db->page_size;
-	// pos = i * db->page_size + pagestart;
+
 	// the first element in the list is the length of the array, skip to the second
-	for (i++; i < list->size; i++) {
-		RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, i);
-		RL_CALL(rl_string_get, RL_OK, db, &tmp_data, *(long *)tmp);
+	RL_CALL(rl_list_iterator_create_at, RL_OK, db, &iterator, list, 1, start / db->page_size + 1);
+	while (pos < size) {
+		retval = rl_list_iterator_next(iterator, &tmp);
+		if (retval != RL_OK) {
+			iterator = NULL;
+			if (retval == RL_END) {
+				retval = RL_OK;
+			}
+			goto cleanup;
+		}
+		retval = rl_read(db, &rl_data_type_string, *(long *)tmp, NULL, (void **)&data, 0);
+		rl_free(tmp);
+		if (retval != RL_FOUND) {
+			goto cleanup;
+		}
 		pagesize = db->page_size - pagestart;
-		if (pos + pagesize > *size) {
-			pagesize = *size - pos;
+		if (pos + pagesize > size) {
+			pagesize = size - pos;
+		}
+		retval = callback(context, start + pos, &data[pagestart], pagesize);
+		rl_free(data);
+		data = NULL;
+		if (retval != RL_OK) {
+			if (retval == RL_END) {
+				retval = RL_OK;
+			}
+			goto cleanup;
 		}
-		memcpy(&data[pos], &tmp_data[pagestart], sizeof(unsigned char) * pagesize);
 		pos += pagesize;
 		pagestart = 0;
 	}
-	data[*size] = 0;
-	*_data = data;
 	retval = RL_OK;
 cleanup:
-	if (retval != RL_OK) {
-		rl_free(data);
+	if (iterator) {
+		rl_list_iterator_destroy(db, iterator);
 	}
 	if (list) {
 		rl_list_nocache_destroy(db, list);
 	}
-	if (node) {
-		rl_list_node_nocache_destroy(db, node);
+	return retval;
+}
+
+int rl_multi_string_setbit(struct rlite *db, long number, long bitoffset, int on, int *previousvalue)
+{
+	long size, byte = bitoffset >> 3, page;
+	int bit = 7 - (bitoffset & 0x7), previous;
+	rl_list *list = NULL;
+	void *tmp;
+	unsigned char *data;
+	int retval;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &tmp, 0);
+	list = tmp;
+
+	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, 0);
+	size = *(long *)tmp;
+	if (byte >= size) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	RL_CALL(rl_list_get_element, RL_FOUND, db, list, &tmp, byte / db->page_size + 1);
+	page = *(long *)tmp;
+	RL_CALL(rl_string_get, RL_OK, db, &data, page);
+	byte %= db->page_size;
+	previous = (data[byte] >> bit) & 0x1;
+	if (previous != (on & 0x1)) {
+		data[byte] ^= 1 << bit;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_string, page, data);
+	}
+	if (previousvalue) {
+		*previousvalue = previous;
+	}
+	retval = RL_OK;
+cleanup:
+	if (list) {
+		rl_list_nocache_destroy(db, list);
 	}
 	return retval;
 }
@@ -405,6 +571,45 @@ int rl_multi_string_set(struct rlite *db, long *number, const unsigned char *dat
 cleanup:
 	return retval;
 }
+int rl_multi_string_set_stream(struct rlite *db, long *number, rl_multi_string_fill_callback callback, void *context)
+{
+	int retval, done = 0;
+	long size = 0, filled, written;
+	unsigned char *buffer = NULL;
+	rl_list *list;
+	void *tmp;
+	RL_CALL(rl_multi_string_set, RL_OK, db, number, NULL, 0);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, *number, &rl_list_type_long, &tmp, 1);
+	list = tmp;
+	RL_MALLOC(buffer, sizeof(unsigned char) * db->page_size);
+	while (!done) {
+		filled = 0;
+		while (filled < db->page_size) {
+			written = 0;
+			retval = callback(context, &buffer[filled], db->page_size - filled, &written);
+			if (retval == RL_END) {
+				done = 1;
+				break;
+			}
+			if (retval != RL_OK) {
+				rl_multi_string_delete(db, *number);
+				goto cleanup;
+			}
+			filled += written;
+		}
+		RL_CALL(append, RL_OK, db, list, *number, buffer, filled);
+		size += filled;
+	}
+	RL_MALLOC(tmp, sizeof(long));
+	*(long *)tmp = size;
+	RL_CALL(rl_list_add_element, RL_OK, db, list, *number, tmp, 0);
+	RL_CALL(rl_list_remove_element, RL_OK, db, list, *number, 1);
+	retval = RL_OK;
+cleanup:
+	rl_free(buffer);
+	return retval;
+}
+
 int rl_multi_string_setrange(struct rlite *db, long number, const unsigned char *data, long size, long offset, long *newlength)
 {
 	long oldsize, newsize;
@@ -571,15 +776,19 @@ int rl_multi_string_delete(struct rlite *db, long page)
 	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, page, &rl_list_type_long, &tmp, 1);
 	list = tmp;
 
-	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
+	// free the pages from last to first, freed pages are reused in reverse
+	// order so the next string allocated gets them in ascending order
+	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, -1);
 
-	int first = 1;
+	long remaining = list->size - 1;
 	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		if (first) {
-			first = 0;
-		}
-		else {
-			RL_CALL(rl_delete, RL_OK, db, *(long *)tmp);
+		// the first element in the list is the length, not a page
+		if (remaining-- > 0) {
+			retval = rl_delete(db, *(long *)tmp);
+			if (retval != RL_OK) {
+				rl_free(tmp);
+				goto cleanup;
+			}
 		}
 		rl_free(tmp);
 	}
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rlite/rlite.h"
+#include "rlite/page_zset_packed.h"
+#include "rlite/util.h"
+
+#define ZSET_PACKED_HEADER_SIZE 4
+#define ZSET_PACKED_ENTRY_SIZE 12
+
+static int member_cmp(unsigned char *member1, long member1len, unsigned char *member2, long member2len)
+{
+	long len = member1len < member2len ? member1len : member2len;
+	int cmp = len > 0 ? memcmp(member1, member2, len) : 0;
+	if (cmp == 0) {
+		if (member1len == member2len) {
+			return 0;
+		}
+		return member1len < member2len ? -1 : 1;
+	}
+	return cmp < 0 ? -1 : 1;
+}
+
+static int entry_cmp(rl_zset_packed *packed, long position, double score, unsigned char *member, long memberlen)
+{
+	if (packed->scores[position] < score) {
+		return -1;
+	}
+	if (packed->scores[position] > score) {
+		return 1;
+	}
+	return member_cmp(packed->members[position], packed->memberslen[position], member, memberlen);
+}
+
+static int ensure_alloc(rl_zset_packed *packed, long size)
+{
+	int retval = RL_OK;
+	void *tmp;
+	long alloc = packed->alloc ? packed->alloc : 8;
+	if (size <= packed->alloc) {
+		goto cleanup;
+	}
+	while (alloc < size) {
+		alloc *= 2;
+	}
+	RL_REALLOC(packed->scores, sizeof(double) * alloc);
+	RL_REALLOC(packed->members, sizeof(unsigned char *) * alloc);
+	RL_REALLOC(packed->memberslen, sizeof(long) * alloc);
+	packed->alloc = alloc;
+cleanup:
+	return retval;
+}
+
+int rl_zset_packed_create(rlite *UNUSED(db), rl_zset_packed **_packed)
+{
+	int retval;
+	rl_zset_packed *packed;
+	RL_MALLOC(packed, sizeof(*packed));
+	packed->size = 0;
+	packed->alloc = 0;
+	packed->scores = NULL;
+	packed->members = NULL;
+	packed->memberslen = NULL;
+	*_packed = packed;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_packed_destroy(rlite *UNUSED(db), void *obj)
+{
+	rl_zset_packed *packed = obj;
+	long i;
+	for (i = 0; i < packed->size; i++) {
+		rl_free(packed->members[i]);
+	}
+	rl_free(packed->scores);
+	rl_free(packed->members);
+	rl_free(packed->memberslen);
+	rl_free(packed);
+	return RL_OK;
+}
+
+int rl_zset_packed_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
+{
+	rl_zset_packed *packed = obj;
+	long i, pos = ZSET_PACKED_HEADER_SIZE;
+	put_4bytes(data, packed->size);
+	for (i = 0; i < packed->size; i++) {
+		put_double(&data[pos], packed->scores[i]);
+		put_4bytes(&data[pos + 8], packed->memberslen[i]);
+		memcpy(&data[pos + ZSET_PACKED_ENTRY_SIZE], packed->members[i], packed->memberslen[i]);
+		pos += ZSET_PACKED_ENTRY_SIZE + packed->memberslen[i];
+	}
+	return RL_OK;
+}
+
+int rl_zset_packed_deserialize(rlite *db, void **obj, void *UNUSED(context), unsigned char *data)
+{
+	int retval;
+	rl_zset_packed *packed = NULL;
+	long i, size, pos = ZSET_PACKED_HEADER_SIZE;
+	RL_CALL(rl_zset_packed_create, RL_OK, db, &packed);
+	size = get_4bytes(data);
+	RL_CALL(ensure_alloc, RL_OK, packed, size);
+	for (i = 0; i < size; i++) {
+		packed->scores[i] = get_double(&data[pos]);
+		packed->memberslen[i] = get_4bytes(&data[pos + 8]);
+		RL_MALLOC(packed->members[i], sizeof(unsigned char) * packed->memberslen[i]);
+		memcpy(packed->members[i], &data[pos + ZSET_PACKED_ENTRY_SIZE], packed->memberslen[i]);
+		pos += ZSET_PACKED_ENTRY_SIZE + packed->memberslen[i];
+		packed->size++;
+	}
+	*obj = packed;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && packed) {
+		rl_zset_packed_destroy(db, packed);
+	}
+	return retval;
+}
+
+long rl_zset_packed_serialized_size(rl_zset_packed *packed)
+{
+	long i, size = ZSET_PACKED_HEADER_SIZE;
+	for (i = 0; i < packed->size; i++) {
+		size += ZSET_PACKED_ENTRY_SIZE + packed->memberslen[i];
+	}
+	return size;
+}
+
+int rl_zset_packed_find(rl_zset_packed *packed, unsigned char *member, long memberlen, long *position)
+{
+	long i;
+	for (i = 0; i < packed->size; i++) {
+		if (member_cmp(packed->members[i], packed->memberslen[i], member, memberlen) == 0) {
+			if (position) {
+				*position = i;
+			}
+			return RL_FOUND;
+		}
+	}
+	return RL_NOT_FOUND;
+}
+
+/**
+ * Number of entries sorted before (score, member)
+ */
+long rl_zset_packed_rank(rl_zset_packed *packed, double score, unsigned char *member, long memberlen)
+{
+	long low = 0, high = packed->size, mid;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (entry_cmp(packed, mid, score, member, memberlen) < 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/**
+ * Number of entries with a score lower than `score`, or lower or equal
+ * when `inclusive` is set.
+ */
+long rl_zset_packed_count_before_score(rl_zset_packed *packed, double score, int inclusive)
+{
+	long low = 0, high = packed->size, mid;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (packed->scores[mid] < score || (inclusive && packed->scores[mid] == score)) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/**
+ * Same as rl_zset_packed_count_before_score, comparing members instead.
+ * Only meaningful when all the elements have the same score.
+ */
+long rl_zset_packed_count_before_member(rl_zset_packed *packed, unsigned char *member, long memberlen, int inclusive)
+{
+	long low = 0, high = packed->size, mid;
+	int cmp;
+	while (low < high) {
+		mid = (low + high) / 2;
+		cmp = member_cmp(packed->members[mid], packed->memberslen[mid], member, memberlen);
+		if (cmp < 0 || (inclusive && cmp == 0)) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+int rl_zset_packed_add(rl_zset_packed *packed, double score, unsigned char *member, long memberlen, long *_position)
+{
+	int retval;
+	unsigned char *copy = NULL;
+	long position = rl_zset_packed_rank(packed, score, member, memberlen);
+	RL_MALLOC(copy, sizeof(unsigned char) * (memberlen > 0 ? memberlen : 1));
+	memcpy(copy, member, memberlen);
+	RL_CALL(ensure_alloc, RL_OK, packed, packed->size + 1);
+	memmove(&packed->scores[position + 1], &packed->scores[position], sizeof(double) * (packed->size - position));
+	memmove(&packed->members[position + 1], &packed->members[position], sizeof(unsigned char *) * (packed->size - position));
+	memmove(&packed->memberslen[position + 1], &packed->memberslen[position], sizeof(long) * (packed->size - position));
+	packed->scores[position] = score;
+	packed->members[position] = copy;
+	packed->memberslen[position] = memberlen;
+	packed->size++;
+	if (_position) {
+		*_position = position;
+	}
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		rl_free(copy);
+	}
+	return retval;
+}
+
+int rl_zset_packed_remove(rl_zset_packed *packed, long position)
+{
+	if (position < 0 || position >= packed->size) {
+		return RL_INVALID_PARAMETERS;
+	}
+	rl_free(packed->members[position]);
+	packed->size--;
+	memmove(&packed->scores[position], &packed->scores[position + 1], sizeof(double) * (packed->size - position));
+	memmove(&packed->members[position], &packed->members[position + 1], sizeof(unsigned char *) * (packed->size - position));
+	memmove(&packed->memberslen[position], &packed->memberslen[position + 1], sizeof(long) * (packed->size - position));
+	return packed->size == 0 ? RL_DELETED : RL_OK;
+}
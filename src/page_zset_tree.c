@@ -0,0 +1,1006 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rlite/rlite.h"
+#include "rlite/page_zset_tree.h"
+#include "rlite/page_multi_string.h"
+#include "rlite/util.h"
+
+#define ZSET_TREE_NODE_HEADER_SIZE 16
+#define ZSET_TREE_LEAF_ENTRY_SIZE 12
+#define ZSET_TREE_INTERNAL_ENTRY_SIZE 20
+
+static int member_cmp(unsigned char *member1, long member1len, unsigned char *member2, long member2len)
+{
+	long len = member1len < member2len ? member1len : member2len;
+	int cmp = len > 0 ? memcmp(member1, member2, len) : 0;
+	if (cmp == 0) {
+		if (member1len == member2len) {
+			return 0;
+		}
+		return member1len < member2len ? -1 : 1;
+	}
+	return cmp < 0 ? -1 : 1;
+}
+
+static long entry_size(rl_zset_tree_node *node, long position)
+{
+	long size = node->leaf ? ZSET_TREE_LEAF_ENTRY_SIZE : ZSET_TREE_INTERNAL_ENTRY_SIZE;
+	return size + (node->member_pages[position] ? 4 : node->memberslen[position]);
+}
+
+static long node_serialized_size(rl_zset_tree_node *node)
+{
+	long i, size = ZSET_TREE_NODE_HEADER_SIZE;
+	for (i = 0; i < node->size; i++) {
+		size += entry_size(node, i);
+	}
+	return size;
+}
+
+static long node_count(rl_zset_tree_node *node)
+{
+	long i, count = 0;
+	if (node->leaf) {
+		return node->size;
+	}
+	for (i = 0; i < node->size; i++) {
+		count += node->counts[i];
+	}
+	return count;
+}
+
+static int ensure_alloc(rl_zset_tree_node *node, long size)
+{
+	int retval = RL_OK;
+	void *tmp;
+	long alloc = node->alloc ? node->alloc : 8;
+	if (size <= node->alloc) {
+		goto cleanup;
+	}
+	while (alloc < size) {
+		alloc *= 2;
+	}
+	RL_REALLOC(node->scores, sizeof(double) * alloc);
+	RL_REALLOC(node->members, sizeof(unsigned char *) * alloc);
+	RL_REALLOC(node->memberslen, sizeof(long) * alloc);
+	RL_REALLOC(node->member_pages, sizeof(long) * alloc);
+	if (!node->leaf) {
+		RL_REALLOC(node->children, sizeof(long) * alloc);
+		RL_REALLOC(node->counts, sizeof(long) * alloc);
+	}
+	node->alloc = alloc;
+cleanup:
+	return retval;
+}
+
+/**
+ * Moves `count` entries from `src` starting at `src_position` into `dst` at
+ * `dst_position`. Members are handed over, not copied.
+ */
+static int move_entries(rl_zset_tree_node *dst, long dst_position, rl_zset_tree_node *src, long src_position, long count)
+{
+	int retval;
+	long tail = dst->size - dst_position;
+	RL_CALL(ensure_alloc, RL_OK, dst, dst->size + count);
+
+#define MOVE_FIELD(field, type)\
+	memmove(&dst->field[dst_position + count], &dst->field[dst_position], sizeof(type) * tail);\
+	memcpy(&dst->field[dst_position], &src->field[src_position], sizeof(type) * count);\
+	memmove(&src->field[src_position], &src->field[src_position + count], sizeof(type) * (src->size - src_position - count));
+
+	MOVE_FIELD(scores, double);
+	MOVE_FIELD(members, unsigned char *);
+	MOVE_FIELD(memberslen, long);
+	MOVE_FIELD(member_pages, long);
+	if (!dst->leaf) {
+		MOVE_FIELD(children, long);
+		MOVE_FIELD(counts, long);
+	}
+#undef MOVE_FIELD
+
+	dst->size += count;
+	src->size -= count;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int node_insert(rl_zset_tree_node *node, long position)
+{
+	int retval;
+	long tail = node->size - position;
+	RL_CALL(ensure_alloc, RL_OK, node, node->size + 1);
+	memmove(&node->scores[position + 1], &node->scores[position], sizeof(double) * tail);
+	memmove(&node->members[position + 1], &node->members[position], sizeof(unsigned char *) * tail);
+	memmove(&node->memberslen[position + 1], &node->memberslen[position], sizeof(long) * tail);
+	memmove(&node->member_pages[position + 1], &node->member_pages[position], sizeof(long) * tail);
+	if (!node->leaf) {
+		memmove(&node->children[position + 1], &node->children[position], sizeof(long) * tail);
+		memmove(&node->counts[position + 1], &node->counts[position], sizeof(long) * tail);
+	}
+	node->members[position] = NULL;
+	node->memberslen[position] = 0;
+	node->member_pages[position] = 0;
+	node->size++;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static void node_remove(rl_zset_tree_node *node, long position)
+{
+	long tail = node->size - position - 1;
+	rl_free(node->members[position]);
+	memmove(&node->scores[position], &node->scores[position + 1], sizeof(double) * tail);
+	memmove(&node->members[position], &node->members[position + 1], sizeof(unsigned char *) * tail);
+	memmove(&node->memberslen[position], &node->memberslen[position + 1], sizeof(long) * tail);
+	memmove(&node->member_pages[position], &node->member_pages[position + 1], sizeof(long) * tail);
+	if (!node->leaf) {
+		memmove(&node->children[position], &node->children[position + 1], sizeof(long) * tail);
+		memmove(&node->counts[position], &node->counts[position + 1], sizeof(long) * tail);
+	}
+	node->size--;
+}
+
+static int set_key(rl_zset_tree_node *node, long position, double score, unsigned char *member, long memberlen, long member_page)
+{
+	int retval = RL_OK;
+	unsigned char *copy = NULL;
+	if (!member_page) {
+		RL_MALLOC(copy, sizeof(unsigned char) * (memberlen > 0 ? memberlen : 1));
+		memcpy(copy, member, memberlen);
+	}
+	rl_free(node->members[position]);
+	node->scores[position] = score;
+	node->members[position] = copy;
+	node->memberslen[position] = memberlen;
+	node->member_pages[position] = member_page;
+cleanup:
+	return retval;
+}
+
+/**
+ * Updates the count and the key `parent` keeps for the child in `position`
+ */
+static int set_child(rl_zset_tree_node *parent, long position, rl_zset_tree_node *child, long child_page)
+{
+	int retval;
+	if (child->size == 0) {
+		fprintf(stderr, "Cannot reference an empty zset tree node\n");
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+	parent->children[position] = child_page;
+	parent->counts[position] = node_count(child);
+	RL_CALL(set_key, RL_OK, parent, position, child->scores[0], child->members[0], child->memberslen[0], child->member_pages[0]);
+cleanup:
+	return retval;
+}
+
+static int insert_child(rl_zset_tree_node *parent, long position, rl_zset_tree_node *child, long child_page)
+{
+	int retval;
+	RL_CALL(node_insert, RL_OK, parent, position);
+	RL_CALL(set_child, RL_OK, parent, position, child, child_page);
+cleanup:
+	return retval;
+}
+
+static int get_member(rlite *db, rl_zset_tree_node *node, long position, unsigned char **member, long *memberlen)
+{
+	int retval;
+	if (node->member_pages[position]) {
+		RL_CALL(rl_multi_string_get, RL_OK, db, node->member_pages[position], member, memberlen);
+	}
+	else {
+		RL_MALLOC(*member, sizeof(unsigned char) * (node->memberslen[position] + 1));
+		memcpy(*member, node->members[position], node->memberslen[position]);
+		(*member)[node->memberslen[position]] = 0;
+		*memberlen = node->memberslen[position];
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+/**
+ * Compares the entry in `position` with (score, member). When member is
+ * NULL only the scores are compared.
+ */
+static int key_cmp(rlite *db, rl_zset_tree_node *node, long position, double score, unsigned char *member, long memberlen, int *cmp)
+{
+	unsigned char *stored = NULL;
+	long storedlen;
+	int retval = RL_OK;
+	if (node->scores[position] != score) {
+		*cmp = node->scores[position] < score ? -1 : 1;
+	}
+	else if (!member) {
+		*cmp = 0;
+	}
+	else if (node->member_pages[position]) {
+		RL_CALL(rl_multi_string_get, RL_OK, db, node->member_pages[position], &stored, &storedlen);
+		*cmp = member_cmp(stored, storedlen, member, memberlen);
+	}
+	else {
+		*cmp = member_cmp(node->members[position], node->memberslen[position], member, memberlen);
+	}
+cleanup:
+	rl_free(stored);
+	return retval;
+}
+
+/**
+ * Number of keys in the node that are lower than (score, member), or lower
+ * or equal if `inclusive` is set.
+ */
+static int node_count_before(rlite *db, rl_zset_tree_node *node, double score, unsigned char *member, long memberlen, int inclusive, long *count)
+{
+	long low = 0, high = node->size, mid;
+	int cmp;
+	int retval = RL_OK;
+	while (low < high) {
+		mid = (low + high) / 2;
+		RL_CALL(key_cmp, RL_OK, db, node, mid, score, member, memberlen, &cmp);
+		if (cmp < 0 || (inclusive && cmp == 0)) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	*count = low;
+cleanup:
+	return retval;
+}
+
+/**
+ * Walks from the root to the leaf where (score, member) is or would be,
+ * storing the path in nodes, pages and positions. `before` is set to the
+ * number of elements sorted before it.
+ */
+static int descend(rlite *db, rl_zset_tree *tree, double score, unsigned char *member, long memberlen, int inclusive, rl_zset_tree_node **nodes, long *pages, long *positions, long *before)
+{
+	void *tmp;
+	rl_zset_tree_node *node;
+	long i, j, page = tree->root, count = 0, position;
+	int retval;
+	for (i = 0; i < tree->height; i++) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+		node = tmp;
+		if (nodes) {
+			nodes[i] = node;
+			pages[i] = page;
+		}
+		if (node->leaf) {
+			RL_CALL(node_count_before, RL_OK, db, node, score, member, memberlen, inclusive, &position);
+			count += position;
+		}
+		else {
+			// keys are compared inclusively when looking for a member, to
+			// get into the child that starts with it
+			RL_CALL(node_count_before, RL_OK, db, node, score, member, memberlen, member ? 1 : inclusive, &position);
+			if (position > 0) {
+				position--;
+			}
+			for (j = 0; j < position; j++) {
+				count += node->counts[j];
+			}
+			page = node->children[position];
+		}
+		if (positions) {
+			positions[i] = position;
+		}
+	}
+	if (before) {
+		*before = count;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int descend_rank(rlite *db, rl_zset_tree *tree, long rank, int cache, rl_zset_tree_node **_node, long *_position)
+{
+	void *tmp;
+	rl_zset_tree_node *node;
+	long i, page = tree->root;
+	int retval;
+	if (rank < 0 || rank >= tree->size) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	while (1) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+		node = tmp;
+		if (node->leaf) {
+			break;
+		}
+		for (i = 0; i < node->size - 1 && rank >= node->counts[i]; i++) {
+			rank -= node->counts[i];
+		}
+		page = node->children[i];
+	}
+	if (!cache) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 0);
+		node = tmp;
+	}
+	*_node = node;
+	*_position = rank;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_create(rlite *db, rl_zset_tree **_tree)
+{
+	int retval;
+	rl_zset_tree *tree;
+	rl_zset_tree_node *node;
+	RL_MALLOC(tree, sizeof(*tree));
+	tree->size = 0;
+	tree->height = 1;
+	tree->root = db->next_empty_page;
+	*_tree = tree;
+	RL_CALL(rl_zset_tree_node_create, RL_OK, db, &node, 1);
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, tree->root, node);
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_destroy(rlite *UNUSED(db), void *tree)
+{
+	rl_free(tree);
+	return RL_OK;
+}
+
+int rl_zset_tree_node_create(rlite *UNUSED(db), rl_zset_tree_node **_node, int leaf)
+{
+	int retval;
+	rl_zset_tree_node *node;
+	RL_MALLOC(node, sizeof(*node));
+	node->leaf = leaf;
+	node->size = 0;
+	node->alloc = 0;
+	node->left = 0;
+	node->right = 0;
+	node->scores = NULL;
+	node->members = NULL;
+	node->memberslen = NULL;
+	node->member_pages = NULL;
+	node->children = NULL;
+	node->counts = NULL;
+	*_node = node;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_node_destroy(rlite *UNUSED(db), void *obj)
+{
+	rl_zset_tree_node *node = obj;
+	long i;
+	for (i = 0; i < node->size; i++) {
+		rl_free(node->members[i]);
+	}
+	rl_free(node->scores);
+	rl_free(node->members);
+	rl_free(node->memberslen);
+	rl_free(node->member_pages);
+	rl_free(node->children);
+	rl_free(node->counts);
+	rl_free(node);
+	return RL_OK;
+}
+
+static int split(rlite *db, rl_zset_tree_node *node, long node_page, rl_zset_tree_node **_new_node, long *_new_page)
+{
+	void *tmp;
+	rl_zset_tree_node *new_node = NULL, *neighbor;
+	long position, bytes = ZSET_TREE_NODE_HEADER_SIZE, half = node_serialized_size(node) / 2;
+	long new_page;
+	int retval;
+	for (position = 0; position < node->size - 1; position++) {
+		bytes += entry_size(node, position);
+		if (bytes >= half) {
+			position++;
+			break;
+		}
+	}
+	if (position == 0) {
+		position = 1;
+	}
+
+	RL_CALL(rl_zset_tree_node_create, RL_OK, db, &new_node, node->leaf);
+	RL_CALL(move_entries, RL_OK, new_node, 0, node, position, node->size - position);
+	new_page = db->next_empty_page;
+	if (node->leaf) {
+		new_node->left = node_page;
+		new_node->right = node->right;
+		node->right = new_page;
+	}
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, new_page, new_node);
+	if (node->leaf && new_node->right) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, new_node->right, NULL, &tmp, 1);
+		neighbor = tmp;
+		neighbor->left = new_page;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, new_node->right, neighbor);
+	}
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, node_page, node);
+	*_new_node = new_node;
+	*_new_page = new_page;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_add(rlite *db, rl_zset_tree *tree, long tree_page, double score, unsigned char *member, long memberlen)
+{
+	rl_zset_tree_node **nodes = NULL, *node, *parent, *new_node, *root;
+	long *pages = NULL, *positions = NULL;
+	long i, position, member_page = 0, new_page, root_page;
+	int retval;
+
+	RL_MALLOC(nodes, sizeof(rl_zset_tree_node *) * tree->height);
+	RL_MALLOC(pages, sizeof(long) * tree->height);
+	RL_MALLOC(positions, sizeof(long) * tree->height);
+	RL_CALL(descend, RL_OK, db, tree, score, member, memberlen, 1, nodes, pages, positions, NULL);
+
+	if (memberlen > RL_ZSET_TREE_INLINE_MEMBER) {
+		RL_CALL(rl_multi_string_set, RL_OK, db, &member_page, member, memberlen);
+	}
+	node = nodes[tree->height - 1];
+	position = positions[tree->height - 1];
+	RL_CALL(node_insert, RL_OK, node, position);
+	RL_CALL(set_key, RL_OK, node, position, score, member, memberlen, member_page);
+
+	for (i = tree->height - 1; i >= 0; i--) {
+		node = nodes[i];
+		new_node = NULL;
+		if (node_serialized_size(node) > db->page_size) {
+			RL_CALL(split, RL_OK, db, node, pages[i], &new_node, &new_page);
+		}
+		else {
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, pages[i], node);
+		}
+
+		if (i > 0) {
+			parent = nodes[i - 1];
+			RL_CALL(set_child, RL_OK, parent, positions[i - 1], node, pages[i]);
+			if (new_node) {
+				RL_CALL(insert_child, RL_OK, parent, positions[i - 1] + 1, new_node, new_page);
+			}
+		}
+		else if (new_node) {
+			RL_CALL(rl_zset_tree_node_create, RL_OK, db, &root, 0);
+			RL_CALL(insert_child, RL_OK, root, 0, node, pages[i]);
+			RL_CALL(insert_child, RL_OK, root, 1, new_node, new_page);
+			root_page = db->next_empty_page;
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, root_page, root);
+			tree->root = root_page;
+			tree->height++;
+		}
+	}
+
+	tree->size++;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, tree_page, tree);
+	retval = RL_OK;
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+/**
+ * `node` has too few bytes, merge it with a sibling or move some entries
+ * from the sibling into it.
+ */
+static int rebalance(rlite *db, rl_zset_tree_node *parent, long position, rl_zset_tree_node *node, long node_page)
+{
+	void *tmp;
+	rl_zset_tree_node *left, *right, *neighbor;
+	long left_position, right_position, left_page, right_page;
+	long left_bytes, right_bytes, bytes;
+	int retval;
+	if (position > 0) {
+		left_position = position - 1;
+		right_position = position;
+		left_page = parent->children[left_position];
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, left_page, NULL, &tmp, 1);
+		left = tmp;
+		right_page = node_page;
+		right = node;
+	}
+	else {
+		left_position = position;
+		right_position = position + 1;
+		left_page = node_page;
+		left = node;
+		right_page = parent->children[right_position];
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, right_page, NULL, &tmp, 1);
+		right = tmp;
+	}
+
+	left_bytes = node_serialized_size(left);
+	right_bytes = node_serialized_size(right);
+	if (left_bytes + right_bytes - ZSET_TREE_NODE_HEADER_SIZE <= db->page_size) {
+		RL_CALL(move_entries, RL_OK, left, left->size, right, 0, right->size);
+		if (left->leaf) {
+			left->right = right->right;
+			if (right->right) {
+				RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, right->right, NULL, &tmp, 1);
+				neighbor = tmp;
+				neighbor->left = left_page;
+				RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, left->right, neighbor);
+			}
+		}
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, left_page, left);
+		RL_CALL(rl_delete, RL_OK, db, right_page);
+		node_remove(parent, right_position);
+		RL_CALL(set_child, RL_OK, parent, left_position, left, left_page);
+		goto cleanup;
+	}
+
+	while (left_bytes < right_bytes && right->size > 1) {
+		bytes = entry_size(right, 0);
+		if (left_bytes + bytes >= right_bytes || left_bytes + bytes > db->page_size) {
+			break;
+		}
+		RL_CALL(move_entries, RL_OK, left, left->size, right, 0, 1);
+		left_bytes += bytes;
+		right_bytes -= bytes;
+	}
+	while (right_bytes < left_bytes && left->size > 1) {
+		bytes = entry_size(left, left->size - 1);
+		if (right_bytes + bytes >= left_bytes || right_bytes + bytes > db->page_size) {
+			break;
+		}
+		RL_CALL(move_entries, RL_OK, right, 0, left, left->size - 1, 1);
+		right_bytes += bytes;
+		left_bytes -= bytes;
+	}
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, left_page, left);
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, right_page, right);
+	RL_CALL(set_child, RL_OK, parent, left_position, left, left_page);
+	RL_CALL(set_child, RL_OK, parent, right_position, right, right_page);
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_delete(rlite *db, rl_zset_tree *tree, long tree_page, double score, unsigned char *member, long memberlen)
+{
+	void *tmp;
+	rl_zset_tree_node **nodes = NULL, *node, *parent;
+	long *pages = NULL, *positions = NULL;
+	long i, position, child_page;
+	int retval, cmp;
+
+	RL_MALLOC(nodes, sizeof(rl_zset_tree_node *) * tree->height);
+	RL_MALLOC(pages, sizeof(long) * tree->height);
+	RL_MALLOC(positions, sizeof(long) * tree->height);
+	RL_CALL(descend, RL_OK, db, tree, score, member, memberlen, 0, nodes, pages, positions, NULL);
+
+	node = nodes[tree->height - 1];
+	position = positions[tree->height - 1];
+	if (position >= node->size) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	RL_CALL(key_cmp, RL_OK, db, node, position, score, member, memberlen, &cmp);
+	if (cmp != 0) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	if (node->member_pages[position]) {
+		RL_CALL(rl_multi_string_delete, RL_OK, db, node->member_pages[position]);
+	}
+	node_remove(node, position);
+	tree->size--;
+
+	for (i = tree->height - 1; i >= 0; i--) {
+		node = nodes[i];
+		if (i == 0) {
+			if (node->size == 0) {
+				RL_CALL(rl_delete, RL_OK, db, pages[i]);
+				RL_CALL(rl_delete, RL_OK, db, tree_page);
+				retval = RL_DELETED;
+				goto cleanup;
+			}
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, pages[i], node);
+			// while the root has a single child, the child can take its place
+			while (!node->leaf && node->size == 1) {
+				child_page = node->children[0];
+				RL_CALL(rl_delete, RL_OK, db, tree->root);
+				tree->root = child_page;
+				tree->height--;
+				RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, tree->root, tree, &tmp, 1);
+				node = tmp;
+			}
+			break;
+		}
+
+		parent = nodes[i - 1];
+		if (node->size == 0 && parent->size == 1) {
+			RL_CALL(rl_delete, RL_OK, db, pages[i]);
+			node_remove(parent, positions[i - 1]);
+		}
+		else if (parent->size > 1 && (node->size == 0 || node_serialized_size(node) < db->page_size / 4)) {
+			RL_CALL(rebalance, RL_OK, db, parent, positions[i - 1], node, pages[i]);
+		}
+		else {
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree_node, pages[i], node);
+			RL_CALL(set_child, RL_OK, parent, positions[i - 1], node, pages[i]);
+		}
+	}
+
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, tree_page, tree);
+	retval = RL_OK;
+cleanup:
+	rl_free(nodes);
+	rl_free(pages);
+	rl_free(positions);
+	return retval;
+}
+
+static int delete_node(rlite *db, rl_zset_tree *tree, long page)
+{
+	void *tmp;
+	rl_zset_tree_node *node;
+	long i;
+	int retval;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+	node = tmp;
+	for (i = 0; i < node->size; i++) {
+		if (node->leaf) {
+			if (node->member_pages[i]) {
+				RL_CALL(rl_multi_string_delete, RL_OK, db, node->member_pages[i]);
+			}
+		}
+		else {
+			RL_CALL(delete_node, RL_OK, db, tree, node->children[i]);
+		}
+	}
+	RL_CALL(rl_delete, RL_OK, db, page);
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_delete_all(rlite *db, rl_zset_tree *tree)
+{
+	return delete_node(db, tree, tree->root);
+}
+
+int rl_zset_tree_count_before(rlite *db, rl_zset_tree *tree, double score, unsigned char *member, long memberlen, int inclusive, long *count)
+{
+	return descend(db, tree, score, member, memberlen, inclusive, NULL, NULL, NULL, count);
+}
+
+int rl_zset_tree_get(rlite *db, rl_zset_tree *tree, long rank, double *score, unsigned char **member, long *memberlen)
+{
+	rl_zset_tree_node *node;
+	long position;
+	int retval;
+	RL_CALL(descend_rank, RL_OK, db, tree, rank, 1, &node, &position);
+	if (score) {
+		*score = node->scores[position];
+	}
+	if (member) {
+		RL_CALL(get_member, RL_OK, db, node, position, member, memberlen);
+	}
+	else if (memberlen) {
+		*memberlen = node->memberslen[position];
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_iterator_create(rlite *db, rl_zset_tree *tree, long rank, int direction, long size, rl_zset_tree_iterator **_iterator)
+{
+	rl_zset_tree_iterator *iterator = NULL;
+	int retval;
+	RL_MALLOC(iterator, sizeof(*iterator));
+	iterator->db = db;
+	iterator->node = NULL;
+	iterator->direction = direction > 0 ? 1 : -1;
+	iterator->size = size;
+	// the iterator keeps its own copy of the leaf, the tree may change while iterating
+	RL_CALL(descend_rank, RL_OK, db, tree, rank, 0, &iterator->node, &iterator->position);
+	*_iterator = iterator;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && iterator) {
+		rl_zset_tree_iterator_destroy(iterator);
+	}
+	return retval;
+}
+
+int rl_zset_tree_iterator_next(rl_zset_tree_iterator *iterator, double *score, unsigned char **member, long *memberlen)
+{
+	void *tmp;
+	rl_zset_tree_node *node = iterator->node;
+	long page;
+	int retval;
+	if (iterator->size <= 0) {
+		retval = RL_END;
+		goto cleanup;
+	}
+	if (iterator->position < 0 || iterator->position >= node->size) {
+		page = iterator->direction > 0 ? node->right : node->left;
+		if (!page) {
+			retval = RL_END;
+			goto cleanup;
+		}
+		RL_CALL(rl_read, RL_FOUND, iterator->db, &rl_data_type_zset_tree_node, page, NULL, &tmp, 0);
+		rl_zset_tree_node_destroy(iterator->db, node);
+		node = iterator->node = tmp;
+		iterator->position = iterator->direction > 0 ? 0 : node->size - 1;
+	}
+	if (score) {
+		*score = node->scores[iterator->position];
+	}
+	if (member) {
+		RL_CALL(get_member, RL_OK, iterator->db, node, iterator->position, member, memberlen);
+	}
+	else if (memberlen) {
+		*memberlen = node->memberslen[iterator->position];
+	}
+	iterator->position += iterator->direction;
+	iterator->size--;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		rl_zset_tree_iterator_destroy(iterator);
+	}
+	return retval;
+}
+
+int rl_zset_tree_iterator_destroy(rl_zset_tree_iterator *iterator)
+{
+	if (iterator->node) {
+		rl_zset_tree_node_destroy(iterator->db, iterator->node);
+	}
+	rl_free(iterator);
+	return RL_OK;
+}
+
+static int entries_cmp(rlite *db, rl_zset_tree_node *node1, long position1, rl_zset_tree_node *node2, long position2, int *cmp)
+{
+	unsigned char *member = NULL;
+	long memberlen;
+	int retval;
+	RL_CALL(get_member, RL_OK, db, node2, position2, &member, &memberlen);
+	RL_CALL(key_cmp, RL_OK, db, node1, position1, node2->scores[position2], member, memberlen, cmp);
+cleanup:
+	rl_free(member);
+	return retval;
+}
+
+static int node_is_balanced(rlite *db, rl_zset_tree *tree, long page, long depth, long *count, long *leftmost)
+{
+	void *tmp;
+	rl_zset_tree_node *node, *child;
+	long i, child_count;
+	int retval, cmp;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+	node = tmp;
+	if (node->size == 0 && (page != tree->root || !node->leaf)) {
+		fprintf(stderr, "Empty zset tree node %ld\n", page);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	if (node_serialized_size(node) > db->page_size) {
+		fprintf(stderr, "Zset tree node %ld does not fit in a page\n", page);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	if (node->leaf != (depth == tree->height - 1)) {
+		fprintf(stderr, "Zset tree leaf %ld found at depth %ld, height is %ld\n", page, depth, tree->height);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	for (i = 1; i < node->size; i++) {
+		RL_CALL(entries_cmp, RL_OK, db, node, i - 1, node, i, &cmp);
+		if (cmp >= 0) {
+			fprintf(stderr, "Zset tree node %ld is not sorted at position %ld\n", page, i);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+	}
+	if (node->leaf) {
+		if (*leftmost == 0) {
+			*leftmost = page;
+		}
+		*count = node->size;
+		retval = RL_OK;
+		goto cleanup;
+	}
+	*count = 0;
+	for (i = 0; i < node->size; i++) {
+		RL_CALL(node_is_balanced, RL_OK, db, tree, node->children[i], depth + 1, &child_count, leftmost);
+		if (child_count != node->counts[i]) {
+			fprintf(stderr, "Zset tree node %ld expected child %ld to have %ld elements, got %ld\n", page, i, node->counts[i], child_count);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, node->children[i], tree, &tmp, 1);
+		child = tmp;
+		RL_CALL(entries_cmp, RL_OK, db, node, i, child, 0, &cmp);
+		if (cmp != 0) {
+			fprintf(stderr, "Zset tree node %ld has a wrong key for child %ld\n", page, i);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		*count += child_count;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_is_balanced(rlite *db, rl_zset_tree *tree)
+{
+	void *tmp;
+	rl_zset_tree_node *node, *previous = NULL;
+	long count, leftmost = 0, page, previous_page = 0, leaves_count = 0;
+	int retval, cmp;
+	RL_CALL(node_is_balanced, RL_OK, db, tree, tree->root, 0, &count, &leftmost);
+	if (count != tree->size) {
+		fprintf(stderr, "Zset tree expected %ld elements, got %ld\n", tree->size, count);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+
+	// leaves must be linked in order
+	for (page = leftmost; page; page = node->right) {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+		node = tmp;
+		if (node->left != previous_page) {
+			fprintf(stderr, "Zset tree leaf %ld points to %ld instead of %ld\n", page, node->left, previous_page);
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		if (previous && node->size > 0) {
+			RL_CALL(entries_cmp, RL_OK, db, previous, previous->size - 1, node, 0, &cmp);
+			if (cmp >= 0) {
+				fprintf(stderr, "Zset tree leaf %ld is not sorted with its left sibling\n", page);
+				retval = RL_INVALID_STATE;
+				goto cleanup;
+			}
+		}
+		leaves_count += node->size;
+		previous = node;
+		previous_page = page;
+	}
+	if (leaves_count != tree->size) {
+		fprintf(stderr, "Zset tree leaves have %ld elements, expected %ld\n", leaves_count, tree->size);
+		retval = RL_INVALID_STATE;
+		goto cleanup;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int node_pages(rlite *db, rl_zset_tree *tree, long page, short *pages)
+{
+	void *tmp;
+	rl_zset_tree_node *node;
+	long i;
+	int retval;
+	pages[page] = 1;
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree_node, page, tree, &tmp, 1);
+	node = tmp;
+	for (i = 0; i < node->size; i++) {
+		if (node->leaf) {
+			if (node->member_pages[i]) {
+				pages[node->member_pages[i]] = 1;
+				RL_CALL(rl_multi_string_pages, RL_OK, db, node->member_pages[i], pages);
+			}
+		}
+		else {
+			RL_CALL(node_pages, RL_OK, db, tree, node->children[i], pages);
+		}
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_pages(rlite *db, rl_zset_tree *tree, short *pages)
+{
+	return node_pages(db, tree, tree->root, pages);
+}
+
+int rl_zset_tree_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
+{
+	rl_zset_tree *tree = obj;
+	put_4bytes(data, tree->root);
+	put_4bytes(&data[4], tree->size);
+	put_4bytes(&data[8], tree->height);
+	return RL_OK;
+}
+
+int rl_zset_tree_deserialize(rlite *UNUSED(db), void **obj, void *UNUSED(context), unsigned char *data)
+{
+	rl_zset_tree *tree;
+	int retval;
+	RL_MALLOC(tree, sizeof(*tree));
+	tree->root = get_4bytes(data);
+	tree->size = get_4bytes(&data[4]);
+	tree->height = get_4bytes(&data[8]);
+	*obj = tree;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_tree_node_serialize(rlite *UNUSED(db), void *obj, unsigned char *data)
+{
+	rl_zset_tree_node *node = obj;
+	long i, pos = ZSET_TREE_NODE_HEADER_SIZE;
+	put_4bytes(data, node->leaf);
+	put_4bytes(&data[4], node->size);
+	put_4bytes(&data[8], node->left);
+	put_4bytes(&data[12], node->right);
+	for (i = 0; i < node->size; i++) {
+		if (!node->leaf) {
+			put_4bytes(&data[pos], node->children[i]);
+			put_4bytes(&data[pos + 4], node->counts[i]);
+			pos += 8;
+		}
+		put_double(&data[pos], node->scores[i]);
+		put_4bytes(&data[pos + 8], node->memberslen[i]);
+		pos += 12;
+		if (node->member_pages[i]) {
+			put_4bytes(&data[pos], node->member_pages[i]);
+			pos += 4;
+		}
+		else {
+			memcpy(&data[pos], node->members[i], node->memberslen[i]);
+			pos += node->memberslen[i];
+		}
+	}
+	return RL_OK;
+}
+
+int rl_zset_tree_node_deserialize(rlite *db, void **obj, void *UNUSED(context), unsigned char *data)
+{
+	rl_zset_tree_node *node = NULL;
+	long i, size, memberlen, pos = ZSET_TREE_NODE_HEADER_SIZE;
+	int retval;
+	RL_CALL(rl_zset_tree_node_create, RL_OK, db, &node, get_4bytes(data));
+	size = get_4bytes(&data[4]);
+	node->left = get_4bytes(&data[8]);
+	node->right = get_4bytes(&data[12]);
+	RL_CALL(ensure_alloc, RL_OK, node, size);
+	for (i = 0; i < size; i++) {
+		if (!node->leaf) {
+			node->children[i] = get_4bytes(&data[pos]);
+			node->counts[i] = get_4bytes(&data[pos + 4]);
+			pos += 8;
+		}
+		node->scores[i] = get_double(&data[pos]);
+		memberlen = node->memberslen[i] = get_4bytes(&data[pos + 8]);
+		pos += 12;
+		node->members[i] = NULL;
+		node->member_pages[i] = 0;
+		node->size++;
+		if (memberlen > RL_ZSET_TREE_INLINE_MEMBER) {
+			node->member_pages[i] = get_4bytes(&data[pos]);
+			pos += 4;
+		}
+		else {
+			RL_MALLOC(node->members[i], sizeof(unsigned char) * (memberlen > 0 ? memberlen : 1));
+			memcpy(node->members[i], &data[pos], memberlen);
+			pos += memberlen;
+		}
+	}
+	*obj = node;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && node) {
+		rl_zset_tree_node_destroy(db, node);
+	}
+	return retval;
+}
@@ -442,3 +442,114 @@ cleanup:
 	rl_select_internal(db, RLITE_INTERNAL_DB_NO);
 	return retval;
 }
+
+static char *get_key_signal_filename(rlite *db, const unsigned char *key, long keylen)
+{
+	// database number, a dot and the 40 hex characters of the key digest
+	char suffix[64], *hex = NULL, *filename = NULL;
+	unsigned char digest[20];
+	if (db->driver_type != RL_FILE_DRIVER) {
+		return NULL;
+	}
+	rl_file_driver *driver = db->driver;
+	if (sha1(key, keylen, digest) != RL_OK || sha1_formatter(digest, &hex, NULL) != RL_OK) {
+		return NULL;
+	}
+	snprintf(suffix, sizeof(suffix), ".%d.%s", db->selected_database, hex);
+	filename = rl_get_filename_with_suffix(driver->filename, suffix);
+	rl_free(hex);
+	return filename;
+}
+
+int rl_signal_key(rlite *db, const unsigned char *key, long keylen)
+{
+	char *filename = get_key_signal_filename(db, key, keylen);
+	if (filename) {
+		// the waiters are woken up now and read the key once our exclusive lock is released
+		rl_write_signal(filename, "1", 1);
+		rl_free(filename);
+	}
+	return RL_OK;
+}
+
+static int listen_keys(rlite *db, int keyc, unsigned char **keys, long *keyslen, rl_signal_listener **listener)
+{
+	char **filenames = NULL;
+	int i, retval;
+	RL_MALLOC(filenames, sizeof(char *) * keyc);
+	for (i = 0; i < keyc; i++) {
+		filenames[i] = NULL;
+	}
+	for (i = 0; i < keyc; i++) {
+		filenames[i] = get_key_signal_filename(db, keys[i], keyslen[i]);
+		if (filenames[i] == NULL) {
+			retval = RL_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+	}
+	RL_CALL(rl_listen_signals, RL_OK, listener, keyc, filenames);
+cleanup:
+	if (filenames) {
+		for (i = 0; i < keyc; i++) {
+			rl_free(filenames[i]);
+		}
+		rl_free(filenames);
+	}
+	return retval;
+}
+
+int rl_block_keys(rlite *db, int keyc, unsigned char **keys, long *keyslen, struct timeval *timeout, int (*pop)(rlite *db, int index, void *context), void *context)
+{
+	rl_signal_listener *listener = NULL;
+	unsigned long long now, deadline = 0;
+	struct timeval remaining;
+	int i, retval, expired = 0;
+
+	if (timeout) {
+		deadline = rl_mstime() + timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+		expired = timeout->tv_sec == 0 && timeout->tv_usec == 0;
+	}
+	while (1) {
+		// listening before looking at the keys, a write landing in between
+		// still wakes us up
+		if (db->driver_type == RL_FILE_DRIVER && !expired) {
+			RL_CALL(listen_keys, RL_OK, db, keyc, keys, keyslen, &listener);
+		}
+		for (i = 0; i < keyc; i++) {
+			retval = pop(db, i, context);
+			if (retval != RL_NOT_FOUND) {
+				goto cleanup;
+			}
+		}
+		if (!listener) {
+			// nobody else can write to this database
+			retval = RL_TIMEOUT;
+			goto cleanup;
+		}
+		if (timeout) {
+			now = rl_mstime();
+			if (now >= deadline) {
+				retval = RL_TIMEOUT;
+				goto cleanup;
+			}
+			remaining.tv_sec = (deadline - now) / 1000;
+			remaining.tv_usec = ((deadline - now) % 1000) * 1000;
+		}
+		// release the lock so writers can get in
+		RL_CALL(rl_discard, RL_OK, db);
+		retval = rl_wait_signals(listener, timeout ? &remaining : NULL);
+		rl_close_signals(listener);
+		listener = NULL;
+		if (retval != RL_OK && retval != RL_TIMEOUT) {
+			goto cleanup;
+		}
+		// on timeout the keys are still checked one last time
+		expired = retval == RL_TIMEOUT;
+		RL_CALL(rl_refresh, RL_OK, db);
+	}
+cleanup:
+	if (listener) {
+		rl_close_signals(listener);
+	}
+	return retval;
+}
@@ -327,9 +327,11 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 	unsigned char *strdata = NULL, *strdata2 = NULL, *strdata3 = NULL;
 	long strdatalen = 0, strdata2len, strdata3len;
 	unsigned long j, encoding, numentries, ulvalue;
-	void **tmp = NULL;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, membersc = 0, membersalloc = 0;
+	double *scores = NULL;
 	char f[40];
-	double d;
+	void *tmp;
 
 	RL_CALL(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
 	RL_CALL(read, RL_OK, streamer, &type, 1);
@@ -353,19 +355,29 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 	}
 	else if (type == REDIS_RDB_TYPE_SET) {
 		RL_CALL(read_length_with_encoding, RL_OK, streamer, &length, NULL);
+		if (length > 0) {
+			RL_MALLOC(members, sizeof(unsigned char *) * length);
+			RL_MALLOC(memberslen, sizeof(long) * length);
+		}
 		for (i = 0; i < length; i++) {
-			RL_CALL(read_string, RL_OK, streamer, &strdata, &strdatalen);
-			if (key) {
-				RL_CALL(rl_sadd, RL_OK, db, key, keylen, 1, &strdata, &strdatalen, NULL);
-			}
-			rl_free(strdata);
-			strdata = NULL;
+			RL_CALL(read_string, RL_OK, streamer, &members[i], &memberslen[i]);
+			membersc++;
+		}
+		if (key) {
+			// the whole set is built at once rather than a member at a time
+			RL_CALL(rl_set_store, RL_OK, db, key, keylen, membersc, members, memberslen, NULL);
 		}
 	}
 	else if (type == REDIS_RDB_TYPE_ZSET) {
 		RL_CALL(read_length_with_encoding, RL_OK, streamer, &length, NULL);
+		if (length > 0) {
+			RL_MALLOC(members, sizeof(unsigned char *) * length);
+			RL_MALLOC(memberslen, sizeof(long) * length);
+			RL_MALLOC(scores, sizeof(double) * length);
+		}
 		for (i = 0; i < length; i++) {
-			RL_CALL(read_string, RL_OK, streamer, &strdata, &strdatalen);
+			RL_CALL(read_string, RL_OK, streamer, &members[i], &memberslen[i]);
+			membersc++;
 			RL_CALL(read, RL_OK, streamer, &ucaux, 1);
 			length2 = ucaux;
 			if (length2 > 40 || length2 < 1) {
@@ -374,13 +386,11 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 			}
 			RL_CALL(read, RL_OK, streamer, (unsigned char *)f, length2);
 			f[length2] = 0;
-			d = strtold(f, NULL);
-
-			if (key) {
-				RL_CALL(rl_zadd, RL_OK, db, key, keylen, d, strdata, strdatalen);
-			}
-			rl_free(strdata);
-			strdata = NULL;
+			scores[i] = strtold(f, NULL);
+		}
+		if (key && membersc > 0) {
+			// the members are added in a single batch
+			RL_CALL(rl_zadd_multi, RL_OK, db, key, keylen, 0, membersc, scores, members, memberslen, NULL, NULL);
 		}
 	}
 	else if (type == REDIS_RDB_TYPE_HASH) {
@@ -431,7 +441,10 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 			retval = RL_UNEXPECTED;
 			goto cleanup;
 		}
-		RL_MALLOC(tmp, sizeof(void *));
+		if (numentries > 0) {
+			RL_MALLOC(members, sizeof(unsigned char *) * numentries);
+			RL_MALLOC(memberslen, sizeof(long) * numentries);
+		}
 		for (j = 0; j < numentries; j++) {
 			if (encoding == 8) {
 				RL_CALL(read_unsigned_long, RL_OK, substreamer, &ulvalue);
@@ -441,12 +454,14 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 				RL_CALL(read_unsigned_short, RL_OK, substreamer, &ulvalue);
 			}
 			length2 = snprintf(f, 40, "%lu", ulvalue);
-			tmp[0] = f;
-			if (key) {
-				RL_CALL(rl_sadd, RL_OK, db, key, keylen, 1, (unsigned char **)tmp, &length2, NULL);
-			}
+			RL_MALLOC(members[membersc], sizeof(unsigned char) * length2);
+			memcpy(members[membersc], f, length2);
+			memberslen[membersc++] = length2;
 		}
 		free_string_streamer(substreamer);
+		if (key) {
+			RL_CALL(rl_set_store, RL_OK, db, key, keylen, membersc, members, memberslen, NULL);
+		}
 	}
 	else if (type == REDIS_RDB_TYPE_ZSET_ZIPLIST) {
 		RL_CALL(read_string, RL_OK, streamer, &strdata, &strdatalen);
@@ -467,16 +482,23 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 			}
 			memcpy(f, strdata3, strdata3len);
 			f[strdata3len] = 0;
-			d = strtold(f, NULL);
-			if (key) {
-				RL_CALL(rl_zadd, RL_OK, db, key, keylen, d, strdata2, strdata2len);
+			if (membersc == membersalloc) {
+				membersalloc = membersalloc ? membersalloc * 2 : 16;
+				RL_REALLOC(members, sizeof(unsigned char *) * membersalloc);
+				RL_REALLOC(memberslen, sizeof(long) * membersalloc);
+				RL_REALLOC(scores, sizeof(double) * membersalloc);
 			}
-			rl_free(strdata2);
+			scores[membersc] = strtold(f, NULL);
+			members[membersc] = strdata2;
+			memberslen[membersc++] = strdata2len;
 			strdata2 = NULL;
 			rl_free(strdata3);
 			strdata3 = NULL;
 		}
 		free_string_streamer(substreamer);
+		if (key && membersc > 0) {
+			RL_CALL(rl_zadd_multi, RL_OK, db, key, keylen, 0, membersc, scores, members, memberslen, NULL, NULL);
+		}
 		rl_free(strdata);
 		strdata = NULL;
 	}
@@ -509,7 +531,12 @@ int rl_restore_stream(struct rlite *db, const unsigned char *key, long keylen, u
 	}
 	retval = RL_OK;
 cleanup:
-	rl_free(tmp);
+	for (i = 0; i < membersc; i++) {
+		rl_free(members[i]);
+	}
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(scores);
 	rl_free(strdata);
 	rl_free(strdata2);
 	rl_free(strdata3);
@@ -10,6 +10,8 @@
 #include "rlite/page_string.h"
 #include "rlite/page_skiplist.h"
 #include "rlite/page_multi_string.h"
+#include "rlite/page_zset_packed.h"
+#include "rlite/page_zset_tree.h"
 #include "rlite/type_string.h"
 #include "rlite/type_zset.h"
 #include "rlite/type_hash.h"
@@ -26,7 +28,7 @@
 #define DEFAULT_READ_PAGES_LEN 16
 #define DEFAULT_WRITE_PAGES_LEN 8
 #define DEFAULT_PAGE_SIZE 1024
-#define HEADER_SIZE 200
+#define HEADER_SIZE 256
 
 int rl_header_serialize(struct rlite *db, void *obj, unsigned char *data);
 int rl_has_flag(rlite *db, int flag);
@@ -115,6 +117,24 @@ rl_data_type rl_data_type_list_node_long = {
 	rl_list_node_deserialize_long,
 	rl_list_node_destroy,
 };
+rl_data_type rl_data_type_list_value = {
+	"rl_data_type_list_value",
+	rl_list_serialize,
+	rl_list_deserialize,
+	rl_list_destroy,
+};
+rl_data_type rl_data_type_list_node_value = {
+	"rl_data_type_list_node_value",
+	rl_list_node_serialize_value,
+	rl_list_node_deserialize_value,
+	rl_list_node_destroy,
+};
+rl_data_type rl_data_type_list_index_node = {
+	"rl_data_type_list_index_node",
+	rl_list_index_node_serialize,
+	rl_list_index_node_deserialize,
+	rl_list_index_node_destroy,
+};
 rl_data_type rl_data_type_string = {
 	"rl_data_type_string",
 	rl_string_serialize,
@@ -135,6 +155,24 @@ rl_data_type rl_data_type_skiplist_node = {
 	rl_skiplist_node_deserialize,
 	rl_skiplist_node_destroy,
 };
+rl_data_type rl_data_type_zset_packed = {
+	"rl_data_type_zset_packed",
+	rl_zset_packed_serialize,
+	rl_zset_packed_deserialize,
+	rl_zset_packed_destroy,
+};
+rl_data_type rl_data_type_zset_tree = {
+	"rl_data_type_zset_tree",
+	rl_zset_tree_serialize,
+	rl_zset_tree_deserialize,
+	rl_zset_tree_destroy,
+};
+rl_data_type rl_data_type_zset_tree_node = {
+	"rl_data_type_zset_tree_node",
+	rl_zset_tree_node_serialize,
+	rl_zset_tree_node_deserialize,
+	rl_zset_tree_node_destroy,
+};
 rl_data_type rl_data_type_long = {
 	"rl_data_type_long",
 	rl_long_serialize,
@@ -144,7 +182,9 @@ rl_data_type rl_data_type_long = {
 
 rl_data_type rl_data_type_skiplist_node;
 
-static const unsigned char *identifier = (unsigned char *)"rlite0.0";
+// bumped whenever the page layout changes, files with another identifier are
+// rejected instead of being read with the wrong layout
+static const unsigned char *identifier = (unsigned char *)"rlite0.1";
 
 static int file_driver_fp(rlite *db)
 {
@@ -181,9 +221,22 @@ cleanup:
 	return retval;
 }
 
+/**
+ * Bytes used by a header with `number_of_databases`: the identifier, four
+ * longs, and the root pages of every database, key index and expire index.
+ */
+static long header_size(long number_of_databases)
+{
+	return strlen((char *)identifier) + 16 + 4 * (number_of_databases + RLITE_INTERNAL_DB_COUNT) + 8 * number_of_databases;
+}
+
 int rl_header_serialize(struct rlite *db, void *UNUSED(obj), unsigned char *data)
 {
 	int identifier_len = strlen((char *)identifier);
+	if (header_size(db->number_of_databases) > HEADER_SIZE) {
+		fprintf(stderr, "Too many databases for the header: %d\n", db->number_of_databases);
+		return RL_INVALID_STATE;
+	}
 	memcpy(data, identifier, identifier_len);
 	put_4bytes(&data[identifier_len], db->page_size);
 	put_4bytes(&data[identifier_len + 4], db->next_empty_page);
@@ -196,6 +249,18 @@ int rl_header_serialize(struct rlite *db, void *UNUSED(obj), unsigned char *data
 		}
 		pos += 4;
 	}
+	for (i = 0; i < db->number_of_databases; i++) {
+		if (db->key_indexes[i] != 0) {
+			put_4bytes(&data[pos], db->key_indexes[i]);
+		}
+		pos += 4;
+	}
+	for (i = 0; i < db->number_of_databases; i++) {
+		if (db->expire_indexes[i] != 0) {
+			put_4bytes(&data[pos], db->expire_indexes[i]);
+		}
+		pos += 4;
+	}
 	return RL_OK;
 }
 
@@ -214,6 +279,10 @@ int rl_header_deserialize(struct rlite *db, void **UNUSED(obj), void *UNUSED(con
 	db->number_of_pages = get_4bytes(&data[identifier_len + 8]);
 	db->initial_number_of_databases =
 	db->number_of_databases = get_4bytes(&data[identifier_len + 12]);
+	if (db->number_of_databases < 0 || header_size(db->number_of_databases) > HEADER_SIZE) {
+		fprintf(stderr, "Too many databases for the header: %d\n", db->number_of_databases);
+		return RL_INVALID_STATE;
+	}
 	rl_free(db->databases);
 	rl_free(db->initial_databases);
 	RL_MALLOC(db->databases, sizeof(long) * (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
@@ -225,6 +294,24 @@ int rl_header_deserialize(struct rlite *db, void **UNUSED(obj), void *UNUSED(con
 		db->databases[i] = get_4bytes(&data[pos]);
 		pos += 4;
 	}
+	rl_free(db->key_indexes);
+	rl_free(db->initial_key_indexes);
+	RL_MALLOC(db->key_indexes, sizeof(long) * db->number_of_databases);
+	RL_MALLOC(db->initial_key_indexes, sizeof(long) * db->number_of_databases);
+	for (i = 0; i < db->number_of_databases; i++) {
+		db->initial_key_indexes[i] =
+		db->key_indexes[i] = get_4bytes(&data[pos]);
+		pos += 4;
+	}
+	rl_free(db->expire_indexes);
+	rl_free(db->initial_expire_indexes);
+	RL_MALLOC(db->expire_indexes, sizeof(long) * db->number_of_databases);
+	RL_MALLOC(db->initial_expire_indexes, sizeof(long) * db->number_of_databases);
+	for (i = 0; i < db->number_of_databases; i++) {
+		db->initial_expire_indexes[i] =
+		db->expire_indexes[i] = get_4bytes(&data[pos]);
+		pos += 4;
+	}
 cleanup:
 	return retval;
 }
@@ -257,6 +344,11 @@ int rl_open(const char *filename, rlite **_db, int flags)
 	db->subscriber_id = NULL;
 	db->databases = NULL;
 	db->initial_databases = NULL;
+	db->key_indexes = NULL;
+	db->initial_key_indexes = NULL;
+	db->expire_indexes = NULL;
+	db->initial_expire_indexes = NULL;
+	db->expire_budget = 0;
 	db->selected_database = 0;
 	db->selected_internal = RLITE_INTERNAL_DB_NO;
 	db->page_size = DEFAULT_PAGE_SIZE;
@@ -368,6 +460,10 @@ int rl_close(rlite *db)
 	rl_free(db->write_pages);
 	rl_free(db->databases);
 	rl_free(db->initial_databases);
+	rl_free(db->key_indexes);
+	rl_free(db->initial_key_indexes);
+	rl_free(db->expire_indexes);
+	rl_free(db->initial_expire_indexes);
 	rl_free(db);
 	return RL_OK;
 }
@@ -396,12 +492,28 @@ int rl_create_db(rlite *db)
 	db->selected_internal = RLITE_INTERNAL_DB_NO;
 	db->initial_number_of_databases =
 	db->number_of_databases = 16;
+	rl_free(db->databases);
+	rl_free(db->initial_databases);
 	RL_MALLOC(db->databases, sizeof(long) * (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
 	RL_MALLOC(db->initial_databases, sizeof(long) * (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
 	for (i = 0; i < db->number_of_databases + RLITE_INTERNAL_DB_COUNT; i++) {
 		db->initial_databases[i] =
 		db->databases[i] = 0;
 	}
+	rl_free(db->key_indexes);
+	rl_free(db->initial_key_indexes);
+	rl_free(db->expire_indexes);
+	rl_free(db->initial_expire_indexes);
+	RL_MALLOC(db->key_indexes, sizeof(long) * db->number_of_databases);
+	RL_MALLOC(db->initial_key_indexes, sizeof(long) * db->number_of_databases);
+	RL_MALLOC(db->expire_indexes, sizeof(long) * db->number_of_databases);
+	RL_MALLOC(db->initial_expire_indexes, sizeof(long) * db->number_of_databases);
+	for (i = 0; i < db->number_of_databases; i++) {
+		db->initial_key_indexes[i] =
+		db->key_indexes[i] = 0;
+		db->initial_expire_indexes[i] =
+		db->expire_indexes[i] = 0;
+	}
 cleanup:
 	return retval;
 }
@@ -435,6 +547,58 @@ cleanup:
 	return retval;
 }
 
+/**
+ * Returns RL_NOT_FOUND when the selected database does not have an index of
+ * key names.
+ */
+int rl_get_key_index(rlite *db, rl_zset_tree **index, long *index_page)
+{
+	void *tmp;
+	int retval;
+	if (db->selected_internal != RLITE_INTERNAL_DB_NO || !db->key_indexes[db->selected_database]) {
+		return RL_NOT_FOUND;
+	}
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, db->key_indexes[db->selected_database], NULL, &tmp, 1);
+	*index = tmp;
+	if (index_page) {
+		*index_page = db->key_indexes[db->selected_database];
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+/**
+ * The expire index of a database is a sorted set tree where every key with
+ * an expiration time is a member, its sha1 digest, scored by the time.
+ * Returns RL_NOT_FOUND when no key expires and `create` is false, or when an
+ * internal database is selected.
+ */
+int rl_get_expire_index(rlite *db, rl_zset_tree **index, long *index_page, int create)
+{
+	void *tmp;
+	int retval;
+	if (db->selected_internal != RLITE_INTERNAL_DB_NO) {
+		return RL_NOT_FOUND;
+	}
+	if (!db->expire_indexes[db->selected_database]) {
+		if (!create) {
+			return RL_NOT_FOUND;
+		}
+		RL_CALL(rl_zset_tree_create, RL_OK, db, index);
+		db->expire_indexes[db->selected_database] = db->next_empty_page;
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, db->expire_indexes[db->selected_database], *index);
+	}
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, db->expire_indexes[db->selected_database], NULL, &tmp, 1);
+	*index = tmp;
+	if (index_page) {
+		*index_page = db->expire_indexes[db->selected_database];
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
 int rl_read_header(rlite *db)
 {
 	db->page_size = HEADER_SIZE;
@@ -582,6 +746,76 @@ int rl_read_from_cache(rlite *db, rl_data_type *type, long page_number, void *co
 	return retval;
 }
 
+/**
+ * Reads `count` consecutive pages starting at `page` from the driver, with a
+ * single read, ignoring the cache.
+ */
+static int rl_read_driver(rlite *db, long page, long count, unsigned char *data)
+{
+	int retval = RL_OK;
+	if (db->driver_type == RL_FILE_DRIVER) {
+		rl_file_driver *driver = db->driver;
+		RL_CALL(file_driver_fp, RL_OK, db);
+		fseek(driver->fp, page * db->page_size, SEEK_SET);
+		size_t read = fread(data, sizeof(unsigned char), db->page_size * count, driver->fp);
+		if (read != (size_t)(db->page_size * count)) {
+			if (page > 0) {
+#ifdef RL_DEBUG
+				print_cache(db);
+#endif
+				fprintf(stderr, "Unable to read page %ld on line %d\n", page, __LINE__);
+				perror(NULL);
+			}
+			retval = RL_NOT_FOUND;
+			goto cleanup;
+		}
+	}
+	else if (db->driver_type == RL_MEMORY_DRIVER) {
+		rl_memory_driver *driver = db->driver;
+		if ((page + count) * db->page_size > driver->datalen) {
+			fprintf(stderr, "Unable to read page %ld on line %d\n", page, __LINE__);
+			retval = RL_NOT_FOUND;
+			goto cleanup;
+		}
+		memcpy(data, &driver->data[page * db->page_size], sizeof(unsigned char) * db->page_size * count);
+	}
+	else {
+		fprintf(stderr, "Unexpected driver %d when asking for page %ld\n", db->driver_type, page);
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+cleanup:
+	return retval;
+}
+
+int rl_read_pages(rlite *db, rl_data_type *type, long page, long count, unsigned char *data)
+{
+	long i, run = 0;
+	void *obj;
+	int retval = RL_OK;
+	for (i = 0; i < count; i++) {
+		retval = rl_read_from_cache(db, type, page + i, NULL, &obj);
+		if (retval == RL_NOT_FOUND) {
+			run++;
+			continue;
+		}
+		if (retval != RL_FOUND) {
+			goto cleanup;
+		}
+		if (run > 0) {
+			RL_CALL(rl_read_driver, RL_OK, db, page + i - run, run, &data[(i - run) * db->page_size]);
+			run = 0;
+		}
+		RL_CALL(type->serialize, RL_OK, db, obj, &data[i * db->page_size]);
+	}
+	if (run > 0) {
+		RL_CALL(rl_read_driver, RL_OK, db, page + count - run, run, &data[(count - run) * db->page_size]);
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
 int rl_read(rlite *db, rl_data_type *type, long page, void *context, void **obj, int cache)
 {
 	// fprintf(stderr, "r %ld %s\n", page, type->name);
@@ -615,37 +849,7 @@ int rl_read(rlite *db, rl_data_type *type, long page, void *context, void **obj,
 		return retval;
 	}
 	RL_MALLOC(data, db->page_size * sizeof(unsigned char));
-	if (db->driver_type == RL_FILE_DRIVER) {
-		rl_file_driver *driver = db->driver;
-		RL_CALL(file_driver_fp, RL_OK, db);
-		fseek(driver->fp, page * db->page_size, SEEK_SET);
-		size_t read = fread(data, sizeof(unsigned char), db->page_size, driver->fp);
-		if (read != (size_t)db->page_size) {
-			if (page > 0) {
-#ifdef RL_DEBUG
-				print_cache(db);
-#endif
-				fprintf(stderr, "Unable to read page %ld on line %d\n", page, __LINE__);
-				perror(NULL);
-			}
-			retval = RL_NOT_FOUND;
-			goto cleanup;
-		}
-	}
-	else if (db->driver_type == RL_MEMORY_DRIVER) {
-		rl_memory_driver *driver = db->driver;
-		if ((page + 1) * db->page_size > driver->datalen) {
-			fprintf(stderr, "Unable to read page %ld on line %d\n", page, __LINE__);
-			retval = RL_NOT_FOUND;
-			goto cleanup;
-		}
-		memcpy(data, &driver->data[page * db->page_size], sizeof(unsigned char) * db->page_size);
-	}
-	else {
-		fprintf(stderr, "Unexpected driver %d when asking for page %ld\n", db->driver_type, page);
-		retval = RL_UNEXPECTED;
-		goto cleanup;
-	}
+	RL_CALL(rl_read_driver, RL_OK, db, page, 1, data);
 
 	long pos;
 	retval = rl_search_cache(db, type, page, NULL, &pos, context, db->read_pages, db->read_pages_len);
@@ -905,6 +1109,9 @@ cleanup:
 int rl_commit(struct rlite *db)
 {
 	int retval;
+	if (db->expire_budget > 0 && rl_has_flag(db, RLITE_OPEN_READWRITE)) {
+		RL_CALL(rl_expire_cycle, RL_OK, db, db->expire_budget, NULL);
+	}
 	RL_CALL(rl_write_apply_wal, RL_OK, db);
 	db->initial_next_empty_page = db->next_empty_page;
 	db->initial_number_of_pages = db->number_of_pages;
@@ -912,6 +1119,12 @@ int rl_commit(struct rlite *db)
 	rl_free(db->initial_databases);
 	RL_MALLOC(db->initial_databases, sizeof(long) * (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
 	memcpy(db->initial_databases, db->databases, sizeof(long) * (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
+	rl_free(db->initial_key_indexes);
+	RL_MALLOC(db->initial_key_indexes, sizeof(long) * db->number_of_databases);
+	memcpy(db->initial_key_indexes, db->key_indexes, sizeof(long) * db->number_of_databases);
+	rl_free(db->initial_expire_indexes);
+	RL_MALLOC(db->initial_expire_indexes, sizeof(long) * db->number_of_databases);
+	memcpy(db->initial_expire_indexes, db->expire_indexes, sizeof(long) * db->number_of_databases);
 	rl_discard(db);
 cleanup:
 	return retval;
@@ -968,6 +1181,16 @@ int rl_discard(struct rlite *db)
 	if (db->initial_databases) {
 		memcpy(db->databases, db->initial_databases, sizeof(long) *  (db->number_of_databases + RLITE_INTERNAL_DB_COUNT));
 	}
+	rl_free(db->key_indexes);
+	RL_MALLOC(db->key_indexes, sizeof(long) * db->number_of_databases);
+	if (db->initial_key_indexes) {
+		memcpy(db->key_indexes, db->initial_key_indexes, sizeof(long) * db->number_of_databases);
+	}
+	rl_free(db->expire_indexes);
+	RL_MALLOC(db->expire_indexes, sizeof(long) * db->number_of_databases);
+	if (db->initial_expire_indexes) {
+		memcpy(db->expire_indexes, db->initial_expire_indexes, sizeof(long) * db->number_of_databases);
+	}
 
 	if (db->read_pages_alloc != DEFAULT_READ_PAGES_LEN) {
 		tmp = rl_realloc(db->read_pages, sizeof(rl_page *) * DEFAULT_READ_PAGES_LEN);
@@ -1062,6 +1285,7 @@ int rl_is_balanced(rlite *db)
 	long i, selected_database = db->selected_database;
 	short *pages = NULL;
 	long missing_pages = 0;
+	void *tmp;
 	RL_MALLOC(pages, sizeof(short) * db->number_of_pages);
 
 	for (i = 1; i < db->number_of_pages; i++) {
@@ -1079,6 +1303,24 @@ int rl_is_balanced(rlite *db)
 
 	RL_CALL(rl_select, RL_OK, db, selected_database);
 
+	for (i = 0; i < db->number_of_databases; i++) {
+		if (db->key_indexes[i] == 0) {
+			continue;
+		}
+		pages[db->key_indexes[i]] = 1;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, db->key_indexes[i], NULL, &tmp, 1);
+		RL_CALL(rl_zset_tree_pages, RL_OK, db, tmp, pages);
+	}
+
+	for (i = 0; i < db->number_of_databases; i++) {
+		if (db->expire_indexes[i] == 0) {
+			continue;
+		}
+		pages[db->expire_indexes[i]] = 1;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, db->expire_indexes[i], NULL, &tmp, 1);
+		RL_CALL(rl_zset_tree_pages, RL_OK, db, tmp, pages);
+	}
+
 	long page_number = db->next_empty_page;
 	while (page_number != db->number_of_pages) {
 		pages[page_number] = 1;
@@ -1120,17 +1362,16 @@ int rl_move(struct rlite *db, unsigned char *key, long keylen, int database)
 {
 	int retval;
 	int olddb = db->selected_database;
-	unsigned char type;
-	unsigned long long expires;
-	long value_page;
+	rl_key entry;
 	// this could be more efficient, if we don't delete the value page
-	RL_CALL(rl_key_get, RL_FOUND, db, key, keylen, &type, NULL, &value_page, &expires, NULL);
+	RL_CALL(rl_key_get_entry, RL_FOUND, db, key, keylen, &entry);
 	RL_CALL(rl_select, RL_OK, db, database);
 	RL_CALL(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
 	RL_CALL(rl_select, RL_OK, db, olddb);
 	RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
 	RL_CALL(rl_select, RL_OK, db, database);
-	RL_CALL(rl_key_set, RL_OK, db, key, keylen, type, value_page, expires, 0);
+	entry.version = 0;
+	RL_CALL(rl_key_set_entry, RL_OK, db, key, keylen, &entry);
 	retval = RL_OK;
 cleanup:
 	rl_select(db, olddb);
@@ -1140,9 +1381,7 @@ cleanup:
 int rl_rename(struct rlite *db, const unsigned char *src, long srclen, const unsigned char *target, long targetlen, int overwrite)
 {
 	int retval;
-	unsigned char type;
-	unsigned long long expires;
-	long value_page;
+	rl_key entry;
 	long version = 0;
 	if (overwrite) {
 		RL_CALL2(rl_key_get, RL_FOUND, RL_NOT_FOUND, db, target, targetlen, NULL, NULL, NULL, NULL, &version);
@@ -1155,9 +1394,10 @@ int rl_rename(struct rlite *db, const unsigned char *src, long srclen, const uns
 		RL_CALL(rl_key_get, RL_NOT_FOUND, db, target, targetlen, NULL, NULL, NULL, NULL, NULL);
 	}
 	// this could be more efficient, if we don't delete the value page
-	RL_CALL(rl_key_get, RL_FOUND, db, src, srclen, &type, NULL, &value_page, &expires, NULL);
+	RL_CALL(rl_key_get_entry, RL_FOUND, db, src, srclen, &entry);
 	RL_CALL(rl_key_delete, RL_OK, db, src, srclen);
-	RL_CALL(rl_key_set, RL_OK, db, target, targetlen, type, value_page, expires, version);
+	entry.version = version;
+	RL_CALL(rl_key_set_entry, RL_OK, db, target, targetlen, &entry);
 	retval = RL_OK;
 cleanup:
 	return retval;
@@ -1182,6 +1422,127 @@ cleanup:
 	return retval;
 }
 
+static long pattern_prefix_length(unsigned char *pattern, long patternlen)
+{
+	long i;
+	for (i = 0; i < patternlen; i++) {
+		if (pattern[i] == '*' || pattern[i] == '?' || pattern[i] == '[' || pattern[i] == '\\') {
+			break;
+		}
+	}
+	return i;
+}
+
+static int keycmp(unsigned char *key1, long key1len, unsigned char *key2, long key2len)
+{
+	int cmp = memcmp(key1, key2, key1len < key2len ? key1len : key2len);
+	if (cmp == 0) {
+		return key1len == key2len ? 0 : (key1len < key2len ? -1 : 1);
+	}
+	return cmp;
+}
+
+// key index cursors have the top bit set, rl_btree_scan never sets it
+#define KEY_INDEX_CURSOR (1ULL << 63)
+
+/**
+ * The cursor resuming a key index scan at a name, made of the top 63 bits of
+ * the 8 bytes following the first `prefixlen`.
+ */
+static unsigned long long key_index_cursor(unsigned char *name, long namelen, long prefixlen)
+{
+	unsigned long long cursor = 0;
+	long i;
+	for (i = prefixlen; i < prefixlen + 8; i++) {
+		cursor = (cursor << 8) | (i < namelen ? name[i] : 0);
+	}
+	return KEY_INDEX_CURSOR | (cursor >> 1);
+}
+
+/**
+ * Visits the key index from the first name not lower than `start`, until a
+ * name is greater than `end` or, when `prefixlen` is positive, it no longer
+ * starts with the first `prefixlen` bytes of `start`.
+ * When `count` is positive the visit stops at the first name after `count`
+ * whose key_index_cursor differs from the previous one, and `next` is set to
+ * that cursor. Names sharing a cursor are never split, so resuming from it
+ * repeats none of them. `next` is zero when the range is exhausted.
+ */
+static int key_index_range(rlite *db, rl_zset_tree *index, unsigned char *start, long startlen, unsigned char *end, long endlen, long prefixlen, unsigned char *pattern, long patternlen, long count, unsigned long long *next, long *_len, unsigned char ***_result, long **_resultlen)
+{
+	int retval;
+	rl_zset_tree_iterator *iterator = NULL;
+	long rank, alloc = 16, len = 0, i, keystrlen, visited = 0;
+	unsigned char **result = NULL, *keystr = NULL;
+	long *resultlen = NULL;
+	unsigned long long cursor, last = 0;
+	void *tmp;
+	if (next) {
+		*next = 0;
+	}
+	RL_MALLOC(result, sizeof(unsigned char *) * alloc);
+	RL_MALLOC(resultlen, sizeof(long) * alloc);
+	RL_CALL(rl_zset_tree_count_before, RL_OK, db, index, 0, start, startlen, 0, &rank);
+	if (rank < index->size) {
+		RL_CALL(rl_zset_tree_iterator_create, RL_OK, db, index, rank, 1, index->size - rank, &iterator);
+	}
+	while (iterator && (retval = rl_zset_tree_iterator_next(iterator, NULL, &keystr, &keystrlen)) == RL_OK) {
+		if ((end && keycmp(keystr, keystrlen, end, endlen) > 0) ||
+				(prefixlen > 0 && (keystrlen < prefixlen || memcmp(keystr, start, prefixlen) != 0))) {
+			break;
+		}
+		if (count > 0) {
+			cursor = key_index_cursor(keystr, keystrlen, prefixlen);
+			if (visited >= count && cursor != last) {
+				if (next) {
+					*next = cursor;
+				}
+				break;
+			}
+			last = cursor;
+		}
+		visited++;
+		if (!pattern || rl_stringmatchlen((char *)pattern, patternlen, (char *)keystr, keystrlen, 0)) {
+			if (len == alloc) {
+				RL_REALLOC(result, sizeof(unsigned char *) * alloc * 2);
+				RL_REALLOC(resultlen, sizeof(long) * alloc * 2);
+				alloc *= 2;
+			}
+			result[len] = keystr;
+			resultlen[len] = keystrlen;
+			len++;
+		}
+		else {
+			rl_free(keystr);
+		}
+		keystr = NULL;
+	}
+	if (iterator && retval != RL_OK) {
+		// the iterator releases itself when it is done
+		iterator = NULL;
+		if (retval != RL_END) {
+			goto cleanup;
+		}
+	}
+	*_len = len;
+	*_result = result;
+	*_resultlen = resultlen;
+	retval = RL_OK;
+cleanup:
+	rl_free(keystr);
+	if (iterator) {
+		rl_zset_tree_iterator_destroy(iterator);
+	}
+	if (retval != RL_OK) {
+		for (i = 0; i < len; i++) {
+			rl_free(result[i]);
+		}
+		rl_free(result);
+		rl_free(resultlen);
+	}
+	return retval;
+}
+
 int rl_keys(struct rlite *db, unsigned char *pattern, long patternlen, long *_len, unsigned char ***_result, long **_resultlen)
 {
 	int retval;
@@ -1192,6 +1553,16 @@ int rl_keys(struct rlite *db, unsigned char *pattern, long patternlen, long *_le
 	long alloc, len;
 	unsigned char **result = NULL, *keystr;
 	long *resultlen = NULL, keystrlen;
+	long prefixlen = pattern_prefix_length(pattern, patternlen);
+	rl_zset_tree *index;
+	if (prefixlen > 0) {
+		// a literal prefix is a range of the key index
+		RL_CALL2(rl_get_key_index, RL_OK, RL_NOT_FOUND, db, &index, NULL);
+		if (retval == RL_OK) {
+			RL_CALL(key_index_range, RL_OK, db, index, pattern, prefixlen, NULL, 0, prefixlen, pattern, patternlen, 0, NULL, _len, _result, _resultlen);
+			goto cleanup;
+		}
+	}
 	retval = rl_get_key_btree(db, &btree, 0);
 	if (retval == RL_NOT_FOUND) {
 		*_len = 0;
@@ -1248,6 +1619,250 @@ cleanup:
 	return retval;
 }
 
+int rl_scan(struct rlite *db, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned char type, unsigned long long *next_cursor, long *_len, unsigned char ***_result, long **_resultlen)
+{
+	int retval;
+	rl_btree *btree;
+	rl_key *key;
+	void **keys = NULL;
+	long i, keyc = 0, len = 0;
+	unsigned char **result = NULL, *keystr, *start = NULL;
+	long *resultlen = NULL, keystrlen, startlen;
+	unsigned long long now = rl_mstime(), next;
+	unsigned char *types = NULL;
+	rl_zset_tree *index;
+	long prefixlen;
+	*next_cursor = 0;
+	*_len = 0;
+	*_result = NULL;
+	*_resultlen = NULL;
+	prefixlen = pattern ? pattern_prefix_length(pattern, patternlen) : 0;
+	if (prefixlen > 0 && (cursor == 0 || (cursor & KEY_INDEX_CURSOR))) {
+		RL_CALL2(rl_get_key_index, RL_OK, RL_NOT_FOUND, db, &index, NULL);
+		if (retval == RL_OK) {
+			// the cursor holds the bytes following the literal prefix in the
+			// next name to visit
+			RL_MALLOC(start, sizeof(unsigned char) * (prefixlen + 8));
+			memcpy(start, pattern, prefixlen);
+			startlen = prefixlen;
+			if (cursor) {
+				cursor <<= 1;
+				for (i = 0; i < 8; i++) {
+					start[startlen++] = (cursor >> (56 - i * 8)) & 0xff;
+				}
+				// trailing zeros may be padding, dropping them only moves the start back
+				while (startlen > prefixlen && start[startlen - 1] == 0) {
+					startlen--;
+				}
+			}
+			RL_CALL(key_index_range, RL_OK, db, index, start, startlen, NULL, 0, prefixlen, pattern, patternlen, count, &next, &len, &result, &resultlen);
+			if (len > 0) {
+				RL_MALLOC(types, sizeof(unsigned char) * len);
+				RL_CALL(rl_key_mget, RL_OK, db, len, result, resultlen, types, NULL);
+			}
+			for (i = 0, keyc = 0; i < len; i++) {
+				if (types[i] == 0 || (type && types[i] != type)) {
+					rl_free(result[i]);
+					continue;
+				}
+				result[keyc] = result[i];
+				resultlen[keyc] = resultlen[i];
+				keyc++;
+			}
+			*next_cursor = next;
+			*_len = keyc;
+			*_result = result;
+			*_resultlen = resultlen;
+			keyc = 0;
+			retval = RL_OK;
+			goto cleanup;
+		}
+	}
+	if (cursor & KEY_INDEX_CURSOR) {
+		// the key index cannot resume it anymore, the btree is scanned from the start
+		cursor = 0;
+	}
+	retval = rl_get_key_btree(db, &btree, 0);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	else if (retval != RL_OK) {
+		goto cleanup;
+	}
+
+	RL_CALL(rl_btree_scan, RL_OK, db, btree, cursor, count, next_cursor, &keyc, &keys);
+	if (keyc == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_MALLOC(result, sizeof(unsigned char *) * keyc);
+	RL_MALLOC(resultlen, sizeof(long) * keyc);
+	for (i = 0; i < keyc; i++) {
+		key = keys[i];
+		if ((type && key->type != type) || (key->expires != 0 && key->expires <= now)) {
+			continue;
+		}
+		RL_CALL(rl_multi_string_get, RL_OK, db, key->string_page, &keystr, &keystrlen);
+		if (!pattern || rl_stringmatchlen((char *)pattern, patternlen, (char *)keystr, keystrlen, 0)) {
+			result[len] = keystr;
+			resultlen[len] = keystrlen;
+			len++;
+		}
+		else {
+			rl_free(keystr);
+		}
+	}
+
+	*_len = len;
+	*_result = result;
+	*_resultlen = resultlen;
+	retval = RL_OK;
+cleanup:
+	for (i = 0; i < keyc; i++) {
+		rl_free(keys[i]);
+	}
+	rl_free(keys);
+	rl_free(types);
+	rl_free(start);
+	if (retval != RL_OK) {
+		for (i = 0; i < len; i++) {
+			rl_free(result[i]);
+		}
+		rl_free(result);
+		rl_free(resultlen);
+	}
+	return retval;
+}
+
+int rl_keys_range(struct rlite *db, unsigned char *start, long startlen, unsigned char *end, long endlen, long *_len, unsigned char ***_result, long **_resultlen)
+{
+	int retval;
+	rl_zset_tree *index;
+	long i, j, len = 0, keystrlen;
+	unsigned char **result = NULL, *keystr;
+	long *resultlen = NULL;
+	*_len = 0;
+	*_result = NULL;
+	*_resultlen = NULL;
+	RL_CALL2(rl_get_key_index, RL_OK, RL_NOT_FOUND, db, &index, NULL);
+	if (retval == RL_OK) {
+		RL_CALL(key_index_range, RL_OK, db, index, start, startlen, end, endlen, 0, NULL, 0, 0, NULL, _len, _result, _resultlen);
+		goto cleanup;
+	}
+
+	// without an index every key name has to be read and sorted
+	RL_CALL(rl_keys, RL_OK, db, (unsigned char *)"*", 1, &len, &result, &resultlen);
+	if (len == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	for (i = 0, j = 0; i < len; i++) {
+		if (keycmp(result[i], resultlen[i], start, startlen) < 0 || keycmp(result[i], resultlen[i], end, endlen) > 0) {
+			rl_free(result[i]);
+			continue;
+		}
+		result[j] = result[i];
+		resultlen[j] = resultlen[i];
+		j++;
+	}
+	len = j;
+	// insertion sort, moving the names along with their lengths
+	for (i = 1; i < len; i++) {
+		keystr = result[i];
+		keystrlen = resultlen[i];
+		for (j = i; j > 0 && keycmp(result[j - 1], resultlen[j - 1], keystr, keystrlen) > 0; j--) {
+			result[j] = result[j - 1];
+			resultlen[j] = resultlen[j - 1];
+		}
+		result[j] = keystr;
+		resultlen[j] = keystrlen;
+	}
+	*_len = len;
+	*_result = result;
+	*_resultlen = resultlen;
+	result = NULL;
+	resultlen = NULL;
+	retval = RL_OK;
+cleanup:
+	if (result) {
+		for (i = 0; i < len; i++) {
+			rl_free(result[i]);
+		}
+	}
+	rl_free(result);
+	rl_free(resultlen);
+	return retval;
+}
+
+int rl_key_index_create(struct rlite *db)
+{
+	int retval;
+	rl_zset_tree *index;
+	rl_btree *btree;
+	rl_btree_iterator *iterator;
+	rl_key *key;
+	long index_page, keystrlen;
+	unsigned char *keystr;
+	void *tmp;
+	if (db->selected_internal != RLITE_INTERNAL_DB_NO) {
+		retval = RL_INVALID_PARAMETERS;
+		goto cleanup;
+	}
+	if (db->key_indexes[db->selected_database]) {
+		retval = RL_FOUND;
+		goto cleanup;
+	}
+	RL_CALL(rl_zset_tree_create, RL_OK, db, &index);
+	index_page = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, index_page, index);
+	db->key_indexes[db->selected_database] = index_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_header, 0, NULL);
+
+	RL_CALL2(rl_get_key_btree, RL_OK, RL_NOT_FOUND, db, &btree, 0);
+	if (retval == RL_NOT_FOUND) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_CALL(rl_btree_iterator_create, RL_OK, db, btree, &iterator);
+	while ((retval = rl_btree_iterator_next(iterator, NULL, &tmp)) == RL_OK) {
+		key = tmp;
+		retval = rl_multi_string_get(db, key->string_page, &keystr, &keystrlen);
+		rl_free(key);
+		if (retval != RL_OK) {
+			rl_btree_iterator_destroy(iterator);
+			goto cleanup;
+		}
+		retval = rl_zset_tree_add(db, index, index_page, 0, keystr, keystrlen);
+		rl_free(keystr);
+		if (retval != RL_OK) {
+			rl_btree_iterator_destroy(iterator);
+			goto cleanup;
+		}
+	}
+	if (retval != RL_END) {
+		goto cleanup;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_key_index_drop(struct rlite *db)
+{
+	int retval;
+	rl_zset_tree *index;
+	long index_page;
+	RL_CALL(rl_get_key_index, RL_OK, db, &index, &index_page);
+	RL_CALL(rl_zset_tree_delete_all, RL_OK, db, index);
+	RL_CALL(rl_delete, RL_OK, db, index_page);
+	db->key_indexes[db->selected_database] = 0;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_header, 0, NULL);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
 int rl_randomkey(struct rlite *db, unsigned char **key, long *keylen)
 {
 	int retval;
@@ -1263,6 +1878,8 @@ cleanup:
 int rl_flushdb(struct rlite *db)
 {
 	int retval;
+	rl_zset_tree *index;
+	long index_page;
 	rl_btree *btree;
 	rl_btree_iterator *iterator = NULL;
 	rl_key *key;
@@ -1287,6 +1904,17 @@ int rl_flushdb(struct rlite *db)
 	RL_CALL(rl_btree_delete, RL_OK, db, btree);
 	RL_CALL(rl_delete, RL_OK, db, db->databases[db->selected_database]);
 	db->databases[db->selected_database] = 0;
+	if (db->selected_database < db->number_of_databases && db->key_indexes[db->selected_database]) {
+		// keep the index, but empty
+		RL_CALL(rl_key_index_drop, RL_OK, db);
+		RL_CALL(rl_key_index_create, RL_OK, db);
+	}
+	if (db->selected_database < db->number_of_databases && db->expire_indexes[db->selected_database]) {
+		RL_CALL(rl_get_expire_index, RL_OK, db, &index, &index_page, 0);
+		RL_CALL(rl_zset_tree_delete_all, RL_OK, db, index);
+		RL_CALL(rl_delete, RL_OK, db, index_page);
+		db->expire_indexes[db->selected_database] = 0;
+	}
 	RL_CALL(rl_write, RL_OK, db, &rl_data_type_header, 0, NULL);
 	retval = RL_OK;
 cleanup:
@@ -31,6 +31,7 @@
  * in the flags field is set when the context is connected. */
 #define RLITE_CONNECTED 0x2
 #define RLITE_LUA_CLIENT (1<<8) /* This is a non connected client used by Lua */
+#define RLITE_MULTI_CLIENT (1<<9) /* Command queued by MULTI and run by EXEC */
 
 /* The async API might try to disconnect cleanly and flush the output
  * buffer and read all subsequent replies before disconnecting.
@@ -82,6 +83,7 @@ extern "C" {
 #endif
 
 struct rliteClient;
+struct rliteStream;
 
 /* This is the reply object returned by rliteCommand() */
 typedef struct rliteReply {
@@ -173,6 +175,40 @@ void *rlitevCommand(rliteContext *c, const char *format, va_list ap);
 void *rliteCommand(rliteContext *c, const char *format, ...);
 void *rliteCommandArgv(rliteContext *c, int argc, char **argv, size_t *argvlen);
 
+/* Streaming access to string values too large to copy into a reply.
+ * These run immediately instead of being queued, so they cannot be used
+ * inside MULTI, and they return the reply instead of adding it to the
+ * context.
+ *
+ * rliteGetStream calls 'callback' with the value one page at a time and
+ * replies with its length, or nil when the key does not exist.
+ *
+ * rliteSetStream sets the key to the bytes 'callback' writes into the
+ * buffer it is given, up to 'size' bytes at a time. The callback sets
+ * '*written' to the number of bytes written, and to 0 once the value is
+ * complete. Replies OK.
+ *
+ * A callback returning anything but RLITE_OK aborts the command with an
+ * error reply, leaving the key untouched. */
+typedef int rliteStreamChunkCallback(void *privdata, const char *data, size_t len);
+typedef int rliteStreamFillCallback(void *privdata, char *buffer, size_t size, size_t *written);
+void *rliteGetStream(rliteContext *c, const char *key, size_t keylen, rliteStreamChunkCallback *callback, void *privdata);
+void *rliteSetStream(rliteContext *c, const char *key, size_t keylen, rliteStreamFillCallback *callback, void *privdata);
+
+/* Runs a command whose reply is an array without building the array.
+ * LRANGE, SMEMBERS, HGETALL, HKEYS, HVALS and the ZRANGE family read each
+ * element straight from the underlying iterator and pass it to 'callback';
+ * other commands build their reply as usual and have its elements passed
+ * one at a time. The element, and any string it holds, is only valid until
+ * the callback returns.
+ *
+ * Replies with the number of elements passed to the callback, or with the
+ * command's own reply when that is not an array (an error, for instance).
+ * Like the other streaming commands it runs immediately and cannot be used
+ * inside MULTI. */
+typedef int rliteStreamElementCallback(void *privdata, const rliteReply *element);
+void *rliteCommandStream(rliteContext *c, int argc, char **argv, size_t *argvlen, rliteStreamElementCallback *callback, void *privdata);
+
 struct rliteCommand *rliteLookupCommand(const char *name, size_t len);
 int rliteCommandHasFlag(struct rliteCommand *cmd, int flag);
 
@@ -194,6 +230,7 @@ typedef struct rliteClient {
 	rliteReply *reply;
 	rliteContext *context;
 	int flags;
+	struct rliteStream *stream; /* Set by rliteCommandStream, NULL otherwise */
 } rliteClient;
 
 typedef void rliteCommandProc(rliteClient *c);
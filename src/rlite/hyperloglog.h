@@ -12,3 +12,10 @@ int rl_str_pfdebug_getreg(unsigned char *str, long strlen, int *size, long **ele
 int rl_str_pfdebug_decode(unsigned char *str, long strlen, unsigned char **response, long *responselen);
 int rl_str_pfdebug_encoding(unsigned char *str, long strlen, unsigned char **response, long *responselen);
 int rl_str_pfdebug_todense(unsigned char *str, long strlen, unsigned char **_str, long *_strlen);
+
+// size of the HLL header, holding the encoding and the cached cardinality
+#define RL_HLL_HDR_SIZE 16
+int rl_str_pfisdense(unsigned char *header, long strlen);
+int rl_str_pfdense_locate(unsigned char *ele, long elelen, long *byte, long *regnum);
+int rl_str_pfdense_update(unsigned char *bytes, long regnum, int count);
+void rl_str_pfinvalidate(unsigned char *header);
@@ -25,9 +25,21 @@ int sha1_cmp(void *v1, void *v2);
 int sha1_formatter(void *v, char **str, int *size);
 #endif
 
+// how the value of a string key or a hash field is stored
+#define RL_VALUE_ENCODING_PAGE 0 // in the multi string at value_page
+#define RL_VALUE_ENCODING_INT 1 // in number.integer, value_page is 0
+#define RL_VALUE_ENCODING_DOUBLE 2 // in number.floating, value_page is 0
+
+typedef union rl_number {
+	long long integer;
+	double floating;
+} rl_number;
+
 typedef struct rl_hashkey {
 	long string_page;
 	long value_page;
+	unsigned char encoding;
+	rl_number number;
 } rl_hashkey;
 
 typedef struct rl_key {
@@ -36,6 +48,8 @@ typedef struct rl_key {
 	long value_page;
 	unsigned long long expires;
 	long version;
+	unsigned char encoding;
+	rl_number number;
 } rl_key;
 
 extern rl_btree_type rl_btree_type_hash_long_long;
@@ -49,6 +63,8 @@ typedef struct rl_btree_node {
 	// children is null when the node is a leaf
 	// when created, allocs size+1.
 	long *children;
+	// number of elements in the subtree of each child, null for leaves
+	long *counts;
 	void **values;
 	// size is the number of children used; allocs the maximum on creation
 	long size;
@@ -79,22 +95,47 @@ int rl_btree_create_size(struct rlite *db, rl_btree **btree, rl_btree_type *type
 int rl_btree_create(struct rlite *db, rl_btree **btree, rl_btree_type *type);
 int rl_btree_destroy(struct rlite *db, void *btree);
 int rl_btree_node_destroy(struct rlite *db, void *node);
+/**
+ * Adds `score` and `value` to the btree, which owns both afterwards, also
+ * when the call fails (they are freed then).
+ */
 int rl_btree_add_element(struct rlite *db, rl_btree *btree, long btree_page, void *score, void *value);
+/**
+ * Adds `size` elements whose scores are strictly ascending and not in the
+ * btree yet. While consecutive scores fall in the same leaf the path to it is
+ * reused instead of descending from the root again, and an empty btree is
+ * bulk loaded.
+ * The btree owns the elements of `scores` and `values` afterwards, the ones
+ * not added on failure are freed. The arrays still belong to the caller.
+ */
+int rl_btree_add_elements(struct rlite *db, rl_btree *btree, long btree_page, long size, void **scores, void **values);
+/**
+ * Fills an empty btree with `size` elements whose scores are strictly
+ * ascending, writing every node once from the leaves up instead of inserting
+ * one element at a time. Nodes get about `fill_factor` (0, 1] of their
+ * capacity so later insertions do not split them right away, but never less
+ * than half of it.
+ * On success the btree owns the elements of `scores` and `values`, the arrays
+ * themselves still belong to the caller.
+ */
+int rl_btree_bulk_load(struct rlite *db, rl_btree *btree, long btree_page, long size, void **scores, void **values, double fill_factor);
 int rl_btree_update_element(struct rlite *db, rl_btree *btree, void *score, void *value);
 int rl_btree_remove_element(struct rlite *db, rl_btree *btree, long btree_page, void *score);
 int rl_btree_find_score(struct rlite *db, rl_btree *btree, void *score, void **value, rl_btree_node **nodes, long *positions);
 /**
- * rl_btree_random_element
- *
- * notice that all the elements in the tree do not have the same probability,
- * and the order in which they were inserted is relevant. For example,
- * inserting ascendenly will probably results in a lower probability
- * to the elements with a higher score. The odds are approximately evenly
- * distributed in the tree nodes, and even within the node, but not all nodes
- * have the same number of elements.
- *
- * A true random element with even probabilities can be done, but it would
- * be really expensive to generate (O(n) instead of O(log n)).
+ * Looks up `size` scores descending the tree once, every node is read at most
+ * once. `values[i]` is set to the value of `scores[i]`, or to NULL when it is
+ * not in the tree.
+ */
+int rl_btree_find_scores(struct rlite *db, rl_btree *btree, long size, void **scores, void **values);
+/**
+ * Gets the element at position `rank` in the order of the scores, in
+ * O(log n) using the number of elements of every subtree.
+ * Returns RL_NOT_FOUND when `rank` is out of range.
+ */
+int rl_btree_get_element(struct rlite *db, rl_btree *btree, long rank, void **score, void **value);
+/**
+ * Every element has the same probability.
  */
 int rl_btree_random_element(struct rlite *db, rl_btree *btree, void **score, void **value);
 int rl_print_btree(struct rlite *db, rl_btree *btree);
@@ -102,9 +143,22 @@ int rl_btree_is_balanced(struct rlite *db, rl_btree *btree);
 int rl_flatten_btree(struct rlite *db, rl_btree *btree, void *** scores, long *size);
 
 int rl_btree_iterator_create(struct rlite *db, rl_btree *btree, rl_btree_iterator **iterator);
+/**
+ * Creates an iterator starting at the first score not lower than `score`.
+ * Returns RL_NOT_FOUND when there is no such score.
+ */
+int rl_btree_iterator_create_at(struct rlite *db, rl_btree *btree, void *score, rl_btree_iterator **iterator);
 int rl_btree_iterator_next(rl_btree_iterator *iterator, void **score, void **value);
 int rl_btree_iterator_destroy(rl_btree_iterator *iterator);
 
+/**
+ * Returns a copy of the values of at least `count` elements (fewer only when
+ * the end is reached) of a btree keyed by sha1 digests, starting at `cursor`. The cursor is the first 63 bits of
+ * the next digest to visit, or 0 once the whole btree has been visited; its top
+ * bit is never set.
+ */
+int rl_btree_scan(struct rlite *db, rl_btree *btree, unsigned long long cursor, long count, unsigned long long *next_cursor, long *size, void ***values);
+
 int rl_btree_serialize(struct rlite *db, void *obj, unsigned char *data);
 int rl_btree_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
 
@@ -1,6 +1,8 @@
 #ifndef _RL_OBJ_KEY_H
 #define _RL_OBJ_KEY_H
 
+#include "page_btree.h"
+
 struct rlite;
 struct watched_key;
 
@@ -14,12 +16,45 @@ extern rl_type types[];
 
 int rl_key_get_or_create(struct rlite *db, const unsigned char *key, long keylen, unsigned char type, long *page, long *version);
 int rl_key_get(struct rlite *db, const unsigned char *key, long keylen, unsigned char *type, long *string_page, long *value_page, unsigned long long *expires, long *version);
+/**
+ * Copies the whole key entry, including a number stored in place of its value
+ */
+int rl_key_get_entry(struct rlite *db, const unsigned char *key, long keylen, rl_key *entry);
+/**
+ * Looks up many keys at once, `types[i]` is 0 when `keys[i]` does not exist
+ */
+int rl_key_mget(struct rlite *db, long keyc, unsigned char **keys, long *keyslen, unsigned char *types, long *value_pages);
 int rl_check_watched_keys(struct rlite *db, int watched_count, struct watched_key** keys);
 int rl_key_set(struct rlite *db, const unsigned char *key, long keylen, unsigned char type, long page, unsigned long long expires, long version);
+/**
+ * Like rl_key_set, taking the type, value, expiration and version from
+ * `entry`. Its string_page is ignored.
+ */
+int rl_key_set_entry(struct rlite *db, const unsigned char *key, long keylen, rl_key *entry);
+/**
+ * Changes the version of an existing key without rewriting the rest of it
+ */
+int rl_key_set_version(struct rlite *db, const unsigned char *key, long keylen, long version);
+/**
+ * Replaces the value of an existing key in place, keeping its name and
+ * expiration. `value_page` is 0 when a number is stored in the key. The
+ * caller deletes the previous value, if any.
+ */
+int rl_key_set_value(struct rlite *db, const unsigned char *key, long keylen, long value_page, unsigned char encoding, rl_number number, long version);
 int rl_key_delete(struct rlite *db, const unsigned char *key, long keylen);
 int rl_key_expires(struct rlite *db, const unsigned char *key, long keylen, unsigned long long expires);
 int rl_key_delete_value(struct rlite *db, unsigned char identifier, long value_page);
 int rl_key_delete_with_value(struct rlite *db, const unsigned char *key, long keylen);
+/**
+ * Deletes up to `budget` keys whose expiration time has passed, oldest first,
+ * in every database. `expired`, if not NULL, is set to the number of keys
+ * deleted.
+ */
+int rl_expire_cycle(struct rlite *db, long budget, long *expired);
+/**
+ * Runs rl_expire_cycle with `budget` on every commit, 0 disables it.
+ */
+int rl_expire_auto(struct rlite *db, long budget);
 int rl_watch(struct rlite *db, struct watched_key** _watched_key, const unsigned char *key, long keylen);
 
 #endif
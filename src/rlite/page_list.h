@@ -11,14 +11,32 @@ struct rl_list_node;
 typedef struct {
 	struct rl_data_type *list_type;
 	struct rl_data_type *list_node_type;
-	int element_size;
+	int element_size; // smallest serialized size when elements vary in size
 	int (*cmp)(void *v1, void *v2);
+	// set for elements of varying size, NULL otherwise
+	long (*element_serialized_size)(void *element);
+	long (*element_alloc_size)(void *element);
 #ifdef RL_DEBUG
 	int (*formatter)(void *v, char **str, int *size);
 #endif
 } rl_list_type;
 
 extern rl_list_type rl_list_type_long;
+extern rl_list_type rl_list_type_value;
+
+// values up to this length are stored inline in the list node pages,
+// longer values are stored in a multi string page
+#define RL_LIST_INLINE_VALUE 128
+
+/**
+ * Element of rl_list_type_value. When `page` is 0 the value is `data`,
+ * otherwise it is stored in the multi string at `page`.
+ */
+typedef struct {
+	long page;
+	long size;
+	unsigned char data[];
+} rl_list_value;
 
 typedef struct rl_list_node {
 	long size;
@@ -27,12 +45,29 @@ typedef struct rl_list_node {
 	void **elements;
 } rl_list_node;
 
+/**
+ * Counted index over the list nodes, to find the node holding a position
+ * without walking the list. Leaves store a list node page and its number of
+ * elements, internal nodes a child page and the number of elements below it.
+ * Only the nodes between the leftmost and the rightmost one are indexed,
+ * pushing and popping at the ends does not need to update it.
+ */
+typedef struct rl_list_index_node {
+	int leaf;
+	long size;
+	long *pages;
+	long *counts;
+} rl_list_index_node;
+
 typedef struct rl_list {
 	long max_node_size; // maximum number of elements in a node
+	// nodes of lists with elements of varying size are also limited by the page size
 	long size;
 	rl_list_type *type;
 	long left;
 	long right;
+	long index_root; // 0 when there are no more than two nodes
+	long index_height;
 } rl_list;
 
 typedef struct rl_list_iterator {
@@ -50,7 +85,9 @@ int rl_list_get_element(struct rlite *db, rl_list *list, void **element, long po
 int rl_list_add_element(struct rlite *db, rl_list *list, long list_page, void *element, long position);
 int rl_list_remove_element(struct rlite *db, rl_list *list, long list_page, long position);
 int rl_list_find_element(struct rlite *db, rl_list *list, void *element, void **found_element, long *position, rl_list_node **found_node, long *found_node_page);
+int rl_list_set_element(struct rlite *db, rl_list *list, long list_page, void *element, long position);
 int rl_list_iterator_create(struct rlite *db, rl_list_iterator **iterator, rl_list *list, int direction);
+int rl_list_iterator_create_at(struct rlite *db, rl_list_iterator **iterator, rl_list *list, int direction, long position);
 int rl_list_iterator_destroy(struct rlite *db, rl_list_iterator *iterator);
 int rl_list_iterator_next(rl_list_iterator *iterator, void **element);
 int rl_print_list(struct rlite *db, rl_list *list);
@@ -62,6 +99,12 @@ int rl_list_deserialize(struct rlite *db, void **obj, void *context, unsigned ch
 
 int rl_list_node_serialize_long(struct rlite *db, void *obj, unsigned char *data);
 int rl_list_node_deserialize_long(struct rlite *db, void **obj, void *context, unsigned char *data);
+int rl_list_node_serialize_value(struct rlite *db, void *obj, unsigned char *data);
+int rl_list_node_deserialize_value(struct rlite *db, void **obj, void *context, unsigned char *data);
+
+int rl_list_index_node_serialize(struct rlite *db, void *obj, unsigned char *data);
+int rl_list_index_node_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
+int rl_list_index_node_destroy(struct rlite *db, void *node);
 
 int rl_list_pages(struct rlite *db, rl_list *list, short *pages);
 int rl_list_delete(struct rlite *db, rl_list *list);
@@ -3,13 +3,37 @@
 
 struct rlite;
 
+typedef int (*rl_multi_string_range_callback)(void *context, long offset, unsigned char *data, long size);
+typedef int (*rl_multi_string_fill_callback)(void *context, unsigned char *data, long size, long *written);
+
 int rl_normalize_string_range(long totalsize, long *start, long *stop);
 int rl_multi_string_cmp(struct rlite *db, long p1, long p2, int *cmp);
 int rl_multi_string_cmp_str(struct rlite *db, long p1, unsigned char *str, long len, int *cmp);
 int rl_multi_string_getrange(struct rlite *db, long number, unsigned char **_data, long *size, long start, long stop);
 int rl_multi_string_get(struct rlite *db, long number, unsigned char **data, long *size);
+/**
+ * Calls `callback` with the bytes in [start, stop] one page at a time,
+ * `offset` being the position of `data` in the string. Pages are read
+ * without caching them, so scanning a large string does not grow the page
+ * cache. A callback returning RL_END stops the scan early, any other value
+ * but RL_OK is returned as an error.
+ */
+int rl_multi_string_foreach_range(struct rlite *db, long number, long start, long stop, rl_multi_string_range_callback callback, void *context);
+/**
+ * Sets or clears one bit, rewriting only the page that holds it.
+ * Returns RL_NOT_FOUND when the bit is past the end of the string.
+ */
+int rl_multi_string_setbit(struct rlite *db, long number, long bitoffset, int on, int *previousvalue);
 int rl_multi_string_setrange(struct rlite *db, long number, const unsigned char *data, long size, long offset, long *newlength);
 int rl_multi_string_set(struct rlite *db, long *number, const unsigned char *data, long size);
+/**
+ * Creates a string from the bytes produced by `callback`, which is given a
+ * buffer of up to `size` bytes to fill and sets `written` to the number of
+ * bytes it wrote, until it returns RL_END. Only one page is buffered at a
+ * time. Any other value but RL_OK is returned as an error, after deleting
+ * the pages written so far.
+ */
+int rl_multi_string_set_stream(struct rlite *db, long *number, rl_multi_string_fill_callback callback, void *context);
 int rl_multi_string_append(struct rlite *db, long number, const unsigned char *data, long datasize, long *newlength);
 int rl_multi_string_sha1(struct rlite *db, unsigned char data[20], long number);
 int rl_multi_string_pages(struct rlite *db, long page, short *pages);
@@ -0,0 +1,33 @@
+#ifndef _RL_PAGE_ZSET_PACKED_H
+#define _RL_PAGE_ZSET_PACKED_H
+
+struct rlite;
+
+/**
+ * A packed sorted set keeps every (score, member) pair in a single page,
+ * sorted by score and then by member, the same order used by the skiplist.
+ * Each entry is serialized as score (8 bytes), member length (4 bytes) and
+ * the member itself.
+ */
+typedef struct {
+	long size;
+	long alloc;
+	double *scores;
+	unsigned char **members;
+	long *memberslen;
+} rl_zset_packed;
+
+int rl_zset_packed_create(struct rlite *db, rl_zset_packed **packed);
+int rl_zset_packed_destroy(struct rlite *db, void *packed);
+int rl_zset_packed_serialize(struct rlite *db, void *obj, unsigned char *data);
+int rl_zset_packed_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
+
+long rl_zset_packed_serialized_size(rl_zset_packed *packed);
+int rl_zset_packed_find(rl_zset_packed *packed, unsigned char *member, long memberlen, long *position);
+long rl_zset_packed_rank(rl_zset_packed *packed, double score, unsigned char *member, long memberlen);
+long rl_zset_packed_count_before_score(rl_zset_packed *packed, double score, int inclusive);
+long rl_zset_packed_count_before_member(rl_zset_packed *packed, unsigned char *member, long memberlen, int inclusive);
+int rl_zset_packed_add(rl_zset_packed *packed, double score, unsigned char *member, long memberlen, long *position);
+int rl_zset_packed_remove(rl_zset_packed *packed, long position);
+
+#endif
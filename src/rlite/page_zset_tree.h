@@ -0,0 +1,70 @@
+#ifndef _RL_PAGE_ZSET_TREE_H
+#define _RL_PAGE_ZSET_TREE_H
+
+#include "rlite.h"
+
+// members up to this length are stored inline in the tree nodes,
+// longer members are stored in a multi string page
+#define RL_ZSET_TREE_INLINE_MEMBER 64
+
+struct rlite;
+
+/**
+ * B+tree keyed by (score, member), sorted the same way as a skiplist.
+ * Leaves store many entries per page and are linked to their siblings.
+ * Internal nodes store, for each child, the number of elements in its
+ * subtree and the first key of the subtree, allowing rank lookups in
+ * O(log n).
+ */
+typedef struct rl_zset_tree {
+	long root;
+	long size;
+	long height;
+} rl_zset_tree;
+
+typedef struct {
+	int leaf;
+	long size;
+	long alloc;
+	long left;
+	long right;
+	double *scores;
+	unsigned char **members;
+	long *memberslen;
+	long *member_pages;
+	long *children;
+	long *counts;
+} rl_zset_tree_node;
+
+typedef struct rl_zset_tree_iterator {
+	struct rlite *db;
+	rl_zset_tree_node *node;
+	long position;
+	int direction; // 1 for right, -1 for left
+	long size;
+} rl_zset_tree_iterator;
+
+int rl_zset_tree_create(struct rlite *db, rl_zset_tree **tree);
+int rl_zset_tree_destroy(struct rlite *db, void *tree);
+int rl_zset_tree_node_create(struct rlite *db, rl_zset_tree_node **node, int leaf);
+int rl_zset_tree_node_destroy(struct rlite *db, void *node);
+
+int rl_zset_tree_add(struct rlite *db, rl_zset_tree *tree, long tree_page, double score, unsigned char *member, long memberlen);
+int rl_zset_tree_delete(struct rlite *db, rl_zset_tree *tree, long tree_page, double score, unsigned char *member, long memberlen);
+int rl_zset_tree_delete_all(struct rlite *db, rl_zset_tree *tree);
+int rl_zset_tree_count_before(struct rlite *db, rl_zset_tree *tree, double score, unsigned char *member, long memberlen, int inclusive, long *count);
+int rl_zset_tree_get(struct rlite *db, rl_zset_tree *tree, long rank, double *score, unsigned char **member, long *memberlen);
+
+int rl_zset_tree_iterator_create(struct rlite *db, rl_zset_tree *tree, long rank, int direction, long size, rl_zset_tree_iterator **iterator);
+int rl_zset_tree_iterator_next(rl_zset_tree_iterator *iterator, double *score, unsigned char **member, long *memberlen);
+int rl_zset_tree_iterator_destroy(rl_zset_tree_iterator *iterator);
+
+int rl_zset_tree_is_balanced(struct rlite *db, rl_zset_tree *tree);
+int rl_zset_tree_pages(struct rlite *db, rl_zset_tree *tree, short *pages);
+
+int rl_zset_tree_serialize(struct rlite *db, void *obj, unsigned char *data);
+int rl_zset_tree_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
+int rl_zset_tree_node_serialize(struct rlite *db, void *obj, unsigned char *data);
+int rl_zset_tree_node_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
+
+#endif
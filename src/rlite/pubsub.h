@@ -16,6 +16,21 @@ int rl_poll(rlite *db, int *elementc, unsigned char ***_elements, long **_elemen
 int rl_poll_wait(rlite *db, int *elementc, unsigned char ***_elements, long **_elementslen, struct timeval *timeout);
 int rl_publish(rlite *db, unsigned char *channel, size_t channellen, const char *data, size_t datalen, long *recipients);
 
+/**
+ * Wakes up the clients blocked on `key` in the selected database. Writers call
+ * it when a key gets elements to pop; it does nothing when nobody is waiting.
+ */
+int rl_signal_key(rlite *db, const unsigned char *key, long keylen);
+/**
+ * Calls `pop` for every key in order until one returns something other than
+ * RL_NOT_FOUND, and returns that. While every key is empty, the lock on the
+ * database is released and the call blocks until a writer signals any of the
+ * keys or `timeout` expires (RL_TIMEOUT); a NULL `timeout` waits forever and
+ * a zero one checks the keys once. In memory databases never block, since no
+ * other client can write to them.
+ */
+int rl_block_keys(rlite *db, int keyc, unsigned char **keys, long *keyslen, struct timeval *timeout, int (*pop)(rlite *db, int index, void *context), void *context);
+
 int rl_pubsub_count_subscriptions(rlite *db, long *numsubscriptions);
 int rl_pubsub_channels(rlite *db, unsigned char *pattern, long patternlen, long* channelc, unsigned char ***channelv, long **channelvlen);
 int rl_pubsub_patterns(rlite *db, long* patternc, unsigned char ***patternv, long **patternvlen);
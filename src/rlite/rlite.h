@@ -70,6 +70,7 @@
 
 struct rlite;
 struct rl_btree;
+struct rl_zset_tree;
 
 typedef struct rl_data_type {
 	const char *name;
@@ -106,6 +107,8 @@ typedef struct rlite {
 	long initial_number_of_pages;
 	int initial_number_of_databases;
 	long *initial_databases;
+	long *initial_key_indexes;
+	long *initial_expire_indexes;
 
 	long number_of_pages;
 	long next_empty_page;
@@ -116,6 +119,12 @@ typedef struct rlite {
 	int selected_database;
 	int number_of_databases;
 	long *databases;
+	// optional index of key names for every database, sorted by name
+	long *key_indexes;
+	// keys with an expiration time for every database, sorted by the time
+	long *expire_indexes;
+	// maximum number of expired keys deleted on every commit, 0 to disable
+	long expire_budget;
 	long read_pages_alloc;
 	long read_pages_len;
 	rl_page **read_pages;
@@ -142,7 +151,16 @@ int rl_ensure_pages(rlite *db);
 int rl_read_header(rlite *db);
 int rl_header_deserialize(struct rlite *db, void **obj, void *context, unsigned char *data);
 int rl_read(struct rlite *db, rl_data_type *type, long page, void *context, void **obj, int cache);
+/**
+ * Copies the serialized data of `count` consecutive pages starting at `page`
+ * into `data`, which must hold `count` pages. Cached pages are copied from
+ * the cache and each run of pages that are not is read with a single read.
+ * Nothing is added to the cache.
+ */
+int rl_read_pages(struct rlite *db, rl_data_type *type, long page, long count, unsigned char *data);
 int rl_get_key_btree(rlite *db, struct rl_btree **btree, int create);
+int rl_get_key_index(rlite *db, struct rl_zset_tree **index, long *index_page);
+int rl_get_expire_index(rlite *db, struct rl_zset_tree **index, long *index_page, int create);
 int rl_alloc_page_number(rlite *db, long *page_number);
 int rl_write(struct rlite *db, rl_data_type *type, long page, void *obj);
 int rl_purge_cache(struct rlite *db, long page);
@@ -158,6 +176,27 @@ int rl_move(struct rlite *db, unsigned char *key, long keylen, int database);
 int rl_rename(struct rlite *db, const unsigned char *src, long srclen, const unsigned char *target, long targetlen, int overwrite);
 int rl_dbsize(struct rlite *db, long *size);
 int rl_keys(struct rlite *db, unsigned char *pattern, long patternlen, long *size, unsigned char ***result, long **resultlen);
+/**
+ * Returns the keys visited from `cursor`, about `count` of them, matching
+ * the optional `pattern` and `type` (0 for any). `next_cursor` is 0 once
+ * every key has been visited.
+ * With a key index and a pattern starting with a literal prefix the cursor
+ * holds the start of the next name to visit after the prefix, and has its top
+ * bit set.
+ */
+int rl_scan(struct rlite *db, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned char type, unsigned long long *next_cursor, long *size, unsigned char ***result, long **resultlen);
+/**
+ * Returns the keys whose names are between `start` and `end`, both
+ * inclusive, sorted by name.
+ */
+int rl_keys_range(struct rlite *db, unsigned char *start, long startlen, unsigned char *end, long endlen, long *size, unsigned char ***result, long **resultlen);
+/**
+ * The key index keeps the key names of the selected database sorted, making
+ * KEYSRANGE and KEYS or SCAN with a literal prefix range queries.
+ * rl_key_index_create returns RL_FOUND when the index already exists.
+ */
+int rl_key_index_create(struct rlite *db);
+int rl_key_index_drop(struct rlite *db);
 int rl_randomkey(struct rlite *db, unsigned char **key, long *keylen);
 int rl_flushall(struct rlite *db);
 int rl_flushdb(struct rlite *db);
@@ -179,10 +218,16 @@ extern rl_data_type rl_data_type_btree_hash_sha1_long;
 extern rl_data_type rl_data_type_btree_node_hash_sha1_long;
 extern rl_data_type rl_data_type_list_long;
 extern rl_data_type rl_data_type_list_node_long;
+extern rl_data_type rl_data_type_list_value;
+extern rl_data_type rl_data_type_list_node_value;
+extern rl_data_type rl_data_type_list_index_node;
 extern rl_data_type rl_data_type_list_node_key;
 extern rl_data_type rl_data_type_string;
 extern rl_data_type rl_data_type_long;
 extern rl_data_type rl_data_type_skiplist;
 extern rl_data_type rl_data_type_skiplist_node;
+extern rl_data_type rl_data_type_zset_packed;
+extern rl_data_type rl_data_type_zset_tree;
+extern rl_data_type rl_data_type_zset_tree_node;
 
 #endif
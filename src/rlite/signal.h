@@ -8,4 +8,22 @@ int rl_delete_signal(const char *signal_name);
 int rl_read_signal(const char *signal_name, struct timeval *timeout, char **_data, size_t *_datalen);
 int rl_write_signal(const char *signal_name, const char *data, size_t datalen);
 
+typedef struct {
+	int signalc;
+	int *fds;
+} rl_signal_listener;
+
+/**
+ * Opens the read end of `signalc` signals, creating them if needed. Writes
+ * made after this call are kept until the listener is closed, so a caller can
+ * start listening, check its condition and only then wait.
+ */
+int rl_listen_signals(rl_signal_listener **listener, int signalc, char **signal_names);
+/**
+ * Waits until any of the signals is written, or `timeout` expires
+ * (RL_TIMEOUT). A NULL `timeout` waits forever.
+ */
+int rl_wait_signals(rl_signal_listener *listener, struct timeval *timeout);
+int rl_close_signals(rl_signal_listener *listener);
+
 #endif
@@ -17,9 +17,10 @@ int rl_hget(struct rlite *db, const unsigned char *key, long keylen, unsigned ch
 int rl_hexists(struct rlite *db, const unsigned char *key, long keylen, unsigned char *field, long fieldlen);
 int rl_hdel(struct rlite *db, const unsigned char *key, long keylen, long fieldsc, unsigned char **fields, long *fieldslen, long *delcount);
 int rl_hgetall(struct rlite *db, rl_hash_iterator **iterator, const unsigned char *key, long keylen);
+int rl_hscan(struct rlite *db, const unsigned char *key, long keylen, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned long long *next_cursor, long *fieldc, unsigned char ***fields, long **fieldslen, unsigned char ***datas, long **dataslen);
 int rl_hlen(struct rlite *db, const unsigned char *key, long keylen, long *len);
 int rl_hmget(struct rlite *db, const unsigned char *key, long keylen, int fieldc, unsigned char **fields, long *fieldslen, unsigned char ***_data, long **_datalen);
-int rl_hmset(struct rlite *db, const unsigned char *key, long keylen, int fieldc, unsigned char **fields, long *fieldslen, unsigned char **datas, long *dataslen);
+int rl_hmset(struct rlite *db, const unsigned char *key, long keylen, int fieldc, unsigned char **fields, long *fieldslen, unsigned char **datas, long *dataslen, long *added);
 int rl_hincrby(struct rlite *db, const unsigned char *key, long keylen, unsigned char *field, long fieldlen, long increment, long *newvalue);
 int rl_hincrbyfloat(struct rlite *db, const unsigned char *key, long keylen, unsigned char *field, long fieldlen, double increment, double *newvalue);
 
@@ -1,6 +1,7 @@
 #ifndef _RL_TYPE_LIST_H
 #define _RL_TYPE_LIST_H
 
+#include <sys/time.h>
 #include "page_list.h"
 
 #define RL_TYPE_LIST 'L'
@@ -15,6 +16,17 @@ int rl_llist_iterator_destroy(rl_llist_iterator *iterator);
 int rl_push(struct rlite *db, const unsigned char *key, long keylen, int create, int left, int valuec, unsigned char **values, long *valueslen, long *size);
 int rl_llen(struct rlite *db, const unsigned char *key, long keylen, long *len);
 int rl_pop(struct rlite *db, const unsigned char *key, long keylen, unsigned char **value, long *valuelen, int left);
+/**
+ * Pops one element from the head (`left`) or tail of the first non empty
+ * list, blocking until one of them gets an element or `timeout` expires
+ * (RL_TIMEOUT). See rl_block_keys.
+ */
+int rl_bpop(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, int left, struct timeval *timeout, int *key_index, unsigned char **value, long *valuelen);
+/**
+ * Blocking version of RPOPLPUSH, the popped element is pushed to the head
+ * of `destination` and returned.
+ */
+int rl_brpoplpush(struct rlite *db, const unsigned char *source, long sourcelen, const unsigned char *destination, long destinationlen, struct timeval *timeout, unsigned char **value, long *valuelen);
 int rl_lindex(struct rlite *db, const unsigned char *key, long keylen, long index, unsigned char **value, long *valuelen);
 int rl_linsert(struct rlite *db, const unsigned char *key, long keylen, int after, unsigned char *pivot, long pivotlen, unsigned char *value, long valuelen, long *size);
 int rl_lrange_iterator(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, long *size, rl_list_iterator **_iterator);
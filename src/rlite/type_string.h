@@ -7,8 +7,37 @@
 
 struct rlite;
 
+#define RL_BITFIELD_GET 0
+#define RL_BITFIELD_SET 1
+#define RL_BITFIELD_INCRBY 2
+
+typedef struct {
+	int opcode;
+	int sign;
+	int bits; // up to 64 for signed fields, 63 for unsigned ones
+	long long offset; // in bits
+	long long value; // value for SET, increment for INCRBY
+	int overflow; // BFOVERFLOW_WRAP, BFOVERFLOW_SAT or BFOVERFLOW_FAIL
+} rl_bitfield_op;
+
 int rl_set(struct rlite *db, const unsigned char *key, long keylen, unsigned char *value, long valuelen, int nx, unsigned long long expires);
 int rl_get(struct rlite *db, const unsigned char *key, long keylen, unsigned char **value, long *valuelen);
+/**
+ * Like rl_set, but the value is produced by `callback` a page at a time,
+ * see rl_multi_string_set_stream. The key is left untouched when the
+ * callback fails.
+ */
+int rl_set_stream(struct rlite *db, const unsigned char *key, long keylen, rl_multi_string_fill_callback callback, void *context, int nx, unsigned long long expires);
+/**
+ * Like rl_get, but `callback` is called with the value a page at a time
+ * instead of copying all of it, see rl_multi_string_foreach_range.
+ */
+int rl_get_stream(struct rlite *db, const unsigned char *key, long keylen, rl_multi_string_range_callback callback, void *context);
+/**
+ * Gets many strings at once, `valueslen[i]` is -1 when `keys[i]` does not
+ * exist or is not a string.
+ */
+int rl_mget(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, unsigned char ***values, long **valueslen);
 int rl_get_cpy(struct rlite *db, const unsigned char *key, long keylen, unsigned char *value, long *valuelen);
 int rl_append(struct rlite *db, const unsigned char *key, long keylen, unsigned char *value, long valuelen, long *newlength);
 int rl_getrange(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, unsigned char **value, long *valuelen);
@@ -20,6 +49,13 @@ int rl_setbit(struct rlite *db, const unsigned char *key, long keylen, long bito
 int rl_bitop(struct rlite *db, int op, const unsigned char *dest, long destlen, unsigned long keylen, const unsigned char **keys, long *keyslen);
 int rl_bitcount(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, long *bitcount);
 int rl_bitpos(struct rlite *db, const unsigned char *key, long keylen, int bit, long start, long stop, int end_given, long *position);
+/**
+ * Runs the operations in order. `results[i]` is the value read by GET, the
+ * previous value for SET and the new value for INCRBY. `failed[i]` is set
+ * when an operation was skipped because of OVERFLOW FAIL.
+ * Every string page involved is read once and written back at most once.
+ */
+int rl_bitfield(struct rlite *db, const unsigned char *key, long keylen, long opc, rl_bitfield_op *ops, long long *results, int *failed);
 
 int rl_pfadd(struct rlite *db, const unsigned char *key, long keylen, int elementc, unsigned char **elements, long *elementslen, int *updated);
 int rl_pfcount(struct rlite *db, int keyc, const unsigned char **key, long *keylen, long *count);
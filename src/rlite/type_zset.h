@@ -1,14 +1,31 @@
 #ifndef _RL_TYPE_ZSET_H
 #define _RL_TYPE_ZSET_H
 
-#include "page_skiplist.h"
+#include <sys/time.h>
+#include "page_zset_packed.h"
+#include "page_zset_tree.h"
 
 #define RL_TYPE_ZSET 'Z'
 
+#define RL_ZSET_ENCODING_PACKED 1
+#define RL_ZSET_ENCODING_TREE 2
+
+// sorted sets are stored in a single packed page until they exceed any of
+// these limits, then they are converted into a scores btree and a zset tree
+#define RL_ZSET_PACKED_MAX_ENTRIES 128
+#define RL_ZSET_PACKED_MAX_MEMBER 64
+
 #define RL_ZSET_AGGREGATE_SUM 0
 #define RL_ZSET_AGGREGATE_MIN 1
 #define RL_ZSET_AGGREGATE_MAX 2
 
+#define RL_ZADD_NX 1
+#define RL_ZADD_XX 2
+#define RL_ZADD_GT 4
+#define RL_ZADD_LT 8
+#define RL_ZADD_CH 16
+#define RL_ZADD_INCR 32
+
 struct rlite;
 
 typedef struct {
@@ -18,16 +35,49 @@ typedef struct {
 	int maxex;
 } rl_zrangespec;
 
-typedef struct rl_skiplist_iterator rl_zset_iterator;
+typedef struct {
+	struct rlite *db;
+	long size;
+	int direction;
+	long position;
+	rl_zset_packed *packed;
+	struct rl_zset_tree_iterator *tree_iterator;
+} rl_zset_iterator;
 
 int rl_zset_iterator_next(rl_zset_iterator *iterator, long *page, double *score, unsigned char **data, long *datalen);
 int rl_zset_iterator_destroy(rl_zset_iterator *iterator);
 
 int rl_zadd(struct rlite *db, const unsigned char *key, long keylen, double score, unsigned char *data, long datalen);
+/**
+ * Adds or updates `size` members with the semantics of ZADD and its NX, XX,
+ * GT, LT, CH and INCR flags. The key is resolved once and the existing scores
+ * are looked up together, then the changes are applied in score order.
+ * A member repeated in the batch is handled as if the pairs were added one
+ * after the other.
+ * `changed` is the number of members added, plus the ones updated with CH.
+ * With INCR, `size` must be 1 and the function returns RL_NOT_FOUND when the
+ * flags prevented the update, RL_NAN when the result would not be a number.
+ */
+int rl_zadd_multi(struct rlite *db, const unsigned char *key, long keylen, int flags, long size, double *scores, unsigned char **members, long *memberslen, long *changed, double *newscore);
 int rl_zcard(struct rlite *db, const unsigned char *key, long keylen, long *card);
 int rl_zcount(struct rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long *count);
 int rl_zincrby(struct rlite *db, const unsigned char *key, long keylen, double score, unsigned char *data, long datalen, double *newscore);
+/**
+ * ZINTERSTORE, ZUNIONSTORE and ZDIFFSTORE take the target in `keys[0]`.
+ * Every input, a sorted set or a set (members scored 1), is read once and
+ * aggregated in memory before the target is written. A missing input counts
+ * as empty.
+ */
 int rl_zinterstore(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate);
+int rl_zunionstore(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate);
+int rl_zdiffstore(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len);
+/**
+ * Same as the STORE variants, returning the members sorted by score instead.
+ * `members`, `memberslen` and `scores` are NULL when the result is empty.
+ */
+int rl_zinter(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, long *size, unsigned char ***members, long **memberslen, double **scores);
+int rl_zunion(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, long *size, unsigned char ***members, long **memberslen, double **scores);
+int rl_zdiff(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, long *size, unsigned char ***members, long **memberslen, double **scores);
 int rl_zlexcount(struct rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long *lexcount);
 int rl_zrange(struct rlite *db, const unsigned char *key, long keylen, long start, long end, rl_zset_iterator **iterator);
 int rl_zrangebylex(struct rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long offset, long count, rl_zset_iterator **iterator);
@@ -41,8 +91,20 @@ int rl_zrem(struct rlite *db, const unsigned char *key, long keylen, long member
 int rl_zremrangebylex(struct rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long *changed);
 int rl_zremrangebyrank(struct rlite *db, const unsigned char *key, long keylen, long start, long end, long *changed);
 int rl_zremrangebyscore(struct rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long *changed);
+int rl_zscan(struct rlite *db, const unsigned char *key, long keylen, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned long long *next_cursor, long *membersc, unsigned char ***members, long **memberslen, double **scores);
 int rl_zscore(struct rlite *db, const unsigned char *key, long keylen, unsigned char *data, long datalen, double *score);
-int rl_zunionstore(struct rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate);
+int rl_zset_encoding(struct rlite *db, const unsigned char *key, long keylen, int *encoding);
+
+/**
+ * Removes and returns up to `count` members with the lowest scores, or the
+ * highest ones when `max` is set, in the order they were popped.
+ */
+int rl_zpop(struct rlite *db, const unsigned char *key, long keylen, long count, int max, long *size, unsigned char ***members, long **memberslen, double **scores);
+/**
+ * Pops one member from the first non empty key, blocking until one of them
+ * gets a member or `timeout` expires (RL_TIMEOUT). See rl_block_keys.
+ */
+int rl_bzpop(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, int max, struct timeval *timeout, int *key_index, unsigned char **member, long *memberlen, double *score);
 
 int rl_zset_pages(struct rlite *db, long page, short *pages);
 int rl_zset_delete(struct rlite *db, long value_page);
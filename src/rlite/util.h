@@ -15,6 +15,9 @@
 int expect_fail();
 extern int test_mode;
 extern size_t test_mode_counter;
+// number of allocations and bytes requested, for tests to reset and inspect
+extern size_t test_alloc_count;
+extern size_t test_alloc_bytes;
 void *rl_malloc(size_t size);
 void *rl_realloc(void *ptr, size_t size);
 void rl_free(void *ptr);
@@ -69,6 +72,14 @@ double get_double(const unsigned char *p);
 void put_double(unsigned char *p, double v);
 int sha1(const unsigned char *data, long datalen, unsigned char digest[20]);
 unsigned long long rl_mstime();
+union rl_number;
+/**
+ * Formats a number stored in a key or a hash field as the string it stands
+ * for, "%lld" for integers and "%lf" for doubles as INCRBY and INCRBYFLOAT
+ * used to store them. `data` is allocated and NUL terminated, and can be
+ * NULL to only get the length.
+ */
+int rl_number_format(unsigned char encoding, union rl_number *number, unsigned char **data, long *datalen);
 double rl_strtod(unsigned char *str, long strlen, unsigned char **eptr);
 char *rl_get_filename_with_suffix(const char *filename, char *suffix);
 
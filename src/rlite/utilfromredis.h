@@ -1,11 +1,22 @@
 #include <stdlib.h>
+#include <stdint.h>
 
 #define BITOP_AND 0
 #define BITOP_OR 1
 #define BITOP_XOR 2
 #define BITOP_NOT 3
 
+#define BFOVERFLOW_WRAP 0
+#define BFOVERFLOW_SAT 1
+#define BFOVERFLOW_FAIL 2
+
 int rl_stringmatchlen(const char *pattern, int patternLen, const char *string, int stringLen, int nocase);
 void rl_internal_bitop(int op, unsigned long numkeys, unsigned char **objects, unsigned long *objectslen, unsigned char **result, long *resultlen);
 size_t rl_redisPopcount(void *s, long count);
 long rl_internal_bitpos(void *s, unsigned long count, int bit);
+void rl_setUnsignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits, uint64_t value);
+void rl_setSignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits, int64_t value);
+uint64_t rl_getUnsignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits);
+int64_t rl_getSignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits);
+int rl_checkUnsignedBitfieldOverflow(uint64_t value, int64_t incr, uint64_t bits, int owtype, uint64_t *limit);
+int rl_checkSignedBitfieldOverflow(int64_t value, int64_t incr, uint64_t bits, int owtype, int64_t *limit);
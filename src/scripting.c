@@ -680,6 +680,7 @@ void scriptingInit(void) {
 		lua_client = rl_malloc(sizeof(*lua_client));
 
 		lua_client->flags = RLITE_LUA_CLIENT;
+		lua_client->stream = NULL;
 	}
 
 	/* Lua beginners often don't use "local", this is likely to introduce
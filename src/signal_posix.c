@@ -1,4 +1,9 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -10,6 +15,7 @@
 #include "rlite/util.h"
 #include "rlite/crc64.h"
 #include "rlite/endianconv.h"
+#include "rlite/signal.h"
 
 // header is 4-bytes size and 8-bytes crc
 #define FIFO_HEADER_SIZE 12
@@ -53,7 +59,7 @@ int rl_read_signal(const char *signal_name, struct timeval *timeout, char **_dat
 		if (retval == -1) {
 			retval = RL_UNEXPECTED;
 			goto cleanup;
-		} else if (retval != 0) {
+		} else if (retval == 0) {
 			retval = RL_TIMEOUT;
 			goto cleanup;
 		}
@@ -111,8 +117,100 @@ int rl_write_signal(const char *signal_name, const char *data, size_t datalen) {
 		// it is a way to signal between processes, but it is fire and forget
 		return RL_OK;
 	}
-	write(fd, header, FIFO_HEADER_SIZE);
-	write(fd, data, datalen);
+	// a reader may close its end between our open and write; block SIGPIPE
+	// so that the write fails with EPIPE instead of killing the process
+	sigset_t pipeset, oldset, pendingset;
+	int sigpipe_pending, broken = 0;
+	sigemptyset(&pipeset);
+	sigaddset(&pipeset, SIGPIPE);
+	sigpending(&pendingset);
+	sigpipe_pending = sigismember(&pendingset, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeset, &oldset);
+	if (write(fd, header, FIFO_HEADER_SIZE) == -1 && errno == EPIPE) {
+		broken = 1;
+	}
+	else if (write(fd, data, datalen) == -1 && errno == EPIPE) {
+		broken = 1;
+	}
+	if (broken && !sigpipe_pending) {
+		sigpending(&pendingset);
+		if (sigismember(&pendingset, SIGPIPE)) {
+			int sig;
+			sigwait(&pipeset, &sig);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 	close(fd);
 	return RL_OK;
 }
+
+int rl_listen_signals(rl_signal_listener **_listener, int signalc, char **signal_names)
+{
+	rl_signal_listener *listener = NULL;
+	int i, retval;
+
+	RL_MALLOC(listener, sizeof(*listener));
+	listener->signalc = 0;
+	listener->fds = NULL;
+	RL_MALLOC(listener->fds, sizeof(int) * signalc);
+	for (i = 0; i < signalc; i++) {
+		rl_create_signal(signal_names[i]);
+		// a reader must be connected for writes not to be dropped
+		listener->fds[i] = open(signal_names[i], O_RDONLY | O_NONBLOCK);
+		if (listener->fds[i] == -1) {
+			retval = RL_UNEXPECTED;
+			goto cleanup;
+		}
+		listener->signalc++;
+	}
+	*_listener = listener;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK && listener) {
+		rl_close_signals(listener);
+	}
+	return retval;
+}
+
+int rl_wait_signals(rl_signal_listener *listener, struct timeval *timeout)
+{
+	char buffer[64];
+	fd_set rfds;
+	int i, maxfd = -1, retval;
+
+	FD_ZERO(&rfds);
+	for (i = 0; i < listener->signalc; i++) {
+		FD_SET(listener->fds[i], &rfds);
+		if (listener->fds[i] > maxfd) {
+			maxfd = listener->fds[i];
+		}
+	}
+	retval = select(maxfd + 1, &rfds, NULL, NULL, timeout);
+	if (retval == -1) {
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	} else if (retval == 0) {
+		retval = RL_TIMEOUT;
+		goto cleanup;
+	}
+	// only the wake up matters, the payload is drained and dropped
+	for (i = 0; i < listener->signalc; i++) {
+		if (FD_ISSET(listener->fds[i], &rfds)) {
+			while (read(listener->fds[i], buffer, sizeof(buffer)) > 0);
+		}
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_close_signals(rl_signal_listener *listener)
+{
+	int i;
+	for (i = 0; i < listener->signalc; i++) {
+		close(listener->fds[i]);
+	}
+	rl_free(listener->fds);
+	rl_free(listener);
+	return RL_OK;
+}
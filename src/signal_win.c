@@ -1,4 +1,5 @@
 #include "rlite/rlite.h"
+#include "rlite/signal.h"
 
 int rl_create_signal(const char *signal_name) {
 	return RL_NOT_IMPLEMENTED;
@@ -15,3 +16,15 @@ int rl_read_signal(const char *signal_name, char **_data, size_t *_datalen) {
 int rl_write_signal(const char *signal_name, const char *data, size_t datalen) {
 	return RL_NOT_IMPLEMENTED;
 }
+
+int rl_listen_signals(rl_signal_listener **_listener, int signalc, char **signal_names) {
+	return RL_NOT_IMPLEMENTED;
+}
+
+int rl_wait_signals(rl_signal_listener *listener, struct timeval *timeout) {
+	return RL_NOT_IMPLEMENTED;
+}
+
+int rl_close_signals(rl_signal_listener *listener) {
+	return RL_NOT_IMPLEMENTED;
+}
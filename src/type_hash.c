@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "rlite/rlite.h"
 #include "rlite/page_multi_string.h"
 #include "rlite/type_hash.h"
@@ -39,7 +40,6 @@ static int rl_hash_get_objects(rlite *db, const unsigned char *key, long keylen,
 {
 	long hash_page_number = 0, version = 0;
 	int retval;
-	unsigned long long expires = 0;
 	if (create) {
 		retval = rl_key_get_or_create(db, key, keylen, RL_TYPE_HASH, &hash_page_number, &version);
 		if (retval != RL_FOUND && retval != RL_NOT_FOUND) {
@@ -55,7 +55,7 @@ static int rl_hash_get_objects(rlite *db, const unsigned char *key, long keylen,
 	}
 	else {
 		unsigned char type;
-		retval = rl_key_get(db, key, keylen, &type, NULL, &hash_page_number, &expires, &version);
+		retval = rl_key_get(db, key, keylen, &type, NULL, &hash_page_number, NULL, &version);
 		if (retval != RL_FOUND) {
 			goto cleanup;
 		}
@@ -66,7 +66,7 @@ static int rl_hash_get_objects(rlite *db, const unsigned char *key, long keylen,
 		RL_CALL(rl_hash_read, RL_OK, db, hash_page_number, btree);
 	}
 	if (update_version) {
-		RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_HASH, hash_page_number, expires, version + 1);
+		RL_CALL(rl_key_set_version, RL_OK, db, key, keylen, version + 1);
 	}
 cleanup:
 	if (_hash_page_number) {
@@ -75,6 +75,29 @@ cleanup:
 	return retval;
 }
 
+static int hashkey_get_value(rlite *db, rl_hashkey *hashkey, unsigned char **data, long *datalen)
+{
+	if (hashkey->encoding == RL_VALUE_ENCODING_PAGE) {
+		return rl_multi_string_get(db, hashkey->value_page, data, datalen);
+	}
+	return rl_number_format(hashkey->encoding, &hashkey->number, data, datalen);
+}
+
+static int hashkey_delete_value(rlite *db, rl_hashkey *hashkey)
+{
+	if (hashkey->encoding == RL_VALUE_ENCODING_PAGE) {
+		return rl_multi_string_delete(db, hashkey->value_page);
+	}
+	return RL_OK;
+}
+
+static int hashkey_set_value(rlite *db, rl_hashkey *hashkey, unsigned char *data, long datalen)
+{
+	hashkey->encoding = RL_VALUE_ENCODING_PAGE;
+	hashkey->number.integer = 0;
+	return rl_multi_string_set(db, &hashkey->value_page, data, datalen);
+}
+
 int rl_hset(struct rlite *db, const unsigned char *key, long keylen, unsigned char *field, long fieldlen, unsigned char *data, long datalen, long *added, int update)
 {
 	int retval;
@@ -97,12 +120,12 @@ int rl_hset(struct rlite *db, const unsigned char *key, long keylen, unsigned ch
 		}
 		hashkey = tmp;
 		rl_multi_string_delete(db, hashkey->string_page);
-		rl_multi_string_delete(db, hashkey->value_page);
+		hashkey_delete_value(db, hashkey);
 	}
 
 	RL_MALLOC(hashkey, sizeof(*hashkey));
 	RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->string_page, field, fieldlen);
-	RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, data, datalen);
+	RL_CALL(hashkey_set_value, RL_OK, db, hashkey, data, datalen);
 	if (update) {
 		retval = rl_btree_update_element(db, hash, digest, hashkey);
 		if (retval == RL_OK) {
@@ -116,6 +139,9 @@ int rl_hset(struct rlite *db, const unsigned char *key, long keylen, unsigned ch
 	}
 	if (add) {
 		retval = rl_btree_add_element(db, hash, hash_page_number, digest, hashkey);
+		// the btree owns them, even on failure
+		digest = NULL;
+		hashkey = NULL;
 		if (retval == RL_FOUND) {
 			add = 0;
 		}
@@ -152,7 +178,7 @@ int rl_hget(struct rlite *db, const unsigned char *key, long keylen, unsigned ch
 	if (retval == RL_FOUND) {
 		if (data || datalen) {
 			hashkey = tmp;
-			rl_multi_string_get(db, hashkey->value_page, data, datalen);
+			hashkey_get_value(db, hashkey, data, datalen);
 		}
 	}
 cleanup:
@@ -165,89 +191,155 @@ int rl_hmget(struct rlite *db, const unsigned char *key, long keylen, int fieldc
 	int retval;
 	long hash_page_number;
 	rl_btree *hash;
-	void *tmp;
-	unsigned char *digest = NULL;
+	unsigned char *digests = NULL;
+	void **scores = NULL, **values = NULL;
 	rl_hashkey *hashkey;
+	int i, got = 0;
 
 	unsigned char **data = rl_malloc(sizeof(unsigned char *) * fieldc);
 	long *datalen = rl_malloc(sizeof(long) * fieldc);
+	if (!data || !datalen) {
+		retval = RL_OUT_OF_MEMORY;
+		goto cleanup;
+	}
 	RL_CALL(rl_hash_get_objects, RL_OK, db, key, keylen, &hash_page_number, &hash, 0, 0);
 
-	RL_MALLOC(digest, sizeof(unsigned char) * 20);
-	int i;
+	RL_MALLOC(digests, sizeof(unsigned char) * 20 * fieldc);
+	RL_MALLOC(scores, sizeof(void *) * fieldc);
+	RL_MALLOC(values, sizeof(void *) * fieldc);
 	for (i = 0; i < fieldc; i++) {
-		RL_CALL(sha1, RL_OK, fields[i], fieldslen[i], digest);
-
-		retval = rl_btree_find_score(db, hash, digest, &tmp, NULL, NULL);
-		if (retval == RL_FOUND) {
-			hashkey = tmp;
-			rl_multi_string_get(db, hashkey->value_page, &data[i], &datalen[i]);
+		RL_CALL(sha1, RL_OK, fields[i], fieldslen[i], &digests[i * 20]);
+		scores[i] = &digests[i * 20];
+	}
+	RL_CALL(rl_btree_find_scores, RL_OK, db, hash, fieldc, scores, values);
+	for (i = 0; i < fieldc; i++) {
+		hashkey = values[i];
+		if (hashkey) {
+			RL_CALL(hashkey_get_value, RL_OK, db, hashkey, &data[i], &datalen[i]);
 		}
-		else if (retval == RL_NOT_FOUND) {
+		else {
 			data[i] = NULL;
 			datalen[i] = -1;
 		}
-		else {
-			goto cleanup;
-		}
+		got++;
 	}
 	*_data = data;
 	*_datalen = datalen;
 	retval = RL_OK;
 cleanup:
 	if (retval != RL_OK) {
+		for (i = 0; i < got; i++) {
+			rl_free(data[i]);
+		}
 		rl_free(data);
 		rl_free(datalen);
 	}
-	rl_free(digest);
+	rl_free(digests);
+	rl_free(scores);
+	rl_free(values);
 	return retval;
 }
 
-int rl_hmset(struct rlite *db, const unsigned char *key, long keylen, int fieldc, unsigned char **fields, long *fieldslen, unsigned char **datas, long *dataslen)
+typedef struct {
+	unsigned char digest[20];
+	unsigned char *field;
+	long fieldlen;
+	unsigned char *data;
+	long datalen;
+	// position in the batch, when a field is repeated
+	long position;
+} hmset_item;
+
+static int hmset_item_cmp(const void *a, const void *b)
 {
-	int i, retval;
-	long hash_page_number;
+	const hmset_item *item1 = a, *item2 = b;
+	int cmp = memcmp(item1->digest, item2->digest, 20);
+	if (cmp == 0) {
+		return item1->position < item2->position ? -1 : (item1->position > item2->position ? 1 : 0);
+	}
+	return cmp;
+}
+
+int rl_hmset(struct rlite *db, const unsigned char *key, long keylen, int fieldc, unsigned char **fields, long *fieldslen, unsigned char **datas, long *dataslen, long *added)
+{
+	int retval;
+	long i, count = 0, newc = 0, addedc, hash_page_number;
 	rl_btree *hash;
-	unsigned char *digest = NULL;
-	rl_hashkey *hashkey = NULL;
-	void *tmp;
-	RL_CALL(rl_hash_get_objects, RL_OK, db, key, keylen, &hash_page_number, &hash, 1, 1);
+	rl_hashkey *hashkey;
+	hmset_item *items = NULL;
+	void **scores = NULL, **values = NULL, **newscores = NULL, **newvalues = NULL;
 
+	if (fieldc < 1) {
+		retval = RL_INVALID_PARAMETERS;
+		goto cleanup;
+	}
+	RL_MALLOC(items, sizeof(hmset_item) * fieldc);
 	for (i = 0; i < fieldc; i++) {
-		RL_MALLOC(digest, sizeof(unsigned char) * 20);
-		RL_CALL(sha1, RL_OK, fields[i], fieldslen[i], digest);
-
-		retval = rl_btree_find_score(db, hash, digest, &tmp, NULL, NULL);
-		if (retval == RL_FOUND) {
-			hashkey = tmp;
-			rl_multi_string_delete(db, hashkey->value_page);
-			RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, datas[i], dataslen[i]);
-			retval = rl_btree_update_element(db, hash, digest, hashkey);
-			if (retval == RL_OK) {
-				rl_free(digest);
-				digest = NULL;
-			}
-			else {
-				goto cleanup;
-			}
+		RL_CALL(sha1, RL_OK, fields[i], fieldslen[i], items[i].digest);
+		items[i].field = fields[i];
+		items[i].fieldlen = fieldslen[i];
+		items[i].data = datas[i];
+		items[i].datalen = dataslen[i];
+		items[i].position = i;
+	}
+	// a repeated field keeps the last value, as if the batch was set in order
+	qsort(items, fieldc, sizeof(hmset_item), hmset_item_cmp);
+	for (i = 0; i < fieldc; i++) {
+		if (count > 0 && memcmp(items[count - 1].digest, items[i].digest, 20) == 0) {
+			items[count - 1].data = items[i].data;
+			items[count - 1].datalen = items[i].datalen;
+			continue;
 		}
-		else if (retval == RL_NOT_FOUND) {
-			RL_MALLOC(hashkey, sizeof(*hashkey));
-			RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->string_page, fields[i], fieldslen[i]);
-			RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, datas[i], dataslen[i]);
+		items[count++] = items[i];
+	}
 
-			retval = rl_btree_add_element(db, hash, hash_page_number, digest, hashkey);
-			if (retval != RL_FOUND && retval != RL_OK) {
-				goto cleanup;
-			}
+	RL_CALL(rl_hash_get_objects, RL_OK, db, key, keylen, &hash_page_number, &hash, 1, 1);
+
+	// every field is looked up descending the btree once
+	RL_MALLOC(scores, sizeof(void *) * count);
+	RL_MALLOC(values, sizeof(void *) * count);
+	for (i = 0; i < count; i++) {
+		scores[i] = items[i].digest;
+	}
+	RL_CALL(rl_btree_find_scores, RL_OK, db, hash, count, scores, values);
+
+	RL_MALLOC(newscores, sizeof(void *) * count);
+	RL_MALLOC(newvalues, sizeof(void *) * count);
+	for (i = 0; i < count; i++) {
+		if (values[i]) {
+			hashkey = values[i];
+			hashkey_delete_value(db, hashkey);
+			RL_CALL(hashkey_set_value, RL_OK, db, hashkey, items[i].data, items[i].datalen);
+			RL_CALL(rl_btree_update_element, RL_OK, db, hash, items[i].digest, hashkey);
+			continue;
 		}
+		newscores[newc] = newvalues[newc] = NULL;
+		newc++;
+		RL_MALLOC(newscores[newc - 1], sizeof(unsigned char) * 20);
+		memcpy(newscores[newc - 1], items[i].digest, 20);
+		RL_MALLOC(hashkey, sizeof(*hashkey));
+		newvalues[newc - 1] = hashkey;
+		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->string_page, items[i].field, items[i].fieldlen);
+		RL_CALL(hashkey_set_value, RL_OK, db, hashkey, items[i].data, items[i].datalen);
+	}
+	// the digests are sorted, so the new fields go in in btree order
+	addedc = newc;
+	newc = 0;
+	RL_CALL(rl_btree_add_elements, RL_OK, db, hash, hash_page_number, addedc, newscores, newvalues);
+	if (added) {
+		*added = addedc;
 	}
 	retval = RL_OK;
 cleanup:
-	if (retval != RL_OK) {
-		rl_free(digest);
-		rl_free(hashkey);
-	}
+	for (i = 0; i < newc; i++) {
+		rl_free(newscores[i]);
+		rl_free(newvalues[i]);
+	}
+	rl_free(items);
+	rl_free(scores);
+	rl_free(values);
+	rl_free(newscores);
+	rl_free(newvalues);
 	return retval;
 }
 
@@ -289,7 +381,7 @@ int rl_hdel(struct rlite *db, const unsigned char *key, long keylen, long fields
 			deleted++;
 			hashkey = tmp;
 			rl_multi_string_delete(db, hashkey->string_page);
-			rl_multi_string_delete(db, hashkey->value_page);
+			hashkey_delete_value(db, hashkey);
 			retval = rl_btree_remove_element(db, hash, hash_page_number, digest);
 			if (retval != RL_OK && retval != RL_DELETED) {
 				goto cleanup;
@@ -322,6 +414,61 @@ cleanup:
 	return retval;
 }
 
+int rl_hscan(struct rlite *db, const unsigned char *key, long keylen, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned long long *next_cursor, long *_fieldc, unsigned char ***_fields, long **_fieldslen, unsigned char ***_datas, long **_dataslen)
+{
+	int retval;
+	rl_btree *hash;
+	rl_hashkey *hashkey;
+	void **hashkeys = NULL;
+	long i, hashkeysc = 0, fieldc = 0, fieldlen;
+	unsigned char **fields = NULL, **datas = NULL, *field;
+	long *fieldslen = NULL, *dataslen = NULL;
+	RL_CALL(rl_hash_get_objects, RL_OK, db, key, keylen, NULL, &hash, 0, 0);
+	RL_CALL(rl_btree_scan, RL_OK, db, hash, cursor, count, next_cursor, &hashkeysc, &hashkeys);
+	RL_MALLOC(fields, sizeof(unsigned char *) * (hashkeysc + 1));
+	RL_MALLOC(fieldslen, sizeof(long) * (hashkeysc + 1));
+	RL_MALLOC(datas, sizeof(unsigned char *) * (hashkeysc + 1));
+	RL_MALLOC(dataslen, sizeof(long) * (hashkeysc + 1));
+	for (i = 0; i < hashkeysc; i++) {
+		hashkey = hashkeys[i];
+		RL_CALL(rl_multi_string_get, RL_OK, db, hashkey->string_page, &field, &fieldlen);
+		if (pattern && !rl_stringmatchlen((char *)pattern, patternlen, (char *)field, fieldlen, 0)) {
+			rl_free(field);
+			continue;
+		}
+		fields[fieldc] = field;
+		fieldslen[fieldc] = fieldlen;
+		retval = hashkey_get_value(db, hashkey, &datas[fieldc], &dataslen[fieldc]);
+		if (retval != RL_OK) {
+			rl_free(field);
+			goto cleanup;
+		}
+		fieldc++;
+	}
+	*_fieldc = fieldc;
+	*_fields = fields;
+	*_fieldslen = fieldslen;
+	*_datas = datas;
+	*_dataslen = dataslen;
+	retval = RL_OK;
+cleanup:
+	for (i = 0; i < hashkeysc; i++) {
+		rl_free(hashkeys[i]);
+	}
+	rl_free(hashkeys);
+	if (retval != RL_OK) {
+		for (i = 0; i < fieldc; i++) {
+			rl_free(fields[i]);
+			rl_free(datas[i]);
+		}
+		rl_free(fields);
+		rl_free(fieldslen);
+		rl_free(datas);
+		rl_free(dataslen);
+	}
+	return retval;
+}
+
 int rl_hlen(struct rlite *db, const unsigned char *key, long keylen, long *len)
 {
 	int retval;
@@ -352,22 +499,28 @@ int rl_hincrby(struct rlite *db, const unsigned char *key, long keylen, unsigned
 	retval = rl_btree_find_score(db, hash, digest, &tmp, NULL, NULL);
 	if (retval == RL_FOUND) {
 		hashkey = tmp;
-		rl_multi_string_get(db, hashkey->value_page, &data, &datalen);
-		tmp = rl_realloc(data, sizeof(unsigned char) * (datalen + 1));
-		if (!tmp) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
+		if (hashkey->encoding == RL_VALUE_ENCODING_INT) {
+			value = hashkey->number.integer;
 		}
-		data = tmp;
-		data[datalen] = '\0';
-		value = strtoll((char *)data, &end, 10);
-		if (isspace(((char *)data)[0]) || end[0] != '\0' || errno == ERANGE) {
-			rl_free(digest);
-			retval = RL_NAN;
-			goto cleanup;
+		else {
+			RL_CALL(hashkey_get_value, RL_OK, db, hashkey, &data, &datalen);
+			tmp = rl_realloc(data, sizeof(unsigned char) * (datalen + 1));
+			if (!tmp) {
+				retval = RL_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			data = tmp;
+			data[datalen] = '\0';
+			errno = 0;
+			value = strtoll((char *)data, &end, 10);
+			if (datalen == 0 || isspace(((char *)data)[0]) || end[0] != '\0' || errno == ERANGE) {
+				rl_free(digest);
+				retval = RL_NAN;
+				goto cleanup;
+			}
+			rl_free(data);
+			data = NULL;
 		}
-		rl_free(data);
-		data = NULL;
 
 		if ((increment < 0 && value < 0 && increment < (LLONG_MIN - value)) ||
 		        (increment > 0 && value > 0 && increment > (LLONG_MAX - value))) {
@@ -377,11 +530,10 @@ int rl_hincrby(struct rlite *db, const unsigned char *key, long keylen, unsigned
 		}
 
 		value += increment;
-		rl_multi_string_delete(db, hashkey->value_page);
-
-		RL_MALLOC(data, sizeof(unsigned char) * MAX_LLONG_DIGITS);
-		datalen = snprintf((char *)data, MAX_LLONG_DIGITS, "%lld", value);
-		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, data, datalen);
+		RL_CALL(hashkey_delete_value, RL_OK, db, hashkey);
+		hashkey->value_page = 0;
+		hashkey->encoding = RL_VALUE_ENCODING_INT;
+		hashkey->number.integer = value;
 
 		retval = rl_btree_update_element(db, hash, digest, hashkey);
 		if (retval == RL_OK) {
@@ -396,12 +548,11 @@ int rl_hincrby(struct rlite *db, const unsigned char *key, long keylen, unsigned
 		}
 	}
 	else if (retval == RL_NOT_FOUND) {
-		RL_MALLOC(data, sizeof(unsigned char) * MAX_LLONG_DIGITS);
-		datalen = snprintf((char *)data, MAX_LLONG_DIGITS, "%ld", increment);
-
 		RL_MALLOC(hashkey, sizeof(*hashkey));
 		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->string_page, field, fieldlen);
-		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, data, datalen);
+		hashkey->value_page = 0;
+		hashkey->encoding = RL_VALUE_ENCODING_INT;
+		hashkey->number.integer = increment;
 		RL_CALL(rl_btree_add_element, RL_OK, db, hash, hash_page_number, digest, hashkey);
 		if (newvalue) {
 			*newvalue = increment;
@@ -423,7 +574,7 @@ int rl_hincrbyfloat(struct rlite *db, const unsigned char *key, long keylen, uns
 	rl_btree *hash;
 	void *tmp;
 	unsigned char *digest = NULL, *data = NULL;
-	char *end;
+	char *end, buffer[MAX_DOUBLE_DIGITS];
 	long dataalloc, datalen, hash_page_number;
 	double value;
 	rl_hashkey *hashkey;
@@ -436,32 +587,43 @@ int rl_hincrbyfloat(struct rlite *db, const unsigned char *key, long keylen, uns
 	retval = rl_btree_find_score(db, hash, digest, &tmp, NULL, NULL);
 	if (retval == RL_FOUND) {
 		hashkey = tmp;
-		rl_multi_string_get(db, hashkey->value_page, &data, &datalen);
-		dataalloc = (datalen / 8 + 1) * 8;
-		tmp = rl_realloc(data, sizeof(unsigned char) * dataalloc);
-		if (!tmp) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
+		if (hashkey->encoding == RL_VALUE_ENCODING_DOUBLE) {
+			value = hashkey->number.floating;
 		}
-		data = tmp;
-		// valgrind reads 8 bytes at a time
-		memset(&data[datalen], 0, dataalloc - datalen);
-		value = strtod((char *)data, &end);
-		if (isspace(((char *)data)[0]) || end[0] != '\0' ||
-		        (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL || value == 0)) ||
-		        errno == EINVAL || isnan(value)) {
-			rl_free(digest);
-			retval = RL_NAN;
-			goto cleanup;
+		else if (hashkey->encoding == RL_VALUE_ENCODING_INT) {
+			value = (double)hashkey->number.integer;
+		}
+		else {
+			RL_CALL(hashkey_get_value, RL_OK, db, hashkey, &data, &datalen);
+			dataalloc = (datalen / 8 + 1) * 8;
+			tmp = rl_realloc(data, sizeof(unsigned char) * dataalloc);
+			if (!tmp) {
+				retval = RL_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			data = tmp;
+			// valgrind reads 8 bytes at a time
+			memset(&data[datalen], 0, dataalloc - datalen);
+			errno = 0;
+			value = strtod((char *)data, &end);
+			if (datalen == 0 || isspace(((char *)data)[0]) || end[0] != '\0' ||
+			        (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL || value == 0)) ||
+			        errno == EINVAL || isnan(value)) {
+				rl_free(digest);
+				retval = RL_NAN;
+				goto cleanup;
+			}
+			rl_free(data);
+			data = NULL;
 		}
-		rl_free(data);
-		data = NULL;
 		value += increment;
-		rl_multi_string_delete(db, hashkey->value_page);
-
-		RL_MALLOC(data, sizeof(unsigned char) * MAX_DOUBLE_DIGITS);
-		datalen = snprintf((char *)data, MAX_DOUBLE_DIGITS, "%lf", value);
-		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, data, datalen);
+		RL_CALL(hashkey_delete_value, RL_OK, db, hashkey);
+		// keep the number the string would have held, so later increments
+		// round the same way they did when the value was stored as a string
+		snprintf(buffer, MAX_DOUBLE_DIGITS, "%lf", value);
+		hashkey->value_page = 0;
+		hashkey->encoding = RL_VALUE_ENCODING_DOUBLE;
+		hashkey->number.floating = strtod(buffer, NULL);
 
 		retval = rl_btree_update_element(db, hash, digest, hashkey);
 		if (retval == RL_OK) {
@@ -476,12 +638,12 @@ int rl_hincrbyfloat(struct rlite *db, const unsigned char *key, long keylen, uns
 		}
 	}
 	else if (retval == RL_NOT_FOUND) {
-		RL_MALLOC(data, sizeof(unsigned char) * MAX_DOUBLE_DIGITS);
-		datalen = snprintf((char *)data, MAX_DOUBLE_DIGITS, "%lf", increment);
-
+		snprintf(buffer, MAX_DOUBLE_DIGITS, "%lf", increment);
 		RL_MALLOC(hashkey, sizeof(*hashkey));
 		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->string_page, field, fieldlen);
-		RL_CALL(rl_multi_string_set, RL_OK, db, &hashkey->value_page, data, datalen);
+		hashkey->value_page = 0;
+		hashkey->encoding = RL_VALUE_ENCODING_DOUBLE;
+		hashkey->number.floating = strtod(buffer, NULL);
 		RL_CALL(rl_btree_add_element, RL_OK, db, hash, hash_page_number, digest, hashkey);
 		if (newvalue) {
 			*newvalue = increment;
@@ -530,8 +692,12 @@ int rl_hash_iterator_next(rl_hash_iterator *iterator, long *fieldpage, unsigned
 		*memberpage = hashkey->value_page;
 	}
 	if (memberlen) {
-		retval = rl_multi_string_get(iterator->db, hashkey->value_page, member, memberlen);
+		retval = hashkey_get_value(iterator->db, hashkey, member, memberlen);
 		if (retval != RL_OK) {
+			if (field && fieldlen) {
+				rl_free(*field);
+				*field = NULL;
+			}
 			rl_btree_iterator_destroy(iterator);
 			goto cleanup;
 		}
@@ -562,8 +728,10 @@ int rl_hash_pages(struct rlite *db, long page, short *pages)
 	RL_CALL(rl_btree_iterator_create, RL_OK, db, btree, &iterator);
 	while ((retval = rl_btree_iterator_next(iterator, NULL, &tmp)) == RL_OK) {
 		hashkey = tmp;
-		pages[hashkey->value_page] = 1;
-		RL_CALL(rl_multi_string_pages, RL_OK, db, hashkey->value_page, pages);
+		if (hashkey->encoding == RL_VALUE_ENCODING_PAGE) {
+			pages[hashkey->value_page] = 1;
+			RL_CALL(rl_multi_string_pages, RL_OK, db, hashkey->value_page, pages);
+		}
 		pages[hashkey->string_page] = 1;
 		RL_CALL(rl_multi_string_pages, RL_OK, db, hashkey->string_page, pages);
 		rl_free(hashkey);
@@ -596,7 +764,7 @@ int rl_hash_delete(rlite *db, long value_page)
 	while ((retval = rl_btree_iterator_next(iterator, NULL, &tmp)) == RL_OK) {
 		hashkey = tmp;
 		rl_multi_string_delete(db, hashkey->string_page);
-		rl_multi_string_delete(db, hashkey->value_page);
+		hashkey_delete_value(db, hashkey);
 		rl_free(hashkey);
 	}
 	iterator = NULL;
@@ -1,17 +1,92 @@
 #include <stdlib.h>
+#include <string.h>
 #include "rlite/rlite.h"
 #include "rlite/page_multi_string.h"
 #include "rlite/type_list.h"
 #include "rlite/page_list.h"
+#include "rlite/pubsub.h"
 #include "rlite/util.h"
 
+static int value_create(rlite *db, unsigned char *data, long size, rl_list_value **_value)
+{
+	rl_list_value *value = NULL;
+	int retval;
+	if (size <= RL_LIST_INLINE_VALUE && size + 16 <= db->page_size) {
+		RL_MALLOC(value, sizeof(rl_list_value) + size);
+		value->page = 0;
+		value->size = size;
+		if (size > 0) {
+			memcpy(value->data, data, size);
+		}
+	}
+	else {
+		RL_MALLOC(value, sizeof(rl_list_value));
+		value->size = 0;
+		RL_CALL(rl_multi_string_set, RL_OK, db, &value->page, data, size);
+	}
+	*_value = value;
+	value = NULL;
+	retval = RL_OK;
+cleanup:
+	rl_free(value);
+	return retval;
+}
+
+static int value_get(rlite *db, rl_list_value *value, unsigned char **data, long *size)
+{
+	int retval;
+	if (value->page) {
+		RL_CALL(rl_multi_string_get, RL_OK, db, value->page, data, size);
+	}
+	else {
+		*size = value->size;
+		if (data) {
+			*data = NULL;
+			if (value->size > 0) {
+				RL_MALLOC(*data, sizeof(unsigned char) * (value->size + 1));
+				memcpy(*data, value->data, value->size);
+				(*data)[value->size] = 0;
+			}
+		}
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int value_cmp(rlite *db, rl_list_value *value, unsigned char *data, long size, int *cmp)
+{
+	int retval = RL_OK;
+	if (value->page) {
+		RL_CALL(rl_multi_string_cmp_str, RL_OK, db, value->page, data, size, cmp);
+	}
+	else {
+		*cmp = memcmp(value->data, data, value->size < size ? value->size : size);
+		if (*cmp == 0) {
+			*cmp = value->size == size ? 0 : (value->size < size ? -1 : 1);
+		}
+	}
+cleanup:
+	return retval;
+}
+
+static int value_delete(rlite *db, rl_list_value *value)
+{
+	int retval = RL_OK;
+	if (value->page) {
+		RL_CALL(rl_multi_string_delete, RL_OK, db, value->page);
+	}
+cleanup:
+	return retval;
+}
+
 static int rl_llist_create(rlite *db, long list_page, rl_list **_list)
 {
 	rl_list *list = NULL;
 
 	int retval;
-	RL_CALL(rl_list_create, RL_OK, db, &list, &rl_list_type_long);
-	RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_long, list_page, list);
+	RL_CALL(rl_list_create, RL_OK, db, &list, &rl_list_type_value);
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_value, list_page, list);
 
 	if (_list) {
 		*_list = list;
@@ -24,7 +99,7 @@ static int rl_llist_read(rlite *db, long list_page_number, rl_list **list)
 {
 	void *tmp;
 	int retval;
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, list_page_number, &rl_list_type_long, &tmp, 1);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_value, list_page_number, &rl_list_type_value, &tmp, 1);
 	*list = tmp;
 	retval = RL_OK;
 cleanup:
@@ -76,16 +151,18 @@ int rl_push(struct rlite *db, const unsigned char *key, long keylen, int create,
 	rl_list *list;
 	long list_page_number;
 	int retval, i;
-	long *value = NULL;
+	rl_list_value *value;
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, &list_page_number, &list, 1, create ? 1 : 0);
 	for (i = 0; i < valuec; i++) {
-		RL_MALLOC(value, sizeof(*value));
-		RL_CALL(rl_multi_string_set, RL_OK, db, value, values[i], valueslen[i]);
+		RL_CALL(value_create, RL_OK, db, values[i], valueslen[i], &value);
 		RL_CALL(rl_list_add_element, RL_OK, db, list, list_page_number, value, left ? 0 : -1);
 	}
 	if (size) {
 		*size = list->size;
 	}
+	if (valuec > 0) {
+		RL_CALL(rl_signal_key, RL_OK, db, key, keylen);
+	}
 	retval = RL_OK;
 cleanup:
 	return retval;
@@ -111,7 +188,8 @@ int rl_pop(struct rlite *db, const unsigned char *key, long keylen, unsigned cha
 	long position = left ? 0 : -1;
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, &list_page, &list, 1, 0);
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, (void **)&tmp, position);
-	page = *(long *)tmp;
+	RL_CALL(value_get, RL_OK, db, tmp, value, valuelen);
+	page = ((rl_list_value *)tmp)->page;
 	retval = rl_list_remove_element(db, list, list_page, position);
 	if (retval == RL_DELETED) {
 		RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
@@ -119,23 +197,96 @@ int rl_pop(struct rlite *db, const unsigned char *key, long keylen, unsigned cha
 	else if (retval != RL_OK) {
 		goto cleanup;
 	}
-	RL_CALL(rl_multi_string_get, RL_OK, db, page, value, valuelen);
-	RL_CALL(rl_multi_string_delete, RL_OK, db, page);
+	if (page) {
+		RL_CALL(rl_multi_string_delete, RL_OK, db, page);
+	}
 	retval = RL_OK;
 cleanup:
 	return retval;
 }
 
+typedef struct {
+	unsigned char **keys;
+	long *keyslen;
+	int left;
+	const unsigned char *destination;
+	long destinationlen;
+	int key_index;
+	unsigned char *value;
+	long valuelen;
+} bpop_context;
+
+static int bpop_key(rlite *db, int index, void *_context)
+{
+	bpop_context *context = _context;
+	unsigned char *value = NULL;
+	long valuelen;
+	rl_list *list;
+	int retval;
+	if (context->destination) {
+		// do not pop an element that cannot be pushed
+		RL_CALL(rl_llen, RL_OK, db, context->keys[index], context->keyslen[index], &valuelen);
+		retval = rl_llist_get_objects(db, context->destination, context->destinationlen, NULL, &list, 0, 0);
+		if (retval != RL_OK && retval != RL_NOT_FOUND) {
+			goto cleanup;
+		}
+	}
+	RL_CALL(rl_pop, RL_OK, db, context->keys[index], context->keyslen[index], &value, &valuelen, context->left);
+	if (context->destination) {
+		RL_CALL(rl_push, RL_OK, db, context->destination, context->destinationlen, 1, 1, 1, &value, &valuelen, NULL);
+	}
+	context->key_index = index;
+	context->value = value;
+	context->valuelen = valuelen;
+	value = NULL;
+cleanup:
+	rl_free(value);
+	return retval;
+}
+
+int rl_bpop(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, int left, struct timeval *timeout, int *key_index, unsigned char **value, long *valuelen)
+{
+	bpop_context context;
+	int retval;
+	context.keys = keys;
+	context.keyslen = keyslen;
+	context.left = left;
+	context.destination = NULL;
+	RL_CALL(rl_block_keys, RL_OK, db, keyc, keys, keyslen, timeout, bpop_key, &context);
+	*key_index = context.key_index;
+	*value = context.value;
+	*valuelen = context.valuelen;
+cleanup:
+	return retval;
+}
+
+int rl_brpoplpush(struct rlite *db, const unsigned char *source, long sourcelen, const unsigned char *destination, long destinationlen, struct timeval *timeout, unsigned char **value, long *valuelen)
+{
+	bpop_context context;
+	unsigned char *keys[1] = {(unsigned char *)source};
+	long keyslen[1] = {sourcelen};
+	int retval;
+	context.keys = keys;
+	context.keyslen = keyslen;
+	context.left = 0;
+	context.destination = destination;
+	context.destinationlen = destinationlen;
+	RL_CALL(rl_block_keys, RL_OK, db, 1, keys, keyslen, timeout, bpop_key, &context);
+	*value = context.value;
+	*valuelen = context.valuelen;
+cleanup:
+	return retval;
+}
+
 int rl_lindex(struct rlite *db, const unsigned char *key, long keylen, long index, unsigned char **value, long *valuelen)
 {
 	rl_list *list;
 	int retval;
 	void *tmp;
-	long page, list_page;
+	long list_page;
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, &list_page, &list, 0, 0);
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, (void **)&tmp, index);
-	page = *(long *)tmp;
-	RL_CALL(rl_multi_string_get, RL_OK, db, page, value, valuelen);
+	RL_CALL(value_get, RL_OK, db, tmp, value, valuelen);
 	retval = RL_OK;
 cleanup:
 	return retval;
@@ -144,9 +295,8 @@ cleanup:
 int rl_lrange_iterator(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, long *size, rl_list_iterator **_iterator)
 {
 	rl_list *list;
-	rl_list_iterator *iterator;
 	int retval;
-	long len, i = 0;
+	long len;
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, NULL, &list, 0, 0);
 	len = list->size;
 
@@ -170,11 +320,7 @@ int rl_lrange_iterator(struct rlite *db, const unsigned char *key, long keylen,
 	}
 	*size = stop - start + 1;
 
-	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
-	while (i < start && rl_list_iterator_next(iterator, NULL) == RL_OK) {
-		i++;
-	}
-	*_iterator = iterator;
+	RL_CALL(rl_list_iterator_create_at, RL_OK, db, _iterator, list, 1, start);
 cleanup:
 	return retval;
 }
@@ -198,7 +344,7 @@ int rl_lrange(struct rlite *db, const unsigned char *key, long keylen, long star
 	RL_MALLOC(valueslen, sizeof(unsigned char *) * size);
 	i = 0;
 	while (i < size && (retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		RL_CALL(rl_multi_string_get, RL_OK, db, *(long *)tmp, &values[i], &valueslen[i]);
+		RL_CALL(value_get, RL_OK, db, tmp, &values[i], &valueslen[i]);
 		rl_free(tmp);
 		i++;
 	}
@@ -227,15 +373,18 @@ int rl_linsert(struct rlite *db, const unsigned char *key, long keylen, int afte
 	rl_list_iterator *iterator;
 	int retval, cmp;
 	void *tmp;
-	long list_page, *value_page;
-	long member;
+	long list_page;
+	rl_list_value *new_value;
 	long pos = 0;
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, &list_page, &list, 1, 0);
 	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
 	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		member = *(long *)tmp;
+		retval = value_cmp(db, tmp, pivot, pivotlen, &cmp);
 		rl_free(tmp);
-		RL_CALL(rl_multi_string_cmp_str, RL_OK, db, member, pivot, pivotlen, &cmp);
+		if (retval != RL_OK) {
+			rl_list_iterator_destroy(db, iterator);
+			goto cleanup;
+		}
 		if (cmp == 0) {
 			retval = RL_FOUND;
 			break;
@@ -250,9 +399,8 @@ int rl_linsert(struct rlite *db, const unsigned char *key, long keylen, int afte
 		rl_list_iterator_destroy(db, iterator);
 	}
 	if (retval == RL_FOUND) {
-		RL_MALLOC(value_page, sizeof(*value_page));
-		RL_CALL(rl_multi_string_set, RL_OK, db, value_page, value, valuelen);
-		RL_CALL(rl_list_add_element, RL_OK, db, list, list_page, value_page, pos + (after ? 1 : 0));
+		RL_CALL(value_create, RL_OK, db, value, valuelen, &new_value);
+		RL_CALL(rl_list_add_element, RL_OK, db, list, list_page, new_value, pos + (after ? 1 : 0));
 		retval = RL_OK;
 	}
 	if (size) {
@@ -266,7 +414,7 @@ static int search(struct rlite *db, rl_list *list, unsigned char *value, long va
 {
 	rl_list_iterator *iterator;
 	int retval, cmp;
-	long member;
+	rl_list_value *member;
 	long pos = direction > 0 ? 0 : list->size - 1;
 	void *tmp = NULL;
 	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, direction);
@@ -275,13 +423,19 @@ static int search(struct rlite *db, rl_list *list, unsigned char *value, long va
 			pos += direction;
 			continue;
 		}
-		member = *(long *)tmp;
-		rl_free(tmp);
-		RL_CALL(rl_multi_string_cmp_str, RL_OK, db, member, value, valuelen, &cmp);
+		member = tmp;
+		tmp = NULL;
+		retval = value_cmp(db, member, value, valuelen, &cmp);
+		if (retval != RL_OK) {
+			rl_free(member);
+			rl_list_iterator_destroy(db, iterator);
+			goto cleanup;
+		}
+		if (page) {
+			*page = member->page;
+		}
+		rl_free(member);
 		if (cmp == 0) {
-			if (page) {
-				*page = member;
-			}
 			*position = pos;
 			retval = RL_FOUND;
 			break;
@@ -320,7 +474,9 @@ int rl_lrem(struct rlite *db, const unsigned char *key, long keylen, int directi
 		}
 		else if (retval == RL_FOUND) {
 			count++;
-			RL_CALL(rl_multi_string_delete, RL_OK, db, page);
+			if (page) {
+				RL_CALL(rl_multi_string_delete, RL_OK, db, page);
+			}
 			retval = rl_list_remove_element(db, list, list_page, pos);
 			if (retval == RL_DELETED) {
 				RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
@@ -354,15 +510,12 @@ int rl_lset(struct rlite *db, const unsigned char *key, long keylen, long index,
 {
 	rl_list *list;
 	int retval;
-	long list_page, *value_page;
+	long list_page;
+	rl_list_value *new_value;
 	void *tmp;
 
 	RL_CALL(rl_llist_get_objects, RL_OK, db, key, keylen, &list_page, &list, 1, 0);
 
-	// first add the new one and then delete the old one
-	// we could instead add an update to page_list
-	// but don't delete first since we might delete the only element
-
 	if (index < 0) {
 		index += list->size;
 		if (index < 0) {
@@ -375,14 +528,11 @@ int rl_lset(struct rlite *db, const unsigned char *key, long keylen, long index,
 		goto cleanup;
 	}
 
-	RL_MALLOC(value_page, sizeof(*value_page));
-	RL_CALL(rl_multi_string_set, RL_OK, db, value_page, value, valuelen);
-	RL_CALL(rl_list_add_element, RL_OK, db, list, list_page, value_page, index + 1);
-
 	RL_CALL(rl_list_get_element, RL_FOUND, db, list, (void **)&tmp, index);
-	RL_CALL(rl_multi_string_delete, RL_OK, db, *(long *)tmp);
-	RL_CALL(rl_list_remove_element, RL_OK, db, list, list_page, index);
-	retval = RL_OK;
+	RL_CALL(value_delete, RL_OK, db, tmp);
+	RL_CALL(value_create, RL_OK, db, value, valuelen, &new_value);
+	// the list node takes ownership of new_value
+	RL_CALL(rl_list_set_element, RL_OK, db, list, list_page, new_value, index);
 cleanup:
 	return retval;
 }
@@ -416,12 +566,12 @@ int rl_ltrim(struct rlite *db, const unsigned char *key, long keylen, long start
 	}
 	for (i = 0; i < start; i++) {
 		RL_CALL(rl_list_get_element, RL_FOUND, db, list, (void **)&tmp, 0);
-		RL_CALL(rl_multi_string_delete, RL_OK, db, *(long *)tmp);
+		RL_CALL(value_delete, RL_OK, db, tmp);
 		RL_CALL(rl_list_remove_element, RL_OK, db, list, list_page, 0);
 	}
 	while (list->size > stop - start + 1) {
 		RL_CALL(rl_list_get_element, RL_FOUND, db, list, (void **)&tmp, -1);
-		RL_CALL(rl_multi_string_delete, RL_OK, db, *(long *)tmp);
+		RL_CALL(value_delete, RL_OK, db, tmp);
 		RL_CALL(rl_list_remove_element, RL_OK, db, list, list_page, -1);
 	}
 	retval = RL_OK;
@@ -432,17 +582,19 @@ cleanup:
 int rl_llist_iterator_next(rl_llist_iterator *iterator, long *_page, unsigned char **value, long *valuelen)
 {
 	void *tmp;
-	long page;
+	rlite *db = iterator->db;
 	int retval = rl_list_iterator_next(iterator, &tmp);
 	if (retval == RL_OK) {
-		page = *(long *)tmp;
 		if (_page) {
-			*_page = page;
+			*_page = ((rl_list_value *)tmp)->page;
 		}
+		retval = value_get(db, tmp, value, valuelen);
 		rl_free(tmp);
-		RL_CALL(rl_multi_string_get, RL_OK, iterator->db, page, value, valuelen);
+		if (retval != RL_OK) {
+			// like rl_list_iterator_next, the iterator is done on failure
+			rl_list_iterator_destroy(db, iterator);
+		}
 	}
-cleanup:
 	return retval;
 }
 
@@ -456,19 +608,24 @@ int rl_llist_pages(struct rlite *db, long page, short *pages)
 	rl_list_iterator *iterator;
 	int retval;
 	void *tmp;
-	long member;
+	rl_list_value *member;
 
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, page, &rl_list_type_long, &tmp, 1);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_value, page, &rl_list_type_value, &tmp, 1);
 	list = tmp;
 
 	RL_CALL(rl_list_pages, RL_OK, db, list, pages);
 
 	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
 	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		member = *(long *)tmp;
-		pages[member] = 1;
-		RL_CALL(rl_multi_string_pages, RL_OK, db, member, pages);
-		rl_free(tmp);
+		member = tmp;
+		if (member->page) {
+			pages[member->page] = 1;
+			retval = rl_multi_string_pages(db, member->page, pages);
+		}
+		rl_free(member);
+		if (retval != RL_OK) {
+			goto cleanup;
+		}
 	}
 	iterator = NULL;
 
@@ -489,15 +646,13 @@ int rl_llist_delete(rlite *db, long value_page)
 {
 	rl_list *list = NULL;
 	rl_list_iterator *iterator;
-	long member;
 	int retval;
 	void *tmp;
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, value_page, &rl_list_type_long, &tmp, 1);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_value, value_page, &rl_list_type_value, &tmp, 1);
 	list = tmp;
 	RL_CALL(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
 	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
-		member = *(long *)tmp;
-		rl_multi_string_delete(db, member);
+		value_delete(db, tmp);
 		rl_free(tmp);
 	}
 	iterator = NULL;
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "rlite/rlite.h"
 #include "rlite/page_multi_string.h"
 #include "rlite/type_set.h"
@@ -91,7 +92,13 @@ int rl_sadd(struct rlite *db, const unsigned char *key, long keylen, int memberc
 		if (retval == RL_NOT_FOUND) {
 			RL_MALLOC(member, sizeof(*member));
 			RL_CALL(rl_multi_string_set, RL_OK, db, member, members[i], memberslen[i]);
-			RL_CALL(rl_btree_add_element, RL_OK, db, set, set_page_number, digest, member);
+			retval = rl_btree_add_element(db, set, set_page_number, digest, member);
+			// the btree owns them, even on failure
+			digest = NULL;
+			member = NULL;
+			if (retval != RL_OK) {
+				goto cleanup;
+			}
 			count++;
 		}
 		else if (retval == RL_FOUND) {
@@ -170,6 +177,37 @@ cleanup:
 	return retval;
 }
 
+int rl_smismember(struct rlite *db, const unsigned char *key, long keylen, int memberc, unsigned char **members, long *memberslen, int *results)
+{
+	int retval, i;
+	long set_page_number;
+	rl_btree *set;
+	unsigned char *digests = NULL;
+	void **scores = NULL, **values = NULL;
+	for (i = 0; i < memberc; i++) {
+		results[i] = 0;
+	}
+	RL_CALL(rl_set_get_objects, RL_OK, db, key, keylen, &set_page_number, &set, 0, 0);
+
+	RL_MALLOC(digests, sizeof(unsigned char) * 20 * memberc);
+	RL_MALLOC(scores, sizeof(void *) * memberc);
+	RL_MALLOC(values, sizeof(void *) * memberc);
+	for (i = 0; i < memberc; i++) {
+		RL_CALL(sha1, RL_OK, members[i], memberslen[i], &digests[i * 20]);
+		scores[i] = &digests[i * 20];
+	}
+	RL_CALL(rl_btree_find_scores, RL_OK, db, set, memberc, scores, values);
+	for (i = 0; i < memberc; i++) {
+		results[i] = values[i] != NULL;
+	}
+	retval = RL_OK;
+cleanup:
+	rl_free(digests);
+	rl_free(scores);
+	rl_free(values);
+	return retval;
+}
+
 int rl_scard(struct rlite *db, const unsigned char *key, long keylen, long *card)
 {
 	int retval;
@@ -186,7 +224,7 @@ int rl_smove(struct rlite *db, const unsigned char *source, long sourcelen, cons
 {
 	rl_btree *source_hash, *target_hash;
 	void *tmp;
-	long target_page_number, source_page_number, *member_page_number;
+	long target_page_number, source_page_number, *member_page_number = NULL;
 	int retval;
 	unsigned char *digest = NULL;
 	// make sure the target key is a set or does not exist
@@ -210,13 +248,24 @@ int rl_smove(struct rlite *db, const unsigned char *source, long sourcelen, cons
 		goto cleanup;
 	}
 	RL_CALL(rl_set_get_objects, RL_OK, db, destination, destinationlen, &target_page_number, &target_hash, 1, 1);
+	retval = rl_btree_find_score(db, target_hash, digest, NULL, NULL, NULL);
+	if (retval == RL_FOUND) {
+		// the destination already has it, moving is just removing from the source
+		retval = RL_OK;
+		goto cleanup;
+	}
+	else if (retval != RL_NOT_FOUND) {
+		goto cleanup;
+	}
 	RL_MALLOC(member_page_number, sizeof(*member_page_number))
 	RL_CALL(rl_multi_string_set, RL_OK, db, member_page_number, member, memberlen);
-	RL_CALL(rl_btree_add_element, RL_OK, db, target_hash, target_page_number, digest, member_page_number);
+	retval = rl_btree_add_element(db, target_hash, target_page_number, digest, member_page_number);
+	// the btree owns them, even on failure
+	digest = NULL;
+	member_page_number = NULL;
 cleanup:
-	if (retval != RL_OK) {
-		rl_free(digest);
-	}
+	rl_free(digest);
+	rl_free(member_page_number);
 	return retval;
 }
 
@@ -254,50 +303,132 @@ cleanup:
 	return retval;
 }
 
-static int contains(long size, long *elements, long element)
+int rl_sscan(struct rlite *db, const unsigned char *key, long keylen, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned long long *next_cursor, long *_membersc, unsigned char ***_members, long **_memberslen)
 {
-	long i;
-	for (i = 0; i < size; i++) {
-		if (element == elements[i]) {
-			return 1;
+	int retval;
+	rl_btree *set;
+	void **pages = NULL;
+	long i, pagesc = 0, membersc = 0, memberlen;
+	unsigned char **members = NULL, *member;
+	long *memberslen = NULL;
+	RL_CALL(rl_set_get_objects, RL_OK, db, key, keylen, NULL, &set, 0, 0);
+	RL_CALL(rl_btree_scan, RL_OK, db, set, cursor, count, next_cursor, &pagesc, &pages);
+	RL_MALLOC(members, sizeof(unsigned char *) * (pagesc + 1));
+	RL_MALLOC(memberslen, sizeof(long) * (pagesc + 1));
+	for (i = 0; i < pagesc; i++) {
+		RL_CALL(rl_multi_string_get, RL_OK, db, *(long *)pages[i], &member, &memberlen);
+		if (!pattern || rl_stringmatchlen((char *)pattern, patternlen, (char *)member, memberlen, 0)) {
+			members[membersc] = member;
+			memberslen[membersc] = memberlen;
+			membersc++;
+		}
+		else {
+			rl_free(member);
+		}
+	}
+	*_membersc = membersc;
+	*_members = members;
+	*_memberslen = memberslen;
+	retval = RL_OK;
+cleanup:
+	for (i = 0; i < pagesc; i++) {
+		rl_free(pages[i]);
+	}
+	rl_free(pages);
+	if (retval != RL_OK) {
+		for (i = 0; i < membersc; i++) {
+			rl_free(members[i]);
+		}
+		rl_free(members);
+		rl_free(memberslen);
+	}
+	return retval;
+}
+
+static int rank_cmp(const void *a, const void *b)
+{
+	long ra = *(const long *)a, rb = *(const long *)b;
+	return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+static long random_rank(long size)
+{
+	return (long)(((double)rand() / ((double)RAND_MAX + 1)) * size);
+}
+
+/**
+ * Picks `count` different ranks lower than `size`, sorted, every subset
+ * having the same probability.
+ */
+static void sample_ranks(long size, long count, long *ranks)
+{
+	long i, n = 0;
+	if (count * 2 > size) {
+		// selection sampling, each rank is taken with probability missing / left
+		for (i = 0; i < size && n < count; i++) {
+			if (random_rank(size - i) < count - n) {
+				ranks[n++] = i;
+			}
+		}
+		return;
+	}
+	// with a small sample repetitions are rare, draw again only the repeated ones
+	while (n < count) {
+		for (i = n; i < count; i++) {
+			ranks[i] = random_rank(size);
+		}
+		qsort(ranks, count, sizeof(long), rank_cmp);
+		n = 1;
+		for (i = 1; i < count; i++) {
+			if (ranks[i] != ranks[n - 1]) {
+				ranks[n++] = ranks[i];
+			}
 		}
 	}
-	return 0;
 }
 
 int rl_srandmembers(struct rlite *db, const unsigned char *key, long keylen, int repeat, long *memberc, unsigned char ***_members, long **_memberslen)
 {
-	long i;
+	long i, j, tmplen;
 	int retval;
 	long *member;
-	long *used_members = NULL;
+	long *ranks = NULL;
 	rl_btree *set;
-	unsigned char **members = NULL;
+	unsigned char **members = NULL, *tmp;
 	long *memberslen = NULL;
 	RL_CALL(rl_set_get_objects, RL_OK, db, key, keylen, NULL, &set, 0, 0);
 	if (!repeat) {
 		if (*memberc > set->number_of_elements) {
 			*memberc = set->number_of_elements;
 		}
-		RL_MALLOC(used_members, sizeof(long) * *memberc);
+		RL_MALLOC(ranks, sizeof(long) * *memberc);
+		sample_ranks(set->number_of_elements, *memberc, ranks);
 	}
 
 	RL_MALLOC(members, sizeof(unsigned char *) * *memberc);
 	RL_MALLOC(memberslen, sizeof(long) * *memberc);
 
 	for (i = 0; i < *memberc; i++) {
-		RL_CALL(rl_btree_random_element, RL_OK, db, set, NULL, (void **)&member);
-		if (!repeat) {
-			if (contains(i, used_members, *member)) {
-				i--;
-				continue;
-			}
-			else {
-				used_members[i] = *member;
-			}
+		if (repeat) {
+			RL_CALL(rl_btree_random_element, RL_OK, db, set, NULL, (void **)&member);
+		}
+		else {
+			RL_CALL(rl_btree_get_element, RL_OK, db, set, ranks[i], NULL, (void **)&member);
 		}
 		RL_CALL(rl_multi_string_get, RL_OK, db, *member, &members[i], &memberslen[i]);
 	}
+	if (!repeat) {
+		// the ranks are sorted, shuffle them back
+		for (i = *memberc - 1; i > 0; i--) {
+			j = random_rank(i + 1);
+			tmp = members[i];
+			members[i] = members[j];
+			members[j] = tmp;
+			tmplen = memberslen[i];
+			memberslen[i] = memberslen[j];
+			memberslen[j] = tmplen;
+		}
+	}
 	*_members = members;
 	*_memberslen = memberslen;
 cleanup:
@@ -305,7 +436,7 @@ cleanup:
 		rl_free(members);
 		rl_free(memberslen);
 	}
-	rl_free(used_members);
+	rl_free(ranks);
 	return retval;
 }
 
@@ -331,405 +462,577 @@ cleanup:
 	return retval;
 }
 
-int rl_sdiff(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
-{
-	int retval, found;
-	rl_btree *source = NULL;
-	rl_btree **sets = NULL;
+#define SET_OP_INTER 0
+#define SET_OP_UNION 1
+#define SET_OP_DIFF 2
+
+typedef struct {
 	rl_btree_iterator *iterator;
-	unsigned char **members = NULL, *digest;
-	long *memberslen = NULL, i, member_page, setsc = 0;
-	long membersc = 0;
-	void *tmp;
+	unsigned char *digest;
+	long member_page;
+} set_cursor;
 
-	if (keyc == 0) {
-		retval = RL_NOT_FOUND;
-		goto cleanup;
+static int set_cursor_next(set_cursor *cursor)
+{
+	int retval;
+	void *tmp;
+	rl_free(cursor->digest);
+	cursor->digest = NULL;
+	retval = rl_btree_iterator_next(cursor->iterator, (void **)&cursor->digest, &tmp);
+	if (retval == RL_OK) {
+		cursor->member_page = *(long *)tmp;
+		rl_free(tmp);
 	}
+	else {
+		// the iterator destroys itself when it is done
+		cursor->iterator = NULL;
+	}
+	return retval;
+}
 
-	RL_CALL(rl_set_get_objects, RL_OK, db, keys[0], keyslen[0], NULL, &source, 0, 0);
-	RL_MALLOC(members, sizeof(unsigned char *) * source->number_of_elements);
-	RL_MALLOC(memberslen, sizeof(long) * source->number_of_elements);
-	RL_MALLOC(sets, sizeof(rl_btree *) * (keyc - 1));
-	for (i = 1; i < keyc; i++) {
-		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &sets[setsc], 0, 0);
-		if (retval == RL_OK) {
-			setsc++;
+static void set_cursor_heap_down(set_cursor **heap, long size, long i)
+{
+	long child;
+	set_cursor *tmp;
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size && memcmp(heap[child + 1]->digest, heap[child]->digest, 20) < 0) {
+			child++;
 		}
-		else if (retval != RL_NOT_FOUND) {
-			goto cleanup;
+		if (memcmp(heap[i]->digest, heap[child]->digest, 20) <= 0) {
+			break;
 		}
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
 	}
+}
 
-	RL_CALL(rl_btree_iterator_create, RL_OK, db, source, &iterator);
-	while ((retval = rl_btree_iterator_next(iterator, (void **)&digest, &tmp)) == RL_OK) {
-		found = 0;
-		for (i = 0; i < setsc; i++) {
-			retval = rl_btree_find_score(db, sets[i], digest, NULL, NULL, NULL);
-			if (retval == RL_FOUND) {
-				found = 1;
-				break;
+/**
+ * Moves the cursor with the lowest digest forward, dropping it from the heap
+ * when it has no more members.
+ */
+static int set_cursor_heap_next(set_cursor **heap, long *size)
+{
+	int retval = set_cursor_next(heap[0]);
+	if (retval == RL_END) {
+		heap[0] = heap[--(*size)];
+	}
+	else if (retval != RL_OK) {
+		return retval;
+	}
+	set_cursor_heap_down(heap, *size, 0);
+	return RL_OK;
+}
+
+static void set_merge_add(set_cursor *cursor, unsigned char *digests, long *member_pages, long *size)
+{
+	memcpy(&digests[*size * 20], cursor->digest, 20);
+	member_pages[*size] = cursor->member_page;
+	(*size)++;
+}
+
+/**
+ * Combines `sets` walking each of them once in digest order, which all set
+ * btrees share. The result is sorted by digest and only has the member
+ * pages, the member strings are not read. For SET_OP_DIFF the members of
+ * `sets[0]` not in the other sets are returned. When `limit` is positive,
+ * stops after that many members.
+ */
+static int set_merge(rlite *db, int op, long setc, rl_btree **sets, long limit, long *_size, unsigned char **_digests, long **_member_pages)
+{
+	int retval = RL_OK;
+	set_cursor *cursors = NULL, **heap = NULL, *max = NULL, *source = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, i, heapc = 0, alloc = 0, size = 0;
+
+	for (i = 0; i < setc; i++) {
+		if (op == SET_OP_UNION) {
+			alloc += sets[i]->number_of_elements;
+		}
+		else if (op == SET_OP_INTER) {
+			if (i == 0 || sets[i]->number_of_elements < alloc) {
+				alloc = sets[i]->number_of_elements;
 			}
 		}
-		if (!found) {
-			member_page = *(long *)tmp;
-			RL_CALL(rl_multi_string_get, RL_OK, db, member_page, &members[membersc], &memberslen[membersc]);
-			membersc++;
+		else if (i == 0) {
+			alloc = sets[0]->number_of_elements;
 		}
-		rl_free(digest);
-		rl_free(tmp);
 	}
-	iterator = NULL;
-
-	if (retval != RL_END) {
+	if (limit > 0 && limit < alloc) {
+		alloc = limit;
+	}
+	if (alloc == 0) {
 		goto cleanup;
 	}
 
-	if (membersc == 0) {
-		retval = RL_NOT_FOUND;
-		goto cleanup;
+	RL_MALLOC(digests, sizeof(unsigned char) * 20 * alloc);
+	RL_MALLOC(member_pages, sizeof(long) * alloc);
+	RL_MALLOC(cursors, sizeof(set_cursor) * setc);
+	for (i = 0; i < setc; i++) {
+		cursors[i].iterator = NULL;
+		cursors[i].digest = NULL;
 	}
-	else if (membersc == source->number_of_elements) {
-		*_members = members;
-		*_memberslen = memberslen;
+	RL_MALLOC(heap, sizeof(set_cursor *) * setc);
+	for (i = 0; i < setc; i++) {
+		RL_CALL(rl_btree_iterator_create, RL_OK, db, sets[i], &cursors[i].iterator);
+		RL_CALL(set_cursor_next, RL_OK, &cursors[i]);
+		if (op == SET_OP_DIFF && i == 0) {
+			source = &cursors[0];
+			continue;
+		}
+		heap[heapc++] = &cursors[i];
+		if (!max || memcmp(cursors[i].digest, max->digest, 20) > 0) {
+			max = &cursors[i];
+		}
+	}
+	for (i = heapc / 2 - 1; i >= 0; i--) {
+		set_cursor_heap_down(heap, heapc, i);
+	}
+
+	if (op == SET_OP_INTER) {
+		// every set has a member when the lowest and the highest cursors match
+		while (size < alloc) {
+			if (memcmp(heap[0]->digest, max->digest, 20) == 0) {
+				set_merge_add(heap[0], digests, member_pages, &size);
+			}
+			retval = set_cursor_next(heap[0]);
+			if (retval == RL_END) {
+				break;
+			}
+			else if (retval != RL_OK) {
+				goto cleanup;
+			}
+			if (memcmp(heap[0]->digest, max->digest, 20) > 0) {
+				max = heap[0];
+			}
+			set_cursor_heap_down(heap, heapc, 0);
+		}
+	}
+	else if (op == SET_OP_UNION) {
+		while (heapc > 0 && size < alloc) {
+			if (size == 0 || memcmp(&digests[(size - 1) * 20], heap[0]->digest, 20) != 0) {
+				set_merge_add(heap[0], digests, member_pages, &size);
+			}
+			RL_CALL(set_cursor_heap_next, RL_OK, heap, &heapc);
+		}
 	}
 	else {
-		*_members = rl_realloc(members, sizeof(unsigned char *) * membersc);
-		if (*_members == NULL) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
+		while (size < alloc) {
+			while (heapc > 0 && memcmp(heap[0]->digest, source->digest, 20) < 0) {
+				RL_CALL(set_cursor_heap_next, RL_OK, heap, &heapc);
+			}
+			if (heapc == 0 || memcmp(heap[0]->digest, source->digest, 20) != 0) {
+				set_merge_add(source, digests, member_pages, &size);
+			}
+			retval = set_cursor_next(source);
+			if (retval == RL_END) {
+				break;
+			}
+			else if (retval != RL_OK) {
+				goto cleanup;
+			}
 		}
-		*_memberslen = rl_realloc(memberslen, sizeof(long) * membersc);
-		if (*_memberslen == NULL) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
+	}
+	retval = RL_OK;
+cleanup:
+	if (cursors) {
+		for (i = 0; i < setc; i++) {
+			if (cursors[i].iterator) {
+				rl_btree_iterator_destroy(cursors[i].iterator);
+			}
+			rl_free(cursors[i].digest);
 		}
 	}
+	rl_free(cursors);
+	rl_free(heap);
+	if (retval == RL_OK) {
+		*_size = size;
+		*_digests = digests;
+		*_member_pages = member_pages;
+	}
+	else {
+		rl_free(digests);
+		rl_free(member_pages);
+	}
+	return retval;
+}
 
+static int set_merge_members(rlite *db, long size, long *member_pages, unsigned char ***_members, long **_memberslen)
+{
+	int retval = RL_OK;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, i = 0;
+	if (size > 0) {
+		RL_MALLOC(members, sizeof(unsigned char *) * size);
+		RL_MALLOC(memberslen, sizeof(long) * size);
+		for (i = 0; i < size; i++) {
+			RL_CALL(rl_multi_string_get, RL_OK, db, member_pages[i], &members[i], &memberslen[i]);
+		}
+	}
+	*_members = members;
+	*_memberslen = memberslen;
 	retval = RL_OK;
 cleanup:
-	*_membersc = membersc;
 	if (retval != RL_OK) {
+		while (i-- > 0) {
+			rl_free(members[i]);
+		}
 		rl_free(members);
 		rl_free(memberslen);
 	}
-	rl_free(sets);
 	return retval;
 }
 
-int rl_sdiffstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
+/**
+ * Replaces `target` with a set of `members`, which are sorted by their
+ * distinct `digests`. The btree is written in one pass instead of splitting
+ * nodes on every insertion.
+ */
+static int set_bulk_store(rlite *db, const unsigned char *target, long targetlen, long size, unsigned char *digests, unsigned char **members, long *memberslen, long *added)
 {
 	int retval;
-	unsigned char **members = NULL;
-	long *memberslen = NULL, membersc = 0, i;
+	void **scores = NULL, **values = NULL;
+	long target_page_number, i, loaded = 0;
+	rl_btree *target_set;
 
 	retval = rl_key_delete_with_value(db, target, targetlen);
 	if (retval != RL_NOT_FOUND && retval != RL_OK) {
 		goto cleanup;
 	}
-	*added = 0;
-	// this might be done more efficiently since we don't really need to have all members in memory
-	// at the same time, but this is so easy to do...
-	RL_CALL(rl_sdiff, RL_OK, db, keyc, keys, keyslen, &membersc, &members, &memberslen);
-	if (membersc > 0) {
-		RL_CALL(rl_sadd, RL_OK, db, target, targetlen, membersc, members, memberslen, added);
+	if (size > 0) {
+		RL_MALLOC(scores, sizeof(void *) * size);
+		RL_MALLOC(values, sizeof(void *) * size);
+		for (i = 0; i < size; i++) {
+			scores[i] = values[i] = NULL;
+		}
+		for (i = 0; i < size; i++) {
+			RL_MALLOC(scores[i], sizeof(unsigned char) * 20);
+			memcpy(scores[i], &digests[i * 20], 20);
+			RL_MALLOC(values[i], sizeof(long));
+			RL_CALL(rl_multi_string_set, RL_OK, db, values[i], members[i], memberslen[i]);
+		}
+		RL_CALL(rl_set_get_objects, RL_OK, db, target, targetlen, &target_page_number, &target_set, 0, 1);
+		retval = rl_btree_bulk_load(db, target_set, target_page_number, size, scores, values, 1.0);
+		// the btree owns them now unless they were rejected up front
+		loaded = retval != RL_INVALID_PARAMETERS;
+		if (retval != RL_OK) {
+			goto cleanup;
+		}
+	}
+	if (added) {
+		*added = size;
 	}
+	retval = RL_OK;
 cleanup:
-	for (i = 0; i < membersc; i++) {
-		rl_free(members[i]);
+	if (!loaded && scores) {
+		for (i = 0; i < size; i++) {
+			rl_free(scores[i]);
+			rl_free(values[i]);
+		}
 	}
-	rl_free(members);
-	rl_free(memberslen);
+	rl_free(scores);
+	rl_free(values);
 	return retval;
 }
 
-int rl_sinter(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
+/**
+ * Replaces `target` with a set of the merged members. The members are read
+ * before deleting the target since it may be one of the merged sets.
+ */
+static int set_merge_store(rlite *db, unsigned char *target, long targetlen, long size, unsigned char *digests, long *member_pages, long *added)
 {
-	int retval, found;
-	rl_btree **sets = NULL;
-	rl_btree_iterator *iterator;
-	unsigned char **members = NULL, *digest;
-	long *memberslen = NULL, i, member_page;
-	long membersc = 0, maxmemberc = 0;
-	void *tmp;
-
-	if (keyc == 0) {
-		retval = RL_NOT_FOUND;
-		goto cleanup;
-	}
+	int retval;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, i;
 
-	RL_MALLOC(sets, sizeof(rl_btree *) * keyc);
-	for (i = 0; i < keyc; i++) {
-		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &sets[i], 0, 0);
-		if (retval != RL_OK) {
-			goto cleanup;
-		}
-		if (i == 0 || sets[i]->number_of_elements < maxmemberc) {
-			maxmemberc = sets[i]->number_of_elements;
-			if (i != 0) {
-				tmp = sets[i];
-				sets[i] = sets[0];
-				sets[0] = tmp;
-			}
+	RL_CALL(set_merge_members, RL_OK, db, size, member_pages, &members, &memberslen);
+	RL_CALL(set_bulk_store, RL_OK, db, target, targetlen, size, digests, members, memberslen, added);
+cleanup:
+	if (members) {
+		for (i = 0; i < size; i++) {
+			rl_free(members[i]);
 		}
 	}
+	rl_free(members);
+	rl_free(memberslen);
+	return retval;
+}
 
-	if (maxmemberc == 0) {
+/**
+ * Reads the sets to diff, missing sets other than the first are skipped
+ */
+static int set_diff_objects(rlite *db, int keyc, unsigned char **keys, long *keyslen, rl_btree **sets, long *setc)
+{
+	int retval;
+	long i;
+	*setc = 0;
+	if (keyc == 0) {
 		retval = RL_NOT_FOUND;
 		goto cleanup;
 	}
-	RL_MALLOC(members, sizeof(unsigned char *) * maxmemberc);
-	RL_MALLOC(memberslen, sizeof(long) * maxmemberc);
-
-	RL_CALL(rl_btree_iterator_create, RL_OK, db, sets[0], &iterator);
-	while ((retval = rl_btree_iterator_next(iterator, (void **)&digest, &tmp)) == RL_OK) {
-		found = 1;
-		for (i = 1; i < keyc; i++) {
-			retval = rl_btree_find_score(db, sets[i], digest, NULL, NULL, NULL);
-			if (retval == RL_NOT_FOUND) {
-				found = 0;
-				break;
-			}
+	RL_CALL(rl_set_get_objects, RL_OK, db, keys[0], keyslen[0], NULL, &sets[0], 0, 0);
+	*setc = 1;
+	for (i = 1; i < keyc; i++) {
+		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &sets[*setc], 0, 0);
+		if (retval == RL_OK) {
+			(*setc)++;
 		}
-		if (found) {
-			member_page = *(long *)tmp;
-			RL_CALL(rl_multi_string_get, RL_OK, db, member_page, &members[membersc], &memberslen[membersc]);
-			membersc++;
+		else if (retval != RL_NOT_FOUND) {
+			goto cleanup;
 		}
-		rl_free(digest);
-		rl_free(tmp);
 	}
-	iterator = NULL;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
 
-	if (retval != RL_END) {
-		goto cleanup;
+/**
+ * Reads the sets to intersect, returns RL_NOT_FOUND if any of them is
+ * missing
+ */
+static int set_inter_objects(rlite *db, int keyc, unsigned char **keys, long *keyslen, rl_btree **sets)
+{
+	int retval = RL_NOT_FOUND;
+	long i;
+	for (i = 0; i < keyc; i++) {
+		RL_CALL(rl_set_get_objects, RL_OK, db, keys[i], keyslen[i], NULL, &sets[i], 0, 0);
 	}
+cleanup:
+	return retval;
+}
 
-	*_membersc = membersc;
-	if (membersc == maxmemberc) {
-		*_members = members;
-		*_memberslen = memberslen;
-	}
-	else {
-		*_members = rl_realloc(members, sizeof(unsigned char *) * membersc);
-		if (*_members == NULL) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
+/**
+ * Reads the sets to unite, missing sets are skipped
+ */
+static int set_union_objects(rlite *db, int keyc, unsigned char **keys, long *keyslen, rl_btree **sets, long *setc)
+{
+	int retval = RL_OK;
+	long i;
+	*setc = 0;
+	for (i = 0; i < keyc; i++) {
+		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &sets[*setc], 0, 0);
+		if (retval == RL_OK) {
+			(*setc)++;
 		}
-		*_memberslen = rl_realloc(memberslen, sizeof(long) * membersc);
-		if (*_memberslen == NULL) {
-			retval = RL_OUT_OF_MEMORY;
+		else if (retval != RL_NOT_FOUND) {
 			goto cleanup;
 		}
 	}
+	retval = *setc > 0 ? RL_OK : RL_NOT_FOUND;
+cleanup:
+	return retval;
+}
+
+int rl_sdiff(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
+{
+	int retval;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, setc, membersc = 0;
 
+	RL_MALLOC(sets, sizeof(rl_btree *) * (keyc > 0 ? keyc : 1));
+	RL_CALL(set_diff_objects, RL_OK, db, keyc, keys, keyslen, sets, &setc);
+	RL_CALL(set_merge, RL_OK, db, SET_OP_DIFF, setc, sets, 0, &membersc, &digests, &member_pages);
+	if (membersc == 0) {
+		retval = RL_NOT_FOUND;
+		goto cleanup;
+	}
+	RL_CALL(set_merge_members, RL_OK, db, membersc, member_pages, _members, _memberslen);
 	retval = RL_OK;
 cleanup:
-	if (retval != RL_OK) {
-		*_membersc = 0;
-		rl_free(members);
-		rl_free(memberslen);
-	}
+	*_membersc = retval == RL_OK ? membersc : 0;
 	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
 	return retval;
 }
 
-int rl_sinterstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
+int rl_sdiffstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
 {
 	int retval;
-	unsigned char **members = NULL;
-	long *memberslen = NULL, membersc = 0, i;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, setc, membersc = 0;
 
-	retval = rl_key_delete_with_value(db, target, targetlen);
-	if (retval != RL_NOT_FOUND && retval != RL_OK) {
-		goto cleanup;
-	}
 	*added = 0;
-	// this might be done more efficiently since we don't really need to have all members in memory
-	// at the same time, but this is so easy to do...
-	RL_CALL(rl_sinter, RL_OK, db, keyc, keys, keyslen, &membersc, &members, &memberslen);
-	if (membersc > 0) {
-		RL_CALL(rl_sadd, RL_OK, db, target, targetlen, membersc, members, memberslen, added);
+	RL_MALLOC(sets, sizeof(rl_btree *) * (keyc > 0 ? keyc : 1));
+	RL_CALL2(set_diff_objects, RL_OK, RL_NOT_FOUND, db, keyc, keys, keyslen, sets, &setc);
+	if (retval == RL_OK) {
+		RL_CALL(set_merge, RL_OK, db, SET_OP_DIFF, setc, sets, 0, &membersc, &digests, &member_pages);
 	}
+	RL_CALL(set_merge_store, RL_OK, db, target, targetlen, membersc, digests, member_pages, added);
 cleanup:
-	for (i = 0; i < membersc; i++) {
-		rl_free(members[i]);
-	}
-	rl_free(members);
-	rl_free(memberslen);
+	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
 	return retval;
 }
 
-int rl_sunion(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
+int rl_sinter(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
 {
-	int retval, found;
+	int retval;
 	rl_btree **sets = NULL;
-	rl_btree_iterator *iterator;
-	unsigned char **members = NULL;
-	long *memberslen = NULL, i, j, member_page;
-	long membersc = 0, maxmemberc = 0;
-	void *tmp;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, membersc = 0;
 
 	if (keyc == 0) {
 		retval = RL_NOT_FOUND;
 		goto cleanup;
 	}
-
 	RL_MALLOC(sets, sizeof(rl_btree *) * keyc);
-	for (i = 0; i < keyc; i++) {
-		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &sets[i], 0, 0);
-		if (retval == RL_NOT_FOUND) {
-			sets[i] = NULL;
-		}
-		else if (retval != RL_OK) {
-			goto cleanup;
-		}
-		else {
-			maxmemberc += sets[i]->number_of_elements;
-		}
+	RL_CALL(set_inter_objects, RL_OK, db, keyc, keys, keyslen, sets);
+	RL_CALL(set_merge, RL_OK, db, SET_OP_INTER, keyc, sets, 0, &membersc, &digests, &member_pages);
+	RL_CALL(set_merge_members, RL_OK, db, membersc, member_pages, _members, _memberslen);
+	retval = RL_OK;
+cleanup:
+	*_membersc = retval == RL_OK ? membersc : 0;
+	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
+	return retval;
+}
+
+int rl_sinterstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
+{
+	int retval;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, membersc = 0;
+
+	*added = 0;
+	RL_MALLOC(sets, sizeof(rl_btree *) * (keyc > 0 ? keyc : 1));
+	RL_CALL2(set_inter_objects, RL_OK, RL_NOT_FOUND, db, keyc, keys, keyslen, sets);
+	if (retval == RL_OK && keyc > 0) {
+		RL_CALL(set_merge, RL_OK, db, SET_OP_INTER, keyc, sets, 0, &membersc, &digests, &member_pages);
 	}
+	RL_CALL(set_merge_store, RL_OK, db, target, targetlen, membersc, digests, member_pages, added);
+cleanup:
+	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
+	return retval;
+}
 
-	if (maxmemberc == 0) {
-		*_membersc = 0;
-		retval = RL_NOT_FOUND;
+int rl_sintercard(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long limit, long *card)
+{
+	int retval, missing = 0;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, i;
+
+	*card = 0;
+	if (keyc == 0) {
+		retval = RL_OK;
 		goto cleanup;
 	}
-	RL_MALLOC(members, sizeof(unsigned char *) * maxmemberc);
-	RL_MALLOC(memberslen, sizeof(long) * maxmemberc);
-
+	RL_MALLOC(sets, sizeof(rl_btree *) * keyc);
+	// a missing set makes the intersection empty, but every key is type checked
 	for (i = 0; i < keyc; i++) {
-		if (!sets[i]) {
-			continue;
-		}
-		RL_CALL(rl_btree_iterator_create, RL_OK, db, sets[i], &iterator);
-
-		while ((retval = rl_btree_iterator_next(iterator, NULL, &tmp)) == RL_OK) {
-			member_page = *(long *)tmp;
-			rl_free(tmp);
-			RL_CALL(rl_multi_string_get, RL_OK, db, member_page, &members[membersc], &memberslen[membersc]);
-			found = 0;
-			for (j = 0; j < membersc; j++) {
-				if (memberslen[membersc] == memberslen[j] && memcmp(members[membersc], members[j], memberslen[membersc]) == 0) {
-					found = 1;
-					break;
-				}
-			}
-			if (found) {
-				rl_free(members[membersc]);
-			}
-			else {
-				membersc++;
-			}
-		}
-		iterator = NULL;
-
-		if (retval != RL_END) {
-			goto cleanup;
+		RL_CALL2(rl_set_get_objects, RL_OK, RL_NOT_FOUND, db, keys[i], keyslen[i], NULL, &sets[i], 0, 0);
+		if (retval == RL_NOT_FOUND) {
+			missing = 1;
 		}
 	}
-
-	*_membersc = membersc;
-	if (membersc == maxmemberc) {
-		*_members = members;
-		*_memberslen = memberslen;
+	if (!missing) {
+		RL_CALL(set_merge, RL_OK, db, SET_OP_INTER, keyc, sets, limit, card, &digests, &member_pages);
 	}
-	else {
-		*_members = rl_realloc(members, sizeof(unsigned char *) * membersc);
-		if (*_members == NULL) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
-		}
-		*_memberslen = rl_realloc(memberslen, sizeof(long) * membersc);
-		if (*_memberslen == NULL) {
-			retval = RL_OUT_OF_MEMORY;
-			goto cleanup;
-		}
-	}
-
 	retval = RL_OK;
 cleanup:
-	if (retval != RL_OK) {
-		rl_free(members);
-		rl_free(memberslen);
-	}
 	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
 	return retval;
 }
 
-int rl_sunionstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
+int rl_sunion(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, long *_membersc, unsigned char ***_members, long **_memberslen)
 {
 	int retval;
-	rl_btree *target_set = NULL;
-	rl_btree *set = NULL;
-	rl_btree_iterator *iterator;
-	unsigned char *digest = NULL;
-	unsigned char *member;
-	long memberlen, i, member_page;
-	long target_page_number;
-	void *tmp;
-	long *member_object = NULL;
-	long count = 0;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, setc, membersc = 0;
 
-	*added = 0;
-	retval = rl_key_delete_with_value(db, target, targetlen);
-	if (retval != RL_NOT_FOUND && retval != RL_OK) {
-		goto cleanup;
-	}
 	if (keyc == 0) {
 		retval = RL_NOT_FOUND;
 		goto cleanup;
 	}
+	RL_MALLOC(sets, sizeof(rl_btree *) * keyc);
+	RL_CALL(set_union_objects, RL_OK, db, keyc, keys, keyslen, sets, &setc);
+	RL_CALL(set_merge, RL_OK, db, SET_OP_UNION, setc, sets, 0, &membersc, &digests, &member_pages);
+	RL_CALL(set_merge_members, RL_OK, db, membersc, member_pages, _members, _memberslen);
+	retval = RL_OK;
+cleanup:
+	*_membersc = retval == RL_OK ? membersc : 0;
+	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
+	return retval;
+}
 
-	RL_CALL(rl_set_get_objects, RL_OK, db, target, targetlen, &target_page_number, &target_set, 0, 1);
+int rl_sunionstore(struct rlite *db, unsigned char *target, long targetlen, int keyc, unsigned char **keys, long *keyslen, long *added)
+{
+	int retval;
+	rl_btree **sets = NULL;
+	unsigned char *digests = NULL;
+	long *member_pages = NULL, setc, membersc = 0;
 
-	for (i = 0; i < keyc; i++) {
-		retval = rl_set_get_objects(db, keys[i], keyslen[i], NULL, &set, 0, 0);
-		if (retval == RL_NOT_FOUND) {
-			continue;
-		}
-		else if (retval != RL_OK) {
-			goto cleanup;
-		}
+	*added = 0;
+	RL_MALLOC(sets, sizeof(rl_btree *) * (keyc > 0 ? keyc : 1));
+	RL_CALL2(set_union_objects, RL_OK, RL_NOT_FOUND, db, keyc, keys, keyslen, sets, &setc);
+	if (retval == RL_OK) {
+		RL_CALL(set_merge, RL_OK, db, SET_OP_UNION, setc, sets, 0, &membersc, &digests, &member_pages);
+	}
+	RL_CALL(set_merge_store, RL_OK, db, target, targetlen, membersc, digests, member_pages, added);
+cleanup:
+	rl_free(sets);
+	rl_free(digests);
+	rl_free(member_pages);
+	return retval;
+}
 
-		RL_CALL(rl_btree_iterator_create, RL_OK, db, set, &iterator);
-		while ((retval = rl_btree_iterator_next(iterator, (void **)&digest, &tmp)) == RL_OK) {
-			member_page = *(long *)tmp;
-			rl_free(tmp);
+typedef struct {
+	unsigned char digest[20];
+	long index;
+} set_store_entry;
 
-			retval = rl_btree_find_score(db, target_set, digest, &tmp, NULL, NULL);
-			if (retval == RL_NOT_FOUND) {
-				RL_CALL(rl_multi_string_get, RL_OK, db, member_page, &member, &memberlen);
-				RL_MALLOC(member_object, sizeof(*member_object));
-				RL_CALL(rl_multi_string_set, RL_OK, db, member_object, member, memberlen);
+static int set_store_entry_cmp(const void *a, const void *b)
+{
+	return memcmp(((const set_store_entry *)a)->digest, ((const set_store_entry *)b)->digest, 20);
+}
 
-				retval = rl_btree_add_element(db, target_set, target_page_number, digest, member_object);
-				if (retval != RL_OK) {
-					goto cleanup;
-				}
-				count++;
-				rl_free(member);
-			}
-			else if (retval == RL_FOUND) {
-				rl_free(digest);
-				digest = NULL;
-			}
-			else {
-				goto cleanup;
-			}
+int rl_set_store(struct rlite *db, const unsigned char *key, long keylen, long memberc, unsigned char **members, long *memberslen, long *added)
+{
+	int retval = RL_OK;
+	set_store_entry *entries = NULL;
+	unsigned char **sorted = NULL, *digests = NULL;
+	long *sortedlen = NULL, i, size = 0;
+
+	if (memberc > 0) {
+		RL_MALLOC(entries, sizeof(set_store_entry) * memberc);
+		RL_MALLOC(digests, sizeof(unsigned char) * 20 * memberc);
+		RL_MALLOC(sorted, sizeof(unsigned char *) * memberc);
+		RL_MALLOC(sortedlen, sizeof(long) * memberc);
+		for (i = 0; i < memberc; i++) {
+			RL_CALL(sha1, RL_OK, members[i], memberslen[i], entries[i].digest);
+			entries[i].index = i;
 		}
-		iterator = NULL;
-
-		if (retval != RL_END) {
-			goto cleanup;
+		qsort(entries, memberc, sizeof(set_store_entry), set_store_entry_cmp);
+		for (i = 0; i < memberc; i++) {
+			if (size > 0 && memcmp(&digests[(size - 1) * 20], entries[i].digest, 20) == 0) {
+				continue;
+			}
+			memcpy(&digests[size * 20], entries[i].digest, 20);
+			sorted[size] = members[entries[i].index];
+			sortedlen[size] = memberslen[entries[i].index];
+			size++;
 		}
 	}
-
-	if (count == 0) {
-		RL_CALL(rl_key_delete_with_value, RL_OK, db, target, targetlen);
-	}
-	*added = count;
-	retval = RL_OK;
+	RL_CALL(set_bulk_store, RL_OK, db, key, keylen, size, digests, sorted, sortedlen, added);
 cleanup:
+	rl_free(entries);
+	rl_free(digests);
+	rl_free(sorted);
+	rl_free(sortedlen);
 	return retval;
 }
 
@@ -1,31 +1,148 @@
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <math.h>
 #include <ctype.h>
 #include "rlite/rlite.h"
 #include "rlite/page_multi_string.h"
+#include "rlite/page_string.h"
 #include "rlite/type_string.h"
 #include "rlite/util.h"
 #include "rlite/hyperloglog.h"
 
-static int rl_string_get_objects(rlite *db, const unsigned char *key, long keylen, long *_page_number, unsigned long long *expires, long *version)
+/**
+ * Value of a string key, either in a multi string or, for counters, stored
+ * in the key as a number.
+ */
+typedef struct {
+	long page;
+	unsigned char encoding;
+	rl_number number;
+} string_value;
+
+static int rl_string_get_value(rlite *db, const unsigned char *key, long keylen, string_value *value, unsigned long long *expires, long *version)
 {
-	long page_number;
+	rl_key entry;
 	int retval;
-	unsigned char type;
-	retval = rl_key_get(db, key, keylen, &type, NULL, &page_number, expires, version);
+	retval = rl_key_get_entry(db, key, keylen, &entry);
 	if (retval != RL_FOUND) {
 		goto cleanup;
 	}
-	if (type != RL_TYPE_STRING) {
+	if (entry.type != RL_TYPE_STRING) {
 		retval = RL_WRONG_TYPE;
 		goto cleanup;
 	}
+	if (value) {
+		value->page = entry.value_page;
+		value->encoding = entry.encoding;
+		value->number = entry.number;
+	}
+	if (expires) {
+		*expires = entry.expires;
+	}
+	if (version) {
+		*version = entry.version;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+/**
+ * Gets the multi string holding the value of a string key, for operations
+ * that work on its bytes. A number stored in the key is moved to a multi
+ * string first.
+ */
+static int rl_string_get_objects(rlite *db, const unsigned char *key, long keylen, long *_page_number, unsigned long long *expires, long *version)
+{
+	string_value value;
+	unsigned char *data = NULL;
+	long datalen, _version = 0;
+	int retval;
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &value, expires, &_version);
+	if (value.encoding != RL_VALUE_ENCODING_PAGE) {
+		RL_CALL(rl_number_format, RL_OK, value.encoding, &value.number, &data, &datalen);
+		RL_CALL(rl_multi_string_set, RL_OK, db, &value.page, data, datalen);
+		RL_CALL(rl_key_set_value, RL_OK, db, key, keylen, value.page, RL_VALUE_ENCODING_PAGE, value.number, _version);
+	}
 	if (_page_number) {
-		*_page_number = page_number;
+		*_page_number = value.page;
+	}
+	if (version) {
+		*version = _version;
+	}
+	retval = RL_OK;
+cleanup:
+	rl_free(data);
+	return retval;
+}
+
+static int string_value_getrange(rlite *db, string_value *value, unsigned char **_data, long *size, long start, long stop)
+{
+	unsigned char *data = NULL;
+	long datalen;
+	int retval;
+	if (value->encoding == RL_VALUE_ENCODING_PAGE) {
+		return rl_multi_string_getrange(db, value->page, _data, size, start, stop);
+	}
+	RL_CALL(rl_number_format, RL_OK, value->encoding, &value->number, &data, &datalen);
+	rl_normalize_string_range(datalen, &start, &stop);
+	*size = stop < start ? 0 : stop - start + 1;
+	if (_data) {
+		if (*size == 0) {
+			*_data = NULL;
+		}
+		else {
+			memmove(data, &data[start], *size);
+			data[*size] = 0;
+			*_data = data;
+			data = NULL;
+		}
 	}
 	retval = RL_OK;
 cleanup:
+	rl_free(data);
+	return retval;
+}
+
+static int string_value_cpyrange(rlite *db, string_value *value, unsigned char *data, long *size, long start, long stop)
+{
+	unsigned char *range = NULL;
+	long rangelen;
+	int retval;
+	if (value->encoding == RL_VALUE_ENCODING_PAGE) {
+		return rl_multi_string_cpyrange(db, value->page, data, size, start, stop);
+	}
+	RL_CALL(string_value_getrange, RL_OK, db, value, &range, &rangelen, start, stop);
+	if (data) {
+		memcpy(data, range, rangelen);
+	}
+	if (size) {
+		*size = rangelen;
+	}
+cleanup:
+	rl_free(range);
+	return retval;
+}
+
+static int string_value_foreach_range(rlite *db, string_value *value, long start, long stop, rl_multi_string_range_callback callback, void *context)
+{
+	unsigned char *data = NULL;
+	long datalen;
+	int retval;
+	if (value->encoding == RL_VALUE_ENCODING_PAGE) {
+		return rl_multi_string_foreach_range(db, value->page, start, stop, callback, context);
+	}
+	RL_CALL(rl_number_format, RL_OK, value->encoding, &value->number, &data, &datalen);
+	rl_normalize_string_range(datalen, &start, &stop);
+	if (start <= stop) {
+		retval = callback(context, start, &data[start], stop - start + 1);
+		if (retval == RL_END) {
+			retval = RL_OK;
+		}
+	}
+cleanup:
+	rl_free(data);
 	return retval;
 }
 
@@ -55,24 +172,104 @@ cleanup:
 
 int rl_get(struct rlite *db, const unsigned char *key, long keylen, unsigned char **value, long *valuelen)
 {
-	long page_number;
+	string_value svalue;
 	int retval;
-	RL_CALL(rl_string_get_objects, RL_OK, db, key, keylen, &page_number, NULL, NULL);
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &svalue, NULL, NULL);
 	if (valuelen) {
-		RL_CALL(rl_multi_string_get, RL_OK, db, page_number, value, valuelen);
+		RL_CALL(string_value_getrange, RL_OK, db, &svalue, value, valuelen, 0, -1);
 	}
 	retval = RL_OK;
 cleanup:
 	return retval;
 }
 
-int rl_get_cpy(struct rlite *db, const unsigned char *key, long keylen, unsigned char *value, long *valuelen)
+int rl_set_stream(struct rlite *db, const unsigned char *key, long keylen, rl_multi_string_fill_callback callback, void *context, int nx, unsigned long long expires)
 {
+	int retval, found;
 	long page_number;
+	unsigned char type;
+	long value_page, version;
+	retval = rl_key_get(db, key, keylen, &type, NULL, &value_page, NULL, &version);
+	found = retval == RL_FOUND;
+	if (found) {
+		if (nx) {
+			goto cleanup;
+		}
+	} else {
+		version = rand();
+	}
+	RL_CALL(rl_multi_string_set_stream, RL_OK, db, &page_number, callback, context);
+	if (found) {
+		RL_CALL(rl_key_delete_with_value, RL_OK, db, key, keylen);
+	}
+	RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_STRING, page_number, expires, version + 1);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_get_stream(struct rlite *db, const unsigned char *key, long keylen, rl_multi_string_range_callback callback, void *context)
+{
+	string_value value;
+	int retval;
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &value, NULL, NULL);
+	RL_CALL(string_value_foreach_range, RL_OK, db, &value, 0, -1, callback, context);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_mget(struct rlite *db, int keyc, unsigned char **keys, long *keyslen, unsigned char ***_values, long **_valueslen)
+{
+	int retval;
+	int i, got = 0;
+	unsigned char *types = NULL;
+	long *pages = NULL;
+	unsigned char **values = NULL;
+	long *valueslen = NULL;
+
+	RL_MALLOC(types, sizeof(unsigned char) * keyc);
+	RL_MALLOC(pages, sizeof(long) * keyc);
+	RL_MALLOC(values, sizeof(unsigned char *) * keyc);
+	RL_MALLOC(valueslen, sizeof(long) * keyc);
+	RL_CALL(rl_key_mget, RL_OK, db, keyc, keys, keyslen, types, pages);
+	for (i = 0; i < keyc; i++) {
+		if (types[i] == RL_TYPE_STRING && pages[i] == 0) {
+			// a number stored in the key
+			RL_CALL(rl_get, RL_OK, db, keys[i], keyslen[i], &values[i], &valueslen[i]);
+		}
+		else if (types[i] == RL_TYPE_STRING) {
+			RL_CALL(rl_multi_string_get, RL_OK, db, pages[i], &values[i], &valueslen[i]);
+		}
+		else {
+			values[i] = NULL;
+			valueslen[i] = -1;
+		}
+		got++;
+	}
+	*_values = values;
+	*_valueslen = valueslen;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		for (i = 0; i < got; i++) {
+			rl_free(values[i]);
+		}
+		rl_free(values);
+		rl_free(valueslen);
+	}
+	rl_free(types);
+	rl_free(pages);
+	return retval;
+}
+
+int rl_get_cpy(struct rlite *db, const unsigned char *key, long keylen, unsigned char *value, long *valuelen)
+{
+	string_value svalue;
 	int retval;
-	RL_CALL(rl_string_get_objects, RL_OK, db, key, keylen, &page_number, NULL, NULL);
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &svalue, NULL, NULL);
 	if (value || valuelen) {
-		RL_CALL(rl_multi_string_cpy, RL_OK, db, page_number, value, valuelen);
+		RL_CALL(string_value_cpyrange, RL_OK, db, &svalue, value, valuelen, 0, -1);
 	}
 	retval = RL_OK;
 cleanup:
@@ -94,7 +291,7 @@ int rl_append(struct rlite *db, const unsigned char *key, long keylen, unsigned
 		}
 	}
 	else {
-		RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_STRING, page_number, 0, version + 1);
+		RL_CALL(rl_key_set_version, RL_OK, db, key, keylen, version + 1);
 		RL_CALL(rl_multi_string_append, RL_OK, db, page_number, value, valuelen, newlength);
 	}
 	retval = RL_OK;
@@ -104,10 +301,10 @@ cleanup:
 
 int rl_getrange(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, unsigned char **value, long *valuelen)
 {
-	long page_number;
+	string_value svalue;
 	int retval;
-	RL_CALL(rl_string_get_objects, RL_OK, db, key, keylen, &page_number, NULL, NULL);
-	RL_CALL(rl_multi_string_getrange, RL_OK, db, page_number, value, valuelen, start, stop);
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &svalue, NULL, NULL);
+	RL_CALL(string_value_getrange, RL_OK, db, &svalue, value, valuelen, start, stop);
 	retval = RL_OK;
 cleanup:
 	return retval;
@@ -141,37 +338,59 @@ cleanup:
 	return retval;
 }
 
-int rl_incr(struct rlite *db, const unsigned char *key, long keylen, long long increment, long long *newvalue)
+/**
+ * Stores the result of INCRBY or INCRBYFLOAT in the key, replacing the
+ * previous value. New keys are created without expiration.
+ */
+static int string_set_number(rlite *db, const unsigned char *key, long keylen, int found, string_value *value, long version, unsigned char encoding, rl_number number)
 {
-	long page_number;
+	rl_key entry;
 	int retval;
-	unsigned char *value = NULL;
-	char *end;
-	long valuelen;
-	long long lvalue;
-	unsigned long long expires;
-	RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, key, keylen, &page_number, &expires, NULL);
-	if (retval == RL_NOT_FOUND) {
-		RL_MALLOC(value, sizeof(unsigned char) * MAX_LLONG_DIGITS);
-		valuelen = snprintf((char *)value, MAX_LLONG_DIGITS, "%lld", increment);
-		if (newvalue) {
-			*newvalue = increment;
-		}
-		retval = rl_set(db, key, keylen, value, valuelen, 1, 0);
+	if (!found) {
+		entry.type = RL_TYPE_STRING;
+		entry.value_page = 0;
+		entry.expires = 0;
+		entry.version = rand() + 1;
+		entry.encoding = encoding;
+		entry.number = number;
+		RL_CALL(rl_key_set_entry, RL_OK, db, key, keylen, &entry);
 		goto cleanup;
 	}
-	RL_CALL(rl_multi_string_getrange, RL_OK, db, page_number, &value, &valuelen, 0, MAX_LLONG_DIGITS + 1);
-	if (valuelen == MAX_LLONG_DIGITS + 1) {
-		retval = RL_NAN;
-		goto cleanup;
+	if (value->encoding == RL_VALUE_ENCODING_PAGE) {
+		RL_CALL(rl_multi_string_delete, RL_OK, db, value->page);
 	}
-	lvalue = strtoll((char *)value, &end, 10);
-	if (isspace(((char *)value)[0]) || end[0] != '\0' || errno == ERANGE) {
-		retval = RL_NAN;
-		goto cleanup;
+	RL_CALL(rl_key_set_value, RL_OK, db, key, keylen, 0, encoding, number, version + 1);
+cleanup:
+	return retval;
+}
+
+int rl_incr(struct rlite *db, const unsigned char *key, long keylen, long long increment, long long *newvalue)
+{
+	int retval, found;
+	unsigned char *value = NULL;
+	char *end;
+	long valuelen, version = 0;
+	long long lvalue = 0;
+	string_value svalue;
+	rl_number number;
+	RL_CALL2(rl_string_get_value, RL_OK, RL_NOT_FOUND, db, key, keylen, &svalue, NULL, &version);
+	found = retval == RL_OK;
+	if (found && svalue.encoding == RL_VALUE_ENCODING_INT) {
+		lvalue = svalue.number.integer;
+	}
+	else if (found) {
+		RL_CALL(string_value_getrange, RL_OK, db, &svalue, &value, &valuelen, 0, MAX_LLONG_DIGITS + 1);
+		if (valuelen == 0 || valuelen == MAX_LLONG_DIGITS + 1) {
+			retval = RL_NAN;
+			goto cleanup;
+		}
+		errno = 0;
+		lvalue = strtoll((char *)value, &end, 10);
+		if (isspace(((char *)value)[0]) || end[0] != '\0' || errno == ERANGE) {
+			retval = RL_NAN;
+			goto cleanup;
+		}
 	}
-	rl_free(value);
-	value = NULL;
 	if ((increment < 0 && lvalue < 0 && increment < (LLONG_MIN - lvalue)) ||
 	        (increment > 0 && lvalue > 0 && increment > (LLONG_MAX - lvalue))) {
 		retval = RL_OVERFLOW;
@@ -181,9 +400,8 @@ int rl_incr(struct rlite *db, const unsigned char *key, long keylen, long long i
 	if (newvalue) {
 		*newvalue = lvalue;
 	}
-	RL_MALLOC(value, sizeof(unsigned char) * MAX_LLONG_DIGITS);
-	valuelen = snprintf((char *)value, MAX_LLONG_DIGITS, "%lld", lvalue);
-	RL_CALL(rl_set, RL_OK, db, key, keylen, value, valuelen, 0, expires);
+	number.integer = lvalue;
+	RL_CALL(string_set_number, RL_OK, db, key, keylen, found, &svalue, version, RL_VALUE_ENCODING_INT, number);
 	retval = RL_OK;
 cleanup:
 	rl_free(value);
@@ -192,35 +410,34 @@ cleanup:
 
 int rl_incrbyfloat(struct rlite *db, const unsigned char *key, long keylen, double increment, double *newvalue)
 {
-	long page_number;
-	int retval;
+	int retval, found;
 	unsigned char *value = NULL;
-	char *end;
-	long valuelen;
-	double dvalue;
-	unsigned long long expires;
-	RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, key, keylen, &page_number, &expires, NULL);
-	if (retval == RL_NOT_FOUND) {
-		RL_MALLOC(value, sizeof(unsigned char) * MAX_DOUBLE_DIGITS);
-		valuelen = snprintf((char *)value, MAX_DOUBLE_DIGITS, "%lf", increment);
-		if (newvalue) {
-			*newvalue = increment;
-		}
-		retval = rl_set(db, key, keylen, value, valuelen, 1, 0);
-		goto cleanup;
+	char buffer[MAX_DOUBLE_DIGITS], *end;
+	long valuelen, version = 0;
+	double dvalue = 0;
+	string_value svalue;
+	rl_number number;
+	RL_CALL2(rl_string_get_value, RL_OK, RL_NOT_FOUND, db, key, keylen, &svalue, NULL, &version);
+	found = retval == RL_OK;
+	if (found && svalue.encoding == RL_VALUE_ENCODING_DOUBLE) {
+		dvalue = svalue.number.floating;
 	}
-	RL_CALL(rl_multi_string_getrange, RL_OK, db, page_number, &value, &valuelen, 0, MAX_DOUBLE_DIGITS + 1);
-	if (valuelen == MAX_DOUBLE_DIGITS + 1) {
-		retval = RL_NAN;
-		goto cleanup;
+	else if (found && svalue.encoding == RL_VALUE_ENCODING_INT) {
+		dvalue = (double)svalue.number.integer;
 	}
-	dvalue = strtold((char *)value, &end);
-	if (isspace(((char *)value)[0]) || end[0] != '\0' || errno == ERANGE || isnan(dvalue)) {
-		retval = RL_NAN;
-		goto cleanup;
+	else if (found) {
+		RL_CALL(string_value_getrange, RL_OK, db, &svalue, &value, &valuelen, 0, MAX_DOUBLE_DIGITS + 1);
+		if (valuelen == 0 || valuelen == MAX_DOUBLE_DIGITS + 1) {
+			retval = RL_NAN;
+			goto cleanup;
+		}
+		errno = 0;
+		dvalue = strtold((char *)value, &end);
+		if (isspace(((char *)value)[0]) || end[0] != '\0' || errno == ERANGE || isnan(dvalue)) {
+			retval = RL_NAN;
+			goto cleanup;
+		}
 	}
-	rl_free(value);
-	value = NULL;
 	dvalue += increment;
 	if (isinf(dvalue) || isnan(dvalue)) {
 		retval = RL_OVERFLOW;
@@ -229,9 +446,11 @@ int rl_incrbyfloat(struct rlite *db, const unsigned char *key, long keylen, doub
 	if (newvalue) {
 		*newvalue = dvalue;
 	}
-	RL_MALLOC(value, sizeof(unsigned char) * MAX_DOUBLE_DIGITS);
-	valuelen = snprintf((char *)value, MAX_DOUBLE_DIGITS, "%lf", dvalue);
-	RL_CALL(rl_set, RL_OK, db, key, keylen, value, valuelen, 0, expires);
+	// keep the number the string would have held, so later increments
+	// round the same way they did when the value was stored as a string
+	snprintf(buffer, MAX_DOUBLE_DIGITS, "%lf", dvalue);
+	number.floating = strtod(buffer, NULL);
+	RL_CALL(string_set_number, RL_OK, db, key, keylen, found, &svalue, version, RL_VALUE_ENCODING_DOUBLE, number);
 	retval = RL_OK;
 cleanup:
 	rl_free(value);
@@ -241,29 +460,32 @@ cleanup:
 int rl_getbit(struct rlite *db, const unsigned char *key, long keylen, long bitoffset, int *value)
 {
 	int retval;
-	unsigned char *rangevalue = NULL;
-	long rangevaluelen, start;
-	start = bitoffset >> 3;
-	long bit = 7 - (bitoffset & 0x7);
-	RL_CALL2(rl_getrange, RL_OK, RL_NOT_FOUND, db, key, keylen, start, start, &rangevalue, &rangevaluelen);
-	if (retval == RL_NOT_FOUND || rangevaluelen == 0) {
+	unsigned char byte;
+	long size, start = bitoffset >> 3;
+	int bit = 7 - (bitoffset & 0x7);
+	string_value svalue;
+	RL_CALL2(rl_string_get_value, RL_OK, RL_NOT_FOUND, db, key, keylen, &svalue, NULL, NULL);
+	if (retval == RL_NOT_FOUND) {
 		*value = 0;
 		retval = RL_OK;
 		goto cleanup;
 	}
-	*value = (rangevalue[0] & (1 << bit)) ? 1 : 0;
-	retval = RL_OK;
+	RL_CALL(string_value_cpyrange, RL_OK, db, &svalue, &byte, &size, start, start);
+	if (size == 0) {
+		*value = 0;
+		goto cleanup;
+	}
+	*value = (byte >> bit) & 0x1;
 cleanup:
-	rl_free(rangevalue);
 	return retval;
 }
 
 int rl_setbit(struct rlite *db, const unsigned char *key, long keylen, long bitoffset, int on, int *previousvalue)
 {
 	int retval;
-	unsigned char *rangevalue = NULL;
-	long rangevaluelen, start;
-	char val;
+	long page_number, version, start;
+	unsigned long long expires;
+	unsigned char val;
 	start = bitoffset >> 3;
 	long bit = 7 - (bitoffset & 0x7);
 
@@ -274,150 +496,524 @@ int rl_setbit(struct rlite *db, const unsigned char *key, long keylen, long bito
 		goto cleanup;
 	}
 
-	RL_CALL2(rl_getrange, RL_OK, RL_NOT_FOUND, db, key, keylen, start, start, &rangevalue, &rangevaluelen);
-	if (retval == RL_NOT_FOUND || rangevaluelen == 0) {
-		val = 0;
-		val &= ~(1 << bit);
-		val |= ((on & 0x1) << bit);
-		retval = rl_setrange(db, key, keylen, start, (unsigned char *)&val, 1, NULL);
-		if (previousvalue) {
-			*previousvalue = 0;
+	RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, key, keylen, &page_number, &expires, &version);
+	if (retval == RL_OK) {
+		retval = rl_multi_string_setbit(db, page_number, bitoffset, on, previousvalue);
+		if (retval == RL_OK) {
+			RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_STRING, page_number, expires, version + 1);
+			goto cleanup;
+		}
+		else if (retval != RL_NOT_FOUND) {
+			goto cleanup;
 		}
-		goto cleanup;
 	}
 
-	int bitval = rangevalue[0] & (1 << bit);
+	// the string grows, zero padded up to the new byte
+	val = (on & 0x1) << bit;
+	RL_CALL(rl_setrange, RL_OK, db, key, keylen, start, &val, 1, NULL);
 	if (previousvalue) {
-		*previousvalue = bitval ? 1 : 0;
+		*previousvalue = 0;
 	}
-
-	rangevalue[0] &= ~(1 << bit);
-	rangevalue[0] |= ((on & 0x1) << bit);
-	retval = rl_setrange(db, key, keylen, start, rangevalue, 1, NULL);
 cleanup:
-	rl_free(rangevalue);
 	return retval;
 }
 
+typedef struct {
+	rl_list *list;
+	rl_list_iterator *iterator;
+	long size;
+	unsigned char *page;
+} bitop_operand;
+
 int rl_bitop(struct rlite *db, int op, const unsigned char *dest, long destlen, unsigned long keyc, const unsigned char **keys, long *keyslen)
 {
-	long ltmp;
 	int retval;
-	unsigned char **values = NULL, *result;
-	unsigned long *valueslen = NULL, i;
-	long resultlen;
-	RL_MALLOC(valueslen, sizeof(unsigned long) * keyc);
-	RL_MALLOC(values, sizeof(unsigned char *) * keyc);
-	values[0] = NULL;
+	bitop_operand *operands = NULL;
+	unsigned char **chunks = NULL, *result = NULL, type;
+	unsigned long *chunkslen = NULL, i;
+	long page_number, value_page, version, maxlen = 0, pos, chunklen, resultlen;
+	void *tmp;
+
+	RL_MALLOC(operands, sizeof(bitop_operand) * keyc);
 	for (i = 0; i < keyc; i++) {
-		RL_CALL2(rl_get, RL_OK, RL_NOT_FOUND, db, keys[i], keyslen[i], &values[i], &ltmp);
+		operands[i].list = NULL;
+		operands[i].iterator = NULL;
+		operands[i].size = 0;
+		operands[i].page = NULL;
+	}
+	RL_MALLOC(chunks, sizeof(unsigned char *) * keyc);
+	RL_MALLOC(chunkslen, sizeof(unsigned long) * keyc);
+	for (i = 0; i < keyc; i++) {
+		RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, keys[i], keyslen[i], &page_number, NULL, NULL);
 		if (retval == RL_NOT_FOUND) {
-			values[i] = NULL;
-			valueslen[i] = 0;
+			continue;
 		}
-		else if (retval == RL_OK) {
-			valueslen[i] = ltmp;
-		} else {
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, page_number, &rl_list_type_long, &tmp, 0);
+		operands[i].list = tmp;
+		RL_CALL(rl_list_get_element, RL_FOUND, db, operands[i].list, &tmp, 0);
+		operands[i].size = *(long *)tmp;
+		if (operands[i].size > 0) {
+			RL_CALL(rl_list_iterator_create_at, RL_OK, db, &operands[i].iterator, operands[i].list, 1, 1);
+		}
+		if (operands[i].size > maxlen) {
+			maxlen = operands[i].size;
+		}
+	}
+
+	// the result is built in a new string, page by page, so that the
+	// destination can also be one of the operands
+	RL_CALL(rl_multi_string_set, RL_OK, db, &value_page, NULL, 0);
+	for (pos = 0; pos < maxlen; pos += db->page_size) {
+		for (i = 0; i < keyc; i++) {
+			chunks[i] = NULL;
+			chunkslen[i] = 0;
+			if (operands[i].size <= pos) {
+				continue;
+			}
+			retval = rl_list_iterator_next(operands[i].iterator, &tmp);
+			if (retval != RL_OK) {
+				// the iterator destroys itself on error
+				operands[i].iterator = NULL;
+				goto cleanup;
+			}
+			page_number = *(long *)tmp;
+			rl_free(tmp);
+			rl_free(operands[i].page);
+			operands[i].page = NULL;
+			retval = rl_read(db, &rl_data_type_string, page_number, NULL, &tmp, 0);
+			if (retval != RL_FOUND) {
+				goto cleanup;
+			}
+			operands[i].page = tmp;
+			chunks[i] = operands[i].page;
+			chunklen = operands[i].size - pos;
+			chunkslen[i] = chunklen > db->page_size ? db->page_size : chunklen;
+		}
+		rl_internal_bitop(op, keyc, chunks, chunkslen, &result, &resultlen);
+		if (!result) {
+			retval = RL_OUT_OF_MEMORY;
 			goto cleanup;
 		}
+		RL_CALL(rl_multi_string_append, RL_OK, db, value_page, result, resultlen, NULL);
+		rl_free(result);
+		result = NULL;
 	}
-	rl_internal_bitop(op, keyc, values, valueslen, &result, &resultlen);
-	RL_CALL(rl_set, RL_OK, db, dest, destlen, result, resultlen, 0, 0);
-	rl_free(result);
+
+	retval = rl_key_get(db, dest, destlen, &type, NULL, NULL, NULL, &version);
+	if (retval == RL_FOUND) {
+		RL_CALL(rl_key_delete_with_value, RL_OK, db, dest, destlen);
+	}
+	else if (retval == RL_NOT_FOUND) {
+		version = rand();
+	}
+	else {
+		goto cleanup;
+	}
+	RL_CALL(rl_key_set, RL_OK, db, dest, destlen, RL_TYPE_STRING, value_page, 0, version + 1);
 	retval = RL_OK;
 cleanup:
-	if (values) {
-		if (i > 0) {
-			for (i--; i > 0; i--) {
-				rl_free(values[i]);
+	if (operands) {
+		for (i = 0; i < keyc; i++) {
+			if (operands[i].iterator) {
+				rl_list_iterator_destroy(db, operands[i].iterator);
+			}
+			if (operands[i].list) {
+				rl_list_nocache_destroy(db, operands[i].list);
 			}
+			rl_free(operands[i].page);
 		}
-		rl_free(values[0]);
 	}
-	rl_free(values);
-	rl_free(valueslen);
+	rl_free(operands);
+	rl_free(chunks);
+	rl_free(chunkslen);
+	rl_free(result);
 	return retval;
 }
 
+static int bitcount_range(void *context, long UNUSED(offset), unsigned char *data, long size)
+{
+	*(long *)context += (long)rl_redisPopcount(data, size);
+	return RL_OK;
+}
+
 int rl_bitcount(struct rlite *db, const unsigned char *key, long keylen, long start, long stop, long *bitcount)
 {
 	int retval;
-	unsigned char *value;
-	long valuelen;
-	RL_CALL(rl_getrange, RL_OK, db, key, keylen, start, stop, &value, &valuelen);
-	*bitcount = (long)rl_redisPopcount(value, valuelen);
-	rl_free(value);
+	string_value value;
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &value, NULL, NULL);
+	*bitcount = 0;
+	RL_CALL(string_value_foreach_range, RL_OK, db, &value, start, stop, bitcount_range, bitcount);
 cleanup:
 	return retval;
 }
 
+typedef struct {
+	int bit;
+	long position;
+} bitpos_context;
+
+static int bitpos_range(void *_context, long offset, unsigned char *data, long size)
+{
+	bitpos_context *context = _context;
+	long pos = rl_internal_bitpos(data, size, context->bit);
+	// looking for a 0, a page full of ones reports the first bit after it
+	if (pos == -1 || pos == size * 8) {
+		return RL_OK;
+	}
+	context->position = offset * 8 + pos;
+	return RL_END;
+}
+
 int rl_bitpos(struct rlite *db, const unsigned char *key, long keylen, int bit, long start, long stop, int end_given, long *position)
 {
 	int retval;
-	unsigned char *value = NULL;
-	long valuelen, totalsize;
+	long totalsize;
+	string_value value;
+	bitpos_context context;
 
 	if (bit != 0 && bit != 1) {
 		retval = RL_INVALID_PARAMETERS;
 		goto cleanup;
 	}
 
-	RL_CALL(rl_getrange, RL_OK, db, key, keylen, start, stop, &value, &valuelen);
-
-	if (valuelen == 0) {
+	RL_CALL(rl_string_get_value, RL_OK, db, key, keylen, &value, NULL, NULL);
+	RL_CALL(string_value_getrange, RL_OK, db, &value, NULL, &totalsize, 0, -1);
+	RL_CALL(rl_normalize_string_range, RL_OK, totalsize, &start, &stop);
+	if (totalsize == 0 || stop < start) {
 		*position = -1;
 		retval = RL_OK;
 		goto cleanup;
 	}
 
-	RL_CALL(rl_get, RL_OK, db, key, keylen, NULL, &totalsize);
-	RL_CALL(rl_normalize_string_range, RL_OK, totalsize, &start, &stop);
-
-	long bytes = stop - start + 1;
-	// stop may be after the end of the string and in that case it is treated
-	// as if it had 0 padding
-	//
-	// however, it can also be negative! the following check will handle
-	// the negative case (which cannot exceed the string size)
-	if (bytes < valuelen) {
-		bytes = valuelen;
-	}
-	long pos = rl_internal_bitpos(value, bytes, bit);
+	context.bit = bit;
+	context.position = -1;
+	RL_CALL(string_value_foreach_range, RL_OK, db, &value, start, stop, bitpos_range, &context);
 
 	/* If we are looking for clear bits, and the user specified an exact
 	 * range with start-end, we can't consider the right of the range as
 	 * zero padded (as we do when no explicit end is given).
 	 *
-	 * So if rl_internal_bitpos() returns the first bit outside the range,
-	 * we return -1 to the caller, to mean, in the specified range there
-	 * is not a single "0" bit. */
-	if (end_given && bit == 0 && pos == bytes * 8) {
-		*position = -1;
-		retval = RL_OK;
+	 * So if no clear bit is found in the range, we return -1 to the caller,
+	 * to mean, in the specified range there is not a single "0" bit. */
+	if (context.position == -1 && bit == 0 && !end_given) {
+		context.position = (stop + 1) * 8;
+	}
+
+	*position = context.position;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+/**
+ * Pages of a string value loaded on demand, so a command touching a few
+ * bytes of a large string reads and writes back only the pages holding them.
+ */
+typedef struct {
+	long index;
+	long page;
+	unsigned char *data;
+	int dirty;
+} string_page;
+
+typedef struct {
+	rlite *db;
+	rl_list *list;
+	long size;
+	long pagesc;
+	long pagesalloc;
+	string_page *pages;
+} paged_string;
+
+static int paged_string_get_page(paged_string *string, long index, string_page **_page)
+{
+	rlite *db = string->db;
+	string_page *page;
+	void *tmp;
+	long i;
+	int retval;
+	for (i = 0; i < string->pagesc; i++) {
+		if (string->pages[i].index == index) {
+			*_page = &string->pages[i];
+			retval = RL_OK;
+			goto cleanup;
+		}
+	}
+	if (string->pagesc == string->pagesalloc) {
+		string->pagesalloc = string->pagesalloc ? string->pagesalloc * 2 : 4;
+		RL_REALLOC(string->pages, sizeof(string_page) * string->pagesalloc);
+	}
+	page = &string->pages[string->pagesc];
+	RL_CALL(rl_list_get_element, RL_FOUND, db, string->list, &tmp, index + 1);
+	page->index = index;
+	page->page = *(long *)tmp;
+	page->dirty = 0;
+	RL_CALL(rl_string_get, RL_OK, db, &page->data, page->page);
+	string->pagesc++;
+	*_page = page;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static void paged_string_init(rlite *db, paged_string *string)
+{
+	string->db = db;
+	string->list = NULL;
+	string->size = 0;
+	string->pagesc = string->pagesalloc = 0;
+	string->pages = NULL;
+}
+
+static int paged_string_open(paged_string *string, long page_number, long size)
+{
+	void *tmp;
+	int retval = RL_OK;
+	string->size = size;
+	if (size > 0) {
+		RL_CALL(rl_read, RL_FOUND, string->db, &rl_data_type_list_long, page_number, &rl_list_type_long, &tmp, 0);
+		string->list = tmp;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int paged_string_flush(paged_string *string)
+{
+	long i;
+	int retval = RL_OK;
+	for (i = 0; i < string->pagesc; i++) {
+		if (string->pages[i].dirty) {
+			RL_CALL(rl_write, RL_OK, string->db, &rl_data_type_string, string->pages[i].page, string->pages[i].data);
+			string->pages[i].dirty = 0;
+		}
+	}
+cleanup:
+	return retval;
+}
+
+static void paged_string_destroy(paged_string *string)
+{
+	if (string->list) {
+		rl_list_nocache_destroy(string->db, string->list);
+	}
+	rl_free(string->pages);
+}
+
+/**
+ * Copies `len` bytes starting at `byte` from (or into, when `write` is set)
+ * the string pages, reading bytes past the end of the string as zero.
+ */
+static int paged_string_copy(paged_string *string, long byte, long len, unsigned char *buffer, int write)
+{
+	long page_size = string->db->page_size, pagestart, chunk;
+	string_page *page = NULL;
+	int retval = RL_OK;
+	while (len > 0) {
+		pagestart = byte % page_size;
+		chunk = page_size - pagestart;
+		if (chunk > len) {
+			chunk = len;
+		}
+		if (byte >= string->size) {
+			memset(buffer, 0, len);
+			break;
+		}
+		if (byte + chunk > string->size) {
+			chunk = string->size - byte;
+		}
+		RL_CALL(paged_string_get_page, RL_OK, string, byte / page_size, &page);
+		if (write) {
+			memcpy(&page->data[pagestart], buffer, chunk);
+			page->dirty = 1;
+		}
+		else {
+			memcpy(buffer, &page->data[pagestart], chunk);
+		}
+		buffer += chunk;
+		byte += chunk;
+		len -= chunk;
+	}
+cleanup:
+	return retval;
+}
+
+static int bitfield_apply(paged_string *string, rl_bitfield_op *op, long long *result, int *failed)
+{
+	// a field spans at most 9 bytes
+	unsigned char buffer[9];
+	long byte = op->offset >> 3, len = ((op->offset + op->bits - 1) >> 3) - byte + 1;
+	uint64_t offset = op->offset & 0x7;
+	int overflow = 0, retval;
+
+	*failed = 0;
+	RL_CALL(paged_string_copy, RL_OK, string, byte, len, buffer, 0);
+	if (op->sign) {
+		int64_t oldval, newval, wrapped;
+		oldval = rl_getSignedBitfield(buffer, offset, op->bits);
+		if (op->opcode == RL_BITFIELD_GET) {
+			*result = oldval;
+			goto cleanup;
+		}
+		else if (op->opcode == RL_BITFIELD_INCRBY) {
+			overflow = rl_checkSignedBitfieldOverflow(oldval, op->value, op->bits, op->overflow, &wrapped);
+			newval = overflow ? wrapped : (int64_t)((uint64_t)oldval + (uint64_t)op->value);
+			*result = newval;
+		}
+		else {
+			newval = op->value;
+			overflow = rl_checkSignedBitfieldOverflow(newval, 0, op->bits, op->overflow, &wrapped);
+			if (overflow) {
+				newval = wrapped;
+			}
+			*result = oldval;
+		}
+		rl_setSignedBitfield(buffer, offset, op->bits, newval);
+	}
+	else {
+		uint64_t oldval, newval, wrapped;
+		oldval = rl_getUnsignedBitfield(buffer, offset, op->bits);
+		if (op->opcode == RL_BITFIELD_GET) {
+			*result = oldval;
+			goto cleanup;
+		}
+		else if (op->opcode == RL_BITFIELD_INCRBY) {
+			overflow = rl_checkUnsignedBitfieldOverflow(oldval, op->value, op->bits, op->overflow, &wrapped);
+			newval = overflow ? wrapped : oldval + op->value;
+			*result = newval;
+		}
+		else {
+			newval = op->value;
+			overflow = rl_checkUnsignedBitfieldOverflow(newval, 0, op->bits, op->overflow, &wrapped);
+			if (overflow) {
+				newval = wrapped;
+			}
+			*result = oldval;
+		}
+		rl_setUnsignedBitfield(buffer, offset, op->bits, newval);
+	}
+	if (overflow && op->overflow == BFOVERFLOW_FAIL) {
+		*failed = 1;
 		goto cleanup;
 	}
+	RL_CALL(paged_string_copy, RL_OK, string, byte, len, buffer, 1);
+cleanup:
+	return retval;
+}
+
+int rl_bitfield(struct rlite *db, const unsigned char *key, long keylen, long opc, rl_bitfield_op *ops, long long *results, int *failed)
+{
+	paged_string string;
+	long i, page_number = 0, version, maxbyte = -1, byte, size = 0;
+	unsigned long long expires;
+	unsigned char zero = 0;
+	int retval;
+
+	paged_string_init(db, &string);
+
+	for (i = 0; i < opc; i++) {
+		if (ops[i].bits < 1 || ops[i].bits > (ops[i].sign ? 64 : 63) || ops[i].offset < 0 ||
+				((ops[i].offset + ops[i].bits - 1) >> 3) >= 512*1024*1024) {
+			retval = RL_INVALID_PARAMETERS;
+			goto cleanup;
+		}
+		if (ops[i].opcode != RL_BITFIELD_GET) {
+			byte = (ops[i].offset + ops[i].bits - 1) >> 3;
+			if (byte > maxbyte) {
+				maxbyte = byte;
+			}
+		}
+	}
 
-	if (pos != -1) {
-		pos += start * 8; /* Adjust for the bytes we skipped. */
+	RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, key, keylen, &page_number, NULL, NULL);
+	if (retval == RL_OK) {
+		RL_CALL(rl_multi_string_getrange, RL_OK, db, page_number, NULL, &size, 0, -1);
 	}
+	// writes past the end grow the string once, up to the last byte written
+	if (maxbyte >= size) {
+		RL_CALL(rl_setrange, RL_OK, db, key, keylen, maxbyte, &zero, 1, NULL);
+		size = maxbyte + 1;
+	}
+	if (maxbyte >= 0) {
+		RL_CALL(rl_string_get_objects, RL_OK, db, key, keylen, &page_number, &expires, &version);
+		RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_STRING, page_number, expires, version + 1);
+	}
+	RL_CALL(paged_string_open, RL_OK, &string, page_number, size);
 
-	*position = pos;
+	for (i = 0; i < opc; i++) {
+		RL_CALL(bitfield_apply, RL_OK, &string, &ops[i], &results[i], &failed[i]);
+	}
+	RL_CALL(paged_string_flush, RL_OK, &string);
+	retval = RL_OK;
+cleanup:
+	paged_string_destroy(&string);
+	return retval;
+}
+
+/**
+ * Adds the elements to a dense HLL in place. Only the pages holding the
+ * header and the registers that grow are written back.
+ */
+static int pfadd_dense(paged_string *string, int elementc, unsigned char **elements, long *elementslen, int *updated)
+{
+	unsigned char header[RL_HLL_HDR_SIZE], bytes[2];
+	long byte, regnum;
+	int i, count, retval;
+
+	*updated = 0;
+	for (i = 0; i < elementc; i++) {
+		count = rl_str_pfdense_locate(elements[i], elementslen[i], &byte, &regnum);
+		RL_CALL(paged_string_copy, RL_OK, string, byte, 2, bytes, 0);
+		if (rl_str_pfdense_update(bytes, regnum, count)) {
+			RL_CALL(paged_string_copy, RL_OK, string, byte, 2, bytes, 1);
+			*updated = 1;
+		}
+	}
+	if (*updated) {
+		RL_CALL(paged_string_copy, RL_OK, string, 0, RL_HLL_HDR_SIZE, header, 0);
+		rl_str_pfinvalidate(header);
+		RL_CALL(paged_string_copy, RL_OK, string, 0, RL_HLL_HDR_SIZE, header, 1);
+		RL_CALL(paged_string_flush, RL_OK, string);
+	}
 	retval = RL_OK;
 cleanup:
-	rl_free(value);
 	return retval;
 }
 
 int rl_pfadd(struct rlite *db, const unsigned char *key, long keylen, int elementc, unsigned char **elements, long *elementslen, int *updated)
 {
-	int retval;
-	unsigned char *value = NULL;
-	long valuelen = 0;
+	int retval, dense, changed;
+	unsigned char *value = NULL, header[RL_HLL_HDR_SIZE];
+	long valuelen = 0, page_number = 0, version;
 	unsigned long long expires = 0;
+	paged_string string;
 
-	RL_CALL2(rl_get, RL_OK, RL_NOT_FOUND, db, key, keylen, &value, &valuelen);
+	paged_string_init(db, &string);
+	RL_CALL2(rl_string_get_objects, RL_OK, RL_NOT_FOUND, db, key, keylen, &page_number, &expires, &version);
 	if (retval == RL_OK) {
-		RL_CALL(rl_key_get, RL_FOUND, db, key, keylen, NULL, NULL, NULL, &expires, NULL);
+		RL_CALL(rl_multi_string_getrange, RL_OK, db, page_number, NULL, &valuelen, 0, -1);
+		RL_CALL(paged_string_open, RL_OK, &string, page_number, valuelen);
+		RL_CALL(paged_string_copy, RL_OK, &string, 0, RL_HLL_HDR_SIZE, header, 0);
+		dense = rl_str_pfisdense(header, valuelen);
+		if (dense < 0) {
+			retval = RL_INVALID_STATE;
+			goto cleanup;
+		}
+		// dense values have a fixed size and are updated in place,
+		// sparse ones may be rewritten in a different size
+		if (dense) {
+			RL_CALL(pfadd_dense, RL_OK, &string, elementc, elements, elementslen, &changed);
+			if (changed) {
+				RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_STRING, page_number, expires, version + 1);
+			}
+			if (updated) {
+				*updated = changed;
+			}
+			retval = RL_OK;
+			goto cleanup;
+		}
+		RL_CALL(rl_multi_string_get, RL_OK, db, page_number, &value, &valuelen);
 	}
 	retval = rl_str_pfadd(value, valuelen, elementc, elements, elementslen, &value, &valuelen);
 	if (retval != 0 && retval != 1) {
@@ -436,6 +1032,7 @@ int rl_pfadd(struct rlite *db, const unsigned char *key, long keylen, int elemen
 	}
 	retval = RL_OK;
 cleanup:
+	paged_string_destroy(&string);
 	rl_free(value);
 	return retval;
 }
@@ -447,9 +1044,11 @@ int rl_pfcount(struct rlite *db, int keyc, const unsigned char **keys, long *key
 	long *argvlen = NULL;
 	long i;
 	unsigned char *newvalue = NULL;
-	long newvaluelen;
+	long newvaluelen, page_number = 0, version;
 	unsigned long long expires = 0;
+	paged_string string;
 
+	paged_string_init(db, &string);
 	RL_MALLOC(argvlen, sizeof(unsigned char *) * keyc);
 	RL_MALLOC(argv, sizeof(unsigned char *) * keyc);
 	for (i = 0; i < keyc; i++) {
@@ -469,11 +1068,16 @@ int rl_pfcount(struct rlite *db, int keyc, const unsigned char **keys, long *key
 		goto cleanup;
 	}
 	if (newvalue) {
-		RL_CALL2(rl_key_get, RL_FOUND, RL_NOT_FOUND, db, keys[0], keyslen[0], NULL, NULL, NULL, &expires, NULL);
-		RL_CALL(rl_set, RL_OK, db, keys[0], keyslen[0], newvalue, newvaluelen, 0, expires);
+		// only the cached cardinality changed, write back the header
+		RL_CALL(rl_string_get_objects, RL_OK, db, keys[0], keyslen[0], &page_number, &expires, &version);
+		RL_CALL(paged_string_open, RL_OK, &string, page_number, newvaluelen);
+		RL_CALL(paged_string_copy, RL_OK, &string, 0, RL_HLL_HDR_SIZE, newvalue, 1);
+		RL_CALL(paged_string_flush, RL_OK, &string);
+		RL_CALL(rl_key_set, RL_OK, db, keys[0], keyslen[0], RL_TYPE_STRING, page_number, expires, version + 1);
 	}
 	retval = RL_OK;
 cleanup:
+	paged_string_destroy(&string);
 	for (i = 0; i < keyc; i++) {
 		rl_free(argv[i]);
 	}
@@ -617,10 +1221,17 @@ cleanup:
 
 int rl_string_pages(struct rlite *db, long page, short *pages)
 {
+	// numbers are stored in the key, without a value page
+	if (page == 0) {
+		return RL_OK;
+	}
 	return rl_multi_string_pages(db, page, pages);
 }
 
 int rl_string_delete(struct rlite *db, long value_page)
 {
+	if (value_page == 0) {
+		return RL_OK;
+	}
 	return rl_multi_string_delete(db, value_page);
 }
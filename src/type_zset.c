@@ -1,97 +1,96 @@
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "rlite/rlite.h"
 #include "rlite/page_key.h"
 #include "rlite/page_multi_string.h"
 #include "rlite/type_zset.h"
 #include "rlite/page_btree.h"
 #include "rlite/page_list.h"
-#include "rlite/page_skiplist.h"
+#include "rlite/page_zset_packed.h"
+#include "rlite/page_zset_tree.h"
+#include "rlite/pubsub.h"
 #include "rlite/util.h"
 
-static int rl_zset_create(rlite *db, long levels_page_number, rl_btree **btree, long *btree_page, rl_skiplist **_skiplist, long *skiplist_page)
+/**
+ * A sorted set value page is a "levels" list. When the list has a single
+ * element, it points to a packed page with all the members. Otherwise
+ * the first element is the scores btree and the second one the zset tree.
+ */
+typedef struct {
+	long levels_page;
+	rl_zset_packed *packed;
+	long packed_page;
+	rl_btree *scores;
+	long scores_page;
+	rl_zset_tree *tree;
+	long tree_page;
+} rl_zset_objects;
+
+static int rl_zset_create(rlite *db, long levels_page_number, rl_zset_objects *zset)
 {
 	rl_list *levels;
-	rl_btree *scores = NULL;
-	rl_skiplist *skiplist = NULL;
-	long scores_page_number;
-	long skiplist_page_number;
+	rl_zset_packed *packed = NULL;
+	long packed_page_number;
+	long *packed_element;
 
 	int retval;
-	RL_CALL(rl_btree_create, RL_OK, db, &scores, &rl_btree_type_hash_sha1_double);
-	scores_page_number = db->next_empty_page;
-	RL_CALL(rl_write, RL_OK, db, &rl_data_type_btree_hash_sha1_double, scores_page_number, scores);
-	RL_CALL(rl_skiplist_create, RL_OK, db, &skiplist);
-	skiplist_page_number = db->next_empty_page;
-	RL_CALL(rl_write, RL_OK, db, &rl_data_type_skiplist, skiplist_page_number, skiplist);
+	RL_CALL(rl_zset_packed_create, RL_OK, db, &packed);
+	packed_page_number = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_packed, packed_page_number, packed);
 	RL_CALL(rl_list_create, RL_OK, db, &levels, &rl_list_type_long);
 	RL_CALL(rl_write, RL_OK, db, &rl_data_type_list_long, levels_page_number, levels);
 
-	long *scores_element;
-	RL_MALLOC(scores_element, sizeof(long));
-	*scores_element = scores_page_number;
-	RL_CALL(rl_list_add_element, RL_OK, db, levels, levels_page_number, scores_element, 0);
-
-	long *skiplist_element;
-	RL_MALLOC(skiplist_element, sizeof(long))
-	*skiplist_element = skiplist_page_number;
-	RL_CALL(rl_list_add_element, RL_OK, db, levels, levels_page_number, skiplist_element, 1);
-
-	if (btree) {
-		*btree = scores;
-	}
-	if (btree_page) {
-		*btree_page = scores_page_number;
-	}
-	if (_skiplist) {
-		*_skiplist = skiplist;
-	}
-	if (skiplist_page) {
-		*skiplist_page = skiplist_page_number;
-	}
+	RL_MALLOC(packed_element, sizeof(long));
+	*packed_element = packed_page_number;
+	RL_CALL(rl_list_add_element, RL_OK, db, levels, levels_page_number, packed_element, 0);
+
+	zset->levels_page = levels_page_number;
+	zset->packed = packed;
+	zset->packed_page = packed_page_number;
+	zset->scores = NULL;
+	zset->scores_page = 0;
+	zset->tree = NULL;
+	zset->tree_page = 0;
 cleanup:
 	return retval;
 }
 
-static int rl_zset_read(rlite *db, long levels_page_number, rl_btree **btree, long *btree_page, rl_skiplist **skiplist, long *skiplist_page)
+static int rl_zset_read(rlite *db, long levels_page_number, rl_zset_objects *zset)
 {
 	void *tmp;
-	long scores_page_number, skiplist_page_number;
 	rl_list *levels;
 	int retval;
 	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, levels_page_number, &rl_list_type_long, &tmp, 1);
 	levels = tmp;
-	if (btree || btree_page) {
-		RL_CALL(rl_list_get_element, RL_FOUND, db, levels, &tmp, 0);
-		scores_page_number = *(long *)tmp;
-		if (btree) {
-			RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_sha1_double, scores_page_number, &rl_btree_type_hash_sha1_double, &tmp, 1);
-			*btree = tmp;
-		}
-		if (btree_page) {
-			*btree_page = scores_page_number;
-		}
+	zset->levels_page = levels_page_number;
+	zset->packed = NULL;
+	zset->packed_page = 0;
+	zset->scores = NULL;
+	zset->scores_page = 0;
+	zset->tree = NULL;
+	zset->tree_page = 0;
+	RL_CALL(rl_list_get_element, RL_FOUND, db, levels, &tmp, 0);
+	if (levels->size == 1) {
+		zset->packed_page = *(long *)tmp;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_packed, zset->packed_page, NULL, &tmp, 1);
+		zset->packed = tmp;
 	}
-	if (skiplist || skiplist_page) {
+	else {
+		zset->scores_page = *(long *)tmp;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_sha1_double, zset->scores_page, &rl_btree_type_hash_sha1_double, &tmp, 1);
+		zset->scores = tmp;
 		RL_CALL(rl_list_get_element, RL_FOUND, db, levels, &tmp, 1);
-		if (retval != RL_FOUND) {
-			goto cleanup;
-		}
-		skiplist_page_number = *(long *)tmp;
-		if (skiplist) {
-			RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_skiplist, skiplist_page_number, NULL, &tmp, 1);
-			*skiplist = tmp;
-		}
-		if (skiplist_page) {
-			*skiplist_page = skiplist_page_number;
-		}
+		zset->tree_page = *(long *)tmp;
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, zset->tree_page, NULL, &tmp, 1);
+		zset->tree = tmp;
 	}
 	retval = RL_OK;
 cleanup:
 	return retval;
 }
 
-static int rl_zset_get_objects(rlite *db, const unsigned char *key, long keylen, long *_levels_page_number, rl_btree **btree, long *btree_page, rl_skiplist **skiplist, long *skiplist_page, int update_version, int create)
+static int rl_zset_get_objects(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, int update_version, int create)
 {
 	long levels_page_number = 0, version = 0;
 	int retval;
@@ -102,11 +101,11 @@ static int rl_zset_get_objects(rlite *db, const unsigned char *key, long keylen,
 			goto cleanup;
 		}
 		else if (retval == RL_NOT_FOUND) {
-			retval = rl_zset_create(db, levels_page_number, btree, btree_page, skiplist, skiplist_page);
+			retval = rl_zset_create(db, levels_page_number, zset);
 			goto cleanup;
 		}
 		else {
-			RL_CALL(rl_zset_read, RL_OK, db, levels_page_number, btree, btree_page, skiplist, skiplist_page);
+			RL_CALL(rl_zset_read, RL_OK, db, levels_page_number, zset);
 		}
 	}
 	else {
@@ -119,70 +118,119 @@ static int rl_zset_get_objects(rlite *db, const unsigned char *key, long keylen,
 			retval = RL_WRONG_TYPE;
 			goto cleanup;
 		}
-		RL_CALL(rl_zset_read, RL_OK, db, levels_page_number, btree, btree_page, skiplist, skiplist_page);
+		RL_CALL(rl_zset_read, RL_OK, db, levels_page_number, zset);
 	}
 	if (update_version) {
 		RL_CALL(rl_key_set, RL_OK, db, key, keylen, RL_TYPE_ZSET, levels_page_number, expires, version + 1);
 	}
 cleanup:
-	if (_levels_page_number) {
-		*_levels_page_number = levels_page_number;
-	}
 	return retval;
 }
 
-static int remove_member_score_sha1(rlite *db, const unsigned char *key, long keylen, long levels_page_number, rl_btree *scores, long scores_page, rl_skiplist *skiplist, long skiplist_page, unsigned char *member, long member_len, double score, unsigned char digest[20])
+static long zset_card(rl_zset_objects *zset)
+{
+	return zset->packed ? zset->packed->size : zset->tree->size;
+}
+
+static int delete_levels(rlite *db, const unsigned char *key, long keylen, long levels_page_number)
 {
 	void *tmp;
 	int retval;
-	retval = rl_btree_remove_element(db, scores, scores_page, digest);
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, levels_page_number, &rl_list_type_long, &tmp, 1);
+	RL_CALL(rl_list_delete, RL_OK, db, tmp);
+	RL_CALL(rl_delete, RL_OK, db, levels_page_number);
+	RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int packed_remove_range(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, long start, long end)
+{
+	int retval = RL_OK;
+	long i;
+	for (i = end; i >= start; i--) {
+		retval = rl_zset_packed_remove(zset->packed, i);
+		if (retval != RL_OK && retval != RL_DELETED) {
+			goto cleanup;
+		}
+	}
+	if (retval == RL_DELETED) {
+		RL_CALL(rl_delete, RL_OK, db, zset->packed_page);
+		zset->packed = NULL;
+		RL_CALL(delete_levels, RL_OK, db, key, keylen, zset->levels_page);
+		retval = RL_DELETED;
+	}
+	else {
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_packed, zset->packed_page, zset->packed);
+	}
+cleanup:
+	return retval;
+}
+
+static int remove_member_score_sha1(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, unsigned char *member, long member_len, double score, unsigned char digest[20])
+{
+	int retval;
+	retval = rl_btree_remove_element(db, zset->scores, zset->scores_page, digest);
 	if (retval != RL_OK && retval != RL_DELETED) {
 		goto cleanup;
 	}
-	retval = rl_skiplist_delete(db, skiplist, skiplist_page, score, member, member_len);
+	retval = rl_zset_tree_delete(db, zset->tree, zset->tree_page, score, member, member_len);
 	if (retval != RL_OK && retval != RL_DELETED) {
 		goto cleanup;
 	}
 	if (retval == RL_DELETED) {
-		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, levels_page_number, &rl_list_type_long, &tmp, 1);
-		RL_CALL(rl_list_delete, RL_OK, db, tmp);
-		RL_CALL(rl_delete, RL_OK, db, levels_page_number);
-		RL_CALL(rl_key_delete, RL_OK, db, key, keylen);
+		RL_CALL(delete_levels, RL_OK, db, key, keylen, zset->levels_page);
 		retval = RL_DELETED;
 	}
 cleanup:
 	return retval;
 }
 
-static int remove_member_score(rlite *db, const unsigned char *key, long keylen, long levels_page_number, rl_btree *scores, long scores_page, rl_skiplist *skiplist, long skiplist_page, unsigned char *member, long member_len, double score)
+static int remove_member_score(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, unsigned char *member, long member_len, double score)
 {
 	unsigned char digest[20];
+	long position;
 	int retval;
+	if (zset->packed) {
+		position = rl_zset_packed_rank(zset->packed, score, member, member_len);
+		RL_CALL2(packed_remove_range, RL_OK, RL_DELETED, db, key, keylen, zset, position, position);
+		goto cleanup;
+	}
 	RL_CALL(sha1, RL_OK, member, member_len, digest);
-	RL_CALL(remove_member_score_sha1, RL_OK, db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, member, member_len, score, digest);
+	RL_CALL2(remove_member_score_sha1, RL_OK, RL_DELETED, db, key, keylen, zset, member, member_len, score, digest);
 cleanup:
 	return retval;
 }
 
-static int remove_member(rlite *db, const unsigned char *key, long keylen, long levels_page_number, rl_btree *scores, long scores_page, rl_skiplist *skiplist, long skiplist_page, unsigned char *member, long member_len)
+static int remove_member(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, unsigned char *member, long member_len)
 {
 	double score;
 	void *tmp;
+	long position;
 	unsigned char digest[20];
 	int retval;
+	if (zset->packed) {
+		retval = rl_zset_packed_find(zset->packed, member, member_len, &position);
+		if (retval == RL_FOUND) {
+			RL_CALL2(packed_remove_range, RL_OK, RL_DELETED, db, key, keylen, zset, position, position);
+		}
+		goto cleanup;
+	}
 	RL_CALL(sha1, RL_OK, member, member_len, digest);
-	retval = rl_btree_find_score(db, scores, digest, &tmp, NULL, NULL);
+	retval = rl_btree_find_score(db, zset->scores, digest, &tmp, NULL, NULL);
 	if (retval != RL_FOUND && retval != RL_NOT_FOUND) {
 		goto cleanup;
 	}
 	if (retval == RL_FOUND) {
 		score = *(double *)tmp;
-		RL_CALL(remove_member_score_sha1, RL_OK, db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, member, member_len, score, digest);
+		RL_CALL(remove_member_score_sha1, RL_OK, db, key, keylen, zset, member, member_len, score, digest);
 	}
 cleanup:
 	return retval;
 }
-static int add_member(rlite *db, rl_btree *scores, long scores_page, rl_skiplist *skiplist, long skiplist_page, double score, unsigned char *member, long memberlen)
+
+static int add_member_full(rlite *db, rl_zset_objects *zset, double score, unsigned char *member, long memberlen)
 {
 	int retval;
 	unsigned char *digest = NULL;
@@ -201,12 +249,12 @@ static int add_member(rlite *db, rl_btree *scores, long scores_page, rl_skiplist
 		rl_free(digest);
 		goto cleanup;
 	}
-	RL_CALL(rl_btree_add_element, RL_OK, db, scores, scores_page, digest, value_ptr);
+	RL_CALL(rl_btree_add_element, RL_OK, db, zset->scores, zset->scores_page, digest, value_ptr);
 
-	retval = rl_skiplist_add(db, skiplist, skiplist_page, score, member, memberlen);
+	retval = rl_zset_tree_add(db, zset->tree, zset->tree_page, score, member, memberlen);
 	if (retval != RL_OK) {
 		// This failure is critical. The btree already has the element, but
-		// the skiplist failed to add it. If left as is, it would be in an
+		// the zset tree failed to add it. If left as is, it would be in an
 		// inconsistent state. Dropping all the transaction in progress.
 		rl_discard(db);
 		goto cleanup;
@@ -215,36 +263,112 @@ cleanup:
 	return retval;
 }
 
-int rl_zadd(rlite *db, const unsigned char *key, long keylen, double score, unsigned char *member, long memberlen)
+/**
+ * Creates an empty scores btree and zset tree for a packed sorted set
+ */
+static int create_tree_objects(rlite *db, rl_zset_objects *zset)
 {
-	int existed;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, levels_page_number;
+	rl_btree *scores = NULL;
+	rl_zset_tree *tree = NULL;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
-	retval = remove_member(db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, member, memberlen);
-	if (retval != RL_OK && retval != RL_NOT_FOUND && retval != RL_DELETED) {
-		goto cleanup;
+
+	RL_CALL(rl_btree_create, RL_OK, db, &scores, &rl_btree_type_hash_sha1_double);
+	zset->scores_page = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_btree_hash_sha1_double, zset->scores_page, scores);
+	zset->scores = scores;
+	RL_CALL(rl_zset_tree_create, RL_OK, db, &tree);
+	zset->tree_page = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, zset->tree_page, tree);
+	zset->tree = tree;
+cleanup:
+	return retval;
+}
+
+/**
+ * Replaces the packed page in the levels list by the scores btree and the
+ * zset tree.
+ */
+static int install_tree_objects(rlite *db, rl_zset_objects *zset)
+{
+	rl_list *levels;
+	long *element;
+	void *tmp;
+	int retval;
+
+	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, zset->levels_page, &rl_list_type_long, &tmp, 1);
+	levels = tmp;
+	RL_MALLOC(element, sizeof(long));
+	*element = zset->scores_page;
+	RL_CALL(rl_list_add_element, RL_OK, db, levels, zset->levels_page, element, 0);
+	RL_MALLOC(element, sizeof(long));
+	*element = zset->tree_page;
+	RL_CALL(rl_list_add_element, RL_OK, db, levels, zset->levels_page, element, -1);
+	RL_CALL(rl_list_remove_element, RL_OK, db, levels, zset->levels_page, 1);
+
+	RL_CALL(rl_delete, RL_OK, db, zset->packed_page);
+	zset->packed = NULL;
+	zset->packed_page = 0;
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+/**
+ * Moves all the members of a packed sorted set into a scores btree and a
+ * zset tree, and replaces the packed page in the levels list by them.
+ */
+static int convert_to_tree(rlite *db, rl_zset_objects *zset)
+{
+	rl_zset_packed *packed = zset->packed;
+	long i;
+	int retval;
+
+	RL_CALL(create_tree_objects, RL_OK, db, zset);
+	for (i = 0; i < packed->size; i++) {
+		RL_CALL(add_member_full, RL_OK, db, zset, packed->scores[i], packed->members[i], packed->memberslen[i]);
 	}
-	else if (retval == RL_DELETED) {
-		RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
+	RL_CALL(install_tree_objects, RL_OK, db, zset);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static int add_member(rlite *db, rl_zset_objects *zset, double score, unsigned char *member, long memberlen)
+{
+	int retval;
+	rl_zset_packed *packed = zset->packed;
+	if (packed) {
+		if (rl_zset_packed_find(packed, member, memberlen, NULL) == RL_FOUND) {
+			retval = RL_FOUND;
+			goto cleanup;
+		}
+		if (packed->size < RL_ZSET_PACKED_MAX_ENTRIES && memberlen <= RL_ZSET_PACKED_MAX_MEMBER &&
+		        rl_zset_packed_serialized_size(packed) + 12 + memberlen <= db->page_size) {
+			RL_CALL(rl_zset_packed_add, RL_OK, packed, score, member, memberlen, NULL);
+			RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_packed, zset->packed_page, packed);
+			goto cleanup;
+		}
+		RL_CALL(convert_to_tree, RL_OK, db, zset);
 	}
-	existed = retval != RL_NOT_FOUND; // ok or deleted means there was a value
-	RL_CALL(add_member, RL_OK, db, scores, scores_page, skiplist, skiplist_page, score, member, memberlen);
-	retval = existed ? RL_FOUND : RL_OK;
+	RL_CALL(add_member_full, RL_OK, db, zset, score, member, memberlen);
 cleanup:
 	return retval;
 }
 
-static int rl_get_zscore(rlite *db, rl_btree *scores, unsigned char *member, long memberlen, double *score)
+static int rl_get_zscore(rlite *db, rl_zset_objects *zset, unsigned char *member, long memberlen, double *score)
 {
 	unsigned char *digest = NULL;
+	long position;
 	int retval;
+	if (zset->packed) {
+		RL_CALL(rl_zset_packed_find, RL_FOUND, zset->packed, member, memberlen, &position);
+		*score = zset->packed->scores[position];
+		goto cleanup;
+	}
 	RL_MALLOC(digest, sizeof(unsigned char) * 20);
 	RL_CALL(sha1, RL_OK, member, memberlen, digest);
 	void *value;
-	RL_CALL(rl_btree_find_score, RL_FOUND, db, scores, digest, &value, NULL, NULL);
+	RL_CALL(rl_btree_find_score, RL_FOUND, db, zset->scores, digest, &value, NULL, NULL);
 	*score = *(double *)value;
 	retval = RL_FOUND;
 cleanup:
@@ -254,55 +378,108 @@ cleanup:
 
 int rl_zscore(rlite *db, const unsigned char *key, long keylen, unsigned char *member, long memberlen, double *score)
 {
-	rl_btree *scores;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, &scores, NULL, NULL, NULL, 0, 0);
-	RL_CALL(rl_get_zscore, RL_FOUND, db, scores, member, memberlen, score);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(rl_get_zscore, RL_FOUND, db, &zset, member, memberlen, score);
 cleanup:
 	return retval;
 }
 
-int rl_zrank(rlite *db, const unsigned char *key, long keylen, unsigned char *member, long memberlen, long *rank)
+static int zset_rank(rlite *db, rl_zset_objects *zset, unsigned char *member, long memberlen, long *rank)
 {
 	double score;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, &scores, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(rl_get_zscore, RL_FOUND, db, scores, member, memberlen, &score);
-	RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, score, RL_SKIPLIST_INCLUDE_SCORE, member, memberlen, NULL, rank);
+	RL_CALL(rl_get_zscore, RL_FOUND, db, zset, member, memberlen, &score);
+	if (zset->packed) {
+		*rank = rl_zset_packed_rank(zset->packed, score, member, memberlen);
+	}
+	else {
+		RL_CALL(rl_zset_tree_count_before, RL_OK, db, zset->tree, score, member, memberlen, 0, rank);
+		retval = RL_FOUND;
+	}
+cleanup:
+	return retval;
+}
+
+int rl_zrank(rlite *db, const unsigned char *key, long keylen, unsigned char *member, long memberlen, long *rank)
+{
+	rl_zset_objects zset;
+	int retval;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(zset_rank, RL_FOUND, db, &zset, member, memberlen, rank);
 cleanup:
 	return retval;
 }
 
 int rl_zrevrank(rlite *db, const unsigned char *key, long keylen, unsigned char *member, long memberlen, long *revrank)
 {
-	double score;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, &scores, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(rl_get_zscore, RL_FOUND, db, scores, member, memberlen, &score);
-	RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, score, RL_SKIPLIST_INCLUDE_SCORE, member, memberlen, NULL, revrank);
-	*revrank = skiplist->size - (*revrank) - 1;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(zset_rank, RL_FOUND, db, &zset, member, memberlen, revrank);
+	*revrank = zset_card(&zset) - (*revrank) - 1;
 cleanup:
 	return retval;
 }
 
 int rl_zcard(rlite *db, const unsigned char *key, long keylen, long *card)
 {
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
+	int retval;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	*card = zset_card(&zset);
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+int rl_zset_encoding(rlite *db, const unsigned char *key, long keylen, int *encoding)
+{
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	*card = skiplist->size;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	*encoding = zset.packed ? RL_ZSET_ENCODING_PACKED : RL_ZSET_ENCODING_TREE;
 	retval = RL_OK;
 cleanup:
 	return retval;
 }
 
+/**
+ * Number of elements with a score lower than `score`, or lower or equal
+ * when `inclusive` is set.
+ */
+static int zset_count_before_score(rlite *db, rl_zset_objects *zset, double score, int inclusive, long *count)
+{
+	if (zset->packed) {
+		*count = rl_zset_packed_count_before_score(zset->packed, score, inclusive);
+		return RL_OK;
+	}
+	return rl_zset_tree_count_before(db, zset->tree, score, NULL, 0, inclusive, count);
+}
+
+/**
+ * Same as zset_count_before_score, comparing members instead.
+ * Only meaningful when all the elements have the same score.
+ */
+static int zset_count_before_member(rlite *db, rl_zset_objects *zset, unsigned char *member, long memberlen, int inclusive, long *count)
+{
+	double score;
+	int retval;
+	if (zset->packed) {
+		*count = rl_zset_packed_count_before_member(zset->packed, member, memberlen, inclusive);
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_CALL(rl_zset_tree_get, RL_OK, db, zset->tree, 0, &score, NULL, NULL);
+	RL_CALL(rl_zset_tree_count_before, RL_OK, db, zset->tree, score, member, memberlen, inclusive, count);
+cleanup:
+	return retval;
+}
+
 int rl_zcount(rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long *count)
 {
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	long maxrank, minrank;
 	int retval;
 	if (range->max < range->min) {
@@ -311,34 +488,22 @@ int rl_zcount(rlite *db, const unsigned char *key, long keylen, rl_zrangespec *r
 		goto cleanup;
 	}
 
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-
-	retval = rl_skiplist_first_node(db, skiplist, range->max, range->maxex ? RL_SKIPLIST_BEFORE_SCORE : RL_SKIPLIST_UPTO_SCORE, NULL, 0, NULL, &maxrank);
-	if (retval == RL_NOT_FOUND) {
-		maxrank = skiplist->size - 1;
-	}
-	else if (retval != RL_FOUND) {
-		goto cleanup;
-	}
-	retval = rl_skiplist_first_node(db, skiplist, range->min, range->minex ? RL_SKIPLIST_EXCLUDE_SCORE : RL_SKIPLIST_INCLUDE_SCORE, NULL, 0, NULL, &minrank);
-	if (retval != RL_FOUND) {
-		goto cleanup;
-	}
-	else if (minrank < 0) {
-		minrank = 0;
-	}
-
-	*count = maxrank - minrank + 1;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(zset_count_before_score, RL_OK, db, &zset, range->min, range->minex, &minrank);
+	RL_CALL(zset_count_before_score, RL_OK, db, &zset, range->max, !range->maxex, &maxrank);
+	*count = maxrank > minrank ? maxrank - minrank : 0;
 	retval = RL_OK;
 cleanup:
 	return retval;
 }
 
-static int _rl_zrange(rlite *db, rl_skiplist *skiplist, long start, long end, int direction, rl_zset_iterator **iterator)
+static int _rl_zrange(rlite *db, rl_zset_objects *zset, long start, long end, int direction, rl_zset_iterator **_iterator)
 {
 	int retval = RL_OK;
-	long size, node_page;
-	long card = skiplist->size;
+	long size;
+	long card = zset_card(zset);
+	rl_zset_iterator *iterator = NULL;
+	void *tmp;
 
 	if (start < 0) {
 		start += card;
@@ -359,27 +524,37 @@ static int _rl_zrange(rlite *db, rl_skiplist *skiplist, long start, long end, in
 
 	size = end - start + 1;
 
-	RL_CALL(rl_skiplist_node_by_rank, RL_OK, db, skiplist, direction > 0 ? start : end, NULL, &node_page);
-	RL_CALL(rl_skiplist_iterator_create, RL_OK, db, iterator, skiplist, node_page, direction, size);
+	RL_MALLOC(iterator, sizeof(*iterator));
+	iterator->db = db;
+	iterator->size = size;
+	iterator->direction = direction > 0 ? 1 : -1;
+	iterator->position = direction > 0 ? start : end;
+	iterator->packed = NULL;
+	iterator->tree_iterator = NULL;
+	if (zset->packed) {
+		// the iterator keeps its own copy, the sorted set might change while iterating
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_packed, zset->packed_page, NULL, &tmp, 0);
+		iterator->packed = tmp;
+	}
+	else {
+		RL_CALL(rl_zset_tree_iterator_create, RL_OK, db, zset->tree, direction > 0 ? start : end, direction, size, &iterator->tree_iterator);
+	}
+	*_iterator = iterator;
+	retval = RL_OK;
 cleanup:
+	if (retval != RL_OK && iterator) {
+		rl_zset_iterator_destroy(iterator);
+	}
 	return retval;
 }
 
-static int _rl_zrangebyscore(rlite *db, rl_skiplist *skiplist, rl_zrangespec *range, long *_start, long *_end)
+static int _rl_zrangebyscore(rlite *db, rl_zset_objects *zset, rl_zrangespec *range, long *_start, long *_end)
 {
 	long start, end;
-	rl_skiplist_node *node;
 	int retval;
-	RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, range->min, range->minex ? RL_SKIPLIST_EXCLUDE_SCORE : RL_SKIPLIST_INCLUDE_SCORE, NULL, 0, NULL, &start);
-	retval = rl_skiplist_first_node(db, skiplist, range->max, range->maxex ? RL_SKIPLIST_BEFORE_SCORE : RL_SKIPLIST_UPTO_SCORE, NULL, 0, &node, &end);
-	if (retval != RL_FOUND && retval != RL_NOT_FOUND) {
-		goto cleanup;
-	}
-
-	if (retval == RL_FOUND && end == 0 && ((range->maxex && node->score == range->max) || node->score > range->max)) {
-		retval = RL_NOT_FOUND;
-		goto cleanup;
-	}
+	RL_CALL(zset_count_before_score, RL_OK, db, zset, range->min, range->minex, &start);
+	RL_CALL(zset_count_before_score, RL_OK, db, zset, range->max, !range->maxex, &end);
+	end--;
 	if (end < start) {
 		retval = RL_NOT_FOUND;
 		goto cleanup;
@@ -394,14 +569,14 @@ cleanup:
 int rl_zrangebyscore(rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long offset, long count, rl_zset_iterator **iterator)
 {
 	long start, end;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(_rl_zrangebyscore, RL_OK, db, skiplist, range, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(_rl_zrangebyscore, RL_OK, db, &zset, range, &start, &end);
 
 	start += offset;
 
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, iterator);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, start, end, 1, iterator);
 	if (count >= 0 && (*iterator)->size > count) {
 		(*iterator)->size = count;
 	}
@@ -412,14 +587,14 @@ cleanup:
 int rl_zrevrangebyscore(rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long offset, long count, rl_zset_iterator **iterator)
 {
 	long start, end;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(_rl_zrangebyscore, RL_OK, db, skiplist, range, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(_rl_zrangebyscore, RL_OK, db, &zset, range, &start, &end);
 
 	end -= offset;
 
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, -1, iterator);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, start, end, -1, iterator);
 	if (count >= 0 && (*iterator)->size > count) {
 		(*iterator)->size = count;
 	}
@@ -439,32 +614,24 @@ static int validate_lex_range(unsigned char *min, long minlen, unsigned char *ma
 	return RL_OK;
 }
 
-static int lex_get_range(rlite *db, unsigned char *min, long minlen, unsigned char *max, long maxlen, rl_skiplist *skiplist, long *_start, long *_end)
+static int lex_get_range(rlite *db, unsigned char *min, long minlen, unsigned char *max, long maxlen, rl_zset_objects *zset, long *_start, long *_end)
 {
 	int retval;
 	RL_CALL(validate_lex_range, RL_OK, min, minlen, max, maxlen);
 
-	rl_skiplist_node *node;
-	double score;
-	RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, -INFINITY, RL_SKIPLIST_EXCLUDE_SCORE, NULL, 0, &node, NULL);
-	score = node->score;
-
 	long start, end;
 	if (min[0] == '-') {
 		start = 0;
 	}
 	else {
-		RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, score, min[0] == '(' ? RL_SKIPLIST_EXCLUDE_SCORE : RL_SKIPLIST_INCLUDE_SCORE, &min[1], minlen - 1, &node, &start);
+		RL_CALL(zset_count_before_member, RL_OK, db, zset, &min[1], minlen - 1, min[0] == '(', &start);
 	}
-
 	if (max[0] == '+') {
 		end = -1;
 	}
 	else {
-		RL_CALL(rl_skiplist_first_node, RL_FOUND, db, skiplist, score, max[0] == '(' ? RL_SKIPLIST_BEFORE_SCORE : RL_SKIPLIST_UPTO_SCORE, &max[1], maxlen - 1, NULL, &end);
-		if (retval != RL_FOUND) {
-			goto cleanup;
-		}
+		RL_CALL(zset_count_before_member, RL_OK, db, zset, &max[1], maxlen - 1, max[0] == '[', &end);
+		end--;
 		if (end < 0) {
 			retval = RL_NOT_FOUND;
 			goto cleanup;
@@ -485,13 +652,13 @@ cleanup:
 int rl_zlexcount(rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long *lexcount)
 {
 	long start, end;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
 	RL_CALL(validate_lex_range, RL_OK, min, minlen, max, maxlen);
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, skiplist, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, &zset, &start, &end);
 	if (end < 0) {
-		end += skiplist->size;
+		end += zset_card(&zset);
 	}
 
 	if (end >= start) {
@@ -508,15 +675,15 @@ cleanup:
 int rl_zrevrangebylex(rlite *db, const unsigned char *key, long keylen, unsigned char *max, long maxlen, unsigned char *min, long minlen, long offset, long count, rl_zset_iterator **iterator)
 {
 	long start, end;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
 	RL_CALL(validate_lex_range, RL_OK, min, minlen, max, maxlen);
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, skiplist, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, &zset, &start, &end);
 
 	end -= offset;
 
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, -1, iterator);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, start, end, -1, iterator);
 	if (count >= 0 && (*iterator)->size > count) {
 		(*iterator)->size = count;
 	}
@@ -527,15 +694,15 @@ cleanup:
 int rl_zrangebylex(rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long offset, long count, rl_zset_iterator **iterator)
 {
 	long start, end;
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 	int retval;
 	RL_CALL(validate_lex_range, RL_OK, min, minlen, max, maxlen);
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, skiplist, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(lex_get_range, RL_OK, db, min, minlen, max, maxlen, &zset, &start, &end);
 
 	start += offset;
 
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, iterator);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, start, end, 1, iterator);
 	if (count >= 0 && (*iterator)->size > count) {
 		(*iterator)->size = count;
 	}
@@ -545,26 +712,91 @@ cleanup:
 
 int rl_zrevrange(rlite *db, const unsigned char *key, long keylen, long start, long end, rl_zset_iterator **iterator)
 {
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, - end - 1, - start - 1, -1, iterator);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, - end - 1, - start - 1, -1, iterator);
 cleanup:
 	return retval;
 }
 
 int rl_zrange(rlite *db, const unsigned char *key, long keylen, long start, long end, rl_zset_iterator **iterator)
 {
-	rl_skiplist *skiplist;
+	rl_zset_objects zset;
 
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, iterator);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	RL_CALL(_rl_zrange, RL_OK, db, &zset, start, end, 1, iterator);
 cleanup:
 	return retval;
 }
 
+int rl_zscan(struct rlite *db, const unsigned char *key, long keylen, unsigned long long cursor, unsigned char *pattern, long patternlen, long count, unsigned long long *next_cursor, long *_membersc, unsigned char ***_members, long **_memberslen, double **_scores)
+{
+	rl_zset_objects zset;
+	rl_zset_iterator *iterator = NULL;
+	int retval;
+	long card, membersc = 0, memberlen, i;
+	unsigned char **members = NULL, *member;
+	long *memberslen = NULL;
+	double *scores = NULL, score;
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 0);
+	// sorted sets are visited by rank, the cursor is the next rank to visit
+	card = zset_card(&zset);
+	*next_cursor = 0;
+	if (cursor >= (unsigned long long)card) {
+		count = 0;
+	}
+	else {
+		if ((unsigned long long)count >= card - cursor) {
+			count = card - cursor;
+		}
+		else {
+			*next_cursor = cursor + count;
+		}
+		RL_CALL(_rl_zrange, RL_OK, db, &zset, cursor, cursor + count - 1, 1, &iterator);
+	}
+	RL_MALLOC(members, sizeof(unsigned char *) * (count + 1));
+	RL_MALLOC(memberslen, sizeof(long) * (count + 1));
+	RL_MALLOC(scores, sizeof(double) * (count + 1));
+	for (i = 0; i < count; i++) {
+		retval = rl_zset_iterator_next(iterator, NULL, &score, &member, &memberlen);
+		if (retval != RL_OK) {
+			// the iterator releases itself when it fails
+			iterator = NULL;
+			goto cleanup;
+		}
+		if (!pattern || rl_stringmatchlen((char *)pattern, patternlen, (char *)member, memberlen, 0)) {
+			members[membersc] = member;
+			memberslen[membersc] = memberlen;
+			scores[membersc] = score;
+			membersc++;
+		}
+		else {
+			rl_free(member);
+		}
+	}
+	*_membersc = membersc;
+	*_members = members;
+	*_memberslen = memberslen;
+	*_scores = scores;
+	retval = RL_OK;
+cleanup:
+	if (iterator) {
+		rl_zset_iterator_destroy(iterator);
+	}
+	if (retval != RL_OK) {
+		for (i = 0; i < membersc; i++) {
+			rl_free(members[i]);
+		}
+		rl_free(members);
+		rl_free(memberslen);
+		rl_free(scores);
+	}
+	return retval;
+}
+
 int rl_zset_iterator_next(rl_zset_iterator *iterator, long *page, double *score, unsigned char **member, long *memberlen)
 {
 	if (member && !memberlen) {
@@ -572,44 +804,72 @@ int rl_zset_iterator_next(rl_zset_iterator *iterator, long *page, double *score,
 		return RL_UNEXPECTED;
 	}
 
-	rl_skiplist_node *node;
+	rl_zset_packed *packed = iterator->packed;
+	long position = iterator->position;
 	int retval;
-	RL_CALL(rl_skiplist_iterator_next, RL_OK, iterator, &node);
+	if (iterator->size <= 0) {
+		retval = RL_END;
+		goto cleanup;
+	}
 
-	if (page) {
-		*page = node->value;
+	if (packed) {
+		if (page) {
+			*page = 0;
+		}
+		if (member) {
+			RL_MALLOC(*member, sizeof(unsigned char) * (packed->memberslen[position] + 1));
+			memcpy(*member, packed->members[position], packed->memberslen[position]);
+			(*member)[packed->memberslen[position]] = 0;
+		}
+		if (memberlen) {
+			*memberlen = packed->memberslen[position];
+		}
+		if (score) {
+			*score = packed->scores[position];
+		}
+		iterator->position += iterator->direction;
 	}
-	if (memberlen) {
-		retval = rl_multi_string_get(iterator->db, node->value, member, memberlen);
+	else {
+		retval = rl_zset_tree_iterator_next(iterator->tree_iterator, score, member, memberlen);
 		if (retval != RL_OK) {
-			rl_skiplist_iterator_destroy(iterator->db, iterator);
+			// the tree iterator releases itself when it is done
+			iterator->tree_iterator = NULL;
 			goto cleanup;
 		}
+		if (page) {
+			*page = 0;
+		}
 	}
-
-	if (score) {
-		*score = node->score;
-	}
+	iterator->size--;
+	retval = RL_OK;
 cleanup:
+	if (retval != RL_OK) {
+		rl_zset_iterator_destroy(iterator);
+	}
 	return retval;
 }
 
 int rl_zset_iterator_destroy(rl_zset_iterator *iterator)
 {
-	return rl_skiplist_iterator_destroy(iterator->db, iterator);
+	if (iterator->tree_iterator) {
+		rl_zset_tree_iterator_destroy(iterator->tree_iterator);
+	}
+	if (iterator->packed) {
+		rl_zset_packed_destroy(iterator->db, iterator->packed);
+	}
+	rl_free(iterator);
+	return RL_OK;
 }
 
 int rl_zrem(rlite *db, const unsigned char *key, long keylen, long members_size, unsigned char **members, long *members_len, long *changed)
 {
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, levels_page_number;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 1);
 	long i;
 	long _changed = 0;
 	for (i = 0; i < members_size; i++) {
-		retval = remove_member(db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, members[i], members_len[i]);
+		retval = remove_member(db, key, keylen, &zset, members[i], members_len[i]);
 		if (retval != RL_OK && retval != RL_NOT_FOUND && retval != RL_DELETED) {
 			goto cleanup;
 		}
@@ -628,28 +888,44 @@ cleanup:
 	return retval;
 }
 
-static int _zremiterator(rlite *db, const unsigned char *key, long keylen, long levels_page_number, rl_zset_iterator *iterator, rl_btree *scores, long scores_page, rl_skiplist *skiplist, long skiplist_page, long *changed)
+static int zremrange(rlite *db, const unsigned char *key, long keylen, rl_zset_objects *zset, long start, long end, long *changed)
 {
-	long _changed = 0;
-	double score;
 	unsigned char *member;
-	long memberlen;
+	long memberlen, i;
+	double score;
+	long card = zset_card(zset);
 	int retval;
-	while ((retval = rl_zset_iterator_next(iterator, NULL, &score, &member, &memberlen)) == RL_OK) {
-		retval = remove_member_score(db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, member, memberlen, score);
-		rl_free(member);
-		if (retval != RL_OK && retval != RL_DELETED) {
-			rl_zset_iterator_destroy(iterator);
-			goto cleanup;
+	if (start < 0) {
+		start += card;
+		if (start < 0) {
+			start = 0;
 		}
-		_changed++;
 	}
-
-	if (retval != RL_END) {
+	if (end < 0) {
+		end += card;
+	}
+	if (end >= card) {
+		end = card - 1;
+	}
+	if (start > end || start >= card) {
+		retval = RL_NOT_FOUND;
 		goto cleanup;
 	}
-
-	*changed = _changed;
+	if (zset->packed) {
+		RL_CALL2(packed_remove_range, RL_OK, RL_DELETED, db, key, keylen, zset, start, end);
+	}
+	else {
+		// every removal shifts the following elements into `start`
+		for (i = start; i <= end; i++) {
+			RL_CALL(rl_zset_tree_get, RL_OK, db, zset->tree, start, &score, &member, &memberlen);
+			retval = remove_member_score(db, key, keylen, zset, member, memberlen, score);
+			rl_free(member);
+			if (retval != RL_OK && retval != RL_DELETED) {
+				goto cleanup;
+			}
+		}
+	}
+	*changed = end - start + 1;
 	retval = RL_OK;
 cleanup:
 	return retval;
@@ -657,14 +933,10 @@ cleanup:
 
 int rl_zremrangebyrank(rlite *db, const unsigned char *key, long keylen, long start, long end, long *changed)
 {
-	rl_zset_iterator *iterator;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, levels_page_number;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, &iterator);
-	RL_CALL(_zremiterator, RL_OK, db, key, keylen, levels_page_number, iterator, scores, scores_page, skiplist, skiplist_page, changed);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 1);
+	RL_CALL(zremrange, RL_OK, db, key, keylen, &zset, start, end, changed);
 	retval = RL_OK;
 cleanup:
 	if (retval != RL_OK && changed) {
@@ -675,17 +947,13 @@ cleanup:
 
 int rl_zremrangebyscore(rlite *db, const unsigned char *key, long keylen, rl_zrangespec *range, long *changed)
 {
-	rl_zset_iterator *iterator;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, levels_page_number;
+	rl_zset_objects zset;
 	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 1);
 
 	long start, end;
-	RL_CALL(_rl_zrangebyscore, RL_OK, db, skiplist, range, &start, &end);
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, &iterator);
-	RL_CALL(_zremiterator, RL_OK, db, key, keylen, levels_page_number, iterator, scores, scores_page, skiplist, skiplist_page, changed);
+	RL_CALL(_rl_zrangebyscore, RL_OK, db, &zset, range, &start, &end);
+	RL_CALL(zremrange, RL_OK, db, key, keylen, &zset, start, end, changed);
 	retval = RL_OK;
 cleanup:
 	if (retval != RL_OK && changed) {
@@ -696,14 +964,12 @@ cleanup:
 
 int rl_zremrangebylex(rlite *db, const unsigned char *key, long keylen, unsigned char *min, long minlen, unsigned char *max, long maxlen, long *changed)
 {
-	rl_zset_iterator *iterator;
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, start, end, levels_page_number;
+	rl_zset_objects zset;
+	long start, end;
 	int retval;
 	RL_CALL(validate_lex_range, RL_OK, min, minlen, max, maxlen);
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
-	retval = lex_get_range(db, min, minlen, max, maxlen, skiplist, &start, &end);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 1);
+	retval = lex_get_range(db, min, minlen, max, maxlen, &zset, &start, &end);
 	if (retval == RL_NOT_FOUND) {
 		*changed = 0;
 		retval = RL_OK;
@@ -713,8 +979,11 @@ int rl_zremrangebylex(rlite *db, const unsigned char *key, long keylen, unsigned
 		goto cleanup;
 	}
 
-	RL_CALL(_rl_zrange, RL_OK, db, skiplist, start, end, 1, &iterator);
-	RL_CALL(_zremiterator, RL_OK, db, key, keylen, levels_page_number, iterator, scores, scores_page, skiplist, skiplist_page, changed);
+	// a range above every member is empty, not missing
+	RL_CALL2(zremrange, RL_OK, RL_NOT_FOUND, db, key, keylen, &zset, start, end, changed);
+	if (retval == RL_NOT_FOUND) {
+		*changed = 0;
+	}
 	retval = RL_OK;
 cleanup:
 	if (retval != RL_OK && changed) {
@@ -723,366 +992,936 @@ cleanup:
 	return retval;
 }
 
+#define ZSET_OP_UNION 0
+#define ZSET_OP_INTER 1
+#define ZSET_OP_DIFF 2
+
+/**
+ * Open addressing table from a member digest to its aggregated score, every
+ * input is streamed once into it instead of looking members up in the
+ * other inputs or updating the destination one member at a time.
+ * `seen` is the number of inputs the member was found in, 0 marks an empty
+ * slot and -1 a member removed by ZDIFF.
+ */
+typedef struct {
+	unsigned char digest[20];
+	unsigned char *member;
+	long memberlen;
+	double score;
+	long seen;
+} zset_aggregate_entry;
+
+typedef struct {
+	long size;
+	long alloc;
+	zset_aggregate_entry *entries;
+} zset_aggregate;
 
-static int incrby(rlite *db, const unsigned char *key, long keylen, double score, unsigned char *member, long memberlen, double *newscore, int clearnan)
+static unsigned long zset_aggregate_hash(unsigned char *digest)
 {
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	long scores_page, skiplist_page, levels_page_number;
-	double existing_score = 0.0;
-	int retval;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &levels_page_number, &scores, &scores_page, &skiplist, &skiplist_page, 1, 1);
-	retval = rl_get_zscore(db, scores, member, memberlen, &existing_score);
-	if (retval != RL_FOUND && retval != RL_NOT_FOUND) {
-		goto cleanup;
-	}
-	else if (retval == RL_FOUND) {
-		score += existing_score;
-		if (isnan(score)) {
-			if (clearnan) {
-				score = 0.0;
-			}
-			else {
-				retval = RL_NAN;
-				goto cleanup;
-			}
-		}
-		retval = remove_member(db, key, keylen, levels_page_number, scores, scores_page, skiplist, skiplist_page, member, memberlen);
-		if (retval == RL_DELETED) {
-			// it would be nice if we could update the score without destroying the btree, maybe remove_member should have an int destroy?
-			RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, NULL, &scores, &scores_page, &skiplist, &skiplist_page, 0, 1);
-		}
-		else if (retval != RL_OK) {
-			goto cleanup;
-		}
+	unsigned long hash = 0;
+	int i;
+	for (i = 0; i < (int)sizeof(hash); i++) {
+		hash = (hash << 8) | digest[i];
 	}
+	return hash;
+}
 
-	RL_CALL(add_member, RL_OK, db, scores, scores_page, skiplist, skiplist_page, score, member, memberlen);
-	if (newscore) {
-		*newscore = score;
+static int zset_aggregate_init(zset_aggregate *agg, long alloc)
+{
+	int retval = RL_OK;
+	long i;
+	agg->size = 0;
+	agg->alloc = 16;
+	while (agg->alloc < alloc * 2) {
+		agg->alloc *= 2;
+	}
+	RL_MALLOC(agg->entries, sizeof(zset_aggregate_entry) * agg->alloc);
+	for (i = 0; i < agg->alloc; i++) {
+		agg->entries[i].seen = 0;
+		agg->entries[i].member = NULL;
 	}
 cleanup:
 	return retval;
 }
 
-int rl_zincrby(rlite *db, const unsigned char *key, long keylen, double score, unsigned char *member, long memberlen, double *newscore)
+static void zset_aggregate_destroy(zset_aggregate *agg)
 {
-	return incrby(db, key, keylen, score, member, memberlen, newscore, 0);
+	long i;
+	if (!agg->entries) {
+		return;
+	}
+	for (i = 0; i < agg->alloc; i++) {
+		rl_free(agg->entries[i].member);
+	}
+	rl_free(agg->entries);
+	agg->entries = NULL;
 }
 
-int rl_zinterstore(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *_weights, int aggregate)
+static zset_aggregate_entry *zset_aggregate_slot(zset_aggregate_entry *entries, long alloc, unsigned char *digest)
 {
-	unsigned char *member = NULL;
-	rl_btree **btrees = NULL;
-	rl_skiplist **skiplists = NULL;
-	double weight = 1.0, weight_tmp;
-	double *weights = NULL;
-	rl_skiplist_node *node;
-	rl_skiplist_iterator *skiplist_iterator = NULL;
-	rl_btree_iterator *btree_iterator = NULL;
-	int retval;
-	long target_btree_page, target_skiplist_page;
-	long multi_string_page;
-	rl_btree *target_btree;
-	rl_skiplist *target_skiplist;
-	int found;
-	void *tmp;
-	double skiplist_score, tmp_score;
-	long memberlen;
-	unsigned char digest[20];
-
-	if (keys_size > 1) {
-		RL_MALLOC(btrees, sizeof(rl_btree *) * (keys_size - 1));
-		RL_MALLOC(skiplists, sizeof(rl_skiplist *) * (keys_size - 1));
+	unsigned long i = zset_aggregate_hash(digest) & (alloc - 1);
+	while (entries[i].seen != 0 && memcmp(entries[i].digest, digest, 20) != 0) {
+		i = (i + 1) & (alloc - 1);
 	}
-	else {
-		retval = RL_UNEXPECTED;
+	return &entries[i];
+}
+
+/**
+ * Keeps the table at most half full
+ */
+static int zset_aggregate_grow(zset_aggregate *agg)
+{
+	int retval = RL_OK;
+	zset_aggregate_entry *entries = NULL;
+	long i, alloc = agg->alloc * 2;
+	if ((agg->size + 1) * 2 <= agg->alloc) {
 		goto cleanup;
 	}
-	retval = rl_key_delete_with_value(db, keys[0], keys_len[0]);
-	if (retval != RL_OK && retval != RL_NOT_FOUND) {
-		goto cleanup;
+	RL_MALLOC(entries, sizeof(zset_aggregate_entry) * alloc);
+	for (i = 0; i < alloc; i++) {
+		entries[i].seen = 0;
+		entries[i].member = NULL;
 	}
-	rl_btree *btree, *btree_tmp;
-	rl_skiplist *skiplist = NULL, *skiplist_tmp;
-	long i;
-	// key in position 0 is the target key
-	// we'll store a pivot skiplist in btree/skiplist and the others in btrees/skiplists
-	// TODO: qsort instead
-	RL_MALLOC(weights, sizeof(double) * (keys_size - 2));
-	for (i = 1; i < keys_size; i++) {
-		weight_tmp = _weights ? _weights[i - 1] : 1.0;
-		RL_CALL2(rl_zset_get_objects, RL_OK, RL_WRONG_TYPE, db, keys[i], keys_len[i], NULL, &btree_tmp, NULL, &skiplist_tmp, NULL, 0, 0);
-		if (retval == RL_WRONG_TYPE) {
-			skiplist_tmp = NULL;
-			RL_CALL(rl_set_get_objects, RL_OK, db, keys[i], keys_len[i], NULL, &btree_tmp, 0, 0);
-		}
-		if (i == 1) {
-			btree = btree_tmp;
-			skiplist = skiplist_tmp;
-			weight = weight_tmp;
-		}
-		else if (btree_tmp->number_of_elements < btree->number_of_elements) {
-			weights[i - 2] = weight;
-			weight = weight_tmp;
-			btrees[i - 2] = btree;
-			btree = btree_tmp;
-			skiplists[i - 2] = skiplist;
-			skiplist = skiplist_tmp;
-		}
-		else {
-			weights[i - 2] = weight_tmp;
-			btrees[i - 2] = btree_tmp;
-			skiplists[i - 2] = skiplist_tmp;
+	for (i = 0; i < agg->alloc; i++) {
+		if (agg->entries[i].seen != 0) {
+			*zset_aggregate_slot(entries, alloc, agg->entries[i].digest) = agg->entries[i];
 		}
 	}
+	rl_free(agg->entries);
+	agg->entries = entries;
+	agg->alloc = alloc;
+cleanup:
+	return retval;
+}
 
-	RL_CALL(rl_zset_get_objects, RL_OK, db, keys[0], keys_len[0], NULL, &target_btree, &target_btree_page, &target_skiplist, &target_skiplist_page, 1, 1);
+static void zset_aggregate_score(zset_aggregate_entry *entry, double score, int aggregate)
+{
+	if (aggregate == RL_ZSET_AGGREGATE_SUM) {
+		entry->score += score;
+		if (isnan(entry->score)) {
+			entry->score = 0.0;
+		}
+	}
+	else if ((aggregate == RL_ZSET_AGGREGATE_MIN && score < entry->score) ||
+	         (aggregate == RL_ZSET_AGGREGATE_MAX && score > entry->score)) {
+		entry->score = score;
+	}
+}
 
-	if (skiplist) {
-		RL_CALL(rl_skiplist_iterator_create, RL_OK, db, &skiplist_iterator, skiplist, 0, 0, 0);
-	} else {
-		RL_CALL(rl_btree_iterator_create, RL_OK, db, btree, &btree_iterator);
+/**
+ * Adds a member of the input at `index`. `member` is only required when the
+ * member may be added to the table, and it is copied when it is.
+ */
+static int zset_aggregate_add(zset_aggregate *agg, int op, long index, unsigned char *digest, unsigned char *member, long memberlen, double score, int aggregate)
+{
+	int retval = RL_OK;
+	zset_aggregate_entry *entry;
+	if (isnan(score)) {
+		score = 0.0;
 	}
-	while ((retval = skiplist ? rl_skiplist_iterator_next(skiplist_iterator, &node) : rl_btree_iterator_next(btree_iterator, NULL, &tmp)) == RL_OK) {
-		found = 1;
-		if (skiplist) {
-			skiplist_score = node->score * weight;
-			multi_string_page = node->value;
-		} else {
-			skiplist_score = weight;
-			multi_string_page = *(long *)tmp;
-			rl_free(tmp);
+	entry = zset_aggregate_slot(agg->entries, agg->alloc, digest);
+	if (entry->seen == 0) {
+		if (index > 0 && op != ZSET_OP_UNION) {
+			goto cleanup;
 		}
-		for (i = 1; i < keys_size - 1; i++) {
-			RL_CALL(rl_multi_string_sha1, RL_OK, db, digest, multi_string_page);
+		RL_CALL(zset_aggregate_grow, RL_OK, agg);
+		entry = zset_aggregate_slot(agg->entries, agg->alloc, digest);
+		RL_MALLOC(entry->member, sizeof(unsigned char) * (memberlen > 0 ? memberlen : 1));
+		memcpy(entry->member, member, memberlen);
+		memcpy(entry->digest, digest, 20);
+		entry->memberlen = memberlen;
+		entry->score = score;
+		entry->seen = 1;
+		agg->size++;
+	}
+	else if (op == ZSET_OP_DIFF) {
+		entry->seen = -1;
+	}
+	else if (op == ZSET_OP_UNION || entry->seen == index) {
+		zset_aggregate_score(entry, score, aggregate);
+		entry->seen++;
+	}
+cleanup:
+	return retval;
+}
 
-			retval = rl_btree_find_score(db, btrees[i - 1], digest, &tmp, NULL, NULL);
-			if (retval == RL_NOT_FOUND) {
-				found = 0;
-				break;
-			}
-			else if (retval == RL_FOUND) {
-				tmp_score = skiplist ? *(double *)tmp : 1.0;
-				if (aggregate == RL_ZSET_AGGREGATE_SUM) {
-					skiplist_score += tmp_score * weights[i - 1];
-				}
-				else if (
-				    (aggregate == RL_ZSET_AGGREGATE_MIN && tmp_score * weights[i - 1] < skiplist_score) ||
-				    (aggregate == RL_ZSET_AGGREGATE_MAX && tmp_score * weights[i - 1] > skiplist_score)
-				) {
-					skiplist_score = tmp_score * weights[i - 1];
-				}
-			}
-			else {
-				goto cleanup;
+/**
+ * Reads a sorted set or a set to be aggregated. Returns RL_NOT_FOUND when
+ * the key does not exist.
+ */
+static int zset_aggregate_input_objects(rlite *db, unsigned char *key, long keylen, rl_zset_objects *zset, rl_btree **set, long *card)
+{
+	int retval;
+	*set = NULL;
+	retval = rl_zset_get_objects(db, key, keylen, zset, 0, 0);
+	if (retval == RL_WRONG_TYPE) {
+		RL_CALL(rl_set_get_objects, RL_OK, db, key, keylen, NULL, set, 0, 0);
+		*card = (*set)->number_of_elements;
+	}
+	else if (retval == RL_OK) {
+		*card = zset_card(zset);
+	}
+cleanup:
+	return retval;
+}
+
+static int zset_aggregate_input(rlite *db, zset_aggregate *agg, int op, long index, rl_zset_objects *zset, rl_btree *set, double weight, int aggregate)
+{
+	rl_btree_iterator *btree_iterator = NULL;
+	rl_zset_iterator *zset_iterator = NULL;
+	unsigned char digest[20], *member = NULL;
+	void *score = NULL, *value = NULL;
+	long memberlen, i;
+	double member_score;
+	int retval;
+	// only the first input can add members, except for a union
+	int need_member = index == 0 || op == ZSET_OP_UNION;
+
+	if (set) {
+		RL_CALL(rl_btree_iterator_create, RL_OK, db, set, &btree_iterator);
+		while ((retval = rl_btree_iterator_next(btree_iterator, &score, &value)) == RL_OK) {
+			if (need_member && zset_aggregate_slot(agg->entries, agg->alloc, score)->seen == 0) {
+				RL_CALL(rl_multi_string_get, RL_OK, db, *(long *)value, &member, &memberlen);
 			}
+			RL_CALL(zset_aggregate_add, RL_OK, agg, op, index, score, member, memberlen, weight, aggregate);
+			rl_free(member);
+			member = NULL;
+			rl_free(score);
+			score = NULL;
+			rl_free(value);
+			value = NULL;
+		}
+		btree_iterator = NULL;
+	}
+	else if (zset->packed) {
+		for (i = 0; i < zset->packed->size; i++) {
+			RL_CALL(sha1, RL_OK, zset->packed->members[i], zset->packed->memberslen[i], digest);
+			RL_CALL(zset_aggregate_add, RL_OK, agg, op, index, digest, zset->packed->members[i], zset->packed->memberslen[i], zset->packed->scores[i] * weight, aggregate);
+		}
+		retval = RL_END;
+	}
+	else if (!need_member) {
+		// the scores btree has the digests, no need to read or hash the members
+		RL_CALL(rl_btree_iterator_create, RL_OK, db, zset->scores, &btree_iterator);
+		while ((retval = rl_btree_iterator_next(btree_iterator, &score, &value)) == RL_OK) {
+			RL_CALL(zset_aggregate_add, RL_OK, agg, op, index, score, NULL, 0, *(double *)value * weight, aggregate);
+			rl_free(score);
+			score = NULL;
+			rl_free(value);
+			value = NULL;
 		}
-		if (found) {
-			RL_CALL(rl_multi_string_get, RL_OK, db, multi_string_page, &member, &memberlen);
-			RL_CALL(add_member, RL_OK, db, target_btree, target_btree_page, target_skiplist, target_skiplist_page, isnan(skiplist_score) ? 0.0 : skiplist_score, member, memberlen);
+		btree_iterator = NULL;
+	}
+	else {
+		RL_CALL2(_rl_zrange, RL_OK, RL_NOT_FOUND, db, zset, 0, -1, 1, &zset_iterator);
+		if (retval == RL_NOT_FOUND) {
+			zset_iterator = NULL;
+		}
+		while ((retval = rl_zset_iterator_next(zset_iterator, NULL, &member_score, &member, &memberlen)) == RL_OK) {
+			RL_CALL(sha1, RL_OK, member, memberlen, digest);
+			RL_CALL(zset_aggregate_add, RL_OK, agg, op, index, digest, member, memberlen, member_score * weight, aggregate);
 			rl_free(member);
 			member = NULL;
 		}
+		zset_iterator = NULL;
 	}
-	skiplist_iterator = NULL;
-	btree_iterator = NULL;
-
 	if (retval != RL_END) {
 		goto cleanup;
 	}
-
 	retval = RL_OK;
 cleanup:
-	rl_free(member);
-	if (skiplist_iterator) {
-		rl_zset_iterator_destroy(skiplist_iterator);
-	}
 	if (btree_iterator) {
 		rl_btree_iterator_destroy(btree_iterator);
 	}
-	rl_free(weights);
-	rl_free(btrees);
-	rl_free(skiplists);
+	if (zset_iterator) {
+		rl_zset_iterator_destroy(zset_iterator);
+	}
+	rl_free(member);
+	rl_free(score);
+	rl_free(value);
 	return retval;
 }
-static int zunionstore_minmax(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate)
+
+static int zset_member_cmp(const unsigned char *member1, long member1len, const unsigned char *member2, long member2len)
 {
-	rl_btree *target_scores;
-	long target_scores_page, target_skiplist_page;
-	rl_skiplist *target_skiplist;
-	int retval;
-	rl_skiplist_iterator **iterators = NULL;;
-	rl_skiplist *skiplist;
-	double *scores = NULL, score;
-	unsigned char **members = NULL;
-	long *memberslen = NULL, i;
-	long position;
-	RL_CALL(rl_zset_get_objects, RL_OK, db, keys[0], keys_len[0], NULL, &target_scores, &target_scores_page, &target_skiplist, &target_skiplist_page, 1, 1);
-	RL_MALLOC(scores, sizeof(double) * keys_size);
-	RL_MALLOC(members, sizeof(unsigned char *) * keys_size);
-	for (i = 0; i < keys_size; i++) {
-		members[i] = NULL;
+	long len = member1len < member2len ? member1len : member2len;
+	int cmp = len > 0 ? memcmp(member1, member2, len) : 0;
+	if (cmp == 0) {
+		return member1len == member2len ? 0 : (member1len < member2len ? -1 : 1);
 	}
-	RL_MALLOC(memberslen, sizeof(long) * keys_size);
-	RL_MALLOC(iterators, sizeof(rl_skiplist_iterator *) * keys_size);
-	for (i = 0; i < keys_size; i++) {
-		iterators[i] = NULL;
+	return cmp;
+}
+
+static int zset_aggregate_entry_cmp(const void *a, const void *b)
+{
+	const zset_aggregate_entry *entry1 = *(zset_aggregate_entry * const *)a;
+	const zset_aggregate_entry *entry2 = *(zset_aggregate_entry * const *)b;
+	if (entry1->score != entry2->score) {
+		return entry1->score < entry2->score ? -1 : 1;
 	}
+	return zset_member_cmp(entry1->member, entry1->memberlen, entry2->member, entry2->memberlen);
+}
 
+static int zset_aggregate_digest_cmp(const void *a, const void *b)
+{
+	return memcmp((*(zset_aggregate_entry * const *)a)->digest, (*(zset_aggregate_entry * const *)b)->digest, 20);
+}
+
+/**
+ * Aggregates `keys_size` keys into `agg` and returns the resulting entries
+ * sorted by score and member. The entries point into `agg`.
+ */
+static int zset_aggregate_keys(rlite *db, int op, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, zset_aggregate *agg, long *_size, zset_aggregate_entry ***_entries)
+{
+	rl_zset_objects *zsets = NULL;
+	rl_btree **sets = NULL;
+	zset_aggregate_entry **entries = NULL;
+	long *order = NULL, *cards = NULL, i, j, tmp, size = 0, missing = 0;
+	int retval;
+
+	agg->entries = NULL;
+	if (keys_size < 1) {
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+	RL_MALLOC(zsets, sizeof(rl_zset_objects) * keys_size);
+	RL_MALLOC(sets, sizeof(rl_btree *) * keys_size);
+	RL_MALLOC(cards, sizeof(long) * keys_size);
+	RL_MALLOC(order, sizeof(long) * keys_size);
 	for (i = 0; i < keys_size; i++) {
-		retval = rl_zset_get_objects(db, keys[i], keys_len[i], NULL, NULL, NULL, &skiplist, NULL, 0, 0);
+		order[i] = i;
+		retval = zset_aggregate_input_objects(db, keys[i], keys_len[i], &zsets[i], &sets[i], &cards[i]);
 		if (retval == RL_NOT_FOUND) {
-			iterators[i] = NULL;
-			continue;
+			cards[i] = -1;
+			missing = 1;
 		}
-		if (retval != RL_OK) {
+		else if (retval != RL_OK) {
 			goto cleanup;
 		}
-		RL_CALL(rl_skiplist_iterator_create, RL_OK, db, &iterators[i], skiplist, 0, aggregate == RL_ZSET_AGGREGATE_MAX ? -1 : 1, 0);
-		retval = rl_zset_iterator_next(iterators[i], NULL, &scores[i], &members[i], &memberslen[i]);
-		if (retval != RL_OK) {
-			iterators[i] = NULL;
-			if (retval != RL_END) {
-				goto cleanup;
-			}
-		}
 	}
-
-	while (1) {
-		position = -1;
-		for (i = 0; i < keys_size; i++) {
-			if (!iterators[i]) {
-				continue;
-			}
-			if (position == -1) {
-				position = i;
-				continue;
-			}
-			score = weights ? weights[position - 1] * scores[position] : scores[position];
-			if (isnan(score)) {
-				score = 0.0;
-			}
-			if ((aggregate == RL_ZSET_AGGREGATE_MAX && scores[i] > score) ||
-			        (aggregate == RL_ZSET_AGGREGATE_MIN && scores[i] < score)) {
-				position = i;
+	if (op == ZSET_OP_INTER) {
+		// seeding the table with the smallest input keeps it small
+		for (i = 1; i < keys_size; i++) {
+			for (j = i; j > 0 && cards[order[j]] < cards[order[j - 1]]; j--) {
+				tmp = order[j];
+				order[j] = order[j - 1];
+				order[j - 1] = tmp;
 			}
 		}
-		if (position == -1) {
-			break;
+	}
+	RL_CALL(zset_aggregate_init, RL_OK, agg, cards[order[0]] > 0 ? cards[order[0]] : 0);
+	if ((op == ZSET_OP_INTER && missing) || (op == ZSET_OP_DIFF && cards[0] < 0)) {
+		goto done;
+	}
+	for (i = 0, j = 0; i < keys_size; i++) {
+		if (cards[order[i]] < 0) {
+			continue;
 		}
+		RL_CALL(zset_aggregate_input, RL_OK, db, agg, op, op == ZSET_OP_UNION ? j : i, &zsets[order[i]], sets[order[i]], weights ? weights[order[i]] : 1.0, aggregate);
+		j++;
+	}
 
-		score = weights ? weights[position - 1] * scores[position] : scores[position];
-		if (isnan(score)) {
-			score = 0.0;
+done:
+	for (i = 0; i < agg->alloc; i++) {
+		if (agg->entries[i].seen > 0 && (op != ZSET_OP_INTER || agg->entries[i].seen == keys_size)) {
+			size++;
 		}
-		retval = add_member(db, target_scores, target_scores_page, target_skiplist, target_skiplist_page, score, members[position], memberslen[position]);
-		if (retval != RL_FOUND && retval != RL_OK) {
-			goto cleanup;
+	}
+	if (size > 0) {
+		RL_MALLOC(entries, sizeof(zset_aggregate_entry *) * size);
+		for (i = 0, j = 0; i < agg->alloc; i++) {
+			if (agg->entries[i].seen > 0 && (op != ZSET_OP_INTER || agg->entries[i].seen == keys_size)) {
+				entries[j++] = &agg->entries[i];
+			}
 		}
-		rl_free(members[position]);
-		members[position] = NULL;
+		qsort(entries, size, sizeof(zset_aggregate_entry *), zset_aggregate_entry_cmp);
+	}
+	*_size = size;
+	*_entries = entries;
+	entries = NULL;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		zset_aggregate_destroy(agg);
+	}
+	rl_free(entries);
+	rl_free(zsets);
+	rl_free(sets);
+	rl_free(cards);
+	rl_free(order);
+	return retval;
+}
 
-		retval = rl_zset_iterator_next(iterators[position], NULL, &scores[position], &members[position], &memberslen[position]);
-		if (retval != RL_OK) {
-			iterators[position] = NULL;
-			if (retval != RL_END) {
-				goto cleanup;
-			}
+/**
+ * Replaces `key` with a sorted set of the `size` entries, which are sorted by
+ * score and member. Small results fill the packed page directly, larger ones
+ * bulk load the scores btree and append to the zset tree in order.
+ */
+static int zset_aggregate_store(rlite *db, unsigned char *key, long keylen, long size, zset_aggregate_entry **entries)
+{
+	rl_zset_objects zset;
+	zset_aggregate_entry **by_digest = NULL;
+	void **scores = NULL, **values = NULL;
+	long i, packed_size;
+	int retval, packed = 1;
+
+	retval = rl_key_delete_with_value(db, key, keylen);
+	if (retval != RL_OK && retval != RL_NOT_FOUND) {
+		goto cleanup;
+	}
+	if (size == 0) {
+		retval = RL_OK;
+		goto cleanup;
+	}
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 0, 1);
+	packed_size = rl_zset_packed_serialized_size(zset.packed);
+	for (i = 0; i < size; i++) {
+		packed_size += 12 + entries[i]->memberlen;
+		if (entries[i]->memberlen > RL_ZSET_PACKED_MAX_MEMBER) {
+			packed = 0;
 		}
 	}
-	if (target_scores->number_of_elements == 0) {
-		RL_CALL(rl_key_delete_with_value, RL_OK, db, keys[0], keys_len[0]);
+	if (size > RL_ZSET_PACKED_MAX_ENTRIES || packed_size > db->page_size) {
+		packed = 0;
+	}
+
+	if (packed) {
+		// every entry is appended after the previous one
+		for (i = 0; i < size; i++) {
+			RL_CALL(rl_zset_packed_add, RL_OK, zset.packed, entries[i]->score, entries[i]->member, entries[i]->memberlen, NULL);
+		}
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_packed, zset.packed_page, zset.packed);
+		retval = RL_OK;
+		goto cleanup;
 	}
 
+	RL_CALL(create_tree_objects, RL_OK, db, &zset);
+	RL_MALLOC(by_digest, sizeof(zset_aggregate_entry *) * size);
+	memcpy(by_digest, entries, sizeof(zset_aggregate_entry *) * size);
+	qsort(by_digest, size, sizeof(zset_aggregate_entry *), zset_aggregate_digest_cmp);
+	RL_MALLOC(scores, sizeof(void *) * size);
+	RL_MALLOC(values, sizeof(void *) * size);
+	for (i = 0; i < size; i++) {
+		scores[i] = values[i] = NULL;
+	}
+	for (i = 0; i < size; i++) {
+		RL_MALLOC(scores[i], sizeof(unsigned char) * 20);
+		memcpy(scores[i], by_digest[i]->digest, 20);
+		RL_MALLOC(values[i], sizeof(double));
+		*(double *)values[i] = by_digest[i]->score;
+	}
+	retval = rl_btree_bulk_load(db, zset.scores, zset.scores_page, size, scores, values, 1.0);
+	if (retval != RL_INVALID_PARAMETERS) {
+		// the btree owns them now
+		rl_free(scores);
+		rl_free(values);
+		scores = values = NULL;
+	}
+	if (retval != RL_OK) {
+		goto cleanup;
+	}
+	for (i = 0; i < size; i++) {
+		RL_CALL(rl_zset_tree_add, RL_OK, db, zset.tree, zset.tree_page, entries[i]->score, entries[i]->member, entries[i]->memberlen);
+	}
+	RL_CALL(install_tree_objects, RL_OK, db, &zset);
 	retval = RL_OK;
 cleanup:
-	if (iterators) {
-		for (i = 0; i < keys_size; i++) {
-			if (iterators[i]) {
-				rl_zset_iterator_destroy(iterators[i]);
-			}
-			rl_free(members[i]);
+	if (scores) {
+		for (i = 0; i < size; i++) {
+			rl_free(scores[i]);
+			rl_free(values[i]);
 		}
 	}
-	rl_free(iterators);
-	rl_free(memberslen);
+	rl_free(scores);
+	rl_free(values);
+	rl_free(by_digest);
+	return retval;
+}
+
+static int zset_aggregate_generic_store(rlite *db, int op, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate)
+{
+	zset_aggregate agg = {0, 0, NULL};
+	zset_aggregate_entry **entries = NULL;
+	long size = 0;
+	int retval;
+
+	// key in position 0 is the target key
+	if (keys_size < 2) {
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+	RL_CALL(zset_aggregate_keys, RL_OK, db, op, keys_size - 1, &keys[1], &keys_len[1], weights, aggregate, &agg, &size, &entries);
+	RL_CALL(zset_aggregate_store, RL_OK, db, keys[0], keys_len[0], size, entries);
+	if (size > 0) {
+		rl_signal_key(db, keys[0], keys_len[0]);
+	}
+cleanup:
+	rl_free(entries);
+	zset_aggregate_destroy(&agg);
+	return retval;
+}
+
+static int zset_aggregate_generic(rlite *db, int op, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, long *_size, unsigned char ***_members, long **_memberslen, double **_scores)
+{
+	zset_aggregate agg = {0, 0, NULL};
+	zset_aggregate_entry **entries = NULL;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, size = 0, i;
+	double *scores = NULL;
+	int retval;
+
+	RL_CALL(zset_aggregate_keys, RL_OK, db, op, keys_size, keys, keys_len, weights, aggregate, &agg, &size, &entries);
+	if (size > 0) {
+		RL_MALLOC(members, sizeof(unsigned char *) * size);
+		RL_MALLOC(memberslen, sizeof(long) * size);
+		RL_MALLOC(scores, sizeof(double) * size);
+		for (i = 0; i < size; i++) {
+			// handing the member over
+			members[i] = entries[i]->member;
+			entries[i]->member = NULL;
+			memberslen[i] = entries[i]->memberlen;
+			scores[i] = entries[i]->score;
+		}
+	}
+	*_size = size;
+	*_members = members;
+	*_memberslen = memberslen;
+	if (_scores) {
+		*_scores = scores;
+		scores = NULL;
+	}
+	members = NULL;
+	memberslen = NULL;
+	retval = RL_OK;
+cleanup:
 	rl_free(members);
+	rl_free(memberslen);
 	rl_free(scores);
+	rl_free(entries);
+	zset_aggregate_destroy(&agg);
 	return retval;
 }
 
-static int zunionstore_sum(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights)
+int rl_zinterstore(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate)
 {
-	rl_skiplist_iterator *iterator = NULL;
-	rl_skiplist *skiplist;
-	double score;
+	return zset_aggregate_generic_store(db, ZSET_OP_INTER, keys_size, keys, keys_len, weights, aggregate);
+}
+
+int rl_zunionstore(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate)
+{
+	return zset_aggregate_generic_store(db, ZSET_OP_UNION, keys_size, keys, keys_len, weights, aggregate);
+}
+
+int rl_zdiffstore(rlite *db, long keys_size, unsigned char **keys, long *keys_len)
+{
+	return zset_aggregate_generic_store(db, ZSET_OP_DIFF, keys_size, keys, keys_len, NULL, RL_ZSET_AGGREGATE_SUM);
+}
+
+int rl_zinter(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, long *size, unsigned char ***members, long **memberslen, double **scores)
+{
+	return zset_aggregate_generic(db, ZSET_OP_INTER, keys_size, keys, keys_len, weights, aggregate, size, members, memberslen, scores);
+}
+
+int rl_zunion(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate, long *size, unsigned char ***members, long **memberslen, double **scores)
+{
+	return zset_aggregate_generic(db, ZSET_OP_UNION, keys_size, keys, keys_len, weights, aggregate, size, members, memberslen, scores);
+}
+
+int rl_zdiff(rlite *db, long keys_size, unsigned char **keys, long *keys_len, long *size, unsigned char ***members, long **memberslen, double **scores)
+{
+	return zset_aggregate_generic(db, ZSET_OP_DIFF, keys_size, keys, keys_len, NULL, RL_ZSET_AGGREGATE_SUM, size, members, memberslen, scores);
+}
+
+typedef struct {
+	unsigned char digest[20];
 	unsigned char *member;
 	long memberlen;
+	double score;
+	// position in the batch, when a member is repeated
+	long position;
+	// the member's scores in batch order are repeats scores from first
+	long first;
+	long repeats;
+	int exists;
+	double old_score;
+	int changed;
+} zadd_item;
+
+static int zadd_item_digest_cmp(const void *a, const void *b)
+{
+	const zadd_item *item1 = a, *item2 = b;
+	int cmp = memcmp(item1->digest, item2->digest, 20);
+	if (cmp == 0) {
+		return item1->position < item2->position ? -1 : (item1->position > item2->position ? 1 : 0);
+	}
+	return cmp;
+}
+
+static int zadd_item_score_cmp(const void *a, const void *b)
+{
+	const zadd_item *item1 = a, *item2 = b;
+	if (item1->score != item2->score) {
+		return item1->score < item2->score ? -1 : 1;
+	}
+	return zset_member_cmp(item1->member, item1->memberlen, item2->member, item2->memberlen);
+}
+
+/**
+ * Changes the score of a member, the sorted set never becomes empty on the way
+ */
+static int update_member(rlite *db, rl_zset_objects *zset, unsigned char *digest, unsigned char *member, long memberlen, double old_score, double score)
+{
+	void *value;
+	long position;
 	int retval;
+	if (zset->packed) {
+		RL_CALL(rl_zset_packed_find, RL_FOUND, zset->packed, member, memberlen, &position);
+		RL_CALL2(rl_zset_packed_remove, RL_OK, RL_DELETED, zset->packed, position);
+		RL_CALL(rl_zset_packed_add, RL_OK, zset->packed, score, member, memberlen, NULL);
+		RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_packed, zset->packed_page, zset->packed);
+		goto cleanup;
+	}
+	RL_MALLOC(value, sizeof(double));
+	*(double *)value = score;
+	retval = rl_btree_update_element(db, zset->scores, digest, value);
+	if (retval != RL_OK) {
+		rl_free(value);
+		goto cleanup;
+	}
+	RL_CALL(rl_zset_tree_add, RL_OK, db, zset->tree, zset->tree_page, score, member, memberlen);
+	RL_CALL(rl_zset_tree_delete, RL_OK, db, zset->tree, zset->tree_page, old_score, member, memberlen);
+cleanup:
+	return retval;
+}
+
+/**
+ * Applies every score given for the member in batch order, starting from its
+ * current score when it exists, and counts each score that changed it the way
+ * CH does.
+ */
+static int zadd_item_apply(zadd_item *item, int flags, double *scores, long *changes)
+{
+	int exists = item->exists, retval = RL_OK;
+	double score, current = item->old_score;
 	long i;
-	for (i = 1; i < keys_size; i++) {
-		retval = rl_zset_get_objects(db, keys[i], keys_len[i], NULL, NULL, NULL, &skiplist, NULL, 0, 0);
-		if (retval == RL_NOT_FOUND) {
+	item->changed = 0;
+	for (i = item->first; i < item->first + item->repeats; i++) {
+		if (!exists) {
+			if (flags & RL_ZADD_XX) {
+				continue;
+			}
+			exists = 1;
+			current = scores[i];
+			(*changes)++;
 			continue;
 		}
-		if (retval != RL_OK) {
+		if (flags & RL_ZADD_NX) {
+			continue;
+		}
+		score = flags & RL_ZADD_INCR ? current + scores[i] : scores[i];
+		if (isnan(score)) {
+			retval = RL_NAN;
 			goto cleanup;
 		}
-		RL_CALL(rl_skiplist_iterator_create, RL_OK, db, &iterator, skiplist, 0, 1, 0);
-		while ((retval = rl_zset_iterator_next(iterator, NULL, &score, &member, &memberlen)) == RL_OK) {
-			if (weights) {
-				score *= weights[i - 1];
-			}
-			if (isnan(score)) {
-				score = 0.0;
+		if (((flags & RL_ZADD_GT) && score <= current) ||
+		        ((flags & RL_ZADD_LT) && score >= current)) {
+			// INCR reports nothing when the score is left alone
+			if (flags & RL_ZADD_INCR) {
+				item->changed = -1;
 			}
-			retval = incrby(db, keys[0], keys_len[0], score, member, memberlen, NULL, 1);
-			rl_free(member);
-			if (retval != RL_OK) {
-				goto cleanup;
+			continue;
+		}
+		if (score != current) {
+			current = score;
+			(*changes)++;
+		}
+	}
+	item->score = current;
+	if (item->changed == 0 && exists) {
+		item->changed = !item->exists || current != item->old_score;
+	}
+cleanup:
+	return retval;
+}
+
+/**
+ * Writes a new sorted set with every member in the batch
+ */
+static int zadd_create(rlite *db, const unsigned char *key, long keylen, long size, zadd_item *items)
+{
+	zset_aggregate_entry *entries = NULL, **sorted = NULL;
+	long i;
+	int retval;
+	RL_MALLOC(entries, sizeof(zset_aggregate_entry) * size);
+	RL_MALLOC(sorted, sizeof(zset_aggregate_entry *) * size);
+	for (i = 0; i < size; i++) {
+		memcpy(entries[i].digest, items[i].digest, 20);
+		entries[i].member = items[i].member;
+		entries[i].memberlen = items[i].memberlen;
+		entries[i].score = items[i].score;
+		entries[i].seen = 1;
+		sorted[i] = &entries[i];
+		items[i].changed = 1;
+	}
+	qsort(sorted, size, sizeof(zset_aggregate_entry *), zset_aggregate_entry_cmp);
+	RL_CALL(zset_aggregate_store, RL_OK, db, (unsigned char *)key, keylen, size, sorted);
+cleanup:
+	rl_free(entries);
+	rl_free(sorted);
+	return retval;
+}
+
+int rl_zadd_multi(rlite *db, const unsigned char *key, long keylen, int flags, long size, double *scores, unsigned char **members, long *memberslen, long *changed, double *newscore)
+{
+	rl_zset_objects zset;
+	zadd_item *items = NULL;
+	void **digests = NULL, **values = NULL;
+	double *batch = NULL;
+	long i, count = 0, added = 0, updated = 0, changes = 0, position;
+	int retval;
+
+	if (size < 1 ||
+	        ((flags & RL_ZADD_NX) && (flags & (RL_ZADD_XX | RL_ZADD_GT | RL_ZADD_LT))) ||
+	        ((flags & RL_ZADD_GT) && (flags & RL_ZADD_LT)) ||
+	        ((flags & RL_ZADD_INCR) && size != 1)) {
+		retval = RL_INVALID_PARAMETERS;
+		goto cleanup;
+	}
+
+	RL_MALLOC(items, sizeof(zadd_item) * size);
+	RL_MALLOC(batch, sizeof(double) * size);
+	for (i = 0; i < size; i++) {
+		RL_CALL(sha1, RL_OK, members[i], memberslen[i], items[i].digest);
+		items[i].member = members[i];
+		items[i].memberlen = memberslen[i];
+		items[i].score = scores[i];
+		items[i].position = i;
+		items[i].exists = 0;
+		items[i].old_score = 0;
+		items[i].changed = 0;
+	}
+	// a repeated member is looked up once and then gets its scores in order
+	qsort(items, size, sizeof(zadd_item), zadd_item_digest_cmp);
+	for (i = 0; i < size; i++) {
+		batch[i] = items[i].score;
+		if (count > 0 && memcmp(items[count - 1].digest, items[i].digest, 20) == 0) {
+			items[count - 1].repeats++;
+			continue;
+		}
+		items[count] = items[i];
+		items[count].first = i;
+		items[count].repeats = 1;
+		count++;
+	}
+
+	retval = rl_zset_get_objects(db, key, keylen, &zset, 0, 0);
+	if (retval == RL_NOT_FOUND) {
+		if (!(flags & RL_ZADD_XX)) {
+			for (i = 0; i < count; i++) {
+				RL_CALL(zadd_item_apply, RL_OK, &items[i], flags, batch, &changes);
 			}
+			RL_CALL(zadd_create, RL_OK, db, key, keylen, count, items);
+			added = count;
 		}
-		iterator = NULL;
+		retval = RL_OK;
+		goto done;
+	}
+	else if (retval != RL_OK) {
+		goto cleanup;
+	}
 
-		if (retval != RL_END) {
-			goto cleanup;
+	if (zset.packed) {
+		for (i = 0; i < count; i++) {
+			if (rl_zset_packed_find(zset.packed, items[i].member, items[i].memberlen, &position) == RL_FOUND) {
+				items[i].exists = 1;
+				items[i].old_score = zset.packed->scores[position];
+			}
 		}
 	}
+	else {
+		// every score is looked up descending the btree once
+		RL_MALLOC(digests, sizeof(void *) * count);
+		RL_MALLOC(values, sizeof(void *) * count);
+		for (i = 0; i < count; i++) {
+			digests[i] = items[i].digest;
+		}
+		RL_CALL(rl_btree_find_scores, RL_OK, db, zset.scores, count, digests, values);
+		for (i = 0; i < count; i++) {
+			if (values[i]) {
+				items[i].exists = 1;
+				items[i].old_score = *(double *)values[i];
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		RL_CALL(zadd_item_apply, RL_OK, &items[i], flags, batch, &changes);
+	}
 
+	// inserting in score order keeps visiting the same pages
+	qsort(items, count, sizeof(zadd_item), zadd_item_score_cmp);
+	for (i = 0; i < count; i++) {
+		if (items[i].changed != 1) {
+			continue;
+		}
+		if (items[i].exists) {
+			RL_CALL(update_member, RL_OK, db, &zset, items[i].digest, items[i].member, items[i].memberlen, items[i].old_score, items[i].score);
+			updated++;
+		}
+		else {
+			RL_CALL(add_member, RL_OK, db, &zset, items[i].score, items[i].member, items[i].memberlen);
+			added++;
+		}
+	}
+	if (added + updated > 0) {
+		RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 0);
+	}
 	retval = RL_OK;
-cleanup:
-	if (iterator) {
-		rl_zset_iterator_destroy(iterator);
+done:
+	if (added > 0) {
+		rl_signal_key(db, key, keylen);
+	}
+	if (flags & RL_ZADD_INCR) {
+		if (count == 1 && (items[0].changed == 1 || (items[0].exists && items[0].changed == 0 && !(flags & RL_ZADD_NX)))) {
+			if (newscore) {
+				*newscore = items[0].score;
+			}
+		}
+		else {
+			retval = RL_NOT_FOUND;
+		}
+	}
+	if (changed) {
+		*changed = flags & RL_ZADD_CH ? changes : added;
 	}
+cleanup:
+	rl_free(items);
+	rl_free(batch);
+	rl_free(digests);
+	rl_free(values);
 	return retval;
 }
 
-int rl_zunionstore(rlite *db, long keys_size, unsigned char **keys, long *keys_len, double *weights, int aggregate)
+int rl_zadd(rlite *db, const unsigned char *key, long keylen, double score, unsigned char *member, long memberlen)
 {
+	long changed;
 	int retval;
-	retval = rl_key_delete_with_value(db, keys[0], keys_len[0]);
-	if (retval != RL_OK && retval != RL_NOT_FOUND) {
+	RL_CALL(rl_zadd_multi, RL_OK, db, key, keylen, 0, 1, &score, &member, &memberlen, &changed, NULL);
+	retval = changed ? RL_OK : RL_FOUND;
+cleanup:
+	return retval;
+}
+
+int rl_zincrby(rlite *db, const unsigned char *key, long keylen, double score, unsigned char *member, long memberlen, double *newscore)
+{
+	return rl_zadd_multi(db, key, keylen, RL_ZADD_INCR, 1, &score, &member, &memberlen, NULL, newscore);
+}
+
+int rl_zpop(rlite *db, const unsigned char *key, long keylen, long count, int max, long *_size, unsigned char ***_members, long **_memberslen, double **_scores)
+{
+	rl_zset_objects zset;
+	unsigned char **members = NULL;
+	long *memberslen = NULL, i, card, position, size = 0;
+	double *scores = NULL;
+	int retval;
+
+	if (count < 1) {
+		retval = RL_INVALID_PARAMETERS;
 		goto cleanup;
 	}
-	if (aggregate == RL_ZSET_AGGREGATE_SUM) {
-		RL_CALL(zunionstore_sum, RL_OK, db, keys_size, keys, keys_len, weights);
+	RL_CALL(rl_zset_get_objects, RL_OK, db, key, keylen, &zset, 1, 0);
+	card = zset_card(&zset);
+	if (count > card) {
+		count = card;
+	}
+	RL_MALLOC(members, sizeof(unsigned char *) * count);
+	RL_MALLOC(memberslen, sizeof(long) * count);
+	RL_MALLOC(scores, sizeof(double) * count);
+	if (zset.packed) {
+		for (i = 0; i < count; i++) {
+			position = max ? card - 1 - i : i;
+			RL_MALLOC(members[i], sizeof(unsigned char) * (zset.packed->memberslen[position] + 1));
+			memcpy(members[i], zset.packed->members[position], zset.packed->memberslen[position]);
+			memberslen[i] = zset.packed->memberslen[position];
+			scores[i] = zset.packed->scores[position];
+			size++;
+		}
+		RL_CALL2(packed_remove_range, RL_OK, RL_DELETED, db, key, keylen, &zset, max ? card - count : 0, max ? card - 1 : count - 1);
 	}
 	else {
-		RL_CALL(zunionstore_minmax, RL_OK, db, keys_size, keys, keys_len, weights, aggregate);
+		// the head or the tail of the tree, read and removed in the same pass
+		for (i = 0; i < count; i++) {
+			RL_CALL(rl_zset_tree_get, RL_OK, db, zset.tree, max ? card - 1 - i : 0, &scores[i], &members[i], &memberslen[i]);
+			size++;
+			RL_CALL2(remove_member_score, RL_OK, RL_DELETED, db, key, keylen, &zset, members[i], memberslen[i], scores[i]);
+		}
 	}
+	*_size = size;
+	*_members = members;
+	*_memberslen = memberslen;
+	*_scores = scores;
+	retval = RL_OK;
+cleanup:
+	if (retval != RL_OK) {
+		for (i = 0; i < size; i++) {
+			rl_free(members[i]);
+		}
+		rl_free(members);
+		rl_free(memberslen);
+		rl_free(scores);
+	}
+	return retval;
+}
+
+typedef struct {
+	unsigned char **keys;
+	long *keyslen;
+	int max;
+	int key_index;
+	unsigned char *member;
+	long memberlen;
+	double score;
+} bzpop_context;
 
+static int bzpop_key(rlite *db, int index, void *_context)
+{
+	bzpop_context *context = _context;
+	unsigned char **members;
+	long size, *memberslen;
+	double *scores;
+	int retval;
+	RL_CALL(rl_zpop, RL_OK, db, context->keys[index], context->keyslen[index], 1, context->max, &size, &members, &memberslen, &scores);
+	context->key_index = index;
+	context->member = members[0];
+	context->memberlen = memberslen[0];
+	context->score = scores[0];
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(scores);
+cleanup:
+	return retval;
+}
+
+int rl_bzpop(rlite *db, int keyc, unsigned char **keys, long *keyslen, int max, struct timeval *timeout, int *key_index, unsigned char **member, long *memberlen, double *score)
+{
+	bzpop_context context;
+	int retval;
+	context.keys = keys;
+	context.keyslen = keyslen;
+	context.max = max;
+	RL_CALL(rl_block_keys, RL_OK, db, keyc, keys, keyslen, timeout, bzpop_key, &context);
+	*key_index = context.key_index;
+	*member = context.member;
+	*memberlen = context.memberlen;
+	*score = context.score;
 cleanup:
 	return retval;
 }
 
 int rl_zset_pages(struct rlite *db, long page, short *pages)
 {
-	rl_btree *scores;
-	rl_skiplist *skiplist;
-	rl_skiplist_iterator *iterator = NULL;
-	rl_skiplist_node *node;
-	long scores_page, skiplist_page;
+	rl_zset_objects zset;
 	int retval;
 	void *tmp;
 	rl_list *levels;
@@ -1091,57 +1930,36 @@ int rl_zset_pages(struct rlite *db, long page, short *pages)
 	levels = tmp;
 	rl_list_pages(db, levels, pages);
 
-	RL_CALL(rl_zset_read, RL_OK, db, page, &scores, &scores_page, &skiplist, &skiplist_page);
-	pages[scores_page] = 1;
-	pages[skiplist_page] = 1;
-
-	RL_CALL(rl_btree_pages, RL_OK, db, scores, pages);
-
-	RL_CALL(rl_skiplist_pages, RL_OK, db, skiplist, pages);
-
-	RL_CALL(rl_skiplist_iterator_create, RL_OK, db, &iterator, skiplist, 0, 1, 0);
-	while ((rl_skiplist_iterator_next(iterator, &node)) == RL_OK) {
-		pages[node->value] = 1;
-		RL_CALL(rl_multi_string_pages, RL_OK, iterator->db, node->value, pages);
-	}
-	iterator = NULL;
-
-	if (retval != RL_END) {
+	RL_CALL(rl_zset_read, RL_OK, db, page, &zset);
+	if (zset.packed) {
+		pages[zset.packed_page] = 1;
+		retval = RL_OK;
 		goto cleanup;
 	}
+	pages[zset.scores_page] = 1;
+	pages[zset.tree_page] = 1;
 
-	retval = RL_OK;
+	RL_CALL(rl_btree_pages, RL_OK, db, zset.scores, pages);
+	RL_CALL(rl_zset_tree_pages, RL_OK, db, zset.tree, pages);
 cleanup:
-	if (retval != RL_OK) {
-		if (iterator) {
-			rl_skiplist_iterator_destroy(db, iterator);
-		}
-	}
 	return retval;
 }
 
 int rl_zset_delete(rlite *db, long value_page)
 {
-	long skiplist_page, scores_page;
-	rl_skiplist *skiplist;
-	rl_btree *scores;
+	rl_zset_objects zset;
 	int retval;
 	void *tmp;
-	rl_list *levels;
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, value_page, &rl_list_type_long, &tmp, 1);
-	levels = tmp;
-	RL_CALL(rl_list_get_element, RL_FOUND, db, levels, &tmp, 0);
-	scores_page = *(long *)tmp;
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_sha1_double, scores_page, &rl_btree_type_hash_sha1_double, &tmp, 1);
-	scores = tmp;
-	RL_CALL(rl_list_get_element, RL_FOUND, db, levels, &tmp, 1);
-	skiplist_page = *(long *)tmp;
-	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_skiplist, skiplist_page, NULL, &tmp, 1);
-	skiplist = tmp;
-	RL_CALL(rl_skiplist_delete_all, RL_OK, db, skiplist);
-	RL_CALL(rl_delete, RL_OK, db, skiplist_page);
-	RL_CALL(rl_btree_delete, RL_OK, db, scores);
-	RL_CALL(rl_delete, RL_OK, db, scores_page);
+	RL_CALL(rl_zset_read, RL_OK, db, value_page, &zset);
+	if (zset.packed) {
+		RL_CALL(rl_delete, RL_OK, db, zset.packed_page);
+	}
+	else {
+		RL_CALL(rl_zset_tree_delete_all, RL_OK, db, zset.tree);
+		RL_CALL(rl_delete, RL_OK, db, zset.tree_page);
+		RL_CALL(rl_btree_delete, RL_OK, db, zset.scores);
+		RL_CALL(rl_delete, RL_OK, db, zset.scores_page);
+	}
 	RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_list_long, value_page, &rl_list_type_long, &tmp, 1);
 	RL_CALL(rl_list_delete, RL_OK, db, tmp);
 	RL_CALL(rl_delete, RL_OK, db, value_page);
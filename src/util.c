@@ -11,6 +11,7 @@
 #endif
 #include "rlite/status.h"
 #include "rlite/util.h"
+#include "rlite/page_btree.h"
 #include <sys/time.h>
 
 int _sha1_formatter(unsigned char *data, char formatted[40])
@@ -28,6 +29,8 @@ int _sha1_formatter(unsigned char *data, char formatted[40])
 
 int test_mode = 0;
 size_t test_mode_counter;
+size_t test_alloc_count = 0;
+size_t test_alloc_bytes = 0;
 int failed = 0;
 
 int expect_fail()
@@ -42,6 +45,8 @@ void *rl_malloc(size_t size)
 
 void *rl_realloc(void *ptr, size_t size)
 {
+	test_alloc_count++;
+	test_alloc_bytes += size;
 	if (test_mode == 0) {
 		return realloc(ptr, size);
 	}
@@ -304,6 +309,32 @@ double rl_strtod(unsigned char *_str, long strlen, unsigned char **_eptr) {
 	return d;
 }
 
+int rl_number_format(unsigned char encoding, union rl_number *number, unsigned char **data, long *datalen)
+{
+	int retval = RL_OK;
+	char buffer[MAX_DOUBLE_DIGITS];
+	long len;
+	if (encoding == RL_VALUE_ENCODING_INT) {
+		len = snprintf(buffer, MAX_DOUBLE_DIGITS, "%lld", number->integer);
+	}
+	else if (encoding == RL_VALUE_ENCODING_DOUBLE) {
+		len = snprintf(buffer, MAX_DOUBLE_DIGITS, "%lf", number->floating);
+	}
+	else {
+		retval = RL_UNEXPECTED;
+		goto cleanup;
+	}
+	if (data) {
+		RL_MALLOC(*data, sizeof(unsigned char) * (len + 1));
+		memcpy(*data, buffer, len + 1);
+	}
+	if (datalen) {
+		*datalen = len;
+	}
+cleanup:
+	return retval;
+}
+
 char *rl_get_filename_with_suffix(const char *filename, char *suffix) {
 	int retval = RL_OK;
 	char *new_path = NULL;
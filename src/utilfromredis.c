@@ -268,7 +268,7 @@ void rl_internal_bitop(int op, unsigned long numkeys, unsigned char **objects, u
 /* Count number of bits set in the binary array pointed by 's' and long
  * 'count' bytes. The implementation of this function is required to
  * work with a input string length up to 512 MB. */
-size_t rl_redisPopcount(void *s, long count) {
+static size_t popcount_generic(void *s, long count) {
     size_t bits = 0;
     unsigned char *p = s;
     uint32_t *p4;
@@ -310,6 +310,89 @@ size_t rl_redisPopcount(void *s, long count) {
     return bits;
 }
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RL_POPCOUNT_DISPATCH
+
+/* Count 8 bytes at a time with the POPCNT instruction. */
+__attribute__((target("popcnt")))
+static size_t popcount_popcnt(void *s, long count) {
+    size_t bits = 0;
+    unsigned char *p = s;
+    uint64_t w1, w2, w3, w4;
+
+    while (count >= 32) {
+        memcpy(&w1, p, 8);
+        memcpy(&w2, p + 8, 8);
+        memcpy(&w3, p + 16, 8);
+        memcpy(&w4, p + 24, 8);
+        bits += __builtin_popcountll(w1) + __builtin_popcountll(w2) +
+                __builtin_popcountll(w3) + __builtin_popcountll(w4);
+        p += 32;
+        count -= 32;
+    }
+    while (count >= 8) {
+        memcpy(&w1, p, 8);
+        bits += __builtin_popcountll(w1);
+        p += 8;
+        count -= 8;
+    }
+    return bits + popcount_generic(p, count);
+}
+
+/* Count 32 bytes at a time looking up the bits of each nibble with a
+ * shuffle (Mula's algorithm). Byte counters are folded into 64 bit ones
+ * before they can overflow. */
+__attribute__((target("avx2")))
+static size_t popcount_avx2(void *s, long count) {
+    unsigned char *p = s;
+    const __m256i lookup = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    int i;
+
+    while (count >= 32) {
+        __m256i local = _mm256_setzero_si256();
+        /* each iteration adds at most 8 to a byte counter */
+        for (i = 0; i < 31 && count >= 32; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)p);
+            __m256i lo = _mm256_and_si256(v, low_mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, lo));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, hi));
+            p += 32;
+            count -= 32;
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_generic(p, count);
+}
+
+static size_t (*popcount_impl)(void *s, long count) = NULL;
+#endif
+
+size_t rl_redisPopcount(void *s, long count) {
+#ifdef RL_POPCOUNT_DISPATCH
+    if (popcount_impl == NULL) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            popcount_impl = popcount_avx2;
+        } else if (__builtin_cpu_supports("popcnt")) {
+            popcount_impl = popcount_popcnt;
+        } else {
+            popcount_impl = popcount_generic;
+        }
+    }
+    return popcount_impl(s, count);
+#else
+    return popcount_generic(s, count);
+#endif
+}
+
 // https://github.com/antirez/redis/blob/unstable/src/bitops.c#L110
 /* Return the position of the first bit set to one (if 'bit' is 1) or
  * zero (if 'bit' is 0) in the bitmap starting at 's' and long 'count' bytes.
@@ -321,7 +404,7 @@ size_t rl_redisPopcount(void *s, long count) {
 long rl_internal_bitpos(void *s, unsigned long count, int bit) {
     unsigned long *l;
     unsigned char *c;
-    unsigned long skipval, word = 0, one;
+    unsigned long skipval, word = 0;
     long pos = 0; /* Position of bit, to return to the caller. */
     unsigned long j;
 
@@ -344,9 +427,17 @@ long rl_internal_bitpos(void *s, unsigned long count, int bit) {
         pos += 8;
     }
 
-    /* Skip bits with full word step. */
+    /* Skip bits with full word step, four words at a time while possible:
+     * testing them together leaves a single branch per 32 bytes. */
     skipval = bit ? 0 : ULONG_MAX;
     l = (unsigned long*) c;
+    while (count >= sizeof(*l)*4) {
+        if (((l[0] ^ skipval) | (l[1] ^ skipval) |
+             (l[2] ^ skipval) | (l[3] ^ skipval)) != 0) break;
+        l += 4;
+        count -= sizeof(*l)*4;
+        pos += sizeof(*l)*4*8;
+    }
     while (count >= sizeof(*l)) {
         if (*l != skipval) break;
         l++;
@@ -378,11 +469,18 @@ long rl_internal_bitpos(void *s, unsigned long count, int bit) {
      * that the right of the string is zero padded. */
     if (bit == 1 && word == 0) return -1;
 
+#if defined(__GNUC__)
+    /* The first matching bit is the most significant one set in the word,
+     * or in its complement when looking for zeros. Neither is zero here:
+     * a word without zeros only stops the skip above when there are no
+     * bytes left, and then it is zero padded. */
+    return pos + (bit ? __builtin_clzl(word) : __builtin_clzl(~word));
+#else
     /* Last word left, scan bit by bit. The first thing we need is to
      * have a single "1" set in the most significant position in an
      * unsigned long. We don't know the size of the long so we use a
      * simple trick. */
-    one = ULONG_MAX; /* All bits set to 1.*/
+    unsigned long one = ULONG_MAX; /* All bits set to 1.*/
     one >>= 1;       /* All bits set to 1 but the MSB. */
     one = ~one;      /* All bits set to 0 but the MSB. */
 
@@ -391,8 +489,196 @@ long rl_internal_bitpos(void *s, unsigned long count, int bit) {
         pos++;
         one >>= 1;
     }
+#endif
 
     /* If we reached this point, there is a bug in the algorithm, since
      * the case of no match is handled as a special case before. */
     return -2;
 }
+
+// https://github.com/antirez/redis/blob/unstable/src/bitops.c#L211
+/* The following set.*Bitfield and get.*Bitfield functions implement setting
+ * and getting arbitrary size (up to 64 bits) signed and unsigned integers
+ * at arbitrary positions into a bitmap.
+ *
+ * The representation considers the bitmap as having the bit number 0 to be
+ * the most significant bit of the first byte, and so forth, so for example
+ * setting a 5 bits unsigned integer to value 23 at offset 7 into a bitmap
+ * previously set to all zeroes, will produce the following representation:
+ *
+ * +--------+--------+
+ * |00000001|01110000|
+ * +--------+--------+
+ *
+ * When offsets and integer sizes are aligned to bytes boundaries, this is the
+ * same as big endian, however when such alignment does not exist, its
+ * important to also understand how the bits inside a byte are ordered.
+ *
+ * Note that this format follows the same convention as SETBIT and related
+ * commands.
+ */
+void rl_setUnsignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits, uint64_t value) {
+    uint64_t byte, bit, byteval, bitval, j;
+
+    for (j = 0; j < bits; j++) {
+        bitval = (value & ((uint64_t)1<<(bits-1-j))) != 0;
+        byte = offset >> 3;
+        bit = 7 - (offset & 0x7);
+        byteval = p[byte];
+        byteval &= ~(1 << bit);
+        byteval |= bitval << bit;
+        p[byte] = byteval & 0xff;
+        offset++;
+    }
+}
+
+void rl_setSignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits, int64_t value) {
+    uint64_t uv = value; /* Casting will add UINT64_MAX + 1 if v is negative. */
+    rl_setUnsignedBitfield(p,offset,bits,uv);
+}
+
+uint64_t rl_getUnsignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits) {
+    uint64_t byte, bit, byteval, bitval, j, value = 0;
+
+    for (j = 0; j < bits; j++) {
+        byte = offset >> 3;
+        bit = 7 - (offset & 0x7);
+        byteval = p[byte];
+        bitval = (byteval >> bit) & 1;
+        value = (value<<1) | bitval;
+        offset++;
+    }
+    return value;
+}
+
+int64_t rl_getSignedBitfield(unsigned char *p, uint64_t offset, uint64_t bits) {
+    int64_t value;
+    union {uint64_t u; int64_t i;} conv;
+
+    /* Converting from unsigned to signed is undefined when the value does
+     * not fit, however here we assume two's complement and the original value
+     * was obtained from signed -> unsigned conversion, so we'll find the
+     * most significant bit set if the original value was negative.
+     *
+     * Note that two's complement is mandatory for exact-width types
+     * according to the C99 standard. */
+    conv.u = rl_getUnsignedBitfield(p,offset,bits);
+    value = conv.i;
+
+    /* If the top significant bit is 1, propagate it to all the
+     * higher bits for two's complement representation of signed
+     * integers. */
+    if (bits < 64 && (value & ((uint64_t)1 << (bits-1))))
+        value |= ((uint64_t)-1) << bits;
+    return value;
+}
+
+/* The following two functions detect overflow of a value in the context
+ * of storing it as an unsigned or signed integer with the specified
+ * number of bits. The functions both take the value and a possible increment.
+ * If no overflow could happen and the value+increment fit inside the limits,
+ * then zero is returned, otherwise in case of overflow, 1 is returned,
+ * otherwise in case of underflow, -1 is returned.
+ *
+ * When non-zero is returned (overflow or underflow), if not NULL, *limit is
+ * set to the value the operation should result when an overflow happens,
+ * depending on the specified overflow semantics:
+ *
+ * For BFOVERFLOW_SAT if 1 is returned, *limit it is set maximum value that
+ * you can store in that integer. when -1 is returned, *limit is set to the
+ * minimum value that an integer of that size can represent.
+ *
+ * For BFOVERFLOW_WRAP *limit is set by performing the operation in order to
+ * "wrap" around towards zero for unsigned integers, or towards the most
+ * negative number that is possible to represent for signed integers. */
+int rl_checkUnsignedBitfieldOverflow(uint64_t value, int64_t incr, uint64_t bits, int owtype, uint64_t *limit) {
+    uint64_t max = (bits == 64) ? UINT64_MAX : (((uint64_t)1<<bits)-1);
+    int64_t maxincr = max-value;
+    int64_t minincr = -value;
+
+    if (value > max || (incr > 0 && incr > maxincr)) {
+        if (limit) {
+            if (owtype == BFOVERFLOW_WRAP) {
+                goto handle_wrap;
+            } else if (owtype == BFOVERFLOW_SAT) {
+                *limit = max;
+            }
+        }
+        return 1;
+    } else if (incr < 0 && incr < minincr) {
+        if (limit) {
+            if (owtype == BFOVERFLOW_WRAP) {
+                goto handle_wrap;
+            } else if (owtype == BFOVERFLOW_SAT) {
+                *limit = 0;
+            }
+        }
+        return -1;
+    }
+    return 0;
+
+handle_wrap:
+    {
+        uint64_t mask = ((uint64_t)-1) << bits;
+        uint64_t res = value+incr;
+
+        res &= ~mask;
+        *limit = res;
+    }
+    return 1;
+}
+
+int rl_checkSignedBitfieldOverflow(int64_t value, int64_t incr, uint64_t bits, int owtype, int64_t *limit) {
+    int64_t max = (bits == 64) ? INT64_MAX : (((int64_t)1<<(bits-1))-1);
+    int64_t min = (-max)-1;
+
+    /* Note that maxincr and minincr could overflow, but we use the values
+     * only after checking 'value' range, so when we use it no overflow
+     * happens. 'uint64_t' cast is there just to prevent undefined behavior on
+     * overflow */
+    int64_t maxincr = (uint64_t)max-value;
+    int64_t minincr = min-value;
+
+    if (value > max || (bits != 64 && incr > maxincr) || (value >= 0 && incr > 0 && incr > maxincr))
+    {
+        if (limit) {
+            if (owtype == BFOVERFLOW_WRAP) {
+                goto handle_wrap;
+            } else if (owtype == BFOVERFLOW_SAT) {
+                *limit = max;
+            }
+        }
+        return 1;
+    } else if (value < min || (bits != 64 && incr < minincr) || (value < 0 && incr < 0 && incr < minincr)) {
+        if (limit) {
+            if (owtype == BFOVERFLOW_WRAP) {
+                goto handle_wrap;
+            } else if (owtype == BFOVERFLOW_SAT) {
+                *limit = min;
+            }
+        }
+        return -1;
+    }
+    return 0;
+
+handle_wrap:
+    {
+        uint64_t msb = (uint64_t)1 << (bits-1);
+        uint64_t a = value, b = incr, c;
+        c = a+b; /* Perform addition as unsigned so that's defined. */
+
+        /* If the sign bit is set, propagate to all the higher order
+         * bits, to cap the negative value. If it's clear, mask to
+         * the positive integer limit. */
+        if (bits < 64) {
+            uint64_t mask = ((uint64_t)-1) << bits;
+            if (c & msb) {
+                c |= mask;
+            } else {
+                c &= ~mask;
+            }
+        }
+        *limit = c;
+    }
+    return 1;
+}
@@ -383,6 +383,284 @@ cleanup:
 
 #define DELETE_TESTS_COUNT 7
 
+TEST find_scores_test(long size, long btree_node_size)
+{
+	INIT();
+	long *key, *val, i, querysize = size * 2;
+	long *queries = malloc(sizeof(long) * querysize);
+	void **scores = malloc(sizeof(void *) * querysize);
+	void **values = malloc(sizeof(void *) * querysize);
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	for (i = 0; i < size; i++) {
+		key = malloc(sizeof(long));
+		val = malloc(sizeof(long));
+		*key = i * 2;
+		*val = i * 20;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, key, val);
+	}
+
+	// odd numbers are not in the tree, and some queries are repeated
+	for (i = 0; i < querysize; i++) {
+		queries[i] = rand() % (size * 2 + 2) - 1;
+		scores[i] = &queries[i];
+	}
+	RL_CALL_VERBOSE(rl_btree_find_scores, RL_OK, db, btree, querysize, scores, values);
+	for (i = 0; i < querysize; i++) {
+		if (queries[i] >= 0 && queries[i] % 2 == 0 && queries[i] < size * 2) {
+			if (values[i] == NULL) {
+				FAILm("Expected score to be found");
+			}
+			EXPECT_LONG(*(long *)values[i], queries[i] * 10);
+		}
+		else if (values[i] != NULL) {
+			FAILm("Expected score not to be found");
+		}
+	}
+	free(queries);
+	free(scores);
+	free(values);
+	rl_close(db);
+	PASS();
+}
+
+TEST iterator_create_at_test(long size, long btree_node_size)
+{
+	INIT();
+	long *key, *val, *score, *value, i, start, expected;
+	rl_btree_iterator *iterator;
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	for (i = 0; i < size; i++) {
+		key = malloc(sizeof(long));
+		val = malloc(sizeof(long));
+		*key = i * 2;
+		*val = i * 20;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, key, val);
+	}
+
+	// start at every score in the tree and right after it
+	for (start = -1; start < size * 2; start++) {
+		RL_CALL_VERBOSE(rl_btree_iterator_create_at, start == size * 2 - 1 ? RL_NOT_FOUND : RL_OK, db, btree, &start, &iterator);
+		if (start == size * 2 - 1) {
+			continue;
+		}
+		expected = start < 0 ? 0 : (start + 1) / 2 * 2;
+		while ((retval = rl_btree_iterator_next(iterator, (void **)&score, (void **)&value)) == RL_OK) {
+			EXPECT_LONG(*score, expected);
+			EXPECT_LONG(*value, expected * 10);
+			rl_free(score);
+			rl_free(value);
+			expected += 2;
+		}
+		EXPECT_INT(retval, RL_END);
+		EXPECT_LONG(expected, size * 2);
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST get_element_test(long size, long btree_node_size, int _commit)
+{
+	INIT();
+	long *key, *val, *score, *value, i, j;
+	void *tmp;
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	// insert in an order unrelated to the scores
+	for (i = 0; i < size; i++) {
+		key = malloc(sizeof(long));
+		val = malloc(sizeof(long));
+		*key = (i * 37) % size;
+		*val = *key * 10;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, key, val);
+	}
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	if (_commit) {
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+		RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_long_long, btree_page, &rl_btree_type_hash_long_long, &tmp, 1);
+		btree = tmp;
+	}
+
+	for (i = 0; i < size; i++) {
+		RL_CALL_VERBOSE(rl_btree_get_element, RL_OK, db, btree, i, (void **)&score, (void **)&value);
+		EXPECT_LONG(*score, i);
+		EXPECT_LONG(*value, i * 10);
+	}
+	RL_CALL_VERBOSE(rl_btree_get_element, RL_NOT_FOUND, db, btree, size, NULL, NULL);
+	RL_CALL_VERBOSE(rl_btree_get_element, RL_NOT_FOUND, db, btree, -1, NULL, NULL);
+
+	// remove the odd scores, the counts must follow merges and rotations
+	for (i = 1; i < size; i += 2) {
+		RL_CALL_VERBOSE(rl_btree_remove_element, RL_OK, db, btree, btree_page, &i);
+		RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	}
+	for (j = 0; j < (size + 1) / 2; j++) {
+		RL_CALL_VERBOSE(rl_btree_get_element, RL_OK, db, btree, j, (void **)&score, NULL);
+		EXPECT_LONG(*score, j * 2);
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST bulk_load_test(long size, long btree_node_size, double fill_factor, int _commit)
+{
+	INIT();
+	long *score, *value, i;
+	void *tmp, **scores, **values;
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	scores = malloc(sizeof(void *) * (size + 1));
+	values = malloc(sizeof(void *) * (size + 1));
+	for (i = 0; i < size; i++) {
+		scores[i] = malloc(sizeof(long));
+		values[i] = malloc(sizeof(long));
+		*(long *)scores[i] = i * 2;
+		*(long *)values[i] = i * 20;
+	}
+	RL_CALL_VERBOSE(rl_btree_bulk_load, RL_OK, db, btree, btree_page, size, scores, values, fill_factor);
+	free(scores);
+	free(values);
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	EXPECT_LONG(btree->number_of_elements, size);
+	if (_commit) {
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+		RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_long_long, btree_page, &rl_btree_type_hash_long_long, &tmp, 1);
+		btree = tmp;
+	}
+
+	for (i = 0; i < size; i++) {
+		RL_CALL_VERBOSE(rl_btree_get_element, RL_OK, db, btree, i, (void **)&score, (void **)&value);
+		EXPECT_LONG(*score, i * 2);
+		EXPECT_LONG(*value, i * 20);
+		score = malloc(sizeof(long));
+		*score = i * 2 + 1;
+		RL_CALL_VERBOSE(rl_btree_find_score, RL_NOT_FOUND, db, btree, score, NULL, NULL, NULL);
+		free(score);
+	}
+
+	// the loaded tree takes insertions and deletions like any other
+	for (i = 0; i < size; i++) {
+		score = malloc(sizeof(long));
+		value = malloc(sizeof(long));
+		*score = i * 2 + 1;
+		*value = 0;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, score, value);
+	}
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	for (i = 0; i < size * 2; i += 2) {
+		RL_CALL_VERBOSE(rl_btree_remove_element, RL_OK, db, btree, btree_page, &i);
+	}
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	EXPECT_LONG(btree->number_of_elements, size);
+	rl_close(db);
+	PASS();
+}
+
+TEST bulk_load_unsorted_test()
+{
+	long btree_node_size = 10;
+	INIT();
+	long a = 2, b = 1;
+	void *scores[2] = {&a, &b}, *values[2] = {&a, &b};
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	RL_CALL_VERBOSE(rl_btree_bulk_load, RL_INVALID_PARAMETERS, db, btree, btree_page, 2, scores, values, 1.0);
+	RL_CALL_VERBOSE(rl_btree_bulk_load, RL_INVALID_PARAMETERS, db, btree, btree_page, 1, scores, values, 0.0);
+	EXPECT_LONG(btree->number_of_elements, 0);
+	rl_close(db);
+	PASS();
+}
+
+TEST add_elements_test(long size, long btree_node_size, int _commit)
+{
+	INIT();
+	long *score, *value, i, count = 0;
+	void *tmp, **scores, **values;
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	for (i = 0; i < size; i++) {
+		score = malloc(sizeof(long));
+		value = malloc(sizeof(long));
+		*score = i * 3;
+		*value = i * 30;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, score, value);
+	}
+	if (_commit) {
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+		RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_long_long, btree_page, &rl_btree_type_hash_long_long, &tmp, 1);
+		btree = tmp;
+	}
+
+	// fill the gaps between the existing scores and keep going past the end
+	scores = malloc(sizeof(void *) * (size * 3 + 10));
+	values = malloc(sizeof(void *) * (size * 3 + 10));
+	for (i = 0; i < size * 3 + 10; i++) {
+		if (i % 3 == 0 && i < size * 3) {
+			continue;
+		}
+		scores[count] = malloc(sizeof(long));
+		values[count] = malloc(sizeof(long));
+		*(long *)scores[count] = i;
+		*(long *)values[count] = i * 10;
+		count++;
+	}
+	RL_CALL_VERBOSE(rl_btree_add_elements, RL_OK, db, btree, btree_page, count, scores, values);
+	free(scores);
+	free(values);
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+	EXPECT_LONG(btree->number_of_elements, size * 3 + 10);
+	if (_commit) {
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+		RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_btree_hash_long_long, btree_page, &rl_btree_type_hash_long_long, &tmp, 1);
+		btree = tmp;
+	}
+
+	for (i = 0; i < size * 3 + 10; i++) {
+		RL_CALL_VERBOSE(rl_btree_get_element, RL_OK, db, btree, i, (void **)&score, (void **)&value);
+		EXPECT_LONG(*score, i);
+		EXPECT_LONG(*value, i * 10);
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST add_elements_invalid_test()
+{
+	long btree_node_size = 4;
+	INIT();
+	long i, *score, *value;
+	void *scores[3], *values[3];
+	long btree_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, btree->type->btree_type, btree_page, btree);
+	for (i = 1; i < 4; i += 2) {
+		score = malloc(sizeof(long));
+		value = malloc(sizeof(long));
+		*score = *value = i;
+		RL_CALL_VERBOSE(rl_btree_add_element, RL_OK, db, btree, btree_page, score, value);
+	}
+
+	// 1 is already there, 0 goes in and the rest is released
+	for (i = 0; i < 3; i++) {
+		scores[i] = malloc(sizeof(long));
+		values[i] = malloc(sizeof(long));
+		*(long *)scores[i] = *(long *)values[i] = i;
+	}
+	RL_CALL_VERBOSE(rl_btree_add_elements, RL_FOUND, db, btree, btree_page, 3, scores, values);
+	EXPECT_LONG(btree->number_of_elements, 3);
+	RL_CALL_VERBOSE(rl_btree_is_balanced, RL_OK, db, btree);
+
+	for (i = 0; i < 2; i++) {
+		scores[i] = malloc(sizeof(long));
+		values[i] = malloc(sizeof(long));
+		*(long *)scores[i] = *(long *)values[i] = 10 - i;
+	}
+	RL_CALL_VERBOSE(rl_btree_add_elements, RL_INVALID_PARAMETERS, db, btree, btree_page, 2, scores, values);
+	EXPECT_LONG(btree->number_of_elements, 3);
+	rl_close(db);
+	PASS();
+}
+
 SUITE(btree_test)
 {
 	int i, j, k;
@@ -391,6 +669,33 @@ SUITE(btree_test)
 	RUN_TEST(basic_insert_hash_test);
 	RUN_TESTp(random_hash_test, 10, 2);
 	RUN_TESTp(random_hash_test, 100, 10);
+	RUN_TESTp(find_scores_test, 1, 2);
+	RUN_TESTp(find_scores_test, 100, 2);
+	RUN_TESTp(find_scores_test, 1000, 10);
+	RUN_TESTp(iterator_create_at_test, 1, 2);
+	RUN_TESTp(iterator_create_at_test, 100, 2);
+	RUN_TESTp(iterator_create_at_test, 500, 10);
+	RUN_TESTp(get_element_test, 1, 2, 0);
+	RUN_TESTp(get_element_test, 200, 2, 0);
+	RUN_TESTp(get_element_test, 200, 2, 1);
+	RUN_TESTp(get_element_test, 1000, 10, 1);
+	for (i = 0; i < 2; i++) {
+		RUN_TESTp(bulk_load_test, 0, 2, 1.0, i);
+		RUN_TESTp(bulk_load_test, 1, 2, 1.0, i);
+		RUN_TESTp(bulk_load_test, 7, 2, 0.5, i);
+		RUN_TESTp(bulk_load_test, 200, 2, 1.0, i);
+		RUN_TESTp(bulk_load_test, 200, 10, 0.7, i);
+		RUN_TESTp(bulk_load_test, 1000, 10, 1.0, i);
+		RUN_TESTp(bulk_load_test, 1000, 10, 0.5, i);
+	}
+	RUN_TEST(bulk_load_unsorted_test);
+	for (i = 0; i < 2; i++) {
+		RUN_TESTp(add_elements_test, 0, 2, i);
+		RUN_TESTp(add_elements_test, 1, 2, i);
+		RUN_TESTp(add_elements_test, 200, 2, i);
+		RUN_TESTp(add_elements_test, 1000, 10, i);
+	}
+	RUN_TEST(add_elements_invalid_test);
 #ifdef RL_DEBUG
 	RUN_TEST(btree_insert_oom);
 	RUN_TEST(btree_create_oom);
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "rlite/hirlite.h"
@@ -51,6 +52,250 @@ TEST keys() {
 	PASS();
 }
 
+TEST scan() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+	char key[20], cursor[24] = "0";
+	int i, calls = 0, seen[100];
+
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		char* argv[100] = {"set", key, "mydata", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STATUS(reply, "OK", 2);
+		rliteFreeReplyObject(reply);
+		seen[i] = 0;
+	}
+
+	{
+		char* argv[100] = {"hset", "myhash", "field", "value", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	do {
+		char* argv[100] = {"scan", cursor, "match", "key*", "count", "10", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		ASSERT_EQ(reply->element[0]->type, RLITE_REPLY_STRING);
+		ASSERT_EQ(reply->element[1]->type, RLITE_REPLY_ARRAY);
+		for (i = 0; i < (int)reply->element[1]->elements; i++) {
+			seen[atoi(reply->element[1]->element[i]->str + 3)]++;
+		}
+		memcpy(cursor, reply->element[0]->str, reply->element[0]->len);
+		cursor[reply->element[0]->len] = 0;
+		rliteFreeReplyObject(reply);
+		calls++;
+	} while (strcmp(cursor, "0") != 0);
+
+	for (i = 0; i < 100; i++) {
+		EXPECT_INT(seen[i], 1);
+	}
+	if (calls < 10) {
+		FAILm("Expected the scan to take multiple calls");
+	}
+
+	{
+		char* argv[100] = {"scan", "0", "count", "1000", "type", "hash", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], "0", 1);
+		EXPECT_REPLY_LEN(reply->element[1], 1);
+		EXPECT_REPLY_STR(reply->element[1]->element[0], "myhash", 6);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"scan", "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"scan", "0", "count", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST keysrange() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+	char key[20];
+	int i, j;
+
+	for (i = 0; i < 30; i++) {
+		snprintf(key, sizeof(key), "tenant:%d", i);
+		char* argv[100] = {"set", key, "mydata", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STATUS(reply, "OK", 2);
+		rliteFreeReplyObject(reply);
+	}
+
+	// the same replies are expected with and without the index
+	for (j = 0; j < 2; j++) {
+		{
+			char* argv[100] = {"keysrange", "tenant:2", "tenant:3", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_LEN(reply, 12);
+			EXPECT_REPLY_STR(reply->element[0], "tenant:2", 8);
+			EXPECT_REPLY_STR(reply->element[1], "tenant:20", 9);
+			EXPECT_REPLY_STR(reply->element[11], "tenant:3", 8);
+			rliteFreeReplyObject(reply);
+		}
+
+		{
+			char* argv[100] = {"keysrange", "user:", "user:~", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_LEN(reply, 0);
+			rliteFreeReplyObject(reply);
+		}
+
+		{
+			char* argv[100] = {"keys", "tenant:1?", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_LEN(reply, 10);
+			rliteFreeReplyObject(reply);
+		}
+
+		{
+			char* argv[100] = {"scan", "0", "match", "tenant:2*", "count", "1000", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_LEN(reply, 2);
+			EXPECT_REPLY_STR(reply->element[0], "0", 1);
+			EXPECT_REPLY_LEN(reply->element[1], 11);
+			rliteFreeReplyObject(reply);
+		}
+
+		{
+			// COUNT pages through the matching keys
+			char cursor[32] = "0";
+			long calls = 0, total = 0;
+			do {
+				char* argv[100] = {"scan", cursor, "match", "tenant:2*", "count", "2", NULL};
+				reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+				EXPECT_REPLY_LEN(reply, 2);
+				if (reply->element[1]->elements > 2) {
+					FAIL();
+				}
+				total += reply->element[1]->elements;
+				snprintf(cursor, sizeof(cursor), "%.*s", (int)reply->element[0]->len, reply->element[0]->str);
+				rliteFreeReplyObject(reply);
+				calls++;
+			} while (strcmp(cursor, "0") != 0);
+			EXPECT_LONG(total, 11);
+			if (calls < 6) {
+				FAIL();
+			}
+		}
+
+		{
+			char* argv[100] = {"keyindex", "create", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_INTEGER(reply, j == 0 ? 1 : 0);
+			rliteFreeReplyObject(reply);
+		}
+	}
+
+	{
+		char* argv[100] = {"keyindex", "drop", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"keyindex", "drop", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST scan_key_index() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+	char key[40], cursor[32];
+	int i, seen[10];
+	long calls;
+
+	{
+		char* argv[100] = {"keyindex", "create", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	for (i = 0; i < 30; i++) {
+		snprintf(key, sizeof(key), "user:%d", i);
+		char* argv[100] = {"set", key, "mydata", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STATUS(reply, "OK", 2);
+		rliteFreeReplyObject(reply);
+	}
+	for (i = 0; i < 10; i++) {
+		snprintf(key, sizeof(key), "long:abcdefghij%d", i);
+		char* argv[100] = {"set", key, "mydata", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STATUS(reply, "OK", 2);
+		rliteFreeReplyObject(reply);
+	}
+
+	// deleting a key already returned does not skip the following ones
+	memset(seen, 0, sizeof(seen));
+	strcpy(cursor, "0");
+	calls = 0;
+	do {
+		char* argv[100] = {"scan", cursor, "match", "user:1*", "count", "2", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		for (i = 0; i < (int)reply->element[1]->elements; i++) {
+			if (reply->element[1]->element[i]->len == 7) {
+				seen[reply->element[1]->element[i]->str[6] - '0'] = 1;
+			}
+		}
+		snprintf(cursor, sizeof(cursor), "%.*s", (int)reply->element[0]->len, reply->element[0]->str);
+		rliteFreeReplyObject(reply);
+		if (calls++ == 0) {
+			char* argv2[100] = {"del", "user:1", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+			EXPECT_REPLY_INTEGER(reply, 1);
+			rliteFreeReplyObject(reply);
+		}
+	} while (strcmp(cursor, "0") != 0);
+	for (i = 0; i < 10; i++) {
+		EXPECT_INT(seen[i], 1);
+	}
+
+	// names that only differ past the cursor bytes are returned together
+	{
+		char* argv[100] = {"scan", "0", "match", "long:*", "count", "2", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], "0", 1);
+		EXPECT_REPLY_LEN(reply->element[1], 10);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST dbsize() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -120,6 +365,45 @@ TEST expire(char *command, char *time) {
 	PASS();
 }
 
+TEST exists_multiple() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	{
+		char* argv[100] = {"set", "key1", "mydata", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STATUS(reply, "OK", 2);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sadd", "key2", "member", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// keys given more than once are counted every time
+		char* argv[100] = {"exists", "key1", "key3", "key2", "key1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 3);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"exists", "key3", "key4", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_rename() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -609,11 +893,15 @@ TEST flushdb_multidb() {
 SUITE(db_test) {
 	RUN_TEST(test_rlite_connect);
 	RUN_TEST(keys);
+	RUN_TEST(scan);
+	RUN_TEST(keysrange);
+	RUN_TEST(scan_key_index);
 	RUN_TEST(dbsize);
 	RUN_TESTp(expire, "expire", "-1");
 	RUN_TESTp(expire, "pexpire", "-1");
 	RUN_TESTp(expire, "expireat", "1000");
 	RUN_TESTp(expire, "pexpireat", "1000");
+	RUN_TEST(exists_multiple);
 	RUN_TEST(test_rename);
 	RUN_TEST(renamenx);
 	RUN_TEST(ttl_pttl);
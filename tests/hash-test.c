@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include "rlite/hirlite.h"
 #include "util.h"
@@ -21,6 +22,40 @@ TEST test_hset() {
 	PASS();
 }
 
+TEST test_hset_multi() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	char* argv[100] = {"hset", "mykey", "myfield", "mydata", "myfield2", "mydata2", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 2);
+	rliteFreeReplyObject(reply);
+
+	// a repeated field counts once and keeps its last value
+	char* argv2[100] = {"hset", "mykey", "myfield", "mydata3", "myfield3", "x", "myfield3", "mydata4", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv3[100] = {"hmget", "mykey", "myfield", "myfield2", "myfield3", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv3, argvlen), argv3, argvlen);
+	EXPECT_REPLY_LEN(reply, 3);
+	EXPECT_REPLY_STR(reply->element[0], "mydata3", 7);
+	EXPECT_REPLY_STR(reply->element[1], "mydata2", 7);
+	EXPECT_REPLY_STR(reply->element[2], "mydata4", 7);
+	rliteFreeReplyObject(reply);
+
+	char* argv4[100] = {"hset", "mykey", "myfield", "mydata", "myfield2", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv4, argvlen), argv4, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_hsetnx() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -282,6 +317,25 @@ TEST test_hincrbyfloat() {
 	PASS();
 }
 
+struct stream_elements {
+	char data[1024];
+	size_t len;
+	long count;
+	long abort_at;
+};
+
+static int collect_element(void *privdata, const rliteReply *element) {
+	struct stream_elements *elements = privdata;
+	if (elements->count == elements->abort_at) {
+		return RLITE_ERR;
+	}
+	memcpy(elements->data + elements->len, element->str, element->len);
+	elements->len += element->len;
+	elements->data[elements->len++] = ',';
+	elements->count++;
+	return RLITE_OK;
+}
+
 TEST test_hgetall() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -321,6 +375,59 @@ TEST test_hgetall() {
 	PASS();
 }
 
+TEST test_hgetall_stream() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	struct stream_elements elements = {"", 0, 0, -1};
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	{
+		char* argv[100] = {"hmset", "mykey", "myfield", "mydata", "myfield2", "mydata2", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"hgetall", "mykey", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 4);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "myfield2,mydata2,myfield,mydata,", 32);
+	}
+
+	elements.len = elements.count = 0;
+	{
+		char* argv[100] = {"hvals", "mykey", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 2);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "mydata2,mydata,", 15);
+	}
+
+	elements.len = elements.count = 0;
+	elements.abort_at = 1;
+	{
+		char* argv[100] = {"hgetall", "mykey", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+		EXPECT_LONG(elements.count, 1);
+	}
+
+	elements.len = elements.count = 0;
+	elements.abort_at = -1;
+	{
+		char* argv[100] = {"hkeys", "otherkey", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_hkeys() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -426,9 +533,108 @@ TEST test_hmget() {
 	PASS();
 }
 
+TEST test_hscan() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+	char field[20], value[20], cursor[24] = "0";
+	int i, seen[50];
+
+	for (i = 0; i < 50; i++) {
+		snprintf(field, sizeof(field), "field%d", i);
+		snprintf(value, sizeof(value), "value%d", i);
+		char* argv[100] = {"hset", "mykey", field, value, NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+		seen[i] = 0;
+	}
+
+	do {
+		char* argv[100] = {"hscan", "mykey", cursor, "count", "5", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		ASSERT_EQ(reply->element[1]->elements % 2, 0);
+		for (i = 0; i < (int)reply->element[1]->elements; i += 2) {
+			ASSERT_EQ(atoi(reply->element[1]->element[i]->str + 5), atoi(reply->element[1]->element[i + 1]->str + 5));
+			seen[atoi(reply->element[1]->element[i]->str + 5)]++;
+		}
+		memcpy(cursor, reply->element[0]->str, reply->element[0]->len);
+		cursor[reply->element[0]->len] = 0;
+		rliteFreeReplyObject(reply);
+	} while (strcmp(cursor, "0") != 0);
+
+	for (i = 0; i < 50; i++) {
+		EXPECT_INT(seen[i], 1);
+	}
+
+	{
+		char* argv[100] = {"hscan", "mykey", "0", "match", "field1", "count", "100", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_LEN(reply->element[1], 2);
+		EXPECT_REPLY_STR(reply->element[1]->element[0], "field1", 6);
+		EXPECT_REPLY_STR(reply->element[1]->element[1], "value1", 6);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+#ifdef RL_DEBUG
+TEST test_hgetall_copies() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100], bytes[2], getbytes[2];
+	char value[1001];
+	char *fields[10] = {"f0", "f1", "f2", "f3", "f4", "f5", "f6", "f7", "f8", "f9"};
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		memset(value, 'a', 500 * (i + 1));
+		value[500 * (i + 1)] = 0;
+		for (j = 0; j < 10; j++) {
+			char* argv[100] = {"hset", "mykey", fields[j], value, NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			rliteFreeReplyObject(reply);
+		}
+		{
+			char* argv[100] = {"hgetall", "mykey", NULL};
+			test_alloc_bytes = 0;
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			bytes[i] = test_alloc_bytes;
+			EXPECT_REPLY_LEN(reply, 20);
+			EXPECT_REPLY_STR(reply->element[1], value, 500 * (i + 1));
+			rliteFreeReplyObject(reply);
+		}
+		{
+			char* argv[100] = {"hget", "mykey", "f0", NULL};
+			test_alloc_bytes = 0;
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			getbytes[i] = test_alloc_bytes;
+			EXPECT_REPLY_STR(reply, value, 500 * (i + 1));
+			rliteFreeReplyObject(reply);
+		}
+	}
+
+	// each value is allocated once, when read, and the reply adopts it
+	ASSERT(bytes[1] >= bytes[0] + 10 * 500);
+	ASSERT(bytes[1] < bytes[0] + 10 * 750);
+	ASSERT(getbytes[1] >= getbytes[0] + 500);
+	ASSERT(getbytes[1] < getbytes[0] + 750);
+
+	rliteFree(context);
+	PASS();
+}
+#endif
+
 SUITE(hash_test)
 {
 	RUN_TEST(test_hset);
+	RUN_TEST(test_hset_multi);
 	RUN_TEST(test_hsetnx);
 	RUN_TEST(test_hget);
 	RUN_TEST(test_hexists);
@@ -438,7 +644,12 @@ SUITE(hash_test)
 	RUN_TEST(test_hincrby);
 	RUN_TEST(test_hincrbyfloat);
 	RUN_TEST(test_hgetall);
+	RUN_TEST(test_hgetall_stream);
 	RUN_TEST(test_hkeys);
 	RUN_TEST(test_hvals);
 	RUN_TEST(test_hmget);
+	RUN_TEST(test_hscan);
+#ifdef RL_DEBUG
+	RUN_TEST(test_hgetall_copies);
+#endif
 }
@@ -303,6 +303,25 @@ TEST test_linsert() {
 	PASS();
 }
 
+struct stream_elements {
+	char data[1024];
+	size_t len;
+	long count;
+	long abort_at;
+};
+
+static int collect_element(void *privdata, const rliteReply *element) {
+	struct stream_elements *elements = privdata;
+	if (elements->count == elements->abort_at) {
+		return RLITE_ERR;
+	}
+	memcpy(elements->data + elements->len, element->str, element->len);
+	elements->len += element->len;
+	elements->data[elements->len++] = ',';
+	elements->count++;
+	return RLITE_OK;
+}
+
 TEST test_lrange() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -346,6 +365,84 @@ TEST test_lrange() {
 	PASS();
 }
 
+TEST test_lrange_stream() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	struct stream_elements elements = {"", 0, 0, -1};
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	lpush(context, "mylist", "c");
+	lpush(context, "mylist", "b");
+	lpush(context, "mylist", "a");
+
+	{
+		char* argv[100] = {"lrange", "mylist", "0", "1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 2);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "a,b,", 4);
+	}
+
+	elements.len = elements.count = 0;
+	elements.abort_at = 1;
+	{
+		char* argv[100] = {"lrange", "mylist", "0", "-1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+		EXPECT_LONG(elements.count, 1);
+	}
+
+	elements.len = elements.count = 0;
+	elements.abort_at = -1;
+	{
+		char* argv[100] = {"lrange", "otherlist", "0", "-1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"set", "mystring", "a", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"lrange", "mystring", "0", "-1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+		EXPECT_LONG(elements.count, 0);
+	}
+
+	{
+		// commands without a streaming path stream the reply they built
+		char* argv[100] = {"sort", "mylist", "alpha", "desc", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 3);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "c,b,a,", 6);
+	}
+
+	{
+		char* argv[100] = {"multi", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"lrange", "mylist", "0", "-1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_lrem() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -516,6 +613,178 @@ TEST test_rpoplpush() {
 	PASS();
 }
 
+TEST test_blpop() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	char *values[2] = {"value", "othervalue"};
+	char *key = "mylist";
+	char *key2 = "otherlist";
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	lpush(context, key2, values[1]);
+	lpush(context, key2, values[0]);
+
+	{
+		char* argv[100] = {"blpop", key, key2, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], key2, strlen(key2));
+		EXPECT_REPLY_STR(reply->element[1], values[0], strlen(values[0]));
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"brpop", key, key2, "1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], key2, strlen(key2));
+		EXPECT_REPLY_STR(reply->element[1], values[1], strlen(values[1]));
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// nobody else can push to a memory database
+		char* argv[100] = {"blpop", key, key2, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_NIL(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"blpop", key, "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"set", key, "a", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"brpop", key, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST test_brpoplpush() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	char *values[2] = {"value", "othervalue"};
+	char *key = "mylist";
+	char *key2 = "otherlist";
+	char *key3 = "mystring";
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	lpush(context, key, values[1]);
+	lpush(context, key, values[0]);
+
+	{
+		char* argv[100] = {"brpoplpush", key, key2, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STR(reply, values[1], strlen(values[1]));
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"set", key3, "a", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"brpoplpush", key, key3, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// the source keeps its element when the destination has the wrong type
+		char* argv[100] = {"llen", key, NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"brpoplpush", key, key2, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STR(reply, values[0], strlen(values[0]));
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"brpoplpush", key, key2, "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_NIL(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"lrange", key2, "0", "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], values[0], strlen(values[0]));
+		EXPECT_REPLY_STR(reply->element[1], values[1], strlen(values[1]));
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+#ifdef RL_DEBUG
+TEST test_lrange_copies() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100], bytes[2];
+	char value[1001];
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		memset(value, 'a', 500 * (i + 1));
+		value[500 * (i + 1)] = 0;
+		{
+			char* argv[100] = {"del", "mylist", NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			rliteFreeReplyObject(reply);
+		}
+		for (j = 0; j < 10; j++) {
+			lpush(context, "mylist", value);
+		}
+		{
+			char* argv[100] = {"lrange", "mylist", "0", "-1", NULL};
+			test_alloc_bytes = 0;
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			bytes[i] = test_alloc_bytes;
+			EXPECT_REPLY_LEN(reply, 10);
+			EXPECT_REPLY_STR(reply->element[9], value, 500 * (i + 1));
+			rliteFreeReplyObject(reply);
+		}
+	}
+
+	// each element is allocated once, when read, and the reply adopts it
+	ASSERT(bytes[1] >= bytes[0] + 10 * 500);
+	ASSERT(bytes[1] < bytes[0] + 10 * 750);
+
+	rliteFree(context);
+	PASS();
+}
+#endif
+
 SUITE(hlist_test)
 {
 	RUN_TEST(test_lpush);
@@ -526,10 +795,16 @@ SUITE(hlist_test)
 	RUN_TEST(test_lindex);
 	RUN_TEST(test_linsert);
 	RUN_TEST(test_lrange);
+	RUN_TEST(test_lrange_stream);
 	RUN_TEST(test_lrem);
 	RUN_TEST(test_lset);
 	RUN_TEST(test_ltrim);
 	RUN_TEST(test_rpoplpush);
+	RUN_TEST(test_blpop);
+	RUN_TEST(test_brpoplpush);
 	RUN_TEST(test_rpush);
 	RUN_TEST(test_rpushx);
+#ifdef RL_DEBUG
+	RUN_TEST(test_lrange_copies);
+#endif
 }
@@ -168,6 +168,113 @@ TEST test_get() {
 	PASS();
 }
 
+typedef struct {
+	size_t size;
+	size_t position;
+	int abort;
+} stream_context;
+
+static int stream_fill(void *privdata, char *buffer, size_t size, size_t *written) {
+	stream_context *context = privdata;
+	size_t i;
+	if (context->abort && context->position > 0) {
+		return RLITE_ERR;
+	}
+	if (size > 1000) {
+		size = 1000;
+	}
+	if (size > context->size - context->position) {
+		size = context->size - context->position;
+	}
+	for (i = 0; i < size; i++) {
+		buffer[i] = 'a' + (context->position + i) % 26;
+	}
+	context->position += size;
+	*written = size;
+	return RLITE_OK;
+}
+
+static int stream_check(void *privdata, const char *data, size_t len) {
+	stream_context *context = privdata;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (data[i] != 'a' + (context->position + i) % 26) {
+			return RLITE_ERR;
+		}
+	}
+	context->position += len;
+	return context->abort ? RLITE_ERR : RLITE_OK;
+}
+
+TEST test_get_set_stream() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	stream_context stream = {100000, 0, 0};
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	reply = rliteSetStream(context, "mykey", 5, stream_fill, &stream);
+	EXPECT_REPLY_STATUS(reply, "OK", 2);
+	rliteFreeReplyObject(reply);
+
+	{
+		char* argv[100] = {"strlen", "mykey", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 100000);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"getrange", "mykey", "99998", "99999", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STR(reply, "cd", 2);
+		rliteFreeReplyObject(reply);
+	}
+
+	stream.position = 0;
+	reply = rliteGetStream(context, "mykey", 5, stream_check, &stream);
+	EXPECT_REPLY_INTEGER(reply, 100000);
+	rliteFreeReplyObject(reply);
+	EXPECT_LONG(stream.position, 100000);
+
+	stream.position = 0;
+	stream.abort = 1;
+	reply = rliteGetStream(context, "mykey", 5, stream_check, &stream);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	stream.position = 0;
+	stream.size = 10;
+	reply = rliteSetStream(context, "mykey", 5, stream_fill, &stream);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	{
+		char* argv[100] = {"strlen", "mykey", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 100000);
+		rliteFreeReplyObject(reply);
+	}
+
+	reply = rliteGetStream(context, "otherkey", 8, stream_check, &stream);
+	EXPECT_REPLY_NIL(reply);
+	rliteFreeReplyObject(reply);
+
+	{
+		char* argv[100] = {"lpush", "mylist", "a", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	reply = rliteGetStream(context, "mylist", 6, stream_check, &stream);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_append() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -200,6 +307,38 @@ TEST test_append() {
 	PASS();
 }
 
+TEST test_append_many() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+	long i, count = 20000;
+
+	for (i = 0; i < count; i++) {
+		char* argv[100] = {"append", "log", "event-123|", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, (i + 1) * 10);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"getrange", "log", "-10", "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_STR(reply, "event-123|", 10);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"strlen", "log", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, count * 10);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_getset() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -952,6 +1091,126 @@ TEST test_setbit() {
 	PASS();
 }
 
+TEST test_bitfield() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "set", "u8", "0", "255", "set", "u8", "0", "100", "get", "u8", "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 3);
+		EXPECT_REPLY_INTEGER(reply->element[0], 0);
+		EXPECT_REPLY_INTEGER(reply->element[1], 255);
+		EXPECT_REPLY_INTEGER(reply->element[2], 100);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// the default overflow wraps around
+		char* argv[100] = {"bitfield", "mykey", "incrby", "u8", "0", "100", "incrby", "u8", "0", "100", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_INTEGER(reply->element[0], 200);
+		EXPECT_REPLY_INTEGER(reply->element[1], 44);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "set", "i8", "#1", "-100", "get", "i8", "8", "get", "u8", "#1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 3);
+		EXPECT_REPLY_INTEGER(reply->element[0], 0);
+		EXPECT_REPLY_INTEGER(reply->element[1], -100);
+		EXPECT_REPLY_INTEGER(reply->element[2], 156);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "overflow", "sat", "incrby", "u2", "100", "2", "incrby", "u2", "100", "2",
+			"overflow", "fail", "incrby", "u2", "100", "1", "incrby", "i4", "104", "-9", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 4);
+		EXPECT_REPLY_INTEGER(reply->element[0], 2);
+		EXPECT_REPLY_INTEGER(reply->element[1], 3);
+		EXPECT_REPLY_NIL(reply->element[2]);
+		EXPECT_REPLY_NIL(reply->element[3]);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// the string grew up to the last byte written
+		char* argv[100] = {"strlen", "mykey", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 14);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield_ro", "mykey", "get", "u2", "100", "get", "i16", "20000", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_INTEGER(reply->element[0], 3);
+		EXPECT_REPLY_INTEGER(reply->element[1], 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield_ro", "mykey", "set", "u2", "100", "1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "get", "u64", "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "get", "i8", "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "overflow", "none", "get", "i8", "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "mykey", "get", "i8", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"bitfield", "otherkey", "get", "i8", "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 1);
+		EXPECT_REPLY_INTEGER(reply->element[0], 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		// reading does not create the key
+		char* argv[100] = {"exists", "otherkey", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_pfadd_pfcount() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -1115,6 +1374,43 @@ TEST test_pfadd_empty() {
 	PASS();
 }
 
+#ifdef RL_DEBUG
+TEST test_get_copies() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	size_t argvlen[100], bytes[2];
+	char value[8001];
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		memset(value, 'a', 4000 * (i + 1));
+		value[4000 * (i + 1)] = 0;
+		{
+			char* argv[100] = {"set", "mykey", value, NULL};
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			EXPECT_REPLY_STATUS(reply, "OK", 2);
+			rliteFreeReplyObject(reply);
+		}
+		{
+			char* argv[100] = {"get", "mykey", NULL};
+			test_alloc_bytes = 0;
+			reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+			bytes[i] = test_alloc_bytes;
+			EXPECT_REPLY_STR(reply, value, 4000 * (i + 1));
+			rliteFreeReplyObject(reply);
+		}
+	}
+
+	// the extra bytes are allocated once, when read, and the reply adopts them
+	ASSERT(bytes[1] >= bytes[0] + 4000);
+	ASSERT(bytes[1] < bytes[0] + 6000);
+
+	rliteFree(context);
+	PASS();
+}
+#endif
+
 SUITE(hstring_test)
 {
 	RUN_TEST(test_set);
@@ -1122,7 +1418,9 @@ SUITE(hstring_test)
 	RUN_TEST(test_setex);
 	RUN_TEST(test_psetex);
 	RUN_TEST(test_get);
+	RUN_TEST(test_get_set_stream);
 	RUN_TEST(test_append);
+	RUN_TEST(test_append_many);
 	RUN_TEST(test_getset);
 	RUN_TEST(test_mget);
 	RUN_TEST(test_mset);
@@ -1141,8 +1439,12 @@ SUITE(hstring_test)
 	RUN_TEST(test_bitpos);
 	RUN_TEST(test_getbit);
 	RUN_TEST(test_setbit);
+	RUN_TEST(test_bitfield);
 	RUN_TEST(test_pfadd_pfcount);
 	RUN_TEST(test_pfadd_pfmerge_pfcount);
 	RUN_TEST(test_pfadd_pfdebug);
 	RUN_TEST(test_pfadd_empty);
+#ifdef RL_DEBUG
+	RUN_TEST(test_get_copies);
+#endif
 }
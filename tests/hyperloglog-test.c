@@ -44,11 +44,50 @@ int test_hyperloglog_add_merge()
 	free(str3);
 	PASS();
 }
+int test_hyperloglog_dense_count()
+{
+	int retval;
+	unsigned char *str = NULL, *str2 = NULL, *tmp;
+	long strlen = 0, strlen2, card = -1, card2 = -1, card3 = -1, i;
+	char element[32];
+	unsigned char *argv[1] = {UNSIGN(element)};
+	long argvlen[1];
+
+	for (i = 0; i < 20000; i++) {
+		argvlen[0] = snprintf(element, sizeof(element), "element %ld", i);
+		retval = rl_str_pfadd(str, strlen, 1, argv, argvlen, &tmp, &strlen);
+		if (retval != 0 && retval != 1) {
+			fprintf(stderr, "Failed to add element %ld\n", i);
+			FAIL();
+		}
+		str = tmp;
+	}
+	RL_CALL_VERBOSE(rl_str_pfisdense, 1, str, strlen);
+	RL_CALL_VERBOSE(rl_str_pfcount, 0, 1, &str, &strlen, &card, NULL, NULL);
+	if (card < 19600 || card > 20400) {
+		fprintf(stderr, "Expected card to be close to 20000, got %ld\n", card);
+		FAIL();
+	}
+
+	// the union with a missing key merges the dense registers
+	unsigned char *strs[] = {str, NULL};
+	long strslen[] = {strlen, 0};
+	RL_CALL_VERBOSE(rl_str_pfcount, 0, 2, strs, strslen, &card2, NULL, NULL);
+	EXPECT_LONG(card2, card);
 
+	RL_CALL_VERBOSE(rl_str_pfmerge, 0, 1, strs, strslen, &str2, &strlen2);
+	EXPECT_BYTES(str + RL_HLL_HDR_SIZE, strlen - RL_HLL_HDR_SIZE, str2 + RL_HLL_HDR_SIZE, strlen2 - RL_HLL_HDR_SIZE);
+	RL_CALL_VERBOSE(rl_str_pfcount, 0, 1, &str2, &strlen2, &card3, NULL, NULL);
+	EXPECT_LONG(card3, card);
+	free(str);
+	free(str2);
+	PASS();
+}
 
 SUITE(hyperloglog_test)
 {
 	RUN_TEST(test_hyperloglog_selftest);
 	RUN_TEST(test_hyperloglog_add_count);
 	RUN_TEST(test_hyperloglog_add_merge);
+	RUN_TEST(test_hyperloglog_dense_count);
 }
@@ -681,6 +681,144 @@ TEST watch_test(int _commit)
 	PASS();
 }
 
+static int expect_range(rlite *db, char *start, char *end, long expected_len)
+{
+	int retval;
+	long i, len, *keyslen;
+	unsigned char **keys;
+	RL_CALL(rl_keys_range, RL_OK, db, UNSIGN(start), strlen(start), UNSIGN(end), strlen(end), &len, &keys, &keyslen);
+	EXPECT_LONG(len, expected_len);
+	for (i = 0; i < len; i++) {
+		if (i > 0 && (memcmp(keys[i - 1], keys[i], keyslen[i] < keyslen[i - 1] ? keyslen[i] : keyslen[i - 1]) > 0)) {
+			fprintf(stderr, "Expected keys to be sorted on line %d\n", __LINE__);
+			retval = RL_UNEXPECTED;
+		}
+	}
+	for (i = 0; i < len; i++) {
+		rl_free(keys[i]);
+	}
+	rl_free(keys);
+	rl_free(keyslen);
+cleanup:
+	return retval;
+}
+
+TEST test_key_index(int _commit)
+{
+	int retval;
+
+	rlite *db;
+	char key[20];
+	unsigned char *data = UNSIGN("asd");
+	long i, keylen, len, *keyslen;
+	unsigned char **keys;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	// half of the keys exist before the index is created
+	for (i = 0; i < 100; i++) {
+		keylen = snprintf(key, sizeof(key), "user:%ld", i);
+		RL_CALL_VERBOSE(rl_zadd, RL_OK, db, UNSIGN(key), keylen, 1, data, 3);
+	}
+	RL_CALL_VERBOSE(expect_range, RL_OK, db, "user:1", "user:2", 12);
+	RL_CALL_VERBOSE(rl_key_index_create, RL_OK, db);
+	RL_CALL_VERBOSE(rl_key_index_create, RL_FOUND, db);
+	RL_BALANCED();
+	for (i = 100; i < 200; i++) {
+		keylen = snprintf(key, sizeof(key), "user:%ld", i);
+		RL_CALL_VERBOSE(rl_zadd, RL_OK, db, UNSIGN(key), keylen, 1, data, 3);
+	}
+	RL_BALANCED();
+
+	// user:10, user:100 to user:109 and user:11
+	RL_CALL_VERBOSE(expect_range, RL_OK, db, "user:10", "user:11", 12);
+	RL_CALL_VERBOSE(rl_keys, RL_OK, db, UNSIGN("user:1*"), 7, &len, &keys, &keyslen);
+	EXPECT_LONG(len, 111);
+	for (i = 0; i < len; i++) {
+		rl_free(keys[i]);
+	}
+	rl_free(keys);
+	rl_free(keyslen);
+
+	RL_CALL_VERBOSE(rl_key_delete_with_value, RL_OK, db, UNSIGN("user:105"), 8);
+	RL_CALL_VERBOSE(rl_key_delete_with_value, RL_OK, db, UNSIGN("user:11"), 7);
+	RL_CALL_VERBOSE(rl_rename, RL_OK, db, UNSIGN("user:12"), 7, UNSIGN("user:10a"), 8, 0);
+	RL_CALL_VERBOSE(expect_range, RL_OK, db, "user:10", "user:11", 11);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_flushdb, RL_OK, db);
+	RL_CALL_VERBOSE(expect_range, RL_OK, db, "user:", "user:~", 0);
+	RL_CALL_VERBOSE(rl_key_index_create, RL_FOUND, db);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_key_index_drop, RL_OK, db);
+	RL_CALL_VERBOSE(rl_key_index_drop, RL_NOT_FOUND, db);
+	RL_BALANCED();
+	rl_close(db);
+	PASS();
+}
+
+TEST test_expire_cycle(int _commit)
+{
+	int retval;
+
+	rlite *db;
+	char key[20];
+	unsigned char *data = UNSIGN("asd");
+	unsigned long long now = rl_mstime();
+	long i, keylen, expired, size;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	for (i = 0; i < 10; i++) {
+		keylen = snprintf(key, sizeof(key), "past:%ld", i);
+		RL_CALL_VERBOSE(rl_set, RL_OK, db, UNSIGN(key), keylen, data, 3, 0, now - 1000 + i);
+		keylen = snprintf(key, sizeof(key), "future:%ld", i);
+		RL_CALL_VERBOSE(rl_set, RL_OK, db, UNSIGN(key), keylen, data, 3, 0, now + 100000 + i);
+		keylen = snprintf(key, sizeof(key), "persistent:%ld", i);
+		RL_CALL_VERBOSE(rl_set, RL_OK, db, UNSIGN(key), keylen, data, 3, 0, 0);
+	}
+	// changing or removing the expiration moves the key in the index
+	RL_CALL_VERBOSE(rl_key_expires, RL_OK, db, UNSIGN("future:0"), 8, 0);
+	RL_CALL_VERBOSE(rl_key_expires, RL_OK, db, UNSIGN("future:1"), 8, now - 1);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_expire_cycle, RL_OK, db, 4, &expired);
+	EXPECT_LONG(expired, 4);
+	RL_CALL_VERBOSE(rl_dbsize, RL_OK, db, &size);
+	EXPECT_LONG(size, 26);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_expire_cycle, RL_OK, db, 100, &expired);
+	EXPECT_LONG(expired, 7);
+	RL_CALL_VERBOSE(rl_dbsize, RL_OK, db, &size);
+	EXPECT_LONG(size, 19);
+	RL_CALL_VERBOSE(rl_key_get, RL_FOUND, db, UNSIGN("future:0"), 8, NULL, NULL, NULL, NULL, NULL);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, UNSIGN("future:1"), 8, NULL, NULL, NULL, NULL, NULL);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_expire_cycle, RL_OK, db, 100, &expired);
+	EXPECT_LONG(expired, 0);
+
+	// expired keys in other databases are deleted on commit
+	RL_CALL_VERBOSE(rl_select, RL_OK, db, 1);
+	RL_CALL_VERBOSE(rl_set, RL_OK, db, UNSIGN("past"), 4, data, 3, 0, now - 1);
+	RL_CALL_VERBOSE(rl_select, RL_OK, db, 0);
+	RL_CALL_VERBOSE(rl_expire_auto, RL_INVALID_PARAMETERS, db, -1);
+	RL_CALL_VERBOSE(rl_expire_auto, RL_OK, db, 10);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	EXPECT_LONG(db->expire_indexes[1], 0);
+	RL_CALL_VERBOSE(rl_select, RL_OK, db, 1);
+	RL_CALL_VERBOSE(rl_dbsize, RL_OK, db, &size);
+	EXPECT_LONG(size, 0);
+	RL_CALL_VERBOSE(rl_select, RL_OK, db, 0);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_flushdb, RL_OK, db);
+	EXPECT_LONG(db->expire_indexes[0], 0);
+	RL_BALANCED();
+	rl_close(db);
+	PASS();
+}
+
 SUITE(key_test)
 {
 	long i;
@@ -698,6 +836,8 @@ SUITE(key_test)
 		RUN_TESTp(test_rename_no_overwrite, i);
 		RUN_TESTp(test_dbsize, i);
 		RUN_TESTp(test_keys, i);
+		RUN_TESTp(test_key_index, i);
+		RUN_TESTp(test_expire_cycle, i);
 		RUN_TESTp(test_randomkey, i);
 		RUN_TESTp(test_flushdb, i);
 		RUN_TESTp(string_version_test, i);
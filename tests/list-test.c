@@ -294,6 +294,75 @@ TEST fuzzy_list_delete_test(long size, long list_node_size, int _commit)
 	PASS();
 }
 
+TEST fuzzy_list_position_test(long size, long list_node_size, int _commit)
+{
+	rlite *db = NULL;
+	rl_list *list = NULL;
+	rl_list_iterator *iterator;
+	long *elements = malloc(sizeof(long) * size);
+	long i, j, position, *element, *element_copy;
+	int retval;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	db->number_of_databases = 1;
+	db->page_size = sizeof(long) * list_node_size + 12;
+	RL_CALL_VERBOSE(rl_list_create, RL_OK, db, &list, &rl_list_type_long);
+	long list_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_write, RL_OK, db, list->type->list_type, list_page, list);
+
+	for (i = 0; i < size; i++) {
+		position = rand() % (i + 1);
+		memmove(&elements[position + 1], &elements[position], sizeof(long) * (i - position));
+		elements[position] = i;
+		element_copy = malloc(sizeof(long));
+		*element_copy = i;
+		RL_CALL_VERBOSE(rl_list_add_element, RL_OK, db, list, list_page, element_copy, position);
+	}
+	RL_CALL_VERBOSE(rl_list_is_balanced, RL_OK, db, list);
+	if (_commit) {
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+		RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_list_long, list_page, &rl_list_type_long, (void **)&list, 1);
+	}
+
+	for (i = 0; i < size; i++) {
+		RL_CALL_VERBOSE(rl_list_get_element, RL_FOUND, db, list, (void **)&element, i);
+		EXPECT_LONG(*element, elements[i]);
+		RL_CALL_VERBOSE(rl_list_get_element, RL_FOUND, db, list, (void **)&element, i - size);
+		EXPECT_LONG(*element, elements[i]);
+	}
+
+	for (i = 0; i < size; i += 7) {
+		RL_CALL_VERBOSE(rl_list_iterator_create_at, RL_OK, db, &iterator, list, 1, i);
+		for (j = i; j < size; j++) {
+			RL_CALL_VERBOSE(rl_list_iterator_next, RL_OK, iterator, (void **)&element);
+			EXPECT_LONG(*element, elements[j]);
+			rl_free(element);
+		}
+		RL_CALL_VERBOSE(rl_list_iterator_next, RL_END, iterator, NULL);
+
+		RL_CALL_VERBOSE(rl_list_iterator_create_at, RL_OK, db, &iterator, list, -1, i);
+		for (j = i; j >= 0; j--) {
+			RL_CALL_VERBOSE(rl_list_iterator_next, RL_OK, iterator, (void **)&element);
+			EXPECT_LONG(*element, elements[j]);
+			rl_free(element);
+		}
+		RL_CALL_VERBOSE(rl_list_iterator_next, RL_END, iterator, NULL);
+	}
+
+	for (i = 0; i < size; i++) {
+		element_copy = malloc(sizeof(long));
+		*element_copy = elements[i] = size + i;
+		RL_CALL_VERBOSE(rl_list_set_element, RL_OK, db, list, list_page, element_copy, i);
+	}
+	RL_CALL_VERBOSE(rl_list_is_balanced, RL_OK, db, list);
+	for (i = 0; i < size; i++) {
+		RL_CALL_VERBOSE(rl_list_get_element, RL_FOUND, db, list, (void **)&element, i);
+		EXPECT_LONG(*element, elements[i]);
+	}
+	rl_free(elements);
+	rl_close(db);
+	PASS();
+}
+
 #define DELETE_TESTS_COUNT 5
 SUITE(list_test)
 {
@@ -350,4 +419,12 @@ SUITE(list_test)
 			}
 		}
 	}
+
+	for (j = 0; j < 2; j++) {
+		list_node_size = j == 0 ? 2 : 10;
+		for (k = 0; k < 3; k++) {
+			srand(1);
+			RUN_TESTp(fuzzy_list_position_test, 500, list_node_size, k);
+		}
+	}
 }
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include "../src/rlite/rlite.h"
 #include "../src/rlite/page_multi_string.h"
+#include "../src/rlite/page_list.h"
 #include "../src/rlite/util.h"
 #include "util.h"
 
@@ -230,6 +231,51 @@ TEST test_append(long size, long append_size)
 	PASS();
 }
 
+TEST test_append_tail_page()
+{
+	int retval;
+	long size = 5 * 1024 + 10, page, i, length;
+	unsigned char *data = malloc(sizeof(unsigned char) * (size + 1000)), *testdata;
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+
+	for (i = 0; i < size + 1000; i++) {
+		data[i] = i % 123;
+	}
+	RL_CALL_VERBOSE(rl_multi_string_set, RL_OK, db, &page, data, size);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+
+	// a small append only writes the list node holding the length and the last page
+	RL_CALL_VERBOSE(rl_multi_string_append, RL_OK, db, page, &data[size], 10, &length);
+	EXPECT_LONG(length, size + 10);
+	EXPECT_LONG(db->write_pages_len, 2);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+
+	// many small appends fill each page before using the next one
+	for (i = size + 10; i < size + 1000; i += 7) {
+		RL_CALL_VERBOSE(rl_multi_string_append, RL_OK, db, page, &data[i], i + 7 > size + 1000 ? size + 1000 - i : 7, &length);
+	}
+	EXPECT_LONG(length, size + 1000);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	RL_CALL_VERBOSE(rl_multi_string_get, RL_OK, db, page, &testdata, &length);
+	EXPECT_BYTES(data, size + 1000, testdata, length);
+	rl_free(testdata);
+
+	short *pages = calloc(db->number_of_pages, sizeof(short));
+	RL_CALL_VERBOSE(rl_multi_string_pages, RL_OK, db, page, pages);
+	long count = 0;
+	for (i = 0; i < db->number_of_pages; i++) {
+		count += pages[i];
+	}
+	// one list node and as many data pages as needed
+	EXPECT_LONG(count, 1 + (size + 1000 + db->page_size - 1) / db->page_size);
+	free(pages);
+
+	free(data);
+	rl_close(db);
+	PASS();
+}
+
 TEST test_substr(long strsize, long start, long stop, long startindex, long expectedsize)
 {
 	int retval;
@@ -285,6 +331,77 @@ TEST test_setrange(long initialsize, long index, long updatesize)
 	PASS();
 }
 
+static int assert_consecutive_pages(rlite *db, long number)
+{
+	rl_list *list;
+	rl_list_iterator *iterator;
+	void *tmp;
+	long i = 0, page = 0;
+	int retval;
+	RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_list_long, number, &rl_list_type_long, &tmp, 1);
+	list = tmp;
+	RL_CALL_VERBOSE(rl_list_iterator_create, RL_OK, db, &iterator, list, 1);
+	while ((retval = rl_list_iterator_next(iterator, &tmp)) == RL_OK) {
+		// the first element is the length
+		if (i > 1 && *(long *)tmp != page + 1) {
+			fprintf(stderr, "Expected page %ld to follow page %ld\n", *(long *)tmp, page);
+			rl_free(tmp);
+			rl_list_iterator_destroy(db, iterator);
+			return RL_UNEXPECTED;
+		}
+		page = *(long *)tmp;
+		rl_free(tmp);
+		i++;
+	}
+	if (retval != RL_END) {
+		return retval;
+	}
+	return RL_OK;
+}
+
+TEST test_consecutive_pages()
+{
+	int retval;
+	long strsize = 40 * 1024 + 100, page, page2, i, size2;
+	unsigned char *data = malloc(sizeof(unsigned char) * strsize), *data2;
+	unsigned char update[] = "update";
+	long ranges[][2] = {{0, -1}, {0, 1023}, {1, 1024}, {1000, 30000}, {2048, 10239}, {-200, -1}};
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+
+	for (i = 0; i < strsize; i++) {
+		data[i] = i % 123;
+	}
+	RL_CALL_VERBOSE(rl_multi_string_set, RL_OK, db, &page, data, strsize);
+	RL_CALL_VERBOSE(assert_consecutive_pages, RL_OK, db, page);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+
+	// a page changed in the write cache is read from there, the rest from the file
+	RL_CALL_VERBOSE(rl_multi_string_setrange, RL_OK, db, page, update, 6, 5000, NULL);
+	memcpy(&data[5000], update, 6);
+	for (i = 0; i < (long)(sizeof(ranges) / sizeof(ranges[0])); i++) {
+		long start = ranges[i][0], stop = ranges[i][1];
+		rl_normalize_string_range(strsize, &start, &stop);
+		RL_CALL_VERBOSE(rl_multi_string_getrange, RL_OK, db, page, &data2, &size2, ranges[i][0], ranges[i][1]);
+		EXPECT_BYTES(&data[start], stop - start + 1, data2, size2);
+		rl_free(data2);
+	}
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+
+	// the pages of a deleted string are reused in ascending order
+	RL_CALL_VERBOSE(rl_multi_string_delete, RL_OK, db, page);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	RL_CALL_VERBOSE(rl_multi_string_set, RL_OK, db, &page2, data, strsize / 2);
+	RL_CALL_VERBOSE(assert_consecutive_pages, RL_OK, db, page2);
+	RL_CALL_VERBOSE(rl_multi_string_get, RL_OK, db, page2, &data2, &size2);
+	EXPECT_BYTES(data, strsize / 2, data2, size2);
+	rl_free(data2);
+
+	free(data);
+	rl_close(db);
+	PASS();
+}
+
 SUITE(multi_string_test)
 {
 	RUN_TEST(basic_set_get);
@@ -297,6 +414,7 @@ SUITE(multi_string_test)
 	RUN_TESTp(test_append, 10, 1200);
 	RUN_TESTp(test_append, 1200, 10);
 	RUN_TESTp(test_append, 1000, 2000);
+	RUN_TEST(test_append_tail_page);
 	long i, j;
 	for (i = 0; i < 2; i++) {
 		for (j = 0; j < CMP_SIZE / 500; j++) {
@@ -307,6 +425,7 @@ SUITE(multi_string_test)
 	RUN_TESTp(test_substr, 20, 0, 10, 0, 11);
 	RUN_TESTp(test_substr, 2000, 1, -1, 1, 1999);
 	RUN_TESTp(test_substr, 2000, -10, -1, 1990, 10);
+	RUN_TEST(test_consecutive_pages);
 	RUN_TESTp(test_setrange, 10, 5, 3);
 	RUN_TESTp(test_setrange, 10, 5, 20);
 	RUN_TESTp(test_setrange, 10, 20, 5);
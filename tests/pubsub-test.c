@@ -617,6 +617,144 @@ TEST basic_memory_test()
 	FAIL();
 }
 
+#define QUEUE "queue"
+#define QUEUE_SIZE 200
+
+static void* produce_zset(void* UNUSED(arg)) {
+	rlite *db = NULL;
+	char member[20];
+	long i, memberlen;
+	if (setup_db(&db, 1, 0)) {
+		fprintf(stderr, "Failed to open database\n");
+		return NULL;
+	}
+	for (i = 0; i < QUEUE_SIZE; i++) {
+		memberlen = snprintf(member, sizeof(member), "job%ld", i);
+		if (rl_refresh(db) != RL_OK || rl_zadd(db, UNSIGN(QUEUE), strlen(QUEUE), i, UNSIGN(member), memberlen) != RL_OK || rl_commit(db) != RL_OK) {
+			fprintf(stderr, "Failed to produce\n");
+			break;
+		}
+	}
+	rl_close(db);
+	return NULL;
+}
+
+TEST basic_bzpop_producer_consumer()
+{
+	int retval, key_index;
+	unsigned char *key = UNSIGN(QUEUE), *member;
+	long keylen = strlen(QUEUE), memberlen, i;
+	double score;
+	struct timeval timeout;
+	pthread_t thread;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+	pthread_create(&thread, NULL, produce_zset, NULL);
+	for (i = 0; i < QUEUE_SIZE; i++) {
+		timeout.tv_sec = 10;
+		timeout.tv_usec = 0;
+		RL_CALL_VERBOSE(rl_refresh, RL_OK, db);
+		RL_CALL_VERBOSE(rl_bzpop, RL_OK, db, 1, &key, &keylen, 0, &timeout, &key_index, &member, &memberlen, &score);
+		EXPECT_INT(key_index, 0);
+		// jobs are produced in score order, the consumer never skips one
+		EXPECT_DOUBLE(score, i);
+		rl_free(member);
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	}
+	pthread_join(thread, NULL);
+	rl_close(db);
+	PASS();
+}
+
+static void* produce_list(void* UNUSED(arg)) {
+	rlite *db = NULL;
+	char value[20];
+	unsigned char *values[1] = {UNSIGN(value)};
+	long i, valueslen[1];
+	if (setup_db(&db, 1, 0)) {
+		fprintf(stderr, "Failed to open database\n");
+		return NULL;
+	}
+	for (i = 0; i < QUEUE_SIZE; i++) {
+		valueslen[0] = snprintf(value, sizeof(value), "job%ld", i);
+		if (rl_refresh(db) != RL_OK || rl_push(db, UNSIGN(QUEUE), strlen(QUEUE), 1, 0, 1, values, valueslen, NULL) != RL_OK || rl_commit(db) != RL_OK) {
+			fprintf(stderr, "Failed to produce\n");
+			break;
+		}
+	}
+	rl_close(db);
+	return NULL;
+}
+
+TEST basic_blpop_producer_consumer()
+{
+	int retval, key_index;
+	unsigned char *keys[2] = {UNSIGN(CHANNEL), UNSIGN(QUEUE)}, *value;
+	long keyslen[2] = {strlen(CHANNEL), strlen(QUEUE)}, valuelen, i;
+	char expected[20];
+	struct timeval timeout;
+	pthread_t thread;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+	pthread_create(&thread, NULL, produce_list, NULL);
+	for (i = 0; i < QUEUE_SIZE; i++) {
+		timeout.tv_sec = 10;
+		timeout.tv_usec = 0;
+		RL_CALL_VERBOSE(rl_refresh, RL_OK, db);
+		RL_CALL_VERBOSE(rl_bpop, RL_OK, db, 2, keys, keyslen, 1, &timeout, &key_index, &value, &valuelen);
+		EXPECT_INT(key_index, 1);
+		snprintf(expected, sizeof(expected), "job%ld", i);
+		EXPECT_BYTES(value, valuelen, expected, (long)strlen(expected));
+		rl_free(value);
+		RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	}
+	pthread_join(thread, NULL);
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_brpoplpush_timeout()
+{
+	int retval;
+	unsigned char *value;
+	long valuelen, len;
+	struct timeval timeout;
+	unsigned long long start;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 200000;
+	start = rl_mstime();
+	RL_CALL_VERBOSE(rl_brpoplpush, RL_TIMEOUT, db, UNSIGN(QUEUE), strlen(QUEUE), UNSIGN(CHANNEL), strlen(CHANNEL), &timeout, &value, &valuelen);
+	EXPECT_INT(rl_mstime() - start >= 200, 1);
+	RL_CALL_VERBOSE(rl_llen, RL_NOT_FOUND, db, UNSIGN(CHANNEL), strlen(CHANNEL), &len);
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_bzpop_timeout()
+{
+	int retval, key_index;
+	unsigned char *keys[2] = {UNSIGN(QUEUE), UNSIGN(CHANNEL)}, *member;
+	long keyslen[2] = {strlen(QUEUE), strlen(CHANNEL)}, memberlen;
+	double score;
+	struct timeval timeout;
+	unsigned long long start;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 1, 1);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 300000;
+	start = rl_mstime();
+	RL_CALL_VERBOSE(rl_bzpop, RL_TIMEOUT, db, 2, keys, keyslen, 1, &timeout, &key_index, &member, &memberlen, &score);
+	EXPECT_INT(rl_mstime() - start >= 300, 1);
+	rl_close(db);
+	PASS();
+}
+
 SUITE(pubsub_test)
 {
 	RUN_TEST(basic_subscribe_publish);
@@ -636,4 +774,8 @@ SUITE(pubsub_test)
 	RUN_TEST(basic_subscribe_pubsub_numsub);
 	RUN_TEST(basic_subscribe_pubsub_numpat);
 	RUN_TEST(basic_memory_test);
+	RUN_TEST(basic_bzpop_producer_consumer);
+	RUN_TEST(basic_bzpop_timeout);
+	RUN_TEST(basic_blpop_producer_consumer);
+	RUN_TEST(basic_brpoplpush_timeout);
 }
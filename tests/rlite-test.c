@@ -60,6 +60,58 @@ TEST test_has_key()
 	PASS();
 }
 
+TEST test_open_other_format()
+{
+	rlite *db = NULL;
+	int retval;
+	const char *filepath = "rlite-test.rld";
+	if (access(filepath, F_OK) == 0) {
+		unlink(filepath);
+	}
+	RL_CALL_VERBOSE(rl_open, RL_OK, filepath, &db, RLITE_OPEN_CREATE | RLITE_OPEN_READWRITE);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	rl_close(db);
+
+	// a file written with an older page layout
+	FILE *fp = fopen(filepath, "r+");
+	ASSERT(fp != NULL);
+	fwrite("rlite0.0", sizeof(char), 8, fp);
+	fclose(fp);
+
+	db = NULL;
+	RL_CALL_VERBOSE(rl_open, RL_INVALID_STATE, filepath, &db, RLITE_OPEN_CREATE | RLITE_OPEN_READWRITE);
+	EXPECT_PTR(db, NULL);
+	unlink(filepath);
+	PASS();
+}
+
+TEST test_open_too_many_databases()
+{
+	rlite *db = NULL;
+	int retval;
+	const char *filepath = "rlite-test.rld";
+	unsigned char number_of_databases[4] = {0, 0, 0, 100};
+	if (access(filepath, F_OK) == 0) {
+		unlink(filepath);
+	}
+	RL_CALL_VERBOSE(rl_open, RL_OK, filepath, &db, RLITE_OPEN_CREATE | RLITE_OPEN_READWRITE);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+	rl_close(db);
+
+	// the root pages of 100 databases do not fit in the header
+	FILE *fp = fopen(filepath, "r+");
+	ASSERT(fp != NULL);
+	fseek(fp, 20, SEEK_SET);
+	fwrite(number_of_databases, sizeof(unsigned char), 4, fp);
+	fclose(fp);
+
+	db = NULL;
+	RL_CALL_VERBOSE(rl_open, RL_INVALID_STATE, filepath, &db, RLITE_OPEN_CREATE | RLITE_OPEN_READWRITE);
+	EXPECT_PTR(db, NULL);
+	unlink(filepath);
+	PASS();
+}
+
 #ifdef RL_DEBUG
 TEST rl_open_oom()
 {
@@ -91,6 +143,8 @@ SUITE(rlite_test)
 {
 	RUN_TEST(test_rlite_page_cache);
 	RUN_TEST(test_has_key);
+	RUN_TEST(test_open_other_format);
+	RUN_TEST(test_open_too_many_databases);
 #ifdef RL_DEBUG
 	RUN_TEST(rl_open_oom);
 #endif
@@ -101,6 +101,32 @@ TEST test_sismember() {
 	return 0;
 }
 
+TEST test_smismember() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	size_t argvlen[100];
+
+	sadd(context, "myset", "mymember");
+	sadd(context, "myset", "mymember2");
+
+	rliteReply* reply;
+	char* argv[100] = {"smismember", "myset", "mymember2", "not a member", "mymember", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	EXPECT_REPLY_LEN(reply, 3);
+	EXPECT_REPLY_INTEGER(reply->element[0], 1);
+	EXPECT_REPLY_INTEGER(reply->element[1], 0);
+	EXPECT_REPLY_INTEGER(reply->element[2], 1);
+	rliteFreeReplyObject(reply);
+
+	char* argv2[100] = {"smismember", "nokey", "mymember", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	EXPECT_REPLY_LEN(reply, 1);
+	EXPECT_REPLY_INTEGER(reply->element[0], 0);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	return 0;
+}
+
 TEST test_smove() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	size_t argvlen[100];
@@ -147,6 +173,40 @@ TEST test_smove() {
 	return 0;
 }
 
+TEST test_smove_existing() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	size_t argvlen[100];
+
+	sadd(context, "myset", "mymember");
+	sadd(context, "otherset", "mymember");
+
+	rliteReply* reply;
+	{
+		char* argv[100] = {"smove", "myset", "otherset", "mymember", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"exists", "myset", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"smembers", "otherset", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 1);
+		EXPECT_REPLY_STR(reply->element[0], "mymember", 8);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_spop() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	size_t argvlen[100];
@@ -328,6 +388,25 @@ TEST test_srem() {
 	return 0;
 }
 
+struct stream_elements {
+	char data[1024];
+	size_t len;
+	long count;
+	long abort_at;
+};
+
+static int collect_element(void *privdata, const rliteReply *element) {
+	struct stream_elements *elements = privdata;
+	if (elements->count == elements->abort_at) {
+		return RLITE_ERR;
+	}
+	memcpy(elements->data + elements->len, element->str, element->len);
+	elements->len += element->len;
+	elements->data[elements->len++] = ',';
+	elements->count++;
+	return RLITE_OK;
+}
+
 TEST test_smembers() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	size_t argvlen[100];
@@ -355,6 +434,106 @@ TEST test_smembers() {
 	return 0;
 }
 
+TEST test_smembers_stream() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	struct stream_elements elements = {"", 0, 0, -1};
+	size_t argvlen[100];
+	long i;
+
+	sadd(context, "myset", "mymember");
+	sadd(context, "myset", "member2");
+	sadd(context, "myset", "member3");
+
+	rliteReply* reply, *members;
+	{
+		char* argv[100] = {"smembers", "myset", NULL};
+		members = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(members, 3);
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 3);
+		rliteFreeReplyObject(reply);
+	}
+
+	// same members in the same order as the built reply
+	char expected[1024];
+	size_t expectedlen = 0;
+	for (i = 0; i < 3; i++) {
+		memcpy(expected + expectedlen, members->element[i]->str, members->element[i]->len);
+		expectedlen += members->element[i]->len;
+		expected[expectedlen++] = ',';
+	}
+	rliteFreeReplyObject(members);
+	EXPECT_BYTES(elements.data, elements.len, expected, expectedlen);
+
+	elements.len = elements.count = 0;
+	{
+		char* argv[100] = {"smembers", "myset2", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST test_sscan() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	rliteReply* reply;
+	size_t argvlen[100];
+	char member[20], cursor[24] = "0";
+	int i, seen[50];
+
+	for (i = 0; i < 50; i++) {
+		snprintf(member, sizeof(member), "member%d", i);
+		sadd(context, "myset", member);
+		seen[i] = 0;
+	}
+
+	do {
+		char* argv[100] = {"sscan", "myset", cursor, "count", "7", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		for (i = 0; i < (int)reply->element[1]->elements; i++) {
+			seen[atoi(reply->element[1]->element[i]->str + 6)]++;
+		}
+		memcpy(cursor, reply->element[0]->str, reply->element[0]->len);
+		cursor[reply->element[0]->len] = 0;
+		rliteFreeReplyObject(reply);
+	} while (strcmp(cursor, "0") != 0);
+
+	for (i = 0; i < 50; i++) {
+		EXPECT_INT(seen[i], 1);
+	}
+
+	{
+		char* argv[100] = {"sscan", "myset", "0", "match", "member4?", "count", "100", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_LEN(reply->element[1], 10);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sscan", "nokey", "0", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], "0", 1);
+		EXPECT_REPLY_LEN(reply->element[1], 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sscan", "myset", "0", "type", "set", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_sinter() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	size_t argvlen[100];
@@ -409,6 +588,58 @@ TEST test_sinterstore() {
 	return 0;
 }
 
+TEST test_sintercard() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	size_t argvlen[100];
+
+	char *s1 = "myset", *s2 = "myset2";
+	sadd(context, s1, "a");
+	sadd(context, s1, "b");
+	sadd(context, s1, "c");
+	sadd(context, s2, "a");
+	sadd(context, s2, "b");
+	sadd(context, s2, "d");
+
+	rliteReply* reply;
+	{
+		char* argv[100] = {"sintercard", "2", s1, s2, NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 2);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sintercard", "2", s1, s2, "LIMIT", "1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sintercard", "2", s1, "missing", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 0);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sintercard", "3", s1, s2, NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	{
+		char* argv[100] = {"sintercard", "2", s1, s2, "LIMIT", "-1", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	return 0;
+}
+
 TEST test_sunion() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	size_t argvlen[100];
@@ -521,7 +752,9 @@ SUITE(set_test)
 	RUN_TEST(test_sadd);
 	RUN_TEST(test_scard);
 	RUN_TEST(test_sismember);
+	RUN_TEST(test_smismember);
 	RUN_TEST(test_smove);
+	RUN_TEST(test_smove_existing);
 	RUN_TEST(test_spop);
 	RUN_TEST(test_srandmember_nocount);
 	RUN_TEST(test_srandmember_1);
@@ -529,8 +762,11 @@ SUITE(set_test)
 	RUN_TEST(test_srandmember_10_non_unique);
 	RUN_TEST(test_srem);
 	RUN_TEST(test_smembers);
+	RUN_TEST(test_smembers_stream);
+	RUN_TEST(test_sscan);
 	RUN_TEST(test_sinter);
 	RUN_TEST(test_sinterstore);
+	RUN_TEST(test_sintercard);
 	RUN_TEST(test_sunion);
 	RUN_TEST(test_sunionstore);
 	RUN_TEST(test_sdiff);
@@ -17,6 +17,7 @@ extern SUITE(type_set_test);
 extern SUITE(type_zset_test);
 extern SUITE(type_hash_test);
 extern SUITE(skiplist_test);
+extern SUITE(zset_tree_test);
 extern SUITE(long_test);
 extern SUITE(restore_test);
 extern SUITE(hyperloglog_test);
@@ -57,6 +58,7 @@ int main(int argc, char **argv) {
 	RUN_SUITE(type_zset_test);
 	RUN_SUITE(type_hash_test);
 	RUN_SUITE(skiplist_test);
+	RUN_SUITE(zset_tree_test);
 	RUN_SUITE(long_test);
 	RUN_SUITE(restore_test);
 	RUN_SUITE(hyperloglog_test);
@@ -1,9 +1,12 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <limits.h>
 #include <math.h>
 #include "../src/rlite/rlite.h"
 #include "../src/rlite/type_hash.h"
+#include "../src/rlite/page_key.h"
+#include "../src/rlite/dump.h"
 #include "util.h"
 
 #define UNSIGN(str) ((unsigned char *)(str))
@@ -294,7 +297,7 @@ TEST basic_test_hmset_hmget(int _commit)
 	long *dataslen = NULL;
 	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
 
-	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 2, fieldsset, fieldslenset, datasset, dataslenset);
+	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 2, fieldsset, fieldslenset, datasset, dataslenset, NULL);
 	RL_BALANCED();
 
 	RL_CALL_VERBOSE(rl_hmget, RL_OK, db, key, keylen, 3, fields, fieldslen, &datas, &dataslen);
@@ -312,7 +315,7 @@ TEST basic_test_hmset_hmget(int _commit)
 	rl_free(dataslen);
 	dataslen = NULL;
 
-	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 2, fieldsset2, fieldslenset2, datasset, dataslenset);
+	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 2, fieldsset2, fieldslenset2, datasset, dataslenset, NULL);
 	RL_BALANCED();
 
 	RL_CALL_VERBOSE(rl_hmget, RL_OK, db, key, keylen, 3, fields, fieldslen, &datas, &dataslen);
@@ -332,6 +335,61 @@ TEST basic_test_hmset_hmget(int _commit)
 	PASS();
 }
 
+TEST basic_test_hmset_many(int _commit)
+{
+	int retval;
+	long i, added, datalen;
+
+	rlite *db = NULL;
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *fields[1001], *datas[1001], *data;
+	long fieldslen[1001], dataslen[1001];
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	for (i = 0; i < 1000; i++) {
+		fields[i] = malloc(sizeof(unsigned char) * 20);
+		datas[i] = malloc(sizeof(unsigned char) * 20);
+		fieldslen[i] = sprintf((char *)fields[i], "field %ld", i);
+		dataslen[i] = sprintf((char *)datas[i], "data %ld", i);
+	}
+	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 500, fields, fieldslen, datas, dataslen, &added);
+	RL_BALANCED();
+	EXPECT_LONG(added, 500);
+
+	// half of them exist, the last one repeats the first
+	for (i = 250; i < 1000; i++) {
+		dataslen[i] = sprintf((char *)datas[i], "new data %ld", i);
+	}
+	fields[1000] = fields[250];
+	fieldslen[1000] = fieldslen[250];
+	datas[1000] = UNSIGN("last");
+	dataslen[1000] = 4;
+	RL_CALL_VERBOSE(rl_hmset, RL_OK, db, key, keylen, 751, &fields[250], &fieldslen[250], &datas[250], &dataslen[250], &added);
+	RL_BALANCED();
+	EXPECT_LONG(added, 500);
+
+	RL_CALL_VERBOSE(rl_hlen, RL_OK, db, key, keylen, &i);
+	EXPECT_LONG(i, 1000);
+	for (i = 0; i < 1000; i++) {
+		RL_CALL_VERBOSE(rl_hget, RL_FOUND, db, key, keylen, fields[i], fieldslen[i], &data, &datalen);
+		if (i == 250) {
+			EXPECT_STR("last", data, datalen);
+		}
+		else {
+			EXPECT_BYTES(datas[i], dataslen[i], data, datalen);
+		}
+		rl_free(data);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		free(fields[i]);
+		free(datas[i]);
+	}
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_hincrby_hget(int _commit)
 {
 	int retval;
@@ -493,6 +551,78 @@ TEST basic_test_hincrbyfloat_invalid(int _commit)
 	PASS();
 }
 
+TEST basic_test_hincrby_number(int _commit)
+{
+	int retval;
+	long value, added, delcount;
+	double dvalue;
+
+	rlite *db = NULL;
+	unsigned char *key = UNSIGN("my key"), *key2 = UNSIGN("my key2");
+	long keylen = strlen((char *)key), key2len = strlen((char *)key2);
+	unsigned char *field = UNSIGN("my field");
+	long fieldlen = strlen((char *)field);
+	unsigned char *field2 = UNSIGN("my field2");
+	long field2len = strlen((char *)field2);
+	unsigned char *data = NULL, *dump = NULL;
+	long datalen, dumplen;
+	rl_hash_iterator *iterator;
+	unsigned char *f, *m;
+	long fl, ml, i = 0;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	RL_CALL_VERBOSE(rl_hincrby, RL_OK, db, key, keylen, field, fieldlen, 5, &value);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_hincrbyfloat, RL_OK, db, key, keylen, field2, field2len, 1.5, &dvalue);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_hincrby, RL_OK, db, key, keylen, field, fieldlen, 10, &value);
+	RL_BALANCED();
+	EXPECT_LONG(value, 15);
+
+	RL_CALL_VERBOSE(rl_hgetall, RL_OK, db, &iterator, key, keylen);
+	while ((retval = rl_hash_iterator_next(iterator, NULL, &f, &fl, NULL, &m, &ml)) == RL_OK) {
+		if (fl == fieldlen) {
+			EXPECT_BYTES(f, fl, field, fieldlen);
+			EXPECT_STR("15", m, ml);
+		}
+		else {
+			EXPECT_BYTES(f, fl, field2, field2len);
+			EXPECT_STR("1.500000", m, ml);
+		}
+		rl_free(f);
+		rl_free(m);
+		i++;
+	}
+	EXPECT_INT(retval, RL_END);
+	EXPECT_LONG(i, 2);
+
+	RL_CALL_VERBOSE(rl_dump, RL_OK, db, key, keylen, &dump, &dumplen);
+	RL_CALL_VERBOSE(rl_restore, RL_OK, db, key2, key2len, 0, dump, dumplen);
+	RL_BALANCED();
+	rl_free(dump);
+	RL_CALL_VERBOSE(rl_hget, RL_FOUND, db, key2, key2len, field, fieldlen, &data, &datalen);
+	EXPECT_STR("15", data, datalen);
+	rl_free(data);
+
+	RL_CALL_VERBOSE(rl_hset, RL_OK, db, key, keylen, field, fieldlen, UNSIGN("abc"), 3, &added, 1);
+	RL_BALANCED();
+	EXPECT_LONG(added, 0);
+	RL_CALL_VERBOSE(rl_hget, RL_FOUND, db, key, keylen, field, fieldlen, &data, &datalen);
+	EXPECT_STR("abc", data, datalen);
+	rl_free(data);
+	RL_CALL_VERBOSE(rl_hincrby, RL_NAN, db, key, keylen, field, fieldlen, 1, &value);
+
+	RL_CALL_VERBOSE(rl_hdel, RL_OK, db, key, keylen, 1, &field2, &field2len, &delcount);
+	RL_BALANCED();
+	EXPECT_LONG(delcount, 1);
+
+	RL_CALL_VERBOSE(rl_key_delete_with_value, RL_OK, db, key2, key2len);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_hset_del(int _commit)
 {
 	int retval;
@@ -558,11 +688,13 @@ SUITE(type_hash_test)
 		RUN_TEST1(basic_test_hsetnx, i);
 		RUN_TEST1(basic_test_hset_hmget, i);
 		RUN_TEST1(basic_test_hmset_hmget, i);
+		RUN_TEST1(basic_test_hmset_many, i);
 		RUN_TEST1(basic_test_hincrby_hget, i);
 		RUN_TEST1(basic_test_hincrby_invalid, i);
 		RUN_TEST1(basic_test_hincrby_overflow, i);
 		RUN_TEST1(basic_test_hincrbyfloat_hget, i);
 		RUN_TEST1(basic_test_hincrbyfloat_invalid, i);
+		RUN_TEST1(basic_test_hincrby_number, i);
 		RUN_TEST1(basic_test_hset_del, i);
 	}
 	RUN_TEST(hiterator_destroy);
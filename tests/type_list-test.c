@@ -414,6 +414,142 @@ TEST basic_test_ltrim(int _commit)
 	PASS();
 }
 
+TEST basic_test_rpush_inline_pages(int _commit)
+{
+	int retval;
+	rlite *db = NULL;
+	unsigned char *values[100];
+	long valueslen[100], i, size, first_page;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+
+	for (i = 0; i < 100; i++) {
+		values[i] = malloc(sizeof(unsigned char) * 10);
+		memset(values[i], 'a' + i % 26, 10);
+		valueslen[i] = 10;
+	}
+	first_page = db->next_empty_page;
+	RL_CALL_VERBOSE(rl_push, RL_OK, db, key, keylen, 1, 0, 100, values, valueslen, &size);
+	EXPECT_LONG(size, 100);
+	RL_BALANCED();
+	// small values are stored in the list nodes, a few pages hold all of them
+	if (db->next_empty_page - first_page > 10) {
+		FAILm("Expected inline values to share list node pages");
+	}
+	for (i = 0; i < 100; i++) {
+		free(values[i]);
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_push_empty_value(int _commit)
+{
+	int retval;
+	rlite *db = NULL;
+	unsigned char *value = NULL, *data;
+	long valuelen = 0, datalen, size;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+
+	RL_CALL_VERBOSE(rl_push, RL_OK, db, key, keylen, 1, 0, 1, &value, &valuelen, &size);
+	EXPECT_LONG(size, 1);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_lindex, RL_OK, db, key, keylen, 0, &data, &datalen);
+	EXPECT_LONG(datalen, 0);
+	rl_free(data);
+	rl_close(db);
+	PASS();
+}
+
+static unsigned char *fuzzy_value(long id, long *len)
+{
+	unsigned char *value;
+	*len = rand() % 4 == 0 ? 100 + rand() % 400 : 8 + rand() % 20;
+	value = malloc(sizeof(unsigned char) * *len);
+	memset(value, 'a' + id % 26, *len);
+	memcpy(value, &id, sizeof(long));
+	return value;
+}
+
+TEST fuzzy_test_inline_values(int _commit)
+{
+	int retval;
+	rlite *db = NULL;
+	unsigned char *values[600], *value, **range;
+	long valueslen[600], size = 0, i, j, id = 0, len, position, rangesize, *rangelen, list_page, version;
+	unsigned long long expires;
+	unsigned char type;
+	rl_list *list;
+	void *tmp;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+
+	srand(1);
+	for (i = 0; i < 600; i++) {
+		j = rand() % 10;
+		if (size == 0 || j < 5) {
+			value = fuzzy_value(id++, &len);
+			position = rand() % 2 ? 0 : size;
+			RL_CALL_VERBOSE(rl_push, RL_OK, db, key, keylen, 1, position == 0, 1, &value, &len, NULL);
+		}
+		else if (j < 7) {
+			value = fuzzy_value(id++, &len);
+			position = rand() % size;
+			RL_CALL_VERBOSE(rl_linsert, RL_OK, db, key, keylen, 0, values[position], valueslen[position], value, len, NULL);
+		}
+		else if (j < 8) {
+			value = fuzzy_value(id++, &len);
+			position = rand() % size;
+			RL_CALL_VERBOSE(rl_lset, RL_OK, db, key, keylen, position, value, len);
+			free(values[position]);
+			values[position] = value;
+			valueslen[position] = len;
+			value = NULL;
+		}
+		else {
+			position = rand() % 2 ? 0 : size - 1;
+			RL_CALL_VERBOSE(rl_pop, RL_OK, db, key, keylen, &value, &len, position == 0);
+			EXPECT_BYTES(values[position], valueslen[position], value, len);
+			rl_free(value);
+			free(values[position]);
+			memmove(&values[position], &values[position + 1], sizeof(unsigned char *) * (size - position - 1));
+			memmove(&valueslen[position], &valueslen[position + 1], sizeof(long) * (size - position - 1));
+			size--;
+			value = NULL;
+		}
+		if (value) {
+			memmove(&values[position + 1], &values[position], sizeof(unsigned char *) * (size - position));
+			memmove(&valueslen[position + 1], &valueslen[position], sizeof(long) * (size - position));
+			values[position] = value;
+			valueslen[position] = len;
+			size++;
+		}
+		RL_BALANCED();
+		if (size > 0) {
+			RL_CALL_VERBOSE(rl_key_get, RL_FOUND, db, key, keylen, &type, NULL, &list_page, &expires, &version);
+			RL_CALL_VERBOSE(rl_read, RL_FOUND, db, &rl_data_type_list_value, list_page, &rl_list_type_value, &tmp, 1);
+			list = tmp;
+			RL_CALL_VERBOSE(rl_list_is_balanced, RL_OK, db, list);
+		}
+	}
+
+	RL_CALL_VERBOSE(rl_lrange, RL_OK, db, key, keylen, 0, -1, &rangesize, &range, &rangelen);
+	EXPECT_LONG(rangesize, size);
+	for (i = 0; i < size; i++) {
+		EXPECT_BYTES(values[i], valueslen[i], range[i], rangelen[i]);
+		rl_free(range[i]);
+		free(values[i]);
+	}
+	rl_free(range);
+	rl_free(rangelen);
+	rl_close(db);
+	PASS();
+}
+
 SUITE(type_list_test)
 {
 	int i;
@@ -429,5 +565,8 @@ SUITE(type_list_test)
 		RUN_TESTp(basic_test_lrem, i);
 		RUN_TESTp(basic_test_lset, 100, i);
 		RUN_TESTp(basic_test_ltrim, i);
+		RUN_TESTp(basic_test_rpush_inline_pages, i);
+		RUN_TESTp(basic_test_push_empty_value, i);
+		RUN_TESTp(fuzzy_test_inline_values, i);
 	}
 }
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <limits.h>
 #include <math.h>
@@ -37,6 +38,42 @@ TEST basic_test_sadd_sismember(int _commit)
 	PASS();
 }
 
+TEST basic_test_sadd_smismember(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *members[200];
+	long memberslen[200], count, i;
+	int results[200];
+
+	for (i = 0; i < 200; i++) {
+		members[i] = malloc(sizeof(unsigned char) * 20);
+		memberslen[i] = snprintf((char *)members[i], 20, "member %ld", i);
+	}
+	// only even members are added
+	for (i = 0; i < 200; i += 2) {
+		RL_CALL_VERBOSE(rl_sadd, RL_OK, db, key, keylen, 1, &members[i], &memberslen[i], &count);
+	}
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_smismember, RL_OK, db, key, keylen, 200, members, memberslen, results);
+	for (i = 0; i < 200; i++) {
+		EXPECT_INT(results[i], i % 2 == 0);
+	}
+	RL_CALL_VERBOSE(rl_smismember, RL_NOT_FOUND, db, UNSIGN("other key"), 9, 200, members, memberslen, results);
+	for (i = 0; i < 200; i++) {
+		EXPECT_INT(results[i], 0);
+		free(members[i]);
+	}
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_sadd_scard(int _commit)
 {
 	int retval;
@@ -366,10 +403,11 @@ TEST basic_test_sadd_sunion(int _commit)
 	RL_CALL_VERBOSE(rl_sunion, RL_OK, db, 2, keys, keyslen, &datasc, &datasunion, &datasunionlen);
 	EXPECT_LONG(datasc, 4);
 
+	// members come sorted by their sha1, across all sets
 	EXPECT_BYTES(datas[1], dataslen[1], datasunion[0], datasunionlen[0]);
-	EXPECT_BYTES(datas[0], dataslen[0], datasunion[1], datasunionlen[1]);
-	EXPECT_BYTES(datas2[1], datas2len[1], datasunion[2], datasunionlen[2]);
-	EXPECT_BYTES(datas2[0], datas2len[0], datasunion[3], datasunionlen[3]);
+	EXPECT_BYTES(datas2[1], datas2len[1], datasunion[1], datasunionlen[1]);
+	EXPECT_BYTES(datas2[0], datas2len[0], datasunion[2], datasunionlen[2]);
+	EXPECT_BYTES(datas[0], dataslen[0], datasunion[3], datasunionlen[3]);
 
 	for (i = 0; i < datasc; i++) {
 		rl_free(datasunion[i]);
@@ -501,6 +539,16 @@ TEST basic_test_sadd_smove(int _commit)
 	RL_CALL_VERBOSE(rl_smove, RL_NOT_FOUND, db, key, keylen, key2, key2len, data, datalen);
 	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
 
+	// moving a member the destination already has only removes it from the source
+	RL_CALL_VERBOSE(rl_sadd, RL_OK, db, key, keylen, 1, datas, dataslen, NULL);
+	RL_CALL_VERBOSE(rl_smove, RL_OK, db, key, keylen, key2, key2len, data, datalen);
+	RL_BALANCED();
+
+	long card;
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
+	RL_CALL_VERBOSE(rl_scard, RL_OK, db, key2, key2len, &card);
+	EXPECT_LONG(card, 2);
+
 	rl_close(db);
 	PASS();
 }
@@ -545,6 +593,70 @@ TEST basic_test_sadd_smembers(int _commit)
 	PASS();
 }
 
+TEST basic_test_sadd_sscan(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	char data[32];
+	unsigned char *member = UNSIGN(data);
+	long memberlen, i, j, calls = 0, membersc;
+	unsigned char **members;
+	long *memberslen;
+	unsigned long long cursor = 0;
+	int seen[500];
+
+	for (i = 0; i < 500; i++) {
+		memberlen = snprintf(data, sizeof(data), "member%ld", i);
+		RL_CALL_VERBOSE(rl_sadd, RL_OK, db, key, keylen, 1, &member, &memberlen, NULL);
+		seen[i] = 0;
+	}
+	RL_BALANCED();
+
+	do {
+		RL_CALL_VERBOSE(rl_sscan, RL_OK, db, key, keylen, cursor, NULL, 0, 7, &cursor, &membersc, &members, &memberslen);
+		if (cursor != 0) {
+			EXPECT_LONG(membersc, 7);
+		}
+		for (j = 0; j < membersc; j++) {
+			if (memberslen[j] > 6 && memcmp(members[j], "member", 6) == 0) {
+				seen[atol((char *)members[j] + 6)]++;
+			}
+			rl_free(members[j]);
+		}
+		rl_free(members);
+		rl_free(memberslen);
+		calls++;
+		// members added while scanning must not cause others to be repeated
+		if (calls == 10) {
+			memberlen = snprintf(data, sizeof(data), "other");
+			RL_CALL_VERBOSE(rl_sadd, RL_OK, db, key, keylen, 1, &member, &memberlen, NULL);
+		}
+	} while (cursor != 0);
+
+	for (i = 0; i < 500; i++) {
+		EXPECT_INT(seen[i], 1);
+	}
+	if (calls < 500 / 7) {
+		FAILm("Expected the scan to take multiple calls");
+	}
+
+	RL_CALL_VERBOSE(rl_sscan, RL_OK, db, key, keylen, 0, UNSIGN("member1?"), 8, 1000, &cursor, &membersc, &members, &memberslen);
+	EXPECT_LONG(cursor, 0);
+	EXPECT_LONG(membersc, 10);
+	for (j = 0; j < membersc; j++) {
+		rl_free(members[j]);
+	}
+	rl_free(members);
+	rl_free(memberslen);
+
+	rl_close(db);
+	PASS();
+}
+
 static long indexOf(long size, unsigned char **elements, long *elementslen, unsigned char *element, long elementlen)
 {
 	long i;
@@ -668,15 +780,154 @@ TEST fuzzy_test_srandmembers_unique(long size, int _commit)
 	PASS();
 }
 
+static int add_multiples(rlite *db, unsigned char *key, long step)
+{
+	int retval;
+	unsigned char *member;
+	char data[10];
+	long i, datalen;
+	for (i = 0; i < 600; i += step) {
+		datalen = snprintf(data, sizeof(data), "%ld", i);
+		member = UNSIGN(data);
+		RL_CALL(rl_sadd, RL_OK, db, key, strlen((char *)key), 1, &member, &datalen, NULL);
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+static long member_long(unsigned char *member, long memberlen)
+{
+	char data[10];
+	memcpy(data, member, memberlen);
+	data[memberlen] = 0;
+	return strtol(data, NULL, 10);
+}
+
+static void free_members(long membersc, unsigned char **members, long *memberslen)
+{
+	long i;
+	for (i = 0; i < membersc; i++) {
+		rl_free(members[i]);
+	}
+	rl_free(members);
+	rl_free(memberslen);
+}
+
+TEST basic_test_set_merge(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *keys[4] = {UNSIGN("two"), UNSIGN("three"), UNSIGN("five"), UNSIGN("missing")};
+	long keyslen[4] = {3, 5, 4, 7};
+	unsigned char **members;
+	long *memberslen, membersc, card, i;
+
+	RL_CALL_VERBOSE(add_multiples, RL_OK, db, keys[0], 2);
+	RL_CALL_VERBOSE(add_multiples, RL_OK, db, keys[1], 3);
+	RL_CALL_VERBOSE(add_multiples, RL_OK, db, keys[2], 5);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_sinter, RL_OK, db, 3, keys, keyslen, &membersc, &members, &memberslen);
+	EXPECT_LONG(membersc, 20);
+	for (i = 0; i < membersc; i++) {
+		EXPECT_LONG(member_long(members[i], memberslen[i]) % 30, 0);
+	}
+	free_members(membersc, members, memberslen);
+	RL_CALL_VERBOSE(rl_sinter, RL_NOT_FOUND, db, 4, keys, keyslen, &membersc, &members, &memberslen);
+
+	RL_CALL_VERBOSE(rl_sunion, RL_OK, db, 4, keys, keyslen, &membersc, &members, &memberslen);
+	EXPECT_LONG(membersc, 440);
+	free_members(membersc, members, memberslen);
+
+	RL_CALL_VERBOSE(rl_sdiff, RL_OK, db, 4, keys, keyslen, &membersc, &members, &memberslen);
+	EXPECT_LONG(membersc, 160);
+	for (i = 0; i < membersc; i++) {
+		EXPECT_LONG(member_long(members[i], memberslen[i]) % 2, 0);
+		EXPECT_INT(member_long(members[i], memberslen[i]) % 3 != 0, 1);
+		EXPECT_INT(member_long(members[i], memberslen[i]) % 5 != 0, 1);
+	}
+	free_members(membersc, members, memberslen);
+
+	RL_CALL_VERBOSE(rl_sintercard, RL_OK, db, 3, keys, keyslen, 0, &card);
+	EXPECT_LONG(card, 20);
+	RL_CALL_VERBOSE(rl_sintercard, RL_OK, db, 3, keys, keyslen, 5, &card);
+	EXPECT_LONG(card, 5);
+	RL_CALL_VERBOSE(rl_sintercard, RL_OK, db, 4, keys, keyslen, 0, &card);
+	EXPECT_LONG(card, 0);
+
+	// the target can be one of the sources
+	RL_CALL_VERBOSE(rl_sdiffstore, RL_OK, db, keys[1], keyslen[1], 2, &keys[1], &keyslen[1], &card);
+	EXPECT_LONG(card, 160);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_sinterstore, RL_OK, db, keys[0], keyslen[0], 3, keys, keyslen, &card);
+	EXPECT_LONG(card, 0);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, keys[0], keyslen[0], NULL, NULL, NULL, NULL, NULL);
+	RL_CALL_VERBOSE(rl_sunionstore, RL_OK, db, keys[0], keyslen[0], 4, keys, keyslen, &card);
+	EXPECT_LONG(card, 280);
+	RL_CALL_VERBOSE(rl_scard, RL_OK, db, keys[0], keyslen[0], &card);
+	EXPECT_LONG(card, 280);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_set_store(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *members[1000], data[20];
+	long memberslen[1000], added, card, i;
+
+	RL_CALL_VERBOSE(add_multiples, RL_OK, db, key, 7);
+	// every member twice
+	for (i = 0; i < 1000; i++) {
+		memberslen[i] = snprintf((char *)data, sizeof(data), "%ld", i % 500);
+		members[i] = malloc(sizeof(unsigned char) * memberslen[i]);
+		memcpy(members[i], data, memberslen[i]);
+	}
+	RL_CALL_VERBOSE(rl_set_store, RL_OK, db, key, keylen, 1000, members, memberslen, &added);
+	EXPECT_LONG(added, 500);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_scard, RL_OK, db, key, keylen, &card);
+	EXPECT_LONG(card, 500);
+	for (i = 0; i < 500; i++) {
+		RL_CALL_VERBOSE(rl_sismember, RL_FOUND, db, key, keylen, members[i], memberslen[i]);
+	}
+	// the set left behind by add_multiples is gone
+	memberslen[0] = snprintf((char *)data, sizeof(data), "%d", 595);
+	RL_CALL_VERBOSE(rl_sismember, RL_NOT_FOUND, db, key, keylen, data, memberslen[0]);
+	for (i = 0; i < 1000; i++) {
+		free(members[i]);
+	}
+
+	RL_CALL_VERBOSE(rl_set_store, RL_OK, db, key, keylen, 0, NULL, NULL, &added);
+	EXPECT_LONG(added, 0);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
+
+	rl_close(db);
+	PASS();
+}
+
 SUITE(type_set_test)
 {
 	int i;
 	for (i = 0; i < 3; i++) {
 		RUN_TEST1(basic_test_sadd_sismember, i);
+		RUN_TEST1(basic_test_sadd_smismember, i);
 		RUN_TEST1(basic_test_sadd_scard, i);
 		RUN_TEST1(basic_test_sadd_srem, i);
 		RUN_TEST1(basic_test_sadd_smove, i);
 		RUN_TEST1(basic_test_sadd_smembers, i);
+		RUN_TEST1(basic_test_sadd_sscan, i);
 		RUN_TEST1(basic_test_sadd_spop, i);
 		RUN_TEST1(basic_test_sadd_sdiff, i);
 		RUN_TEST1(basic_test_sadd_sdiffstore, i);
@@ -686,6 +937,8 @@ SUITE(type_set_test)
 		RUN_TEST1(basic_test_sadd_sunion, i);
 		RUN_TEST1(basic_test_sadd_sunionstore, i);
 		RUN_TEST1(basic_test_sadd_sunionstore_empty, i);
+		RUN_TEST1(basic_test_set_merge, i);
+		RUN_TEST1(basic_test_set_store, i);
 		RUN_TESTp(fuzzy_test_srandmembers_unique, 10, i);
 		RUN_TESTp(fuzzy_test_srandmembers_unique, 1000, i);
 	}
@@ -4,6 +4,9 @@
 #include <math.h>
 #include "../src/rlite/rlite.h"
 #include "../src/rlite/type_string.h"
+#include "../src/rlite/hyperloglog.h"
+#include "../src/rlite/page_key.h"
+#include "../src/rlite/util.h"
 #include "util.h"
 
 TEST basic_test_set_get(int _commit)
@@ -28,6 +31,106 @@ TEST basic_test_set_get(int _commit)
 	PASS();
 }
 
+typedef struct {
+	long size;
+	long position;
+	long chunk;
+	long fail_at;
+} stream_context;
+
+static int stream_fill(void *_context, unsigned char *data, long size, long *written)
+{
+	stream_context *context = _context;
+	long i;
+	if (context->fail_at >= 0 && context->position >= context->fail_at) {
+		return RL_UNEXPECTED;
+	}
+	if (context->position == context->size) {
+		return RL_END;
+	}
+	if (size > context->chunk) {
+		size = context->chunk;
+	}
+	if (size > context->size - context->position) {
+		size = context->size - context->position;
+	}
+	for (i = 0; i < size; i++) {
+		data[i] = (context->position + i) % 251;
+	}
+	context->position += size;
+	*written = size;
+	return RL_OK;
+}
+
+static int stream_check(void *_context, long offset, unsigned char *data, long size)
+{
+	stream_context *context = _context;
+	long i;
+	if (offset != context->position) {
+		return RL_UNEXPECTED;
+	}
+	for (i = 0; i < size; i++) {
+		if (data[i] != (offset + i) % 251) {
+			return RL_UNEXPECTED;
+		}
+	}
+	context->position += size;
+	context->chunk++;
+	return RL_OK;
+}
+
+TEST basic_test_set_get_stream(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *value = UNSIGN("my value"), *testvalue;
+	long valuelen = strlen((char *)value), testvaluelen;
+	stream_context context = {10000, 0, 333, -1};
+
+	RL_CALL_VERBOSE(rl_set, RL_OK, db, key, keylen, value, valuelen, 0, 0);
+	RL_CALL_VERBOSE(rl_set_stream, RL_FOUND, db, key, keylen, stream_fill, &context, 1, 0);
+	RL_CALL_VERBOSE(rl_set_stream, RL_OK, db, key, keylen, stream_fill, &context, 0, 0);
+	RL_BALANCED();
+	EXPECT_LONG(context.position, 10000);
+
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_LONG(testvaluelen, 10000);
+	rl_free(testvalue);
+
+	context.position = context.chunk = 0;
+	RL_CALL_VERBOSE(rl_get_stream, RL_OK, db, key, keylen, stream_check, &context);
+	EXPECT_LONG(context.position, 10000);
+	EXPECT_LONG(context.chunk, (10000 + db->page_size - 1) / db->page_size);
+
+	// a failing callback leaves the previous value in place
+	context.position = 0;
+	context.chunk = 333;
+	context.fail_at = 3000;
+	RL_CALL_VERBOSE(rl_set_stream, RL_UNEXPECTED, db, key, keylen, stream_fill, &context, 0, 0);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_LONG(testvaluelen, 10000);
+	rl_free(testvalue);
+
+	// an empty value never calls back
+	context.position = context.chunk = 0;
+	context.size = 0;
+	context.fail_at = -1;
+	RL_CALL_VERBOSE(rl_set_stream, RL_OK, db, key, keylen, stream_fill, &context, 0, 0);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_get_stream, RL_OK, db, key, keylen, stream_check, &context);
+	EXPECT_LONG(context.chunk, 0);
+
+	RL_CALL_VERBOSE(rl_get_stream, RL_NOT_FOUND, db, UNSIGN("other"), 5, stream_check, &context);
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_set_delete_get(int _commit)
 {
 	int retval;
@@ -160,6 +263,33 @@ TEST basic_test_append(int _commit)
 	PASS();
 }
 
+TEST basic_test_append_expire(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *value = UNSIGN("my value");
+	long valuelen = strlen((char *)value), testvaluelen;
+	unsigned long long expires = rl_mstime() + 100000, testexpires;
+	long version, testversion;
+
+	RL_CALL_VERBOSE(rl_set, RL_OK, db, key, keylen, value, 2, 0, expires);
+	RL_CALL_VERBOSE(rl_key_get, RL_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, &version);
+	RL_CALL_VERBOSE(rl_append, RL_OK, db, key, keylen, &value[2], valuelen - 2, &testvaluelen);
+	RL_BALANCED();
+	EXPECT_LONG(testvaluelen, valuelen);
+
+	RL_CALL_VERBOSE(rl_key_get, RL_FOUND, db, key, keylen, NULL, NULL, NULL, &testexpires, &testversion);
+	EXPECT_LONG(expires, testexpires);
+	EXPECT_LONG(version + 1, testversion);
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_setnx_setnx_get(int _commit)
 {
 	int retval;
@@ -299,6 +429,134 @@ TEST basic_test_set_incrbyfloat(int _commit)
 	PASS();
 }
 
+TEST basic_test_incr_number(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key"), *key2 = UNSIGN("other key");
+	long keylen = strlen((char *)key), key2len = strlen((char *)key2);
+	unsigned char *testvalue;
+	long testvaluelen, testlen;
+	long long testnewvalue;
+	unsigned long long expires, testexpires;
+	rl_key entry;
+
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key, keylen, 123, &testnewvalue);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_key_get_entry, RL_FOUND, db, key, keylen, &entry);
+	EXPECT_INT(entry.encoding, RL_VALUE_ENCODING_INT);
+	EXPECT_LONG(entry.value_page, 0);
+
+	RL_CALL_VERBOSE(rl_getrange, RL_OK, db, key, keylen, 1, -1, &testvalue, &testvaluelen);
+	EXPECT_STR("23", testvalue, testvaluelen);
+	rl_free(testvalue);
+
+	expires = rl_mstime() + 10000;
+	RL_CALL_VERBOSE(rl_key_expires, RL_OK, db, key, keylen, expires);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_rename, RL_OK, db, key, keylen, key2, key2len, 1);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_key_get_entry, RL_FOUND, db, key2, key2len, &entry);
+	EXPECT_INT(entry.encoding, RL_VALUE_ENCODING_INT);
+	RL_CALL_VERBOSE(rl_key_get, RL_FOUND, db, key2, key2len, NULL, NULL, NULL, &testexpires, NULL);
+	EXPECT_LL(testexpires, expires);
+
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key2, key2len, 1, &testnewvalue);
+	RL_BALANCED();
+	EXPECT_LL(testnewvalue, 124);
+
+	RL_CALL_VERBOSE(rl_append, RL_OK, db, key2, key2len, UNSIGN("5"), 1, &testlen);
+	RL_BALANCED();
+	EXPECT_LONG(testlen, 4);
+	RL_CALL_VERBOSE(rl_key_get_entry, RL_FOUND, db, key2, key2len, &entry);
+	EXPECT_INT(entry.encoding, RL_VALUE_ENCODING_PAGE);
+
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key2, key2len, &testvalue, &testvaluelen);
+	EXPECT_STR("1245", testvalue, testvaluelen);
+	rl_free(testvalue);
+
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key2, key2len, 5, &testnewvalue);
+	RL_BALANCED();
+	EXPECT_LL(testnewvalue, 1250);
+
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key2, key2len, &testvalue, &testvaluelen);
+	EXPECT_STR("1250", testvalue, testvaluelen);
+	rl_free(testvalue);
+
+	RL_CALL_VERBOSE(rl_key_delete_with_value, RL_OK, db, key2, key2len);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_incr_pages(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	long long testnewvalue;
+
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key, keylen, 1, &testnewvalue);
+	RL_CALL_VERBOSE(rl_commit, RL_OK, db);
+
+	// only the key's entry changes, no value pages are allocated
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key, keylen, 1, &testnewvalue);
+	EXPECT_LONG(db->write_pages_len, 1);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_incrbyfloat_number(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *testvalue;
+	long testvaluelen;
+	long long testnewvalue;
+	double testnewdouble;
+	rl_key entry;
+
+	RL_CALL_VERBOSE(rl_incr, RL_OK, db, key, keylen, 10, &testnewvalue);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_incrbyfloat, RL_OK, db, key, keylen, 0.5, &testnewdouble);
+	RL_BALANCED();
+	EXPECT_DOUBLE(testnewdouble, 10.5);
+	RL_CALL_VERBOSE(rl_key_get_entry, RL_FOUND, db, key, keylen, &entry);
+	EXPECT_INT(entry.encoding, RL_VALUE_ENCODING_DOUBLE);
+
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_STR("10.500000", testvalue, testvaluelen);
+	rl_free(testvalue);
+
+	RL_CALL_VERBOSE(rl_incr, RL_NAN, db, key, keylen, 1, &testnewvalue);
+
+	RL_CALL_VERBOSE(rl_setrange, RL_OK, db, key, keylen, 0, UNSIGN("2"), 1, &testvaluelen);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_STR("20.500000", testvalue, testvaluelen);
+	rl_free(testvalue);
+
+	RL_CALL_VERBOSE(rl_incrbyfloat, RL_OK, db, key, keylen, 1, &testnewdouble);
+	RL_BALANCED();
+	EXPECT_DOUBLE(testnewdouble, 21.5);
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_set_getbit(int _commit)
 {
 	int retval;
@@ -433,6 +691,238 @@ TEST basic_test_set_bitpos(int _commit)
 	PASS();
 }
 
+static long naive_bitcount(unsigned char *data, long size)
+{
+	long i, count = 0;
+	for (i = 0; i < size * 8; i++) {
+		count += (data[i / 8] >> (7 - i % 8)) & 1;
+	}
+	return count;
+}
+
+TEST basic_test_popcount()
+{
+	unsigned char data[300];
+	long i, offset, size;
+	for (i = 0; i < 300; i++) {
+		data[i] = (unsigned char)(rand() & 0xff);
+	}
+	// unaligned starts and lengths around the word and vector widths
+	for (offset = 0; offset < 9; offset++) {
+		for (size = 0; size < 300 - offset; size += 7) {
+			EXPECT_LONG((long)rl_redisPopcount(&data[offset], size), naive_bitcount(&data[offset], size));
+		}
+	}
+	PASS();
+}
+
+static long naive_bitpos(unsigned char *data, long size, int bit)
+{
+	long i;
+	for (i = 0; i < size * 8; i++) {
+		if (((data[i / 8] >> (7 - i % 8)) & 1) == bit) {
+			return i;
+		}
+	}
+	return bit ? -1 : size * 8;
+}
+
+TEST basic_test_bitpos()
+{
+	unsigned char data[300];
+	long offset, size, target;
+	int bit;
+	// a single matching bit at every position, with unaligned starts and lengths
+	for (bit = 0; bit < 2; bit++) {
+		for (target = -1; target < 300 * 8; target += 13) {
+			memset(data, bit ? 0 : 0xff, 300);
+			if (target >= 0) {
+				data[target / 8] ^= 1 << (7 - target % 8);
+			}
+			for (offset = 0; offset < 9; offset++) {
+				for (size = 0; size < 300 - offset; size += 31) {
+					EXPECT_LONG(rl_internal_bitpos(&data[offset], size, bit), naive_bitpos(&data[offset], size, bit));
+				}
+			}
+		}
+	}
+	PASS();
+}
+
+#define BITMAP_SIZE 5000
+
+TEST basic_test_bitmap_pages(int _commit)
+{
+	int retval, bitvalue;
+	unsigned char *key = UNSIGN("my key"), *key2 = UNSIGN("other key"), *key3 = UNSIGN("missing key");
+	long keylen = strlen((char *)key), key2len = strlen((char *)key2), key3len = strlen((char *)key3);
+	const unsigned char *keys[3] = {key, key2, key3};
+	long keyslen[3] = {keylen, key2len, key3len};
+	unsigned char value[BITMAP_SIZE], value2[BITMAP_SIZE / 2], *testvalue, *expected;
+	unsigned char *objects[3] = {value, value2, NULL};
+	unsigned long objectslen[3] = {BITMAP_SIZE, BITMAP_SIZE / 2, 0};
+	long i, bitcount, position, testvaluelen, expectedlen;
+	long offsets[5] = {3, 8191, 8192, 20000, BITMAP_SIZE * 8 - 1};
+	int ops[4] = {BITOP_AND, BITOP_OR, BITOP_XOR, BITOP_NOT};
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	for (i = 0; i < BITMAP_SIZE; i++) {
+		value[i] = (unsigned char)(rand() & 0xff);
+	}
+	for (i = 0; i < BITMAP_SIZE / 2; i++) {
+		value2[i] = (unsigned char)(rand() & 0xff);
+	}
+	RL_CALL_VERBOSE(rl_set, RL_OK, db, key, keylen, value, BITMAP_SIZE, 0, 0);
+	RL_CALL_VERBOSE(rl_set, RL_OK, db, key2, key2len, value2, BITMAP_SIZE / 2, 0, 0);
+	RL_COMMIT();
+
+	RL_CALL_VERBOSE(rl_bitcount, RL_OK, db, key, keylen, 0, -1, &bitcount);
+	EXPECT_LONG(bitcount, naive_bitcount(value, BITMAP_SIZE));
+	RL_CALL_VERBOSE(rl_bitcount, RL_OK, db, key, keylen, 1000, 3000, &bitcount);
+	EXPECT_LONG(bitcount, naive_bitcount(&value[1000], 2001));
+	RL_CALL_VERBOSE(rl_bitcount, RL_OK, db, key, keylen, -10, -1, &bitcount);
+	EXPECT_LONG(bitcount, naive_bitcount(&value[BITMAP_SIZE - 10], 10));
+
+	// setbit modifies a single page, bits past the end grow the string
+	for (i = 0; i < 5; i++) {
+		RL_CALL_VERBOSE(rl_setbit, RL_OK, db, key, keylen, offsets[i], 1, &bitvalue);
+		EXPECT_INT(bitvalue, (value[offsets[i] / 8] >> (7 - offsets[i] % 8)) & 1);
+		value[offsets[i] / 8] |= 1 << (7 - offsets[i] % 8);
+		RL_CALL_VERBOSE(rl_getbit, RL_OK, db, key, keylen, offsets[i], &bitvalue);
+		EXPECT_INT(bitvalue, 1);
+	}
+	RL_CALL_VERBOSE(rl_setbit, RL_OK, db, key, keylen, 8192, 0, &bitvalue);
+	EXPECT_INT(bitvalue, 1);
+	value[1024] &= ~(1 << 7);
+	RL_COMMIT();
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_BYTES(testvalue, testvaluelen, value, BITMAP_SIZE);
+	rl_free(testvalue);
+	RL_CALL_VERBOSE(rl_getbit, RL_OK, db, key, keylen, BITMAP_SIZE * 8 + 100, &bitvalue);
+	EXPECT_INT(bitvalue, 0);
+
+	// the first set bit is past the first page
+	memset(value, 0, 1500);
+	RL_CALL_VERBOSE(rl_setrange, RL_OK, db, key, keylen, 0, value, 1500, NULL);
+	RL_CALL_VERBOSE(rl_bitpos, RL_OK, db, key, keylen, 1, 0, -1, 0, &position);
+	EXPECT_LONG(position, rl_internal_bitpos(value, BITMAP_SIZE, 1));
+	RL_CALL_VERBOSE(rl_bitpos, RL_OK, db, key, keylen, 1, 1100, -1, 1, &position);
+	EXPECT_LONG(position, 1100 * 8 + rl_internal_bitpos(&value[1100], BITMAP_SIZE - 1100, 1));
+	memset(value, 0xff, 2100);
+	RL_CALL_VERBOSE(rl_setrange, RL_OK, db, key, keylen, 0, value, 2100, NULL);
+	RL_CALL_VERBOSE(rl_bitpos, RL_OK, db, key, keylen, 0, 0, -1, 0, &position);
+	EXPECT_LONG(position, rl_internal_bitpos(value, BITMAP_SIZE, 0));
+	RL_CALL_VERBOSE(rl_bitpos, RL_OK, db, key, keylen, 0, 0, 2099, 1, &position);
+	EXPECT_LONG(position, -1);
+	RL_CALL_VERBOSE(rl_bitpos, RL_OK, db, key, keylen, 0, 0, 2099, 0, &position);
+	EXPECT_LONG(position, 2100 * 8);
+	RL_COMMIT();
+
+	for (i = 0; i < 4; i++) {
+		rl_internal_bitop(ops[i], ops[i] == BITOP_NOT ? 1 : 3, objects, objectslen, &expected, &expectedlen);
+		// the destination is also the first operand
+		RL_CALL_VERBOSE(rl_set, RL_OK, db, key, keylen, value, BITMAP_SIZE, 0, 0);
+		RL_CALL_VERBOSE(rl_bitop, RL_OK, db, ops[i], key, keylen, ops[i] == BITOP_NOT ? 1 : 3, keys, keyslen);
+		RL_COMMIT();
+		RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+		EXPECT_BYTES(testvalue, testvaluelen, expected, expectedlen);
+		rl_free(testvalue);
+		rl_free(expected);
+	}
+
+	rl_close(db);
+	PASS();
+}
+
+#define BITFIELD_OPS 200
+
+TEST basic_test_bitfield(int _commit)
+{
+	int retval, failed[BITFIELD_OPS];
+	unsigned char *key = UNSIGN("my key"), *testvalue;
+	long keylen = strlen((char *)key), testvaluelen, i, size, expectedsize = 0;
+	unsigned char expected[3000];
+	rl_bitfield_op ops[BITFIELD_OPS];
+	long long results[BITFIELD_OPS];
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	memset(expected, 0, sizeof(expected));
+	for (i = 0; i < BITFIELD_OPS; i++) {
+		ops[i].opcode = rand() % 3;
+		ops[i].sign = rand() % 2;
+		ops[i].bits = 1 + rand() % (ops[i].sign ? 64 : 63);
+		// fields cluster around the page boundaries
+		ops[i].offset = (1 + rand() % 2) * db->page_size * 8 - rand() % 80;
+		ops[i].value = ((long long)rand() << 32) ^ rand();
+		if (rand() % 2) {
+			ops[i].value = -ops[i].value;
+		}
+		ops[i].overflow = rand() % 3;
+	}
+	RL_CALL_VERBOSE(rl_bitfield, RL_OK, db, key, keylen, BITFIELD_OPS, ops, results, failed);
+	RL_COMMIT();
+
+	for (i = 0; i < BITFIELD_OPS; i++) {
+		rl_bitfield_op *op = &ops[i];
+		int overflow = 0;
+		long long result;
+		if (op->opcode != RL_BITFIELD_GET) {
+			size = ((op->offset + op->bits - 1) >> 3) + 1;
+			if (size > expectedsize) {
+				expectedsize = size;
+			}
+		}
+		if (op->sign) {
+			int64_t oldval = rl_getSignedBitfield(expected, op->offset, op->bits), newval, wrapped;
+			result = oldval;
+			if (op->opcode == RL_BITFIELD_INCRBY) {
+				overflow = rl_checkSignedBitfieldOverflow(oldval, op->value, op->bits, op->overflow, &wrapped);
+				newval = overflow ? wrapped : (int64_t)((uint64_t)oldval + (uint64_t)op->value);
+				result = newval;
+			} else if (op->opcode == RL_BITFIELD_SET) {
+				overflow = rl_checkSignedBitfieldOverflow(op->value, 0, op->bits, op->overflow, &wrapped);
+				newval = overflow ? wrapped : op->value;
+			}
+			if (op->opcode != RL_BITFIELD_GET && !(overflow && op->overflow == BFOVERFLOW_FAIL)) {
+				rl_setSignedBitfield(expected, op->offset, op->bits, newval);
+			}
+		} else {
+			uint64_t oldval = rl_getUnsignedBitfield(expected, op->offset, op->bits), newval, wrapped;
+			result = oldval;
+			if (op->opcode == RL_BITFIELD_INCRBY) {
+				overflow = rl_checkUnsignedBitfieldOverflow(oldval, op->value, op->bits, op->overflow, &wrapped);
+				newval = overflow ? wrapped : oldval + op->value;
+				result = newval;
+			} else if (op->opcode == RL_BITFIELD_SET) {
+				overflow = rl_checkUnsignedBitfieldOverflow(op->value, 0, op->bits, op->overflow, &wrapped);
+				newval = overflow ? wrapped : (uint64_t)op->value;
+			}
+			if (op->opcode != RL_BITFIELD_GET && !(overflow && op->overflow == BFOVERFLOW_FAIL)) {
+				rl_setUnsignedBitfield(expected, op->offset, op->bits, newval);
+			}
+		}
+		if (overflow && op->overflow == BFOVERFLOW_FAIL && op->opcode != RL_BITFIELD_GET) {
+			EXPECT_INT(failed[i], 1);
+		} else {
+			EXPECT_INT(failed[i], 0);
+			EXPECT_LONG(results[i], result);
+		}
+	}
+
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &testvalue, &testvaluelen);
+	EXPECT_BYTES(testvalue, testvaluelen, expected, expectedsize);
+	rl_free(testvalue);
+
+	ops[0].bits = 64;
+	ops[0].sign = 0;
+	RL_CALL_VERBOSE(rl_bitfield, RL_INVALID_PARAMETERS, db, key, keylen, 1, ops, results, failed);
+
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_pfadd(int _commit)
 {
 	int retval;
@@ -668,6 +1158,60 @@ TEST basic_test_pfadd_pfdebug_todense(int _commit)
 	PASS();
 }
 
+TEST basic_test_pfadd_dense(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char *value = NULL, *tmp;
+	long valuelen, count, count2, i, j;
+	unsigned char *hll = NULL;
+	long hlllen;
+	char element[5][32];
+	unsigned char *elements[5];
+	long elementslen[5];
+	int changed, updated, updated2;
+
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	elements[0] = UNSIGN("1");
+	elementslen[0] = 1;
+	RL_CALL_VERBOSE(rl_pfadd, RL_OK, db, key, keylen, 1, elements, elementslen, NULL);
+	RL_CALL_VERBOSE(rl_pfdebug_todense, RL_OK, db, key, keylen, &changed);
+	EXPECT_LONG(changed, 1);
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &hll, &hlllen);
+
+	// adds to the dense value in place must match adding to the whole value
+	for (i = 0; i < 1000; i++) {
+		for (j = 0; j < 5; j++) {
+			elements[j] = UNSIGN(element[j]);
+			elementslen[j] = snprintf(element[j], sizeof(element[j]), "element %ld", (i * 5 + j) % 3000);
+		}
+		RL_CALL_VERBOSE(rl_pfadd, RL_OK, db, key, keylen, 5, elements, elementslen, &updated);
+		RL_BALANCED();
+		updated2 = rl_str_pfadd(hll, hlllen, 5, elements, elementslen, &tmp, &hlllen);
+		hll = tmp;
+		EXPECT_LONG(updated, updated2);
+		if (i % 100 == 0) {
+			RL_CALL_VERBOSE(rl_pfcount, RL_OK, db, 1, (const unsigned char **)&key, &keylen, &count);
+			RL_CALL_VERBOSE(rl_str_pfcount, 0, 1, &hll, &hlllen, &count2, NULL, NULL);
+			EXPECT_LONG(count, count2);
+			RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &value, &valuelen);
+			EXPECT_BYTES(hll, hlllen, value, valuelen);
+			rl_free(value);
+		}
+	}
+	RL_CALL_VERBOSE(rl_get, RL_OK, db, key, keylen, &value, &valuelen);
+	EXPECT_BYTES(hll, hlllen, value, valuelen);
+	rl_free(value);
+
+	rl_free(hll);
+	rl_close(db);
+	PASS();
+}
+
 TEST basic_test_pfadd_empty(int _commit)
 {
 	int retval;
@@ -692,22 +1236,31 @@ TEST basic_test_pfadd_empty(int _commit)
 SUITE(type_string_test)
 {
 	int i;
+	RUN_TEST(basic_test_popcount);
+	RUN_TEST(basic_test_bitpos);
 	for (i = 0; i < 3; i++) {
 		RUN_TEST1(basic_test_set_get, i);
+		RUN_TEST1(basic_test_set_get_stream, i);
 		RUN_TEST1(basic_test_set_delete_get, i);
 		RUN_TEST1(basic_test_set_set_get, i);
 		RUN_TEST1(basic_test_set_getrange, i);
 		RUN_TEST1(basic_test_set_setrange, i);
 		RUN_TEST1(basic_test_append, i);
+		RUN_TEST1(basic_test_append_expire, i);
 		RUN_TEST1(basic_test_setnx_setnx_get, i);
 		RUN_TEST1(basic_test_set_expiration, i);
 		RUN_TEST1(basic_test_set_strlen, i);
 		RUN_TEST1(basic_test_set_incr, i);
 		RUN_TEST1(basic_test_set_incrbyfloat, i);
+		RUN_TEST1(basic_test_incr_number, i);
+		RUN_TEST1(basic_test_incr_pages, i);
+		RUN_TEST1(basic_test_incrbyfloat_number, i);
 		RUN_TEST1(basic_test_set_getbit, i);
 		RUN_TEST1(basic_test_set_bitop, i);
 		RUN_TEST1(basic_test_set_bitcount, i);
 		RUN_TEST1(basic_test_set_bitpos, i);
+		RUN_TEST1(basic_test_bitmap_pages, i);
+		RUN_TEST1(basic_test_bitfield, i);
 		RUN_TEST1(basic_test_pfadd, i);
 		RUN_TEST1(basic_test_pfadd_pfcount, i);
 		RUN_TEST1(basic_test_pfadd_pfmerge, i);
@@ -715,6 +1268,7 @@ SUITE(type_string_test)
 		RUN_TEST1(basic_test_pfadd_pfdebug_decode, i);
 		RUN_TEST1(basic_test_pfadd_pfdebug_encoding, i);
 		RUN_TEST1(basic_test_pfadd_pfdebug_todense, i);
+		RUN_TEST1(basic_test_pfadd_dense, i);
 		RUN_TEST1(basic_test_pfadd_empty, i);
 	}
 }
@@ -926,6 +926,10 @@ TEST basic_test_zadd_zremrangebylex(int _commit)
 	run_test_zrangebylex('-', 0, 1, '+', 0, 0, 1, 1, ZRANGEBYLEX_SIZE - 1, ZRANGEBYLEX_SIZE, 0, -1)
 	run_remrangebylex("(a", "[b", 2);
 	run_test_zrangebylex('-', 0, 1, '+', 0, 0, 1, 3, ZRANGEBYLEX_SIZE - 3, ZRANGEBYLEX_SIZE, 0, -1)
+	// ranges above every member
+	run_remrangebylex("(jZ", "+", 0);
+	run_remrangebylex("[x", "[z", 0);
+	run_test_zrangebylex('-', 0, 1, '+', 0, 0, 1, 3, ZRANGEBYLEX_SIZE - 3, ZRANGEBYLEX_SIZE, 0, -1)
 
 	rl_close(db);
 	PASS();
@@ -981,6 +985,390 @@ TEST regression_zrangebyscore(int _commit)
 	PASS();
 }
 
+static long zmember_long(unsigned char *member, long memberlen)
+{
+	char data[20];
+	memcpy(data, member, memberlen);
+	data[memberlen] = 0;
+	return strtol(data, NULL, 10);
+}
+
+static void free_zmembers(long size, unsigned char **members, long *memberslen, double *scores)
+{
+	long i;
+	for (i = 0; i < size; i++) {
+		rl_free(members[i]);
+	}
+	rl_free(members);
+	rl_free(memberslen);
+	rl_free(scores);
+}
+
+TEST basic_test_zaggregate(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *keys[5] = {UNSIGN("target"), UNSIGN("all"), UNSIGN("three"), UNSIGN("five"), UNSIGN("missing")};
+	long keys_len[5] = {6, 3, 5, 4, 7};
+	unsigned char *store_keys[3] = {keys[0], keys[0], NULL};
+	long store_keys_len[3] = {6, 6, 0};
+	unsigned char data[20], **members, *member = data;
+	long datalen, i, size, *memberslen, card;
+	double *scores, weights[3] = {1, 10, 100}, score;
+
+	// "all" is large enough to be a tree, "five" is a set
+	for (i = 0; i < 300; i++) {
+		datalen = snprintf((char *)data, sizeof(data), "%ld", i);
+		RL_CALL_VERBOSE(rl_zadd, RL_OK, db, keys[1], keys_len[1], i, data, datalen);
+		if (i % 3 == 0) {
+			RL_CALL_VERBOSE(rl_zadd, RL_OK, db, keys[2], keys_len[2], 1, data, datalen);
+		}
+		if (i % 5 == 0) {
+			RL_CALL_VERBOSE(rl_sadd, RL_OK, db, keys[3], keys_len[3], 1, &member, &datalen, NULL);
+		}
+	}
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_zinter, RL_OK, db, 3, &keys[1], &keys_len[1], NULL, RL_ZSET_AGGREGATE_SUM, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 20);
+	for (i = 0; i < size; i++) {
+		EXPECT_LONG(zmember_long(members[i], memberslen[i]), i * 15);
+		EXPECT_DOUBLE(scores[i], i * 15 + 2);
+	}
+	free_zmembers(size, members, memberslen, scores);
+
+	RL_CALL_VERBOSE(rl_zunion, RL_OK, db, 4, &keys[1], &keys_len[1], weights, RL_ZSET_AGGREGATE_MAX, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 300);
+	for (i = 1; i < size; i++) {
+		EXPECT_INT(scores[i - 1] <= scores[i], 1);
+	}
+	for (i = 0; i < size; i++) {
+		if (zmember_long(members[i], memberslen[i]) % 5 == 0) {
+			EXPECT_INT(scores[i] >= 100, 1);
+		}
+	}
+	free_zmembers(size, members, memberslen, scores);
+
+	RL_CALL_VERBOSE(rl_zdiff, RL_OK, db, 4, &keys[1], &keys_len[1], &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 160);
+	for (i = 0; i < size; i++) {
+		EXPECT_INT(zmember_long(members[i], memberslen[i]) % 3 != 0, 1);
+		EXPECT_INT(zmember_long(members[i], memberslen[i]) % 5 != 0, 1);
+		EXPECT_DOUBLE(scores[i], zmember_long(members[i], memberslen[i]));
+	}
+	free_zmembers(size, members, memberslen, scores);
+
+	RL_CALL_VERBOSE(rl_zinter, RL_OK, db, 4, &keys[1], &keys_len[1], NULL, RL_ZSET_AGGREGATE_SUM, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 0);
+
+	// large enough for a tree
+	RL_CALL_VERBOSE(rl_zunionstore, RL_OK, db, 3, keys, keys_len, NULL, RL_ZSET_AGGREGATE_SUM);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, keys[0], keys_len[0], &card);
+	EXPECT_LONG(card, 300);
+	datalen = snprintf((char *)data, sizeof(data), "%d", 42);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, keys[0], keys_len[0], data, datalen, &score);
+	EXPECT_DOUBLE(score, 43);
+
+	// the target can be one of the inputs, small enough for a packed page
+	store_keys[2] = keys[2];
+	store_keys_len[2] = keys_len[2];
+	RL_CALL_VERBOSE(rl_zinterstore, RL_OK, db, 3, store_keys, store_keys_len, NULL, RL_ZSET_AGGREGATE_MIN);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, keys[0], keys_len[0], &card);
+	EXPECT_LONG(card, 100);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, keys[0], keys_len[0], data, datalen, &score);
+	EXPECT_DOUBLE(score, 1);
+
+	// an empty result deletes the target
+	store_keys[2] = keys[1];
+	store_keys_len[2] = keys_len[1];
+	RL_CALL_VERBOSE(rl_zdiffstore, RL_OK, db, 3, store_keys, store_keys_len);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, keys[0], keys_len[0], NULL, NULL, NULL, NULL, NULL);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_zadd_multi(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("key"), *other = UNSIGN("other");
+	long keylen = 3, otherlen = 5;
+	unsigned char data[200][20], *members[200], *missing = UNSIGN("missing");
+	long memberslen[200], i, changed, card, missinglen = 7;
+	double scores[200], score;
+
+	for (i = 0; i < 200; i++) {
+		memberslen[i] = snprintf((char *)data[i], sizeof(data[i]), "%ld", i % 150);
+		members[i] = data[i];
+		scores[i] = 200 - i;
+	}
+
+	// a missing key with XX is left alone
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_XX, 10, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 0);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
+
+	// the last score wins on repeated members
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, 0, 200, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 150);
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, key, keylen, &card);
+	EXPECT_LONG(card, 150);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, key, keylen, members[0], memberslen[0], &score);
+	EXPECT_DOUBLE(score, 50);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, key, keylen, members[100], memberslen[100], &score);
+	EXPECT_DOUBLE(score, 100);
+	RL_BALANCED();
+
+	// NX only adds new members
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, other, otherlen, RL_ZADD_NX, 3, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 3);
+	for (i = 0; i < 5; i++) {
+		scores[i] = -1;
+	}
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, other, otherlen, RL_ZADD_NX | RL_ZADD_CH, 5, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 2);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, other, otherlen, members[0], memberslen[0], &score);
+	EXPECT_DOUBLE(score, 200);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, other, otherlen, members[4], memberslen[4], &score);
+	EXPECT_DOUBLE(score, -1);
+
+	// GT and LT only move the scores in one direction, CH counts them
+	for (i = 0; i < 150; i++) {
+		scores[i] = i % 2 ? 1000 : -1000;
+	}
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_GT | RL_ZADD_CH, 150, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 75);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_LT | RL_ZADD_XX, 150, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 0);
+	for (i = 0; i < 150; i++) {
+		RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, key, keylen, members[i], memberslen[i], &score);
+		EXPECT_DOUBLE(score, i % 2 ? 1000 : -1000);
+	}
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, key, keylen, &card);
+	EXPECT_LONG(card, 150);
+	RL_BALANCED();
+
+	// INCR
+	score = 5;
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_INCR, 1, &score, members, memberslen, NULL, &score);
+	EXPECT_DOUBLE(score, -995);
+	score = 5;
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_NOT_FOUND, db, key, keylen, RL_ZADD_INCR | RL_ZADD_LT, 1, &score, members, memberslen, NULL, &score);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_NOT_FOUND, db, key, keylen, RL_ZADD_INCR | RL_ZADD_NX, 1, &score, members, memberslen, NULL, &score);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_NOT_FOUND, db, key, keylen, RL_ZADD_INCR | RL_ZADD_XX, 1, &score, &missing, &missinglen, NULL, &score);
+	score = 7;
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_INCR | RL_ZADD_GT, 1, &score, &missing, &missinglen, NULL, &score);
+	EXPECT_DOUBLE(score, 7);
+
+	// CH counts the repeated members once per score that changed them
+	for (i = 0; i < 3; i++) {
+		members[i] = data[1];
+		memberslen[i] = 1;
+	}
+	scores[0] = 1000;
+	scores[1] = 1001;
+	scores[2] = 999;
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_GT | RL_ZADD_CH, 3, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 1);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_OK, db, key, keylen, RL_ZADD_CH, 3, scores, members, memberslen, &changed, NULL);
+	EXPECT_LONG(changed, 3);
+	RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, key, keylen, data[1], 1, &score);
+	EXPECT_DOUBLE(score, 999);
+	RL_BALANCED();
+
+	// invalid combinations
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_INVALID_PARAMETERS, db, key, keylen, RL_ZADD_NX | RL_ZADD_XX, 1, scores, members, memberslen, NULL, NULL);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_INVALID_PARAMETERS, db, key, keylen, RL_ZADD_GT | RL_ZADD_LT, 1, scores, members, memberslen, NULL, NULL);
+	RL_CALL_VERBOSE(rl_zadd_multi, RL_INVALID_PARAMETERS, db, key, keylen, RL_ZADD_INCR, 2, scores, members, memberslen, NULL, NULL);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_zpop(int _commit, long card)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+	unsigned char *key = UNSIGN("key"), data[20], **members;
+	long keylen = 3, datalen, i, size, *memberslen, left;
+	double *scores;
+
+	for (i = 0; i < card; i++) {
+		datalen = snprintf((char *)data, sizeof(data), "%ld", i);
+		RL_CALL_VERBOSE(rl_zadd, RL_OK, db, key, keylen, i, data, datalen);
+	}
+
+	RL_CALL_VERBOSE(rl_zpop, RL_OK, db, key, keylen, 3, 0, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 3);
+	for (i = 0; i < size; i++) {
+		EXPECT_LONG(zmember_long(members[i], memberslen[i]), i);
+		EXPECT_DOUBLE(scores[i], i);
+	}
+	free_zmembers(size, members, memberslen, scores);
+
+	RL_CALL_VERBOSE(rl_zpop, RL_OK, db, key, keylen, 2, 1, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, 2);
+	for (i = 0; i < size; i++) {
+		EXPECT_LONG(zmember_long(members[i], memberslen[i]), card - 1 - i);
+		EXPECT_DOUBLE(scores[i], card - 1 - i);
+	}
+	free_zmembers(size, members, memberslen, scores);
+	RL_BALANCED();
+
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, key, keylen, &left);
+	EXPECT_LONG(left, card - 5);
+
+	// asking for more than there is empties the key
+	RL_CALL_VERBOSE(rl_zpop, RL_OK, db, key, keylen, card, 0, &size, &members, &memberslen, &scores);
+	EXPECT_LONG(size, card - 5);
+	for (i = 0; i < size; i++) {
+		EXPECT_LONG(zmember_long(members[i], memberslen[i]), i + 3);
+	}
+	free_zmembers(size, members, memberslen, scores);
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
+	RL_CALL_VERBOSE(rl_zpop, RL_NOT_FOUND, db, key, keylen, 1, 0, &size, &members, &memberslen, &scores);
+	RL_CALL_VERBOSE(rl_zpop, RL_INVALID_PARAMETERS, db, key, keylen, 0, 0, &size, &members, &memberslen, &scores);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_zadd_convert(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char data[4];
+	long i, rank, card, count, size = RL_ZSET_PACKED_MAX_ENTRIES + 10;
+	int encoding, converted = 0;
+	double score;
+	rl_zrangespec range;
+	rl_zset_iterator *iterator;
+
+	for (i = 0; i < size; i++) {
+		// insert in reverse order to exercise sorted inserts in both encodings
+		data[0] = 'a' + (size - i - 1) / 26 / 26;
+		data[1] = 'a' + ((size - i - 1) / 26) % 26;
+		data[2] = 'a' + (size - i - 1) % 26;
+		RL_CALL_VERBOSE(rl_zadd, RL_OK, db, key, keylen, (double)(size - i - 1), data, 3);
+		RL_BALANCED();
+		RL_CALL_VERBOSE(rl_zset_encoding, RL_OK, db, key, keylen, &encoding);
+		if (i == 0) {
+			EXPECT_INT(encoding, RL_ZSET_ENCODING_PACKED);
+		}
+		// once converted, a sorted set never goes back to the packed encoding
+		if (converted) {
+			EXPECT_INT(encoding, RL_ZSET_ENCODING_TREE);
+		}
+		converted = encoding == RL_ZSET_ENCODING_TREE;
+	}
+	EXPECT_INT(converted, 1);
+
+	RL_CALL_VERBOSE(rl_zcard, RL_OK, db, key, keylen, &card);
+	EXPECT_LONG(card, size);
+
+	for (i = 0; i < size; i++) {
+		data[0] = 'a' + i / 26 / 26;
+		data[1] = 'a' + (i / 26) % 26;
+		data[2] = 'a' + i % 26;
+		RL_CALL_VERBOSE(rl_zrank, RL_FOUND, db, key, keylen, data, 3, &rank);
+		EXPECT_LONG(rank, i);
+		RL_CALL_VERBOSE(rl_zscore, RL_FOUND, db, key, keylen, data, 3, &score);
+		EXPECT_DOUBLE(score, (double)i);
+	}
+
+	range.min = 10;
+	range.minex = 1;
+	range.max = 20;
+	range.maxex = 0;
+	RL_CALL_VERBOSE(rl_zcount, RL_OK, db, key, keylen, &range, &count);
+	EXPECT_LONG(count, 10);
+	RL_CALL_VERBOSE(rl_zrangebyscore, RL_OK, db, key, keylen, &range, 0, -1, &iterator);
+	for (i = 11; i <= 20; i++) {
+		RL_CALL_VERBOSE(rl_zset_iterator_next, RL_OK, iterator, NULL, &score, NULL, NULL);
+		EXPECT_DOUBLE(score, (double)i);
+	}
+	RL_CALL_VERBOSE(rl_zset_iterator_next, RL_END, iterator, NULL, NULL, NULL, NULL);
+
+	RL_CALL_VERBOSE(rl_zremrangebyrank, RL_OK, db, key, keylen, 0, -1, &count);
+	EXPECT_LONG(count, size);
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_key_get, RL_NOT_FOUND, db, key, keylen, NULL, NULL, NULL, NULL, NULL);
+
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_test_zadd_convert_long_member(int _commit)
+{
+	int retval;
+
+	rlite *db = NULL;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, _commit, 1);
+
+	unsigned char *key = UNSIGN("my key");
+	long keylen = strlen((char *)key);
+	unsigned char data[RL_ZSET_PACKED_MAX_MEMBER + 1];
+	unsigned char *member;
+	long memberlen, rank;
+	int encoding;
+	double score;
+	rl_zset_iterator *iterator;
+
+	RL_CALL_VERBOSE(rl_zadd, RL_OK, db, key, keylen, 1.0, UNSIGN("a"), 1);
+	RL_CALL_VERBOSE(rl_zadd, RL_OK, db, key, keylen, 3.0, UNSIGN("c"), 1);
+	RL_CALL_VERBOSE(rl_zset_encoding, RL_OK, db, key, keylen, &encoding);
+	EXPECT_INT(encoding, RL_ZSET_ENCODING_PACKED);
+
+	memset(data, 'b', sizeof(data));
+	RL_CALL_VERBOSE(rl_zadd, RL_OK, db, key, keylen, 2.0, data, sizeof(data));
+	RL_BALANCED();
+	RL_CALL_VERBOSE(rl_zset_encoding, RL_OK, db, key, keylen, &encoding);
+	EXPECT_INT(encoding, RL_ZSET_ENCODING_TREE);
+
+	RL_CALL_VERBOSE(rl_zrank, RL_FOUND, db, key, keylen, data, sizeof(data), &rank);
+	EXPECT_LONG(rank, 1);
+	RL_CALL_VERBOSE(rl_zrank, RL_FOUND, db, key, keylen, UNSIGN("c"), 1, &rank);
+	EXPECT_LONG(rank, 2);
+
+	RL_CALL_VERBOSE(rl_zrevrange, RL_OK, db, key, keylen, 0, -1, &iterator);
+	RL_CALL_VERBOSE(rl_zset_iterator_next, RL_OK, iterator, NULL, &score, &member, &memberlen);
+	EXPECT_DOUBLE(score, 3.0);
+	EXPECT_BYTES(member, memberlen, "c", 1);
+	rl_free(member);
+	RL_CALL_VERBOSE(rl_zset_iterator_next, RL_OK, iterator, NULL, &score, &member, &memberlen);
+	EXPECT_DOUBLE(score, 2.0);
+	EXPECT_BYTES(member, memberlen, data, (long)sizeof(data));
+	rl_free(member);
+	RL_CALL_VERBOSE(rl_zset_iterator_next, RL_OK, iterator, NULL, &score, &member, &memberlen);
+	EXPECT_DOUBLE(score, 1.0);
+	EXPECT_BYTES(member, memberlen, "a", 1);
+	rl_free(member);
+	RL_CALL_VERBOSE(rl_zset_iterator_next, RL_END, iterator, NULL, NULL, NULL, NULL);
+
+	RL_CALL_VERBOSE(rl_key_delete_with_value, RL_OK, db, key, keylen);
+	RL_BALANCED();
+
+	rl_close(db);
+	PASS();
+}
+
 #define SADD_ZINTERSTORE_TESTS 4
 #define ZINTERSTORE_TESTS 7
 SUITE(type_zset_test)
@@ -1018,6 +1406,12 @@ SUITE(type_zset_test)
 		RUN_TESTp(basic_test_zadd_dupe, i);
 		RUN_TESTp(basic_test_zincrnan, i);
 		RUN_TESTp(regression_zrangebyscore, i);
+		RUN_TESTp(basic_test_zadd_convert, i);
+		RUN_TESTp(basic_test_zaggregate, i);
+		RUN_TESTp(basic_test_zadd_multi, i);
+		RUN_TESTp(basic_test_zpop, i, 10);
+		RUN_TESTp(basic_test_zpop, i, 300);
+		RUN_TESTp(basic_test_zadd_convert_long_member, i);
 		for (j = 0; j < ZINTERSTORE_TESTS; j++) {
 			RUN_TESTp(basic_test_zadd_zinterstore, i, zinterunionstore_tests[j]);
 			RUN_TESTp(basic_test_zadd_zunionstore, i, zinterunionstore_tests[j]);
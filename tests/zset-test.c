@@ -21,6 +21,25 @@ TEST test_zadd() {
 	PASS();
 }
 
+struct stream_elements {
+	char data[1024];
+	size_t len;
+	long count;
+	long abort_at;
+};
+
+static int collect_element(void *privdata, const rliteReply *element) {
+	struct stream_elements *elements = privdata;
+	if (elements->count == elements->abort_at) {
+		return RLITE_ERR;
+	}
+	memcpy(elements->data + elements->len, element->str, element->len);
+	elements->len += element->len;
+	elements->data[elements->len++] = ',';
+	elements->count++;
+	return RLITE_OK;
+}
+
 TEST test_zrange() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	if (_zadd(context) != 0) {
@@ -53,6 +72,48 @@ TEST test_zrange() {
 	PASS();
 }
 
+TEST test_zrange_stream() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	struct stream_elements elements = {"", 0, 0, -1};
+
+	rliteReply* reply;
+	size_t argvlen[100];
+
+	if (_zadd(context) != 0) {
+		return 1;
+	}
+
+	{
+		char* argv[100] = {"ZRANGE", "mykey", "0", "-1", "WITHSCORES", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 4);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "one,1,two,2,", 12);
+	}
+
+	elements.len = elements.count = 0;
+	{
+		char* argv[100] = {"ZREVRANGE", "mykey", "0", "0", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+		EXPECT_BYTES(elements.data, elements.len, "two,", 4);
+	}
+
+	elements.len = elements.count = 0;
+	elements.abort_at = 1;
+	{
+		char* argv[100] = {"ZRANGE", "mykey", "0", "-1", NULL};
+		reply = rliteCommandStream(context, populateArgvlen(argv, argvlen), argv, argvlen, collect_element, &elements);
+		EXPECT_REPLY_ERROR(reply);
+		rliteFreeReplyObject(reply);
+		EXPECT_LONG(elements.count, 1);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_zrevrange() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 	if (_zadd(context) != 0) {
@@ -255,6 +316,225 @@ TEST test_zunionstore() {
 	PASS();
 }
 
+TEST test_zunion_zinter_zdiff() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	char* argv[100] = {"ZADD", "key1", "1", "one", "2", "two", "3", "three", NULL};
+	size_t argvlen[100];
+
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	rliteFreeReplyObject(reply);
+
+	char *argv2[100] = {"ZADD", "key2", "1", "one", "2", "two", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	rliteFreeReplyObject(reply);
+
+	char *argv3[100] = {"ZUNION", "2", "key1", "key2", "WITHSCORES", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv3, argvlen), argv3, argvlen);
+	EXPECT_REPLY_LEN(reply, 6);
+	EXPECT_REPLY_STR(reply->element[0], "one", 3);
+	EXPECT_REPLY_STR(reply->element[1], "2", 1);
+	EXPECT_REPLY_STR(reply->element[2], "three", 5);
+	EXPECT_REPLY_STR(reply->element[3], "3", 1);
+	EXPECT_REPLY_STR(reply->element[4], "two", 3);
+	EXPECT_REPLY_STR(reply->element[5], "4", 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv4[100] = {"ZINTER", "2", "key1", "key2", "WEIGHTS", "1", "3", "AGGREGATE", "MAX", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv4, argvlen), argv4, argvlen);
+	EXPECT_REPLY_LEN(reply, 2);
+	EXPECT_REPLY_STR(reply->element[0], "one", 3);
+	EXPECT_REPLY_STR(reply->element[1], "two", 3);
+	rliteFreeReplyObject(reply);
+
+	char *argv5[100] = {"ZDIFF", "2", "key1", "key2", "WITHSCORES", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv5, argvlen), argv5, argvlen);
+	EXPECT_REPLY_LEN(reply, 2);
+	EXPECT_REPLY_STR(reply->element[0], "three", 5);
+	EXPECT_REPLY_STR(reply->element[1], "3", 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv6[100] = {"ZDIFFSTORE", "out", "2", "key1", "key2", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv6, argvlen), argv6, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv7[100] = {"ZINTER", "2", "key1", "nokey", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv7, argvlen), argv7, argvlen);
+	EXPECT_REPLY_LEN(reply, 0);
+	rliteFreeReplyObject(reply);
+
+	char *argv8[100] = {"ZDIFF", "1", "key1", "WEIGHTS", "1", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv8, argvlen), argv8, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	char *argv9[100] = {"ZUNION", "0", "key1", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv9, argvlen), argv9, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST test_zadd_flags() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	char* argv[100] = {"ZADD", "key", "1", "one", "2", "two", "3", "one", NULL};
+	size_t argvlen[100];
+
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 2);
+	rliteFreeReplyObject(reply);
+
+	char *argv2[100] = {"ZADD", "key", "NX", "10", "one", "4", "four", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv3[100] = {"ZADD", "key", "XX", "CH", "10", "one", "5", "five", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv3, argvlen), argv3, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv4[100] = {"ZADD", "key", "GT", "CH", "1", "two", "3", "four", "6", "six", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv4, argvlen), argv4, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv5[100] = {"ZRANGE", "key", "0", "-1", "WITHSCORES", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv5, argvlen), argv5, argvlen);
+	EXPECT_REPLY_LEN(reply, 8);
+	EXPECT_REPLY_STR(reply->element[0], "two", 3);
+	EXPECT_REPLY_STR(reply->element[1], "2", 1);
+	EXPECT_REPLY_STR(reply->element[2], "four", 4);
+	EXPECT_REPLY_STR(reply->element[3], "4", 1);
+	EXPECT_REPLY_STR(reply->element[4], "six", 3);
+	EXPECT_REPLY_STR(reply->element[5], "6", 1);
+	EXPECT_REPLY_STR(reply->element[6], "one", 3);
+	EXPECT_REPLY_STR(reply->element[7], "10", 2);
+	rliteFreeReplyObject(reply);
+
+	char *argv6[100] = {"ZADD", "key", "LT", "INCR", "-1", "four", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv6, argvlen), argv6, argvlen);
+	EXPECT_REPLY_STR(reply, "3", 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv7[100] = {"ZADD", "key", "LT", "INCR", "1", "four", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv7, argvlen), argv7, argvlen);
+	EXPECT_REPLY_NIL(reply);
+	rliteFreeReplyObject(reply);
+
+	// options are accepted after INCR too
+	char *argv7b[100] = {"ZADD", "key", "INCR", "XX", "5", "four", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv7b, argvlen), argv7b, argvlen);
+	EXPECT_REPLY_STR(reply, "8", 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv8[100] = {"ZADD", "key", "NX", "XX", "1", "one", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv8, argvlen), argv8, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	char *argv9[100] = {"ZADD", "key", "GT", "NX", "1", "one", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv9, argvlen), argv9, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	char *argv10[100] = {"ZADD", "key", "INCR", "1", "one", "2", "two", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv10, argvlen), argv10, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	char *argv11[100] = {"ZADD", "key", "CH", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv11, argvlen), argv11, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	// CH counts every argument that changed the member, in order
+	char *argv12[100] = {"ZADD", "other", "CH", "1", "m", "2", "m", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv12, argvlen), argv12, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 2);
+	rliteFreeReplyObject(reply);
+
+	char *argv13[100] = {"ZADD", "other", "CH", "3", "m", "2", "m", "2", "m", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv13, argvlen), argv13, argvlen);
+	EXPECT_REPLY_INTEGER(reply, 2);
+	rliteFreeReplyObject(reply);
+
+	char *argv14[100] = {"ZSCORE", "other", "m", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv14, argvlen), argv14, argvlen);
+	EXPECT_REPLY_STR(reply, "2", 1);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	PASS();
+}
+
+TEST test_zpop() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+
+	rliteReply* reply;
+	char* argv[100] = {"ZADD", "key", "1", "one", "2", "two", "3", "three", NULL};
+	size_t argvlen[100];
+
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	rliteFreeReplyObject(reply);
+
+	char *argv2[100] = {"ZPOPMIN", "key", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	EXPECT_REPLY_LEN(reply, 2);
+	EXPECT_REPLY_STR(reply->element[0], "one", 3);
+	EXPECT_REPLY_STR(reply->element[1], "1", 1);
+	rliteFreeReplyObject(reply);
+
+	char *argv3[100] = {"ZPOPMAX", "key", "5", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv3, argvlen), argv3, argvlen);
+	EXPECT_REPLY_LEN(reply, 4);
+	EXPECT_REPLY_STR(reply->element[0], "three", 5);
+	EXPECT_REPLY_STR(reply->element[1], "3", 1);
+	EXPECT_REPLY_STR(reply->element[2], "two", 3);
+	EXPECT_REPLY_STR(reply->element[3], "2", 1);
+	rliteFreeReplyObject(reply);
+
+	reply = rliteCommandArgv(context, populateArgvlen(argv2, argvlen), argv2, argvlen);
+	EXPECT_REPLY_LEN(reply, 0);
+	rliteFreeReplyObject(reply);
+
+	char *argv4[100] = {"ZPOPMIN", "key", "-1", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv4, argvlen), argv4, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+	rliteFreeReplyObject(reply);
+
+	char *argv5[100] = {"BZPOPMAX", "nokey", "key", "0", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv5, argvlen), argv5, argvlen);
+	EXPECT_REPLY_LEN(reply, 3);
+	EXPECT_REPLY_STR(reply->element[0], "key", 3);
+	EXPECT_REPLY_STR(reply->element[1], "three", 5);
+	EXPECT_REPLY_STR(reply->element[2], "3", 1);
+	rliteFreeReplyObject(reply);
+
+	// nobody else can write to an in memory database, it does not block
+	char *argv6[100] = {"BZPOPMIN", "nokey", "0", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv6, argvlen), argv6, argvlen);
+	EXPECT_REPLY_NIL(reply);
+	rliteFreeReplyObject(reply);
+
+	char *argv7[100] = {"BZPOPMIN", "key", "-1", NULL};
+	reply = rliteCommandArgv(context, populateArgvlen(argv7, argvlen), argv7, argvlen);
+	EXPECT_REPLY_ERROR(reply);
+	rliteFreeReplyObject(reply);
+
+	rliteFree(context);
+	PASS();
+}
+
 TEST test_zrangebyscore() {
 	rliteContext *context = rliteConnect(":memory:", 0);
 
@@ -506,9 +786,58 @@ TEST test_debug() {
 	PASS();
 }
 
+TEST test_zscan() {
+	rliteContext *context = rliteConnect(":memory:", 0);
+	rliteReply* reply;
+	size_t argvlen[100];
+	char member[20], score[20], cursor[24] = "0";
+	int i, j = 0;
+
+	// enough members to use the tree encoding
+	for (i = 0; i < 200; i++) {
+		snprintf(member, sizeof(member), "member%d", i);
+		snprintf(score, sizeof(score), "%d", i);
+		char* argv[100] = {"zadd", "mykey", score, member, NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_INTEGER(reply, 1);
+		rliteFreeReplyObject(reply);
+	}
+
+	do {
+		char* argv[100] = {"zscan", "mykey", cursor, "count", "15", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		for (i = 0; i < (int)reply->element[1]->elements; i += 2) {
+			snprintf(member, sizeof(member), "member%d", j);
+			snprintf(score, sizeof(score), "%d", j);
+			EXPECT_REPLY_STR(reply->element[1]->element[i], member, (long)strlen(member));
+			EXPECT_REPLY_STR(reply->element[1]->element[i + 1], score, (long)strlen(score));
+			j++;
+		}
+		memcpy(cursor, reply->element[0]->str, reply->element[0]->len);
+		cursor[reply->element[0]->len] = 0;
+		rliteFreeReplyObject(reply);
+	} while (strcmp(cursor, "0") != 0);
+	EXPECT_INT(j, 200);
+
+	{
+		char* argv[100] = {"zscan", "mykey", "190", "match", "*9", NULL};
+		reply = rliteCommandArgv(context, populateArgvlen(argv, argvlen), argv, argvlen);
+		EXPECT_REPLY_LEN(reply, 2);
+		EXPECT_REPLY_STR(reply->element[0], "0", 1);
+		EXPECT_REPLY_LEN(reply->element[1], 2);
+		EXPECT_REPLY_STR(reply->element[1]->element[0], "member199", 9);
+		rliteFreeReplyObject(reply);
+	}
+
+	rliteFree(context);
+	PASS();
+}
+
 SUITE(zset_test) {
 	RUN_TEST(test_zadd);
 	RUN_TEST(test_zrange);
+	RUN_TEST(test_zrange_stream);
 	RUN_TEST(test_zrevrange);
 	RUN_TEST(test_zrem);
 	RUN_TEST(test_zremrangebyrank);
@@ -516,6 +845,9 @@ SUITE(zset_test) {
 	RUN_TEST(test_zcard);
 	RUN_TEST(test_zinterstore);
 	RUN_TEST(test_zunionstore);
+	RUN_TEST(test_zunion_zinter_zdiff);
+	RUN_TEST(test_zadd_flags);
+	RUN_TEST(test_zpop);
 	RUN_TEST(test_zrangebyscore);
 	RUN_TEST(test_zrevrangebyscore);
 	RUN_TEST(test_zrangebylex);
@@ -523,6 +855,7 @@ SUITE(zset_test) {
 	RUN_TEST(test_zlexcount);
 	RUN_TEST(test_zscore);
 	RUN_TEST(test_zrank);
+	RUN_TEST(test_zscan);
 	RUN_TEST(test_zrevrank);
 	RUN_TEST(test_zcount);
 	RUN_TEST(test_exists);
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/rlite/rlite.h"
+#include "../src/rlite/page_zset_tree.h"
+#include "util.h"
+
+#define TEST_SIZE 1000
+
+static int create_tree(rlite *db, rl_zset_tree **tree, long *tree_page)
+{
+	int retval;
+	RL_CALL(rl_zset_tree_create, RL_OK, db, tree);
+	*tree_page = db->next_empty_page;
+	RL_CALL(rl_write, RL_OK, db, &rl_data_type_zset_tree, *tree_page, *tree);
+cleanup:
+	return retval;
+}
+
+static int reload_tree(rlite *db, int commit, rl_zset_tree **tree, long tree_page)
+{
+	void *tmp;
+	int retval = RL_OK;
+	if (commit) {
+		RL_CALL(rl_commit, RL_OK, db);
+		RL_CALL(rl_read, RL_FOUND, db, &rl_data_type_zset_tree, tree_page, NULL, &tmp, 1);
+		*tree = tmp;
+	}
+	retval = RL_OK;
+cleanup:
+	return retval;
+}
+
+TEST basic_zset_tree_test(int sign, int commit)
+{
+	rlite *db;
+	int retval;
+	rl_zset_tree *tree;
+	long tree_page, i, memberlen;
+	unsigned char data[2], *member;
+	double score;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, commit, 1);
+	RL_CALL_VERBOSE(create_tree, RL_OK, db, &tree, &tree_page);
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		data[0] = i / 256;
+		data[1] = i % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_add, RL_OK, db, tree, tree_page, 5.2 * i * sign, data, 2);
+		RL_CALL_VERBOSE(rl_zset_tree_is_balanced, RL_OK, db, tree);
+		RL_CALL_VERBOSE(reload_tree, RL_OK, db, commit, &tree, tree_page);
+	}
+	EXPECT_LONG(tree->size, TEST_SIZE);
+	if (tree->height < 2) {
+		FAILm("Expected the tree to have more than one level");
+	}
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		RL_CALL_VERBOSE(rl_zset_tree_get, RL_OK, db, tree, i, &score, &member, &memberlen);
+		EXPECT_LONG(memberlen, 2);
+		if (sign < 0) {
+			EXPECT_DOUBLE(score, -5.2 * (TEST_SIZE - 1 - i));
+			EXPECT_INT(member[0] * 256 + member[1], TEST_SIZE - 1 - i);
+		}
+		else if (sign > 0) {
+			EXPECT_DOUBLE(score, 5.2 * i);
+			EXPECT_INT(member[0] * 256 + member[1], i);
+		}
+		else {
+			EXPECT_DOUBLE(score, 0.0);
+			EXPECT_INT(member[0] * 256 + member[1], i);
+		}
+		rl_free(member);
+	}
+	RL_CALL_VERBOSE(rl_zset_tree_get, RL_NOT_FOUND, db, tree, TEST_SIZE, NULL, NULL, NULL);
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_zset_tree_count_before_test()
+{
+	rlite *db;
+	int retval;
+	rl_zset_tree *tree;
+	long tree_page, i, count;
+	unsigned char data[2];
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 0, 1);
+	RL_CALL_VERBOSE(create_tree, RL_OK, db, &tree, &tree_page);
+
+	// ten elements for every score
+	for (i = 0; i < TEST_SIZE; i++) {
+		data[0] = i / 256;
+		data[1] = i % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_add, RL_OK, db, tree, tree_page, i / 10, data, 2);
+	}
+	RL_CALL_VERBOSE(rl_zset_tree_is_balanced, RL_OK, db, tree);
+
+	for (i = 0; i < TEST_SIZE / 10; i++) {
+		RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, i, NULL, 0, 0, &count);
+		EXPECT_LONG(count, i * 10);
+		RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, i, NULL, 0, 1, &count);
+		EXPECT_LONG(count, i * 10 + 10);
+		RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, i + 0.5, NULL, 0, 0, &count);
+		EXPECT_LONG(count, i * 10 + 10);
+	}
+	RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, -1, NULL, 0, 1, &count);
+	EXPECT_LONG(count, 0);
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		data[0] = i / 256;
+		data[1] = i % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, i / 10, data, 2, 0, &count);
+		EXPECT_LONG(count, i);
+		RL_CALL_VERBOSE(rl_zset_tree_count_before, RL_OK, db, tree, i / 10, data, 2, 1, &count);
+		EXPECT_LONG(count, i + 1);
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_zset_tree_delete_test(int commit)
+{
+	rlite *db;
+	int retval;
+	rl_zset_tree *tree;
+	long tree_page, i, j;
+	unsigned char data[2];
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, commit, 1);
+	RL_CALL_VERBOSE(create_tree, RL_OK, db, &tree, &tree_page);
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		data[0] = i / 256;
+		data[1] = i % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_add, RL_OK, db, tree, tree_page, i % 7, data, 2);
+	}
+	RL_CALL_VERBOSE(reload_tree, RL_OK, db, commit, &tree, tree_page);
+
+	data[0] = 0;
+	data[1] = 1;
+	RL_CALL_VERBOSE(rl_zset_tree_delete, RL_NOT_FOUND, db, tree, tree_page, 2, data, 2);
+
+	// delete in an order unrelated to the sort order
+	for (i = 0; i < TEST_SIZE; i++) {
+		j = (i * 37) % TEST_SIZE;
+		data[0] = j / 256;
+		data[1] = j % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_delete, i == TEST_SIZE - 1 ? RL_DELETED : RL_OK, db, tree, tree_page, j % 7, data, 2);
+		if (i < TEST_SIZE - 1) {
+			EXPECT_LONG(tree->size, TEST_SIZE - 1 - i);
+			RL_CALL_VERBOSE(rl_zset_tree_is_balanced, RL_OK, db, tree);
+			RL_CALL_VERBOSE(reload_tree, RL_OK, db, commit, &tree, tree_page);
+		}
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_zset_tree_long_member_test(int commit)
+{
+	rlite *db;
+	int retval;
+	rl_zset_tree *tree;
+	long tree_page, i, memberlen;
+	unsigned char data[200], *member;
+	double score;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, commit, 1);
+	RL_CALL_VERBOSE(create_tree, RL_OK, db, &tree, &tree_page);
+
+	memset(data, 'a', sizeof(data));
+	for (i = 0; i < 100; i++) {
+		data[199] = i;
+		RL_CALL_VERBOSE(rl_zset_tree_add, RL_OK, db, tree, tree_page, 1.0, data, 200);
+		RL_CALL_VERBOSE(rl_zset_tree_is_balanced, RL_OK, db, tree);
+		RL_CALL_VERBOSE(reload_tree, RL_OK, db, commit, &tree, tree_page);
+	}
+
+	for (i = 0; i < 100; i++) {
+		RL_CALL_VERBOSE(rl_zset_tree_get, RL_OK, db, tree, i, &score, &member, &memberlen);
+		EXPECT_DOUBLE(score, 1.0);
+		EXPECT_LONG(memberlen, 200);
+		EXPECT_INT(member[199], i);
+		rl_free(member);
+	}
+
+	for (i = 0; i < 100; i++) {
+		data[199] = i;
+		RL_CALL_VERBOSE(rl_zset_tree_delete, i == 99 ? RL_DELETED : RL_OK, db, tree, tree_page, 1.0, data, 200);
+		if (i < 99) {
+			RL_CALL_VERBOSE(rl_zset_tree_is_balanced, RL_OK, db, tree);
+			RL_CALL_VERBOSE(reload_tree, RL_OK, db, commit, &tree, tree_page);
+		}
+	}
+	rl_close(db);
+	PASS();
+}
+
+TEST basic_zset_tree_iterator_test(int direction)
+{
+	rlite *db;
+	int retval;
+	rl_zset_tree *tree;
+	rl_zset_tree_iterator *iterator;
+	long tree_page, i, memberlen, expected;
+	unsigned char data[2], *member;
+	double score;
+	RL_CALL_VERBOSE(setup_db, RL_OK, &db, 0, 1);
+	RL_CALL_VERBOSE(create_tree, RL_OK, db, &tree, &tree_page);
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		data[0] = i / 256;
+		data[1] = i % 256;
+		RL_CALL_VERBOSE(rl_zset_tree_add, RL_OK, db, tree, tree_page, i, data, 2);
+	}
+
+	RL_CALL_VERBOSE(rl_zset_tree_iterator_create, RL_OK, db, tree, 100, direction, 500, &iterator);
+	i = 0;
+	while ((retval = rl_zset_tree_iterator_next(iterator, &score, &member, &memberlen)) == RL_OK) {
+		expected = 100 + i * direction;
+		EXPECT_DOUBLE(score, expected);
+		EXPECT_LONG(memberlen, 2);
+		EXPECT_INT(member[0] * 256 + member[1], expected);
+		rl_free(member);
+		i++;
+	}
+	EXPECT_INT(retval, RL_END);
+	EXPECT_LONG(i, direction > 0 ? 500 : 101);
+	rl_close(db);
+	PASS();
+}
+
+SUITE(zset_tree_test)
+{
+	int i, j;
+	for (i = -1; i <= 1; i++) {
+		for (j = 0; j < 3; j++) {
+			RUN_TESTp(basic_zset_tree_test, i, j);
+		}
+	}
+	RUN_TEST(basic_zset_tree_count_before_test);
+	for (i = 0; i < 3; i++) {
+		RUN_TEST1(basic_zset_tree_delete_test, i);
+		RUN_TEST1(basic_zset_tree_long_member_test, i);
+	}
+	RUN_TEST1(basic_zset_tree_iterator_test, 1);
+	RUN_TEST1(basic_zset_tree_iterator_test, -1);
+}